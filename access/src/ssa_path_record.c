@@ -554,6 +554,42 @@ ssa_pr_status_t ssa_pr_path_params(const struct ssa_db *p_ssa_db_smdb,
 	return SSA_PR_SUCCESS;
 }
 
+int ssa_pr_path_hops(struct ssa_db *p_ssa_db_smdb, void *p_ctnx,
+		     be16_t source_lid, be16_t dest_lid)
+{
+	struct ssa_pr_context *p_context = (struct ssa_pr_context *)p_ctnx;
+	struct smdb_guid2lid source_rec, dest_rec;
+	ssa_path_parms_t path_prm;
+
+	SSA_ASSERT(p_ssa_db_smdb);
+	SSA_ASSERT(p_context);
+
+	if (ssa_pr_rebuild_indexes(p_context->p_index, p_ssa_db_smdb)) {
+		SSA_PR_LOG_ERROR("Index rebuild failed.");
+		return -1;
+	}
+
+	if (ntohs(source_lid) > MAX_LOOKUP_LID ||
+	    ntohs(dest_lid) > MAX_LOOKUP_LID)
+		return -1;
+
+	/* Only LID and switch flag are used for routing through the LFTs */
+	memset(&source_rec, 0, sizeof(source_rec));
+	source_rec.lid = source_lid;
+	source_rec.is_switch = p_context->p_index->is_switch_lookup[ntohs(source_lid)];
+
+	memset(&dest_rec, 0, sizeof(dest_rec));
+	dest_rec.lid = dest_lid;
+	dest_rec.is_switch = p_context->p_index->is_switch_lookup[ntohs(dest_lid)];
+
+	memset(&path_prm, 0, sizeof(path_prm));
+	if (ssa_pr_path_params(p_ssa_db_smdb, p_context, &source_rec,
+			       &dest_rec, &path_prm) != SSA_PR_SUCCESS)
+		return -1;
+
+	return path_prm.hops;
+}
+
 void ssa_pr_reinit_context(void *context, struct ssa_db *smdb)
 {
 	struct ssa_pr_context *p_context = context;
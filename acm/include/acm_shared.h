@@ -85,6 +85,8 @@ struct acm_send_queue {
 	DLIST_ENTRY           pending;
 };
 
+struct acm_prdb_index;
+
 struct acm_ep {
 	void		      *port;
 	struct ibv_cq         *cq;
@@ -96,6 +98,10 @@ struct acm_ep {
 	char                  name[MAX_EP_ADDR][ACM_MAX_ADDRESS];
 	uint8_t               addr_type[MAX_EP_ADDR];
 	void                  *dest_map[ACM_ADDRESS_RESERVED - 1];
+	struct acm_prdb_index *prdb_index;
+	uint64_t              ipdb_gen;	/* IPDB index neighbors were added from */
+	void                  *neg_map;
+	int                   neg_cnt;
 	struct acm_dest       mc_dest[MAX_EP_MC];
 	int                   mc_cnt;
 	unsigned int          ifindex;
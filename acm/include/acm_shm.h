@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2015 Mellanox Technologies LTD. All rights reserved.
+ *
+ * This software is available to you under the OpenIB.org BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AWV
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#if !defined(ACM_SHM_H)
+#define ACM_SHM_H
+
+#include <stdint.h>
+#include <string.h>
+#include <osd.h>
+#include <acm_shared.h>
+
+/*
+ * Path cache published by ibacm into a POSIX shared memory segment.
+ * The segment is written by the daemon only and mapped read-only by
+ * libacm, which resolves from it without a round trip to the daemon.
+ *
+ * Writers bump seq to an odd value before modifying the table and to
+ * the next even value when done.  Readers copy an entry and retry if
+ * seq was odd or changed meanwhile (seqlock).
+ *
+ * Each entry carries the time_stamp_min() after which the daemon would
+ * no longer trust its own copy (addr_timeout/route_timeout).  Readers
+ * treat later lookups as misses and go to the daemon.
+ */
+#define ACM_SHM_NAME		"/ibacm_path_cache"
+#define ACM_SHM_MAGIC		0x41434d43	/* "ACMC" */
+#define ACM_SHM_VERSION		2
+#define ACM_SHM_DEFAULT_SIZE	131072		/* slots, power of 2 */
+#define ACM_SHM_READ_RETRIES	16
+
+/* entry addr_type values besides ACM_ADDRESS_* */
+#define ACM_SHM_ENTRY_FREE	0x00
+#define ACM_SHM_ENTRY_DELETED	0xff
+
+struct acm_shm_entry {
+	uint8_t			addr_type;
+	uint8_t			reserved[7];
+	uint64_t		expires;	/* in time_stamp_min() units */
+	uint8_t			addr[ACM_MAX_ADDRESS];
+	struct ibv_path_record	path;
+};
+
+struct acm_shm_hdr {
+	uint32_t		magic;
+	uint16_t		version;
+	uint16_t		reserved;
+	volatile uint32_t	seq;
+	uint32_t		size;	/* number of slots */
+	uint32_t		count;	/* number of valid entries */
+	uint32_t		reserved2;
+	uint64_t		epoch;	/* last published PRDB epoch */
+	struct acm_shm_entry	entry[0];
+};
+
+#define acm_shm_barrier()	__sync_synchronize()
+
+static inline size_t acm_shm_segment_size(uint32_t size)
+{
+	return sizeof(struct acm_shm_hdr) + size * sizeof(struct acm_shm_entry);
+}
+
+/* Number of significant address bytes for given address type */
+static inline size_t acm_shm_addr_len(uint8_t addr_type)
+{
+	switch (addr_type) {
+	case ACM_ADDRESS_IP:
+		return 4;
+	case ACM_ADDRESS_IP6:
+	case ACM_ADDRESS_GID:
+		return 16;
+	case ACM_ADDRESS_LID:
+		return 2;
+	default:
+		return ACM_MAX_ADDRESS;
+	}
+}
+
+/* FNV-1a over address type and address */
+static inline uint32_t acm_shm_hash(uint8_t addr_type, const uint8_t *addr)
+{
+	uint32_t hash = 2166136261U;
+	size_t i, len = acm_shm_addr_len(addr_type);
+
+	hash = (hash ^ addr_type) * 16777619U;
+	for (i = 0; i < len; i++)
+		hash = (hash ^ addr[i]) * 16777619U;
+	return hash;
+}
+
+/*
+ * Linear probe for addr.  Returns matching slot or NULL.  Readers must
+ * validate the result against hdr->seq.
+ */
+static inline struct acm_shm_entry *
+acm_shm_find(struct acm_shm_hdr *hdr, uint8_t addr_type, const uint8_t *addr)
+{
+	struct acm_shm_entry *entry;
+	uint32_t i, mask = hdr->size - 1;
+	uint32_t slot = acm_shm_hash(addr_type, addr) & mask;
+
+	for (i = 0; i < hdr->size; i++, slot = (slot + 1) & mask) {
+		entry = &hdr->entry[slot];
+		if (entry->addr_type == ACM_SHM_ENTRY_FREE)
+			break;
+		if (entry->addr_type == addr_type &&
+		    !memcmp(entry->addr, addr, ACM_MAX_ADDRESS))
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+ * Lock-free lookup for readers.  Returns 0 and fills path on hit,
+ * -1 on miss, on an expired entry or when the writer keeps the table
+ * busy.
+ */
+static inline int
+acm_shm_lookup(struct acm_shm_hdr *hdr, uint8_t addr_type,
+	       const uint8_t *addr, struct ibv_path_record *path)
+{
+	struct acm_shm_entry *entry;
+	uint64_t expires = 0;
+	uint32_t seq;
+	int i, found;
+
+	for (i = 0; i < ACM_SHM_READ_RETRIES; i++) {
+		seq = hdr->seq;
+		acm_shm_barrier();
+		if (seq & 1 || hdr->magic != ACM_SHM_MAGIC)
+			continue;
+
+		entry = acm_shm_find(hdr, addr_type, addr);
+		found = entry != NULL;
+		if (found) {
+			*path = entry->path;
+			expires = entry->expires;
+		}
+
+		acm_shm_barrier();
+		if (hdr->seq != seq)
+			continue;
+
+		if (!found || time_stamp_min() > expires)
+			return -1;
+		return 0;
+	}
+	return -1;
+}
+
+#endif /* ACM_SHM_H */
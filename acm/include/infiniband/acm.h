@@ -112,6 +112,8 @@ enum {
 	ACM_CNTR_ADDR_CACHE,
 	ACM_CNTR_ROUTE_QUERY,
 	ACM_CNTR_ROUTE_CACHE,
+	ACM_CNTR_QUERY_SAVED,
+	ACM_CNTR_NEG_CACHE,
 	ACM_MAX_COUNTER
 };
 
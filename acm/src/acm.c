@@ -42,6 +42,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <syslog.h>
 #include <rdma/rsocket.h>
@@ -55,6 +56,9 @@
 #include "acm_util.h"
 #include <acm_shared.h>
 #include <acm_neigh.h>
+#include <acm_shm.h>
+#include <ssa_admin.h>
+#include <ssa_metrics.h>
 #include <infiniband/ssa_db.h>
 #include <infiniband/ssa_db_helper.h>
 #include <infiniband/ssa_prdb.h>
@@ -180,6 +184,10 @@ static atomic_t counter[ACM_MAX_COUNTER];
 static int acm_issue_query_done;
 
 static void acm_neigh_handler(void);
+static int acm_ep_prdb_path(struct acm_ep *ep, uint8_t addr_type, uint8_t *addr,
+			    struct ibv_path_record *path);
+static int acm_ep_ipdb_path(struct acm_ep *ep, uint8_t addr_type, uint8_t *addr,
+			    struct ibv_path_record *path);
 
 enum acm_addr_preload {
 	ACM_ADDR_PRELOAD_NONE,
@@ -201,6 +209,7 @@ static enum acm_addr_prot addr_prot = ACM_ADDR_PROT_ACM;
 static int addr_timeout;
 static enum acm_route_prot route_prot = ACM_ROUTE_PROT_SA;
 static int route_timeout = -1;
+static int neg_timeout = 1000;
 static enum acm_loopback_prot loopback_prot = ACM_LOOPBACK_PROT_LOCAL;
 static short server_port = 6125;
 static int timeout = 2000;
@@ -219,13 +228,24 @@ static useconds_t acm_query_timeout = ACM_DEFAULT_QUERY_TIMEOUT;
 static int acm_query_retries = ACM_DEFAULT_QUERY_RETRIES;
 static int neigh_mode = NEIGH_MODE_NONE;
 static int support_ips_in_addr_cfg = 0;
+static int prdb_direct = 0;
+static int shm_cache = 1;
+static int shm_cache_size = ACM_SHM_DEFAULT_SIZE;
+
+static struct acm_shm_hdr *shm_hdr;
+static pthread_mutex_t shm_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t shm_deleted;
 
 extern int log_flush;
+extern int log_async;
+extern int log_rate_limit;
 extern int accum_log_file;
 extern int prdb_dump;
 extern char prdb_dump_dir[128];
 extern short prdb_port;
 extern short admin_port;
+extern short metrics_port;
+extern char metrics_socket[128];
 extern int keepalive;
 extern int reconnect_timeout;
 extern int reconnect_max_count;
@@ -240,6 +260,9 @@ acm_format_name(int level, char *name, size_t name_size,
 {
 	enum ssa_addr_type at;
 
+	if (!ssa_log_enabled(level))
+		return;
+
 	switch (addr_type) {
 	case ACM_EP_INFO_NAME:
 		at = SSA_ADDR_NAME;
@@ -324,7 +347,7 @@ acm_alloc_dest(uint8_t addr_type, uint8_t *addr)
 
 /* Caller must hold ep lock. */
 static struct acm_dest *
-acm_get_dest(struct acm_ep *ep, uint8_t addr_type, uint8_t *addr)
+acm_find_dest(struct acm_ep *ep, uint8_t addr_type, uint8_t *addr)
 {
 	struct acm_dest *dest, **tdest;
 
@@ -334,12 +357,23 @@ acm_get_dest(struct acm_ep *ep, uint8_t addr_type, uint8_t *addr)
 		tdest = tfind(addr, &ep->dest_map[addr_type - 1], acm_compare_dest_by_gid);
 	else
 		tdest = tfind(addr, &ep->dest_map[addr_type - 1], acm_compare_dest);
-	if (tdest) {
-		dest = *tdest;
-		(void) atomic_inc(&dest->refcnt);
-		ssa_log(SSA_LOG_CTRL, "%s\n", dest->name);
-	} else {
-		dest = NULL;
+	if (!tdest)
+		return NULL;
+
+	dest = *tdest;
+	(void) atomic_inc(&dest->refcnt);
+	ssa_log(SSA_LOG_CTRL, "%s\n", dest->name);
+	return dest;
+}
+
+/* Caller must hold ep lock. */
+static struct acm_dest *
+acm_get_dest(struct acm_ep *ep, uint8_t addr_type, uint8_t *addr)
+{
+	struct acm_dest *dest;
+
+	dest = acm_find_dest(ep, addr_type, addr);
+	if (!dest && ssa_log_enabled(SSA_LOG_DEFAULT | SSA_LOG_CTRL)) {
 		acm_format_name(SSA_LOG_DEFAULT | SSA_LOG_CTRL,
 				log_data, sizeof log_data,
 				addr_type, addr, ACM_MAX_ADDRESS);
@@ -362,9 +396,11 @@ acm_acquire_dest(struct acm_ep *ep, uint8_t addr_type, uint8_t *addr)
 {
 	struct acm_dest *dest;
 
-	acm_format_name(SSA_LOG_CTRL, log_data, sizeof log_data,
-			addr_type, addr, ACM_MAX_ADDRESS);
-	ssa_log(SSA_LOG_CTRL, "%s\n", log_data);
+	if (ssa_log_enabled(SSA_LOG_CTRL)) {
+		acm_format_name(SSA_LOG_CTRL, log_data, sizeof log_data,
+				addr_type, addr, ACM_MAX_ADDRESS);
+		ssa_log(SSA_LOG_CTRL, "%s\n", log_data);
+	}
 	pthread_mutex_lock(&ep->lock);
 	dest = acm_get_dest(ep, addr_type, addr);
 	if (!dest) {
@@ -1093,8 +1129,8 @@ acm_send_addr_resp(struct acm_ep *ep, struct acm_dest *dest)
 }
 
 static int
-acm_client_resolve_resp(struct acm_client *client, struct acm_msg *req_msg,
-	struct acm_dest *dest, uint8_t status)
+acm_client_resolve_path_resp(struct acm_client *client, struct acm_msg *req_msg,
+	struct ibv_path_record *path, uint8_t status)
 {
 	struct acm_msg msg;
 	int ret;
@@ -1125,7 +1161,7 @@ acm_client_resolve_resp(struct acm_client *client, struct acm_msg *req_msg,
 		msg.resolve_data[0].flags = IBV_PATH_FLAG_GMP |
 			IBV_PATH_FLAG_PRIMARY | IBV_PATH_FLAG_BIDIRECTIONAL;
 		msg.resolve_data[0].type = ACM_EP_INFO_PATH;
-		msg.resolve_data[0].info.path = dest->path;
+		msg.resolve_data[0].info.path = *path;
 
 		if (req_msg->hdr.src_out) {
 			msg.hdr.length += ACM_MSG_EP_LENGTH;
@@ -1146,6 +1182,14 @@ release:
 	return ret;
 }
 
+static int
+acm_client_resolve_resp(struct acm_client *client, struct acm_msg *req_msg,
+	struct acm_dest *dest, uint8_t status)
+{
+	return acm_client_resolve_path_resp(client, req_msg,
+					    dest ? &dest->path : NULL, status);
+}
+
 static void
 acm_complete_queued_req(struct acm_dest *dest, uint8_t status)
 {
@@ -2269,14 +2313,105 @@ static int acm_dest_timeout(struct acm_dest *dest)
 	return 0;
 }
 
+/*
+ * Negative cache of destinations which could not be resolved in SSA mode.
+ * Entries expire after neg_timeout ms and are flushed when the endpoint
+ * receives a new PRDB.
+ */
+#define ACM_MAX_NEG_DEST	4096
+
+struct acm_neg_dest {
+	uint8_t			address[ACM_MAX_ADDRESS];
+	uint8_t			addr_type;
+	uint64_t		expires;
+};
+
+static int acm_compare_neg_dest(const void *dest1, const void *dest2)
+{
+	const struct acm_neg_dest *neg1 = dest1, *neg2 = dest2;
+
+	if (neg1->addr_type != neg2->addr_type)
+		return neg1->addr_type - neg2->addr_type;
+	return memcmp(neg1->address, neg2->address, ACM_MAX_ADDRESS);
+}
+
+/* Caller must hold ep lock. */
+static void acm_ep_neg_flush(struct acm_ep *ep)
+{
+	if (!ep->neg_map)
+		return;
+
+	ssa_log(SSA_LOG_VERBOSE, "flushing %d negative entries\n", ep->neg_cnt);
+	tdestroy(ep->neg_map, free);
+	ep->neg_map = NULL;
+	ep->neg_cnt = 0;
+}
+
+static int acm_ep_neg_lookup(struct acm_ep *ep, uint8_t addr_type, uint8_t *addr)
+{
+	struct acm_neg_dest key, **neg, *expired;
+	int found = 0;
+
+	if (neg_timeout <= 0)
+		return 0;
+
+	key.addr_type = addr_type;
+	memcpy(key.address, addr, ACM_MAX_ADDRESS);
+	pthread_mutex_lock(&ep->lock);
+	neg = tfind(&key, &ep->neg_map, acm_compare_neg_dest);
+	if (neg) {
+		if ((*neg)->expires > time_stamp_ms()) {
+			found = 1;
+		} else {
+			expired = *neg;
+			tdelete(&key, &ep->neg_map, acm_compare_neg_dest);
+			free(expired);
+			ep->neg_cnt--;
+		}
+	}
+	pthread_mutex_unlock(&ep->lock);
+	return found;
+}
+
+static void acm_ep_neg_add(struct acm_ep *ep, uint8_t addr_type, uint8_t *addr)
+{
+	struct acm_neg_dest *neg, **tneg;
+
+	if (neg_timeout <= 0)
+		return;
+
+	neg = malloc(sizeof(*neg));
+	if (!neg)
+		return;
+
+	neg->addr_type = addr_type;
+	memcpy(neg->address, addr, ACM_MAX_ADDRESS);
+	neg->expires = time_stamp_ms() + neg_timeout;
+
+	pthread_mutex_lock(&ep->lock);
+	if (ep->neg_cnt >= ACM_MAX_NEG_DEST)
+		acm_ep_neg_flush(ep);
+	tneg = tsearch(neg, &ep->neg_map, acm_compare_neg_dest);
+	if (!tneg) {
+		free(neg);
+	} else if (*tneg != neg) {
+		(*tneg)->expires = neg->expires;
+		free(neg);
+	} else {
+		ep->neg_cnt++;
+	}
+	pthread_mutex_unlock(&ep->lock);
+}
+
 static int
 acm_svr_resolve_dest(struct acm_client *client, struct acm_msg *msg)
 {
 	struct acm_ep *ep;
 	struct acm_dest *dest, *gid_dest;
 	struct acm_ep_addr_data *saddr, *daddr;
+	struct ibv_path_record path;
 	uint8_t status;
-	int ret;
+	int ret, coalesced = 0;
 
 	ssa_log(SSA_LOG_VERBOSE, "client %d\n", client->index);
 	status = acm_svr_verify_resolve(msg, &saddr, &daddr);
@@ -2306,10 +2441,44 @@ acm_svr_resolve_dest(struct acm_client *client, struct acm_msg *msg)
 			daddr->type, daddr->info.addr, sizeof daddr->info.addr);
 	ssa_log(SSA_LOG_VERBOSE, "dest %s\n", log_data);
 
-	dest = acm_acquire_dest(ep, daddr->type, daddr->info.addr);
-	if (!dest) {
-		ssa_log_err(0, "unable to allocate destination in client request\n");
-		return acm_client_resolve_resp(client, msg, NULL, ACM_STATUS_ENOMEM);
+	if (acm_mode == ACM_MODE_SSA) {
+		if (acm_ep_neg_lookup(ep, daddr->type, daddr->info.addr)) {
+			ssa_log(SSA_LOG_VERBOSE, "request satisfied from negative cache\n");
+			atomic_inc(&counter[ACM_CNTR_NEG_CACHE]);
+			return acm_client_resolve_resp(client, msg, NULL,
+						       ACM_STATUS_ENODATA);
+		}
+
+		if (acm_addr_index(ep, daddr->info.addr, daddr->type) < 0) {
+			ret = acm_ep_ipdb_path(ep, daddr->type,
+					       daddr->info.addr, &path);
+			if (ret > 0)
+				acm_ep_neg_add(ep, daddr->type, daddr->info.addr);
+			if (ret >= 0) {
+				ssa_log(SSA_LOG_VERBOSE,
+					"request satisfied from IPDB index\n");
+				atomic_inc(&counter[ACM_CNTR_ADDR_CACHE]);
+				return acm_client_resolve_path_resp(client, msg, &path,
+					ret ? ACM_STATUS_ENODATA : ACM_STATUS_SUCCESS);
+			}
+		}
+
+		/* Destinations are only learned from the SSA DB */
+		pthread_mutex_lock(&ep->lock);
+		dest = acm_find_dest(ep, daddr->type, daddr->info.addr);
+		pthread_mutex_unlock(&ep->lock);
+		if (!dest) {
+			ssa_log(SSA_LOG_VERBOSE, "SSA mode but dest not cached\n");
+			acm_ep_neg_add(ep, daddr->type, daddr->info.addr);
+			return acm_client_resolve_resp(client, msg, NULL,
+						       ACM_STATUS_ENODATA);
+		}
+	} else {
+		dest = acm_acquire_dest(ep, daddr->type, daddr->info.addr);
+		if (!dest) {
+			ssa_log_err(0, "unable to allocate destination in client request\n");
+			return acm_client_resolve_resp(client, msg, NULL, ACM_STATUS_ENOMEM);
+		}
 	}
 
 	pthread_mutex_lock(&dest->lock);
@@ -2331,14 +2500,29 @@ test:
 				break;
 			}
 			goto queue;
+		} else if (ep->prdb_index) {	/* ACM_MODE_SSA */
+			pthread_mutex_unlock(&dest->lock);
+			if (acm_ep_prdb_path(ep, ACM_ADDRESS_GID,
+					     dest->path.dgid.raw, &path)) {
+				acm_ep_neg_add(ep, daddr->type, daddr->info.addr);
+				status = ACM_STATUS_ENODATA;
+			} else {
+				status = ACM_STATUS_SUCCESS;
+			}
+
+			ret = acm_client_resolve_path_resp(client, msg,
+							   &path, status);
+			goto put;
 		} else {	/* ACM_MODE_SSA */
 			gid_dest = acm_get_dest(ep, ACM_ADDRESS_GID,
 						dest->path.dgid.raw);
 			pthread_mutex_unlock(&dest->lock);
-			if (!gid_dest)
+			if (!gid_dest) {
+				acm_ep_neg_add(ep, daddr->type, daddr->info.addr);
 				status = ACM_STATUS_ENODATA;
-			else
+			} else {
 				status = ACM_STATUS_SUCCESS;
+			}
 
 			ret = acm_client_resolve_resp(client, msg,
 						      gid_dest, status);
@@ -2357,10 +2541,13 @@ test:
 			/* fall through */
 		} else {	/* ACM_MODE_SSA */
 			ssa_log(SSA_LOG_VERBOSE, "SSA mode but dest not cached\n");
+			acm_ep_neg_add(ep, daddr->type, daddr->info.addr);
 			status = ACM_STATUS_ENODATA;
 			break;
 		}
 	default:
+		/* query already outstanding for this dest */
+		coalesced = 1;
 queue:
 		if (daddr->flags & ACM_FLAGS_NODELAY) {
 			ssa_log(SSA_LOG_VERBOSE,
@@ -2372,6 +2559,8 @@ queue:
 		if (status) {
 			break;
 		}
+		if (coalesced)
+			atomic_inc(&counter[ACM_CNTR_QUERY_SAVED]);
 		ret = 0;
 		pthread_mutex_unlock(&dest->lock);
 		goto put;
@@ -2393,11 +2582,11 @@ acm_svr_resolve_path(struct acm_client *client, struct acm_msg *msg)
 {
 	struct acm_ep *ep;
 	struct acm_dest *dest;
-	struct ibv_path_record *path;
+	struct ibv_path_record *path, index_path;
 	struct ssa_svc *svc;
-	uint8_t *addr;
+	uint8_t *addr, addr_type;
 	uint8_t status;
-	int ret, i;
+	int ret, i, coalesced = 0;
 
 	ssa_log(SSA_LOG_VERBOSE, "client %d\n", client->index);
 	if (msg->hdr.length < (ACM_MSG_HDR_LENGTH + ACM_MSG_EP_LENGTH)) {
@@ -2425,14 +2614,10 @@ acm_svr_resolve_path(struct acm_client *client, struct acm_msg *msg)
 	memset(addr, 0, ACM_MAX_ADDRESS);
 	if (path->dlid) {
 		* ((uint16_t *) addr) = path->dlid;
-		dest = acm_acquire_dest(ep, ACM_ADDRESS_LID, addr);
+		addr_type = ACM_ADDRESS_LID;
 	} else {
 		memcpy(addr, &path->dgid, sizeof path->dgid);
-		dest = acm_acquire_dest(ep, ACM_ADDRESS_GID, addr);
-	}
-	if (!dest) {
-		ssa_log_err(0, "unable to allocate destination in client request\n");
-		return acm_client_resolve_resp(client, msg, NULL, ACM_STATUS_ENOMEM);
+		addr_type = ACM_ADDRESS_GID;
 	}
 
 	if (acm_mode == ACM_MODE_SSA && acm_issue_query_done) {
@@ -2446,6 +2631,20 @@ acm_svr_resolve_path(struct acm_client *client, struct acm_msg *msg)
 		}
 	}
 
+	if (ep->prdb_index &&
+	    !acm_ep_prdb_path(ep, addr_type, addr, &index_path)) {
+		ssa_log(SSA_LOG_VERBOSE, "request satisfied from PRDB index\n");
+		atomic_inc(&counter[ACM_CNTR_ROUTE_CACHE]);
+		return acm_client_resolve_path_resp(client, msg, &index_path,
+						    ACM_STATUS_SUCCESS);
+	}
+
+	dest = acm_acquire_dest(ep, addr_type, addr);
+	if (!dest) {
+		ssa_log_err(0, "unable to allocate destination in client request\n");
+		return acm_client_resolve_resp(client, msg, NULL, ACM_STATUS_ENOMEM);
+	}
+
 	pthread_mutex_lock(&dest->lock);
 test:
 	switch (dest->state) {
@@ -2466,8 +2665,11 @@ test:
 		if (status) {
 			break;
 		}
-		/* fall through */
+		goto queue;
 	default:
+		/* query already outstanding for this dest */
+		coalesced = 1;
+queue:
 		if (msg->resolve_data[0].flags & ACM_FLAGS_NODELAY) {
 			ssa_log(SSA_LOG_VERBOSE,
 				"lookup initiated, but client wants no delay\n");
@@ -2478,6 +2680,8 @@ test:
 		if (status) {
 			break;
 		}
+		if (coalesced)
+			atomic_inc(&counter[ACM_CNTR_QUERY_SAVED]);
 		ret = 0;
 		pthread_mutex_unlock(&dest->lock);
 		goto put;
@@ -2528,6 +2732,28 @@ static int acm_svr_perf_query(struct acm_client *client, struct acm_msg *msg)
 	return ret;
 }
 
+static void acm_metrics(FILE *out, void *context)
+{
+	static const char *names[ACM_MAX_COUNTER] = {
+		[ACM_CNTR_ERROR] = "ssa_acm_errors_total",
+		[ACM_CNTR_RESOLVE] = "ssa_acm_resolve_total",
+		[ACM_CNTR_NODATA] = "ssa_acm_nodata_total",
+		[ACM_CNTR_ADDR_QUERY] = "ssa_acm_addr_query_total",
+		[ACM_CNTR_ADDR_CACHE] = "ssa_acm_addr_cache_hits_total",
+		[ACM_CNTR_ROUTE_QUERY] = "ssa_acm_route_query_total",
+		[ACM_CNTR_ROUTE_CACHE] = "ssa_acm_route_cache_hits_total",
+		[ACM_CNTR_QUERY_SAVED] = "ssa_acm_query_saved_total",
+		[ACM_CNTR_NEG_CACHE] = "ssa_acm_neg_cache_hits_total"
+	};
+	int i;
+
+	for (i = 0; i < ACM_MAX_COUNTER; i++) {
+		ssa_metrics_header(out, names[i], "counter",
+				   "ib_acme -P performance counter");
+		fprintf(out, "%s %ld\n", names[i], atomic_get(&counter[i]));
+	}
+}
+
 static int acm_msg_length(struct acm_msg *msg)
 {
 	return (msg->hdr.opcode == ACM_OP_RESOLVE) ?
@@ -2837,6 +3063,210 @@ static FILE *acm_open_addr_file(void)
 	return fopen(addr_file, "r");
 }
 
+/*
+ * Shared memory path cache.  Only the daemon writes into it, always
+ * between acm_shm_update_begin() and acm_shm_update_end().
+ */
+static int acm_shm_init(void)
+{
+	uint32_t size;
+	size_t len;
+	int fd;
+
+	if (!shm_cache || acm_mode != ACM_MODE_SSA)
+		return 0;
+
+	for (size = 1; size < (uint32_t) shm_cache_size; size <<= 1)
+		;
+	len = acm_shm_segment_size(size);
+
+	shm_unlink(ACM_SHM_NAME);
+	fd = shm_open(ACM_SHM_NAME, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0) {
+		ssa_log_err(0, "unable to create %s ERROR %d (%s)\n",
+			    ACM_SHM_NAME, errno, strerror(errno));
+		return -1;
+	}
+
+	if (ftruncate(fd, len)) {
+		ssa_log_err(0, "unable to size %s to %zu ERROR %d (%s)\n",
+			    ACM_SHM_NAME, len, errno, strerror(errno));
+		goto err;
+	}
+
+	shm_hdr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shm_hdr == MAP_FAILED) {
+		ssa_log_err(0, "unable to map %s ERROR %d (%s)\n",
+			    ACM_SHM_NAME, errno, strerror(errno));
+		shm_hdr = NULL;
+		goto err;
+	}
+	close(fd);
+
+	shm_hdr->version = ACM_SHM_VERSION;
+	shm_hdr->size = size;
+	acm_shm_barrier();
+	shm_hdr->magic = ACM_SHM_MAGIC;
+
+	ssa_log(SSA_LOG_VERBOSE, "path cache %s created with %u slots\n",
+		ACM_SHM_NAME, size);
+	return 0;
+err:
+	close(fd);
+	shm_unlink(ACM_SHM_NAME);
+	return -1;
+}
+
+static void acm_shm_cleanup(void)
+{
+	if (!shm_hdr)
+		return;
+
+	pthread_mutex_lock(&shm_lock);
+	shm_hdr->seq++;
+	acm_shm_barrier();
+	/* readers which still have the segment mapped will see a miss */
+	shm_hdr->magic = 0;
+	acm_shm_barrier();
+	shm_hdr->seq++;
+	munmap(shm_hdr, acm_shm_segment_size(shm_hdr->size));
+	shm_hdr = NULL;
+	pthread_mutex_unlock(&shm_lock);
+	shm_unlink(ACM_SHM_NAME);
+}
+
+static void acm_shm_update_begin(void)
+{
+	if (!shm_hdr)
+		return;
+
+	pthread_mutex_lock(&shm_lock);
+	shm_hdr->seq++;
+	acm_shm_barrier();
+}
+
+/* Rehash valid entries to get rid of deleted slots */
+static void acm_shm_compact(void)
+{
+	struct acm_shm_entry *entries, *entry;
+	uint32_t i, j, cnt, slot, mask = shm_hdr->size - 1;
+
+	entries = malloc(shm_hdr->count * sizeof(*entries));
+	if (!entries) {
+		ssa_log_err(0, "unable to allocate path cache compaction buffer\n");
+		return;
+	}
+
+	for (i = 0, cnt = 0; i < shm_hdr->size; i++) {
+		entry = &shm_hdr->entry[i];
+		if (entry->addr_type != ACM_SHM_ENTRY_FREE &&
+		    entry->addr_type != ACM_SHM_ENTRY_DELETED)
+			entries[cnt++] = *entry;
+		entry->addr_type = ACM_SHM_ENTRY_FREE;
+	}
+
+	for (j = 0; j < cnt; j++) {
+		slot = acm_shm_hash(entries[j].addr_type, entries[j].addr) & mask;
+		while (shm_hdr->entry[slot].addr_type != ACM_SHM_ENTRY_FREE)
+			slot = (slot + 1) & mask;
+		shm_hdr->entry[slot] = entries[j];
+	}
+
+	shm_deleted = 0;
+	free(entries);
+}
+
+static void acm_shm_update_end(uint64_t epoch)
+{
+	if (!shm_hdr)
+		return;
+
+	if (shm_deleted > shm_hdr->size / 4)
+		acm_shm_compact();
+
+	shm_hdr->epoch = epoch;
+	acm_shm_barrier();
+	shm_hdr->seq++;
+	ssa_log(SSA_LOG_VERBOSE, "path cache has %u entries (epoch 0x%" PRIx64 ")\n",
+		shm_hdr->count, epoch);
+	pthread_mutex_unlock(&shm_lock);
+}
+
+/* Drop all entries sourced from the given port (slid in network order) */
+static void acm_shm_remove_port(uint16_t slid)
+{
+	struct acm_shm_entry *entry;
+	uint32_t i;
+
+	if (!shm_hdr)
+		return;
+
+	for (i = 0; i < shm_hdr->size; i++) {
+		entry = &shm_hdr->entry[i];
+		if (entry->addr_type == ACM_SHM_ENTRY_FREE ||
+		    entry->addr_type == ACM_SHM_ENTRY_DELETED ||
+		    entry->path.slid != slid)
+			continue;
+		entry->addr_type = ACM_SHM_ENTRY_DELETED;
+		shm_hdr->count--;
+		shm_deleted++;
+	}
+}
+
+/*
+ * Entries expire like the daemon's own dest entries: when the shorter
+ * of addr_timeout and route_timeout runs out (-1 never expires).
+ */
+static void
+acm_shm_publish(uint8_t addr_type, uint8_t *addr, struct ibv_path_record *path)
+{
+	struct acm_shm_entry *entry, *free_entry = NULL;
+	uint32_t i, slot, mask;
+	uint64_t expires;
+
+	if (!shm_hdr)
+		return;
+
+	expires = time_stamp_min() +
+		  min((unsigned) addr_timeout, (unsigned) route_timeout);
+
+	mask = shm_hdr->size - 1;
+	slot = acm_shm_hash(addr_type, addr) & mask;
+	for (i = 0; i < shm_hdr->size; i++, slot = (slot + 1) & mask) {
+		entry = &shm_hdr->entry[slot];
+		if (entry->addr_type == ACM_SHM_ENTRY_FREE) {
+			if (!free_entry)
+				free_entry = entry;
+			break;
+		}
+		if (entry->addr_type == ACM_SHM_ENTRY_DELETED) {
+			if (!free_entry)
+				free_entry = entry;
+			continue;
+		}
+		if (entry->addr_type == addr_type &&
+		    !memcmp(entry->addr, addr, ACM_MAX_ADDRESS)) {
+			entry->path = *path;
+			entry->expires = expires;
+			return;
+		}
+	}
+
+	if (!free_entry) {
+		ssa_log_warn(SSA_LOG_CTRL, "path cache full (%u entries)\n",
+			     shm_hdr->count);
+		return;
+	}
+
+	if (free_entry->addr_type == ACM_SHM_ENTRY_DELETED)
+		shm_deleted--;
+	memcpy(free_entry->addr, addr, ACM_MAX_ADDRESS);
+	free_entry->path = *path;
+	free_entry->expires = expires;
+	free_entry->addr_type = addr_type;
+	shm_hdr->count++;
+}
+
 /* Parse "opensm full v1" file to build LID to GUID table */
 static void acm_parse_osm_fullv1_lid2guid(FILE *f, uint64_t *lid2guid)
 {
@@ -3041,6 +3471,7 @@ static int acm_parse_osm_fullv1_paths(FILE *f, uint64_t *lid2guid, struct acm_ep
 			}
 			dest->remote_qpn = 1;
 			dest->state = ACM_READY;
+			acm_shm_publish(addr_type, addr, &dest->path);
 			acm_put_dest(dest);
 			ssa_log(SSA_LOG_VERBOSE, "added cached dest %s\n",
 				dest->name);
@@ -3214,6 +3645,7 @@ static int acm_parse_access_v1_paths(struct ssa_db *p_ssa_db,
 			}
 			dest->remote_qpn = 1;
 			dest->state = ACM_READY;
+			acm_shm_publish(addr_type, addr, &dest->path);
 			acm_put_dest(dest);
 			ssa_log(SSA_LOG_VERBOSE, "added cached dest %s\n",
 				dest->name);
@@ -3298,109 +3730,279 @@ acm_parse_access_v1_paths_update(uint64_t *lid2guid, uint64_t *lid2guid_cached,
 	}
 }
 
-static int acm_parse_access_v1(struct acm_ep *ep)
-{
-	struct ssa_db *p_ssa_db;
-	uint64_t *lid2guid;
-	int ret = 1;
+/*
+ * Direct PRDB index (prdb_direct mode): instead of materializing two
+ * dests per PRDB record, the PR table is kept as received and indexed
+ * by DLID and by GUID.  Path records are synthesized at resolve time.
+ */
+struct acm_prdb_guid {
+	uint64_t	guid;	/* network order */
+	uint32_t	index;
+};
 
-	if (!(p_ssa_db = ssa_db_load(route_data_dir, SSA_DB_HELPER_DEBUG))) {
-		ssa_log(SSA_LOG_DEFAULT, "ERROR - couldn't load PRDB from %s\n",
-			route_data_dir);
-		return ret;
-	}
+struct acm_prdb_index {
+	struct prdb_pr		*pr;
+	uint32_t		pr_cnt;
+	uint32_t		*lid_map;	/* DLID -> PR index + 1 */
+	uint32_t		lid_cnt;
+	struct acm_prdb_guid	*guid_map;	/* sorted by GUID */
+	union ibv_gid		sgid;
+	uint16_t		slid;
+	uint16_t		pkey;
+	uint8_t			subnet_timeout;
+	uint64_t		epoch;
+};
 
-	lid2guid = calloc(IB_LID_MCAST_START, sizeof(*lid2guid));
-	if (!lid2guid) {
-		ssa_log(SSA_LOG_DEFAULT, "ERROR - no memory for path record parsing\n");
-		goto err;
-	}
+static int acm_compare_prdb_guid(const void *guid1, const void *guid2)
+{
+	const struct acm_prdb_guid *g1 = guid1, *g2 = guid2;
 
-	acm_parse_access_v1_lid2guid(p_ssa_db, lid2guid);
-	ret = acm_parse_access_v1_paths(p_ssa_db, lid2guid, ep);
-	acm_parse_access_v1_paths_update(lid2guid, lid2guid_cached, ep);
-	if (lid2guid_cached)
-		free(lid2guid_cached);
-	lid2guid_cached = lid2guid;
-err:
-	ssa_db_destroy(p_ssa_db);
-	return ret;
+	if (g1->guid == g2->guid)
+		return 0;
+	return ntohll(g1->guid) < ntohll(g2->guid) ? -1 : 1;
 }
 
-static int acm_insert_addr_dest(struct acm_ep *ep, uint32_t qpn, uint8_t flags,
-				uint8_t *addr, size_t addr_size,
-				uint8_t addr_type, uint8_t *gid)
+static void acm_prdb_index_free(struct acm_prdb_index *index)
 {
-	struct acm_dest *dest, *gid_dest;
-	char buf[ACM_MAX_ADDRESS], host[ACM_MAX_ADDRESS];
-	char lladdr[20];
-	uint8_t name[ACM_MAX_ADDRESS] = { 0 };
-	in_addr_t ipv4_addr, local_ipv4_addr;
-	struct in6_addr ipv6_addr, local_ipv6_addr;
-	int neigh, i, ret = 0;
+	if (!index)
+		return;
+	free(index->guid_map);
+	free(index->lid_map);
+	free(index->pr);
+	free(index);
+}
 
-	if (addr_type == ACM_ADDRESS_NAME)
-		strncpy((char *) name, (char *) addr, addr_size);
-	else
-		memcpy(name, addr, addr_size);
+static struct acm_prdb_index *
+acm_prdb_index_build(struct ssa_db *p_ssa_db, struct acm_ep *ep)
+{
+	struct acm_prdb_index *index;
+	struct ibv_port_attr attr;
+	struct ibv_context *verbs;
+	struct prdb_pr *p_pr_tbl;
+	uint8_t *port_num;
+	uint16_t *port_lid;
+	uint32_t i;
+	uint16_t lid, max_lid = 0;
 
-	dest = acm_acquire_dest(ep, addr_type, name);
-	if (!dest) {
-		if (addr_type == ACM_ADDRESS_IP)
-			inet_ntop(AF_INET, addr, buf, sizeof(buf));
-		else if (addr_type == ACM_ADDRESS_IP6)
-			inet_ntop(AF_INET6, addr, buf, sizeof(buf));
-		else
-			strncpy(buf, (char *) addr, sizeof(buf));
-		ssa_log_err(SSA_LOG_DEFAULT,
-			    "unable to create addr dest %s type %d\n",
-			    buf, addr_type);
-		ret = -1;
-		goto out;
+	index = calloc(1, sizeof(*index));
+	if (!index) {
+		ssa_log_err(0, "unable to allocate PRDB index\n");
+		return NULL;
 	}
 
-	memset(name, 0, sizeof(name));
-	memcpy(name, gid, 16);
-	gid_dest = acm_get_dest(ep, ACM_ADDRESS_GID, name);
-	if (gid_dest) {
-		dest->path = gid_dest->path;
-		dest->state = ACM_READY;
-		acm_put_dest(gid_dest);
-	} else {
-		memcpy(&dest->path.dgid, gid, 16);
-		if (acm_mode == ACM_MODE_ACM) {
-			//ibv_query_gid(((struct acm_port *)ep->port)->dev->verbs,
-			//		((struct acm_port *)ep->port)->port_num,
-			//		0, &dest->path.sgid);
-			dest->path.slid = htons(((struct acm_port *)ep->port)->lid);
-		} else {	/* ACM_MODE_SSA */
-			//ibv_query_gid(((struct ssa_port *)ep->port)->dev->verbs,
-			//		((struct ssa_port *)ep->port)->port_num,
-			//		0, &dest->path.sgid);
-			dest->path.slid = htons(((struct ssa_port *)ep->port)->lid);
-		}
-		dest->path.reversible_numpath = IBV_PATH_RECORD_REVERSIBLE;
-		dest->path.pkey = htons(ep->pkey);
-		dest->state = ACM_ADDR_RESOLVED;
+	if (acm_mode == ACM_MODE_ACM)
+		verbs = ((struct acm_port *)(ep->port))->dev->verbs;
+	else /* ACM_MODE_SSA */
+		verbs = ((struct ssa_port *)(ep->port))->dev->verbs;
+
+	port_num = GET_PORT_FIELD_PTR(ep->port, uint8_t, port_num);
+	port_lid = GET_PORT_FIELD_PTR(ep->port, uint16_t, lid);
+	if (ibv_query_gid(verbs, *port_num, 0, &index->sgid)) {
+		ssa_log_err(0, "unable to query gid for port num %d\n",
+			    *port_num);
+		goto err;
 	}
+	if (ibv_query_port(verbs, *port_num, &attr)) {
+		ssa_log_err(0, "unable to get port state ERROR %d (%s)\n",
+			    errno, strerror(errno));
+		goto err;
+	}
+	index->slid = *port_lid;
+	index->pkey = ep->pkey;
+	index->subnet_timeout = attr.subnet_timeout;
+	index->epoch = ssa_db_get_epoch(p_ssa_db, DB_DEF_TBL_ID);
 
-	dest->remote_qpn = qpn;
-	dest->remote_flags = flags;
-	dest->addr_timeout = time_stamp_min() + (unsigned) addr_timeout;
-	dest->route_timeout = time_stamp_min() + (unsigned) route_timeout;
-	acm_put_dest(dest);
+	p_pr_tbl = (struct prdb_pr *) p_ssa_db->pp_tables[PRDB_TBL_ID_PR];
+	index->pr_cnt = ntohll(p_ssa_db->p_db_tables[PRDB_TBL_ID_PR].set_count);
+	if (!index->pr_cnt)
+		return index;
+
+	index->pr = malloc(index->pr_cnt * sizeof(*index->pr));
+	index->guid_map = malloc(index->pr_cnt * sizeof(*index->guid_map));
+	if (!index->pr || !index->guid_map) {
+		ssa_log_err(0, "unable to allocate PRDB index for %u records\n",
+			    index->pr_cnt);
+		goto err;
+	}
+	memcpy(index->pr, p_pr_tbl, index->pr_cnt * sizeof(*index->pr));
 
-	if (addr_type == ACM_ADDRESS_IP)
-		inet_ntop(AF_INET, addr, host, sizeof(host));
-	else if (addr_type == ACM_ADDRESS_IP6)
-		inet_ntop(AF_INET6, addr, host, sizeof(host));
-	else
-		snprintf(host, sizeof(host), "%s", (char *) addr);
-	inet_ntop(AF_INET6, gid, buf, sizeof(buf));
-	ssa_log(SSA_LOG_VERBOSE,
-		"added host %s address type %d IB GID %s "
-		"QPN 0x%x flags 0x%x pkey 0x%x\n",
-		host, addr_type, buf, qpn, flags, ep->pkey);
+	for (i = 0; i < index->pr_cnt; i++) {
+		lid = ntohs(index->pr[i].lid);
+		if (lid < IB_LID_MCAST_START && lid > max_lid)
+			max_lid = lid;
+		index->guid_map[i].guid = index->pr[i].guid;
+		index->guid_map[i].index = i;
+	}
+	qsort(index->guid_map, index->pr_cnt, sizeof(*index->guid_map),
+	      acm_compare_prdb_guid);
+
+	index->lid_cnt = max_lid + 1;
+	index->lid_map = calloc(index->lid_cnt, sizeof(*index->lid_map));
+	if (!index->lid_map) {
+		ssa_log_err(0, "unable to allocate PRDB LID index\n");
+		goto err;
+	}
+
+	for (i = 0; i < index->pr_cnt; i++) {
+		lid = ntohs(index->pr[i].lid);
+		if (lid >= IB_LID_MCAST_START)
+			continue;
+		if (index->lid_map[lid])
+			ssa_log(SSA_LOG_DEFAULT, "ERROR - duplicate lid %u\n", lid);
+		else
+			index->lid_map[lid] = i + 1;
+	}
+
+	return index;
+err:
+	acm_prdb_index_free(index);
+	return NULL;
+}
+
+static struct prdb_pr *
+acm_prdb_index_find(struct acm_prdb_index *index, uint8_t addr_type,
+		    uint8_t *addr)
+{
+	struct acm_prdb_guid key, *guid;
+	union ibv_gid *dgid;
+	uint16_t dlid;
+
+	if (addr_type == ACM_ADDRESS_LID) {
+		dlid = ntohs(*(uint16_t *) addr);
+		if (dlid >= index->lid_cnt || !index->lid_map[dlid])
+			return NULL;
+		return &index->pr[index->lid_map[dlid] - 1];
+	}
+
+	dgid = (union ibv_gid *) addr;
+	if (dgid->global.subnet_prefix != index->sgid.global.subnet_prefix)
+		return NULL;
+
+	key.guid = dgid->global.interface_id;
+	guid = bsearch(&key, index->guid_map, index->pr_cnt,
+		       sizeof(*index->guid_map), acm_compare_prdb_guid);
+	return guid ? &index->pr[guid->index] : NULL;
+}
+
+static void
+acm_prdb_index_path(struct acm_prdb_index *index, struct prdb_pr *rec,
+		    struct ibv_path_record *path)
+{
+	memset(path, 0, sizeof(*path));
+	path->sgid = index->sgid;
+	path->slid = htons(index->slid);
+	path->dgid.global.subnet_prefix = index->sgid.global.subnet_prefix;
+	path->dgid.global.interface_id = rec->guid;
+	path->dlid = rec->lid;
+	path->reversible_numpath = IBV_PATH_RECORD_REVERSIBLE;
+	path->pkey = htons(index->pkey);
+	path->mtu = rec->mtu;
+	path->rate = rec->rate;
+	path->qosclass_sl = htons((uint16_t) rec->sl & 0xF);
+	path->packetlifetime = (ntohs(rec->lid) == index->slid) ?
+			       0 : index->subnet_timeout;
+}
+
+/* Resolve LID or GID address of ep destination from the PRDB index */
+static int
+acm_ep_prdb_path(struct acm_ep *ep, uint8_t addr_type, uint8_t *addr,
+		 struct ibv_path_record *path)
+{
+	struct prdb_pr *rec = NULL;
+
+	pthread_mutex_lock(&ep->lock);
+	if (ep->prdb_index)
+		rec = acm_prdb_index_find(ep->prdb_index, addr_type, addr);
+	if (rec)
+		acm_prdb_index_path(ep->prdb_index, rec, path);
+	pthread_mutex_unlock(&ep->lock);
+
+	return rec ? 0 : -1;
+}
+
+static int acm_prdb_index_update(struct ssa_db *p_ssa_db, struct acm_ep *ep)
+{
+	struct acm_prdb_index *index, *old_index;
+	struct ibv_path_record path;
+	uint8_t addr[ACM_MAX_ADDRESS];
+	uint32_t i;
+
+	index = acm_prdb_index_build(p_ssa_db, ep);
+	if (!index)
+		return 1;
+
+	pthread_mutex_lock(&ep->lock);
+	old_index = ep->prdb_index;
+	ep->prdb_index = index;
+	pthread_mutex_unlock(&ep->lock);
+	acm_prdb_index_free(old_index);
+
+	for (i = 0; shm_hdr && i < index->pr_cnt; i++) {
+		acm_prdb_index_path(index, &index->pr[i], &path);
+		memset(addr, 0, sizeof(addr));
+		memcpy(addr, &path.dlid, sizeof(path.dlid));
+		acm_shm_publish(ACM_ADDRESS_LID, addr, &path);
+		memset(addr, 0, sizeof(addr));
+		memcpy(addr, &path.dgid, sizeof(path.dgid));
+		acm_shm_publish(ACM_ADDRESS_GID, addr, &path);
+	}
+
+	ssa_log(SSA_LOG_VERBOSE, "PRDB index with %u records for epoch 0x%"
+		PRIx64 "\n", index->pr_cnt, index->epoch);
+	return 0;
+}
+
+static int acm_parse_access_v1_prdb(struct ssa_db *p_ssa_db, struct acm_ep *ep)
+{
+	uint64_t *lid2guid;
+	int ret;
+
+	if (prdb_direct)
+		return acm_prdb_index_update(p_ssa_db, ep);
+
+	lid2guid = calloc(IB_LID_MCAST_START, sizeof(*lid2guid));
+	if (!lid2guid) {
+		ssa_log(SSA_LOG_DEFAULT, "ERROR - no memory for path record parsing\n");
+		return 1;
+	}
+
+	acm_parse_access_v1_lid2guid(p_ssa_db, lid2guid);
+	ret = acm_parse_access_v1_paths(p_ssa_db, lid2guid, ep);
+	acm_parse_access_v1_paths_update(lid2guid, lid2guid_cached, ep);
+	if (lid2guid_cached)
+		free(lid2guid_cached);
+	lid2guid_cached = lid2guid;
+	return ret;
+}
+
+static int acm_parse_access_v1(struct acm_ep *ep)
+{
+	struct ssa_db *p_ssa_db;
+	int ret = 1;
+
+	p_ssa_db = ssa_db_load(route_data_dir, SSA_DB_HELPER_MMAP);
+	if (!p_ssa_db)
+		p_ssa_db = ssa_db_load(route_data_dir, SSA_DB_HELPER_DEBUG);
+	if (!p_ssa_db) {
+		ssa_log(SSA_LOG_DEFAULT, "ERROR - couldn't load PRDB from %s\n",
+			route_data_dir);
+		return ret;
+	}
+
+	ret = acm_parse_access_v1_prdb(p_ssa_db, ep);
+	ssa_db_destroy(p_ssa_db);
+	return ret;
+}
+
+/* Sync kernel neighbor cache with IPoIB address of remote host */
+static void acm_addr_neigh_add(struct acm_ep *ep, uint32_t qpn, uint8_t flags,
+			       uint8_t *addr, uint8_t addr_type, uint8_t *gid)
+{
+	char buf[ACM_MAX_ADDRESS];
+	char lladdr[20];
+	in_addr_t ipv4_addr, local_ipv4_addr;
+	struct in6_addr ipv6_addr, local_ipv6_addr;
+	int neigh, i;
 
 	if (addr_type == ACM_ADDRESS_IP)
 		neigh = NEIGH_MODE_IPV4;
@@ -3422,7 +4024,7 @@ static int acm_insert_addr_dest(struct acm_ep *ep, uint32_t qpn, uint8_t flags,
 
 			memcpy(&ipv4_addr, addr, 4);
 			if (ipv4_addr == local_ipv4_addr)
-				goto out;
+				return;
 			ssa_log(SSA_LOG_VERBOSE,
 				"IPv4 neighbor 0x%x to be added to ifindex %u\n",
 				htonl(ipv4_addr), ep->ifindex);
@@ -3448,7 +4050,7 @@ static int acm_insert_addr_dest(struct acm_ep *ep, uint32_t qpn, uint8_t flags,
 
 			memcpy(&ipv6_addr, addr, 16);
 			if (!memcmp(&ipv6_addr, &local_ipv6_addr, 16))
-				goto out;
+				return;
 			inet_ntop(AF_INET6, &ipv6_addr, buf, sizeof(buf));
 			ssa_log(SSA_LOG_VERBOSE,
 				"IPv6 neighbor %s to be added to ifindex %u\n",
@@ -3463,6 +4065,86 @@ static int acm_insert_addr_dest(struct acm_ep *ep, uint32_t qpn, uint8_t flags,
 					buf);
 		}
 	}
+}
+
+static int acm_insert_addr_dest(struct acm_ep *ep, uint32_t qpn, uint8_t flags,
+				uint8_t *addr, size_t addr_size,
+				uint8_t addr_type, uint8_t *gid)
+{
+	struct acm_dest *dest, *gid_dest;
+	struct ibv_path_record path;
+	char buf[ACM_MAX_ADDRESS], host[ACM_MAX_ADDRESS];
+	uint8_t name[ACM_MAX_ADDRESS] = { 0 };
+	int ret = 0;
+
+	if (addr_type == ACM_ADDRESS_NAME)
+		strncpy((char *) name, (char *) addr, addr_size);
+	else
+		memcpy(name, addr, addr_size);
+
+	dest = acm_acquire_dest(ep, addr_type, name);
+	if (!dest) {
+		if (addr_type == ACM_ADDRESS_IP)
+			inet_ntop(AF_INET, addr, buf, sizeof(buf));
+		else if (addr_type == ACM_ADDRESS_IP6)
+			inet_ntop(AF_INET6, addr, buf, sizeof(buf));
+		else
+			strncpy(buf, (char *) addr, sizeof(buf));
+		ssa_log_err(SSA_LOG_DEFAULT,
+			    "unable to create addr dest %s type %d\n",
+			    buf, addr_type);
+		ret = -1;
+		goto out;
+	}
+
+	memset(name, 0, sizeof(name));
+	memcpy(name, gid, 16);
+	gid_dest = acm_get_dest(ep, ACM_ADDRESS_GID, name);
+	if (gid_dest) {
+		dest->path = gid_dest->path;
+		dest->state = ACM_READY;
+		acm_shm_publish(addr_type, dest->address, &dest->path);
+		acm_put_dest(gid_dest);
+	} else {
+		memcpy(&dest->path.dgid, gid, 16);
+		if (ep->prdb_index &&
+		    !acm_ep_prdb_path(ep, ACM_ADDRESS_GID, name, &path))
+			acm_shm_publish(addr_type, dest->address, &path);
+		if (acm_mode == ACM_MODE_ACM) {
+			//ibv_query_gid(((struct acm_port *)ep->port)->dev->verbs,
+			//		((struct acm_port *)ep->port)->port_num,
+			//		0, &dest->path.sgid);
+			dest->path.slid = htons(((struct acm_port *)ep->port)->lid);
+		} else {	/* ACM_MODE_SSA */
+			//ibv_query_gid(((struct ssa_port *)ep->port)->dev->verbs,
+			//		((struct ssa_port *)ep->port)->port_num,
+			//		0, &dest->path.sgid);
+			dest->path.slid = htons(((struct ssa_port *)ep->port)->lid);
+		}
+		dest->path.reversible_numpath = IBV_PATH_RECORD_REVERSIBLE;
+		dest->path.pkey = htons(ep->pkey);
+		dest->state = ACM_ADDR_RESOLVED;
+	}
+
+	dest->remote_qpn = qpn;
+	dest->remote_flags = flags;
+	dest->addr_timeout = time_stamp_min() + (unsigned) addr_timeout;
+	dest->route_timeout = time_stamp_min() + (unsigned) route_timeout;
+	acm_put_dest(dest);
+
+	if (addr_type == ACM_ADDRESS_IP)
+		inet_ntop(AF_INET, addr, host, sizeof(host));
+	else if (addr_type == ACM_ADDRESS_IP6)
+		inet_ntop(AF_INET6, addr, host, sizeof(host));
+	else
+		snprintf(host, sizeof(host), "%s", (char *) addr);
+	inet_ntop(AF_INET6, gid, buf, sizeof(buf));
+	ssa_log(SSA_LOG_VERBOSE,
+		"added host %s address type %d IB GID %s "
+		"QPN 0x%x flags 0x%x pkey 0x%x\n",
+		host, addr_type, buf, qpn, flags, ep->pkey);
+
+	acm_addr_neigh_add(ep, qpn, flags, addr, addr_type, gid);
 out:
 	return ret;
 }
@@ -3753,6 +4435,7 @@ static int acm_assign_ep_names(struct acm_ep *ep)
  */
 static void acm_ep_preload(struct acm_ep *ep)
 {
+	acm_shm_update_begin();
 	switch (route_preload) {
 	case ACM_ROUTE_PRELOAD_OSM_FULL_V1:
 		if (acm_parse_osm_fullv1(ep))
@@ -3773,6 +4456,7 @@ static void acm_ep_preload(struct acm_ep *ep)
 	default:
 		break;
 	}
+	acm_shm_update_end(0);
 }
 
 static int acm_init_ep_loopback(struct acm_ep *ep)
@@ -4040,52 +4724,313 @@ err0:
 	free(ep);
 }
 
+/*
+ * IPDB address index.  The IPv4, IPv6 and name tables are indexed once
+ * per IPDB epoch into per pkey hash tables, shared by all endpoints.
+ * The address is kept in the same zero padded form as dest addresses.
+ */
+#define ACM_IPDB_TBLS	3
+
+struct acm_ipdb_rec {
+	uint8_t			addr[ACM_MAX_ADDRESS];
+	uint8_t			gid[16];
+	uint32_t		qpn;
+	uint16_t		pkey;
+	uint8_t			addr_type;
+	uint8_t			flags;
+};
+
+struct acm_ipdb_part {
+	uint16_t		pkey;
+	uint32_t		rec_cnt;
+	uint32_t		mask;
+	uint32_t		*slot;	/* record index + 1 */
+};
+
+struct acm_ipdb_index {
+	uint64_t		epoch[ACM_IPDB_TBLS];
+	uint64_t		gen;	/* never 0, see acm_ep ipdb_gen */
+	struct acm_ipdb_rec	*rec;
+	uint32_t		rec_cnt;
+	struct acm_ipdb_part	*part;
+	int			part_cnt;
+};
+
+static struct acm_ipdb_index *ipdb_index;
+static uint64_t ipdb_index_gen;
+static pthread_mutex_t ipdb_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const struct {
+	int		tbl_id;
+	uint8_t		addr_type;
+	size_t		rec_size;
+	size_t		addr_size;
+} ipdb_tbls[ACM_IPDB_TBLS] = {
+	{ PRDB_TBL_ID_IPv4, ACM_ADDRESS_IP, sizeof(struct ipdb_ipv4),
+	  sizeof(((struct ipdb_ipv4 *) 0)->addr) },
+	{ PRDB_TBL_ID_IPv6, ACM_ADDRESS_IP6, sizeof(struct ipdb_ipv6),
+	  sizeof(((struct ipdb_ipv6 *) 0)->addr) },
+	{ PRDB_TBL_ID_NAME, ACM_ADDRESS_NAME, sizeof(struct ipdb_name),
+	  sizeof(((struct ipdb_name *) 0)->addr) },
+};
+
+static void acm_ipdb_index_free(struct acm_ipdb_index *index)
+{
+	int i;
+
+	if (!index)
+		return;
+	for (i = 0; i < index->part_cnt; i++)
+		free(index->part[i].slot);
+	free(index->part);
+	free(index->rec);
+	free(index);
+}
+
+static struct acm_ipdb_part *
+acm_ipdb_index_part(struct acm_ipdb_index *index, uint16_t pkey)
+{
+	int i;
+
+	for (i = 0; i < index->part_cnt; i++)
+		if (index->part[i].pkey == pkey)
+			return &index->part[i];
+	return NULL;
+}
+
+static struct acm_ipdb_part *
+acm_ipdb_index_add_part(struct acm_ipdb_index *index, uint16_t pkey)
+{
+	struct acm_ipdb_part *part;
+
+	part = realloc(index->part, (index->part_cnt + 1) * sizeof(*part));
+	if (!part)
+		return NULL;
+
+	index->part = part;
+	part = &index->part[index->part_cnt++];
+	memset(part, 0, sizeof(*part));
+	part->pkey = pkey;
+	return part;
+}
+
+static struct acm_ipdb_index *
+acm_ipdb_index_build(struct ssa_db *ssa_db, uint64_t *epoch)
+{
+	struct acm_ipdb_index *index;
+	struct acm_ipdb_part *part;
+	struct acm_ipdb_rec *rec;
+	struct ipdb_ipv4 *ipdb_rec;
+	uint64_t i, rec_cnt = 0;
+	uint32_t size, slot;
+	int t;
+
+	index = calloc(1, sizeof(*index));
+	if (!index)
+		goto err;
+	memcpy(index->epoch, epoch, sizeof(index->epoch));
+	index->gen = ++ipdb_index_gen;
+
+	for (t = 0; t < ACM_IPDB_TBLS; t++)
+		rec_cnt += ntohll(ssa_db->p_db_tables[ipdb_tbls[t].tbl_id].set_count);
+	if (!rec_cnt)
+		return index;
+
+	index->rec = calloc(rec_cnt, sizeof(*index->rec));
+	if (!index->rec)
+		goto err;
+
+	/*
+	 * All IPDB records start with the same qpn, pkey, flags and gid
+	 * fields, followed by the address.
+	 */
+	for (t = 0; t < ACM_IPDB_TBLS; t++) {
+		rec_cnt = ntohll(ssa_db->p_db_tables[ipdb_tbls[t].tbl_id].set_count);
+		for (i = 0; i < rec_cnt; i++) {
+			ipdb_rec = (struct ipdb_ipv4 *)
+				   ((uint8_t *) ssa_db->pp_tables[ipdb_tbls[t].tbl_id] +
+				    i * ipdb_tbls[t].rec_size);
+			rec = &index->rec[index->rec_cnt++];
+			rec->addr_type = ipdb_tbls[t].addr_type;
+			rec->qpn = ntohl(ipdb_rec->qpn);
+			rec->pkey = ntohs(ipdb_rec->pkey);
+			rec->flags = ipdb_rec->flags;
+			memcpy(rec->gid, ipdb_rec->gid, sizeof(rec->gid));
+			if (rec->addr_type == ACM_ADDRESS_NAME)
+				strncpy((char *) rec->addr, (char *) ipdb_rec->addr,
+					ipdb_tbls[t].addr_size);
+			else
+				memcpy(rec->addr, ipdb_rec->addr,
+				       ipdb_tbls[t].addr_size);
+
+			part = acm_ipdb_index_part(index, rec->pkey);
+			if (!part)
+				part = acm_ipdb_index_add_part(index, rec->pkey);
+			if (!part)
+				goto err;
+			part->rec_cnt++;
+		}
+	}
+
+	for (t = 0; t < index->part_cnt; t++) {
+		part = &index->part[t];
+		for (size = 2; size < 2 * part->rec_cnt; size <<= 1)
+			;
+		part->mask = size - 1;
+		part->slot = calloc(size, sizeof(*part->slot));
+		if (!part->slot)
+			goto err;
+	}
+
+	for (i = 0; i < index->rec_cnt; i++) {
+		rec = &index->rec[i];
+		part = acm_ipdb_index_part(index, rec->pkey);
+		slot = acm_shm_hash(rec->addr_type, rec->addr) & part->mask;
+		while (part->slot[slot])
+			slot = (slot + 1) & part->mask;
+		part->slot[slot] = i + 1;
+	}
+
+	return index;
+err:
+	ssa_log_err(0, "unable to allocate IPDB address index\n");
+	acm_ipdb_index_free(index);
+	return NULL;
+}
+
+static struct acm_ipdb_rec *
+acm_ipdb_index_find(struct acm_ipdb_index *index, uint16_t pkey,
+		    uint8_t addr_type, uint8_t *addr)
+{
+	struct acm_ipdb_part *part;
+	struct acm_ipdb_rec *rec;
+	uint32_t slot;
+
+	part = acm_ipdb_index_part(index, pkey);
+	if (!part)
+		return NULL;
+
+	slot = acm_shm_hash(addr_type, addr) & part->mask;
+	for (; part->slot[slot]; slot = (slot + 1) & part->mask) {
+		rec = &index->rec[part->slot[slot] - 1];
+		if (rec->addr_type == addr_type &&
+		    !memcmp(rec->addr, addr, ACM_MAX_ADDRESS))
+			return rec;
+	}
+	return NULL;
+}
+
+/* Path to destination GID, either from the PRDB index or the GID dest */
 static int
-acm_parse_access_v1_address(struct ssa_db *ssa_db, struct acm_ep *ep)
+acm_ep_gid_path(struct acm_ep *ep, uint8_t *gid, struct ibv_path_record *path)
 {
-	struct ipdb_ipv4 *ipv4;
-	struct ipdb_ipv6 *ipv6;
-	struct ipdb_name *name;
-	uint64_t i, rec_cnt;
-	int no_recs = 1;
+	struct acm_dest *gid_dest;
+	uint8_t addr[ACM_MAX_ADDRESS] = { 0 };
 
-	rec_cnt = ntohll(ssa_db->p_db_tables[PRDB_TBL_ID_IPv4].set_count);
-	ipv4 = (struct ipdb_ipv4 *) ssa_db->pp_tables[PRDB_TBL_ID_IPv4];
-	for (i = 0; i < rec_cnt; ipv4++, i++) {
-		if (ep->pkey != ntohs(ipv4->pkey))
-			continue;
+	memcpy(addr, gid, 16);
+	if (ep->prdb_index)
+		return acm_ep_prdb_path(ep, ACM_ADDRESS_GID, addr, path);
+
+	pthread_mutex_lock(&ep->lock);
+	gid_dest = acm_get_dest(ep, ACM_ADDRESS_GID, addr);
+	pthread_mutex_unlock(&ep->lock);
+	if (!gid_dest)
+		return -1;
 
-		acm_insert_addr_dest(ep, ntohl(ipv4->qpn), ipv4->flags,
-				     ipv4->addr, sizeof(ipv4->addr),
-				     ACM_ADDRESS_IP, ipv4->gid);
-		no_recs = 0;
+	pthread_mutex_lock(&gid_dest->lock);
+	*path = gid_dest->path;
+	pthread_mutex_unlock(&gid_dest->lock);
+	acm_put_dest(gid_dest);
+	return 0;
+}
+
+/*
+ * Resolve IPDB address of ep destination.  Returns -1 if the address
+ * is not in the IPDB, 1 if it is but there is no path to its GID.
+ */
+static int
+acm_ep_ipdb_path(struct acm_ep *ep, uint8_t addr_type, uint8_t *addr,
+		 struct ibv_path_record *path)
+{
+	struct acm_ipdb_rec *rec;
+	uint8_t gid[16];
+	int found = 0;
+
+	pthread_mutex_lock(&ipdb_lock);
+	if (ipdb_index) {
+		rec = acm_ipdb_index_find(ipdb_index, ep->pkey, addr_type, addr);
+		if (rec) {
+			memcpy(gid, rec->gid, sizeof(gid));
+			found = 1;
+		}
 	}
+	pthread_mutex_unlock(&ipdb_lock);
 
-	rec_cnt = ntohll(ssa_db->p_db_tables[PRDB_TBL_ID_IPv6].set_count);
-	ipv6 = (struct ipdb_ipv6 *) ssa_db->pp_tables[PRDB_TBL_ID_IPv6];
-	for (i = 0; i < rec_cnt; ipv6++, i++) {
-		if (ep->pkey != ntohs(ipv6->pkey))
-			continue;
+	if (!found)
+		return -1;
 
-		acm_insert_addr_dest(ep, ntohl(ipv6->qpn), ipv6->flags,
-				     ipv6->addr, sizeof(ipv6->addr),
-				     ACM_ADDRESS_IP6, ipv6->gid);
-		no_recs = 0;
+	return acm_ep_gid_path(ep, gid, path) ? 1 : 0;
+}
+
+static int
+acm_parse_access_v1_address(struct ssa_db *ssa_db, struct acm_ep *ep)
+{
+	struct acm_ipdb_index *index, *old_index;
+	struct acm_ipdb_part *part;
+	struct acm_ipdb_rec *rec;
+	struct ibv_path_record path;
+	uint64_t epoch[ACM_IPDB_TBLS];
+	uint32_t slot;
+	int t, rebuild, add_neigh;
+
+	for (t = 0; t < ACM_IPDB_TBLS; t++)
+		epoch[t] = ssa_db_get_epoch(ssa_db, ipdb_tbls[t].tbl_id);
+
+	/* Only the control thread replaces the index */
+	index = ipdb_index;
+	rebuild = !index || memcmp(index->epoch, epoch, sizeof(epoch));
+	if (rebuild) {
+		index = acm_ipdb_index_build(ssa_db, epoch);
+		if (!index)
+			return 1;
+
+		pthread_mutex_lock(&ipdb_lock);
+		old_index = ipdb_index;
+		ipdb_index = index;
+		pthread_mutex_unlock(&ipdb_lock);
+		acm_ipdb_index_free(old_index);
+		ssa_log(SSA_LOG_VERBOSE, "IPDB index rebuilt with %u addresses "
+			"in %d partitions\n", index->rec_cnt, index->part_cnt);
+	} else {
+		ssa_log(SSA_LOG_VERBOSE, "IPDB epochs unchanged\n");
 	}
 
-	rec_cnt = ntohll(ssa_db->p_db_tables[PRDB_TBL_ID_NAME].set_count);
-	name = (struct ipdb_name *) ssa_db->pp_tables[PRDB_TBL_ID_NAME];
-	for (i = 0; i < rec_cnt; name++, i++) {
-		if (ep->pkey != ntohs(name->pkey))
+	part = acm_ipdb_index_part(index, ep->pkey);
+	if (!part)
+		return 1;
+
+	/*
+	 * Every endpoint needs the neighbors of the current index once,
+	 * whether or not its update is the one that rebuilt the index.
+	 */
+	add_neigh = ep->ipdb_gen != index->gen;
+	if (!add_neigh && !shm_hdr)
+		return 0;
+
+	for (slot = 0; slot <= part->mask; slot++) {
+		if (!part->slot[slot])
 			continue;
 
-		acm_insert_addr_dest(ep, ntohl(name->qpn), name->flags,
-				     name->addr, sizeof(name->addr),
-				     ACM_ADDRESS_NAME, name->gid);
-		no_recs = 0;
+		rec = &index->rec[part->slot[slot] - 1];
+		if (add_neigh)
+			acm_addr_neigh_add(ep, rec->qpn, rec->flags, rec->addr,
+					   rec->addr_type, rec->gid);
+		if (shm_hdr && !acm_ep_gid_path(ep, rec->gid, &path))
+			acm_shm_publish(rec->addr_type, rec->addr, &path);
 	}
+	ep->ipdb_gen = index->gen;
 
-	return no_recs;
+	return 0;
 }
 
 static int acm_parse_ssa_db(struct ssa_db *p_ssa_db, struct ssa_svc *svc)
@@ -4093,7 +5038,6 @@ static int acm_parse_ssa_db(struct ssa_db *p_ssa_db, struct ssa_svc *svc)
 	struct ssa_device *ssa_dev1 = NULL;
 	struct ssa_port *port;
 	struct acm_ep *acm_ep;
-	uint64_t *lid2guid;
 	uint16_t pkey;
 	int d, ret = 1;
 
@@ -4131,30 +5075,28 @@ static int acm_parse_ssa_db(struct ssa_db *p_ssa_db, struct ssa_svc *svc)
 		goto err;
 	}
 
-	lid2guid = calloc(IB_LID_MCAST_START, sizeof(*lid2guid));
-	if (!lid2guid) {
-		ssa_log(SSA_LOG_DEFAULT, "ERROR - no memory for path record parsing\n");
-		goto err;
-	}
+	pthread_mutex_lock(&acm_ep->lock);
+	acm_ep_neg_flush(acm_ep);
+	pthread_mutex_unlock(&acm_ep->lock);
 
-	acm_parse_access_v1_lid2guid(p_ssa_db, lid2guid);
-	ret = acm_parse_access_v1_paths(p_ssa_db, lid2guid, acm_ep);
-	acm_parse_access_v1_paths_update(lid2guid, lid2guid_cached, acm_ep);
-	if (lid2guid_cached)
-		free(lid2guid_cached);
-	lid2guid_cached = lid2guid;
+	acm_shm_update_begin();
+	acm_shm_remove_port(htons(port->lid));
+
+	ret = acm_parse_access_v1_prdb(p_ssa_db, acm_ep);
+	if (ret == 1)
+		goto shm;
 
 	ssa_log(SSA_LOG_VERBOSE,
 		"cache update complete with PRDB epoch 0x%" PRIx64 "\n",
 		ssa_db_get_epoch(p_ssa_db, DB_DEF_TBL_ID));
 
-	if (acm_parse_access_v1_address(p_ssa_db, acm_ep))
-		goto err;
-	else
+	if (!acm_parse_access_v1_address(p_ssa_db, acm_ep))
 		ssa_log(SSA_LOG_VERBOSE,
 			"cache update complete with IPDB epoch 0x%" PRIx64 "\n",
 			ssa_db_get_epoch(p_ssa_db, PRDB_TBL_ID_IPv4));
 
+shm:
+	acm_shm_update_end(ssa_db_get_epoch(p_ssa_db, DB_DEF_TBL_ID));
 err:
 	/* TODO: decide whether the destroy call is needed */
 	/* ssa_db_destroy(p_ssa_db); */
@@ -4499,6 +5441,8 @@ static int acm_process_dev_event(struct ssa_svc *svc, struct ssa_ctrl_msg_buf *m
 
 static int acm_process_msg(struct ssa_svc *svc, struct ssa_ctrl_msg_buf *msg)
 {
+	struct timeval start;
+
 	ssa_log(SSA_LOG_VERBOSE | SSA_LOG_CTRL, "%s\n", svc->name);
 	switch(msg->hdr.type) {
 	case SSA_CTRL_MAD:
@@ -4516,9 +5460,11 @@ ssa_log(SSA_LOG_DEFAULT, "SSA DB update ssa_db %p epoch 0x%" PRIx64 "\n", ((stru
 			ssa_db_save(prdb_dump_dir,
 				    ((struct ssa_db_update_msg *)msg)->db_upd.db,
 				    prdb_dump);
+		gettimeofday(&start, NULL);
 		if (acm_parse_ssa_db((struct ssa_db *)(((struct ssa_db_update_msg *)msg)->db_upd.db), svc))
 			ssa_log(SSA_LOG_DEFAULT,
 				"ERROR - unable to preload ACM cache\n");
+		ssa_hist_record_since(HIST_ID_ACM_CACHE_UPDATE, &start);
 		return 1;
 	case SSA_CTRL_DEV_EVENT:
 		return acm_process_dev_event(svc, msg);
@@ -4556,6 +5502,10 @@ static void acm_set_options(void)
 			ssa_set_log_level(atoi(value));
 		else if (!strcasecmp("log_flush", opt))
 			log_flush = atoi(value);
+		else if (!strcasecmp("log_async", opt))
+			log_async = atoi(value);
+		else if (!strcasecmp("log_rate_limit", opt))
+			log_rate_limit = atoi(value);
 		else if (!strcasecmp("accum_log_file", opt))
 			accum_log_file = atoi(value);
 		else if (!strcasecmp("lock_file", opt))
@@ -4568,12 +5518,18 @@ static void acm_set_options(void)
 			route_prot = acm_convert_route_prot(value);
 		else if (!strcmp("route_timeout", opt))
 			route_timeout = atoi(value);
+		else if (!strcasecmp("neg_timeout", opt))
+			neg_timeout = atoi(value);
 		else if (!strcasecmp("loopback_prot", opt))
 			loopback_prot = acm_convert_loopback_prot(value);
 		else if (!strcasecmp("server_port", opt))
 			server_port = (short) atoi(value);
 		else if (!strcasecmp("prdb_port", opt))
 			prdb_port = (short) atoi(value);
+		else if (!strcasecmp("metrics_port", opt))
+			metrics_port = (short) atoi(value);
+		else if (!strcasecmp("metrics_socket", opt))
+			strcpy(metrics_socket, value);
 		else if (!strcasecmp("prdb_dump", opt))
 			prdb_dump = atoi(value);
 		else if (!strcasecmp("prdb_dump_dir", opt))
@@ -4622,6 +5578,12 @@ static void acm_set_options(void)
 			neigh_mode = atoi(value);
 		else if (!strcasecmp("support_ips_in_addr_cfg", opt))
 			support_ips_in_addr_cfg = atoi(value);
+		else if (!strcasecmp("prdb_direct", opt))
+			prdb_direct = atoi(value);
+		else if (!strcasecmp("shm_cache", opt))
+			shm_cache = atoi(value);
+		else if (!strcasecmp("shm_cache_size", opt))
+			shm_cache_size = atoi(value);
 	}
 
 	fclose(f);
@@ -4639,10 +5601,13 @@ static void acm_log_options(void)
 	ssa_log(SSA_LOG_DEFAULT, "address timeout %d\n", addr_timeout);
 	ssa_log(SSA_LOG_DEFAULT, "route resolution %d\n", route_prot);
 	ssa_log(SSA_LOG_DEFAULT, "route timeout %d\n", route_timeout);
+	ssa_log(SSA_LOG_DEFAULT, "negative cache timeout %d\n", neg_timeout);
 	ssa_log(SSA_LOG_DEFAULT, "loopback resolution %d\n", loopback_prot);
 	ssa_log(SSA_LOG_DEFAULT, "server port %d\n", server_port);
 	ssa_log(SSA_LOG_DEFAULT, "prdb port %u\n", prdb_port);
 	ssa_log(SSA_LOG_DEFAULT, "admin port %u\n", admin_port);
+	ssa_log(SSA_LOG_DEFAULT, "metrics port %u\n", metrics_port);
+	ssa_log(SSA_LOG_DEFAULT, "metrics socket %s\n", metrics_socket);
 	ssa_log(SSA_LOG_DEFAULT, "prdb dump %d\n", prdb_dump);
 	ssa_log(SSA_LOG_DEFAULT, "prdb dump dir %s\n", prdb_dump_dir);
 	ssa_log(SSA_LOG_DEFAULT, "timeout %d ms\n", timeout);
@@ -4676,6 +5641,10 @@ static void acm_log_options(void)
 	ssa_log(SSA_LOG_DEFAULT, "neigh_mode %d\n", neigh_mode);
 	ssa_log(SSA_LOG_DEFAULT, "support IPs in ibacm_addr.data %d\n",
 		support_ips_in_addr_cfg);
+	ssa_log(SSA_LOG_DEFAULT, "prdb direct %d\n", prdb_direct);
+	ssa_log(SSA_LOG_DEFAULT, "shared memory path cache %d\n", shm_cache);
+	ssa_log(SSA_LOG_DEFAULT, "shared memory path cache size %d\n",
+		shm_cache_size);
 }
 
 static int acm_init_svc(struct ssa_svc *svc)
@@ -4761,6 +5730,7 @@ static void *acm_ctrl_handler(void *context)
 	if (acm_mode == ACM_MODE_SSA)
 		pthread_create(&query_thread, NULL, acm_issue_query, svc);
 
+	ssa_metrics_register(acm_metrics, NULL);
 	ret = ssa_start_admin(&ssa);
 	if (ret) {
 		ssa_log(SSA_LOG_DEFAULT, "ERROR starting admin thread\n");
@@ -4869,6 +5839,10 @@ int main(int argc, char **argv)
 			return -1;
 		}
 	} else { /* ACM_MODE_SSA */
+		if (acm_shm_init())
+			ssa_log_warn(SSA_LOG_DEFAULT,
+				     "continuing without shared memory path cache\n");
+
 		ssa_log(SSA_LOG_VERBOSE, "starting SSA framework\n");
 		if (ssa_open_devices(&ssa)) {
 			ssa_log_err(0, "unable to open any SSA device\n");
@@ -4894,9 +5868,11 @@ int main(int argc, char **argv)
 	pthread_join(ctrl_thread, NULL);
 	if (neigh_socket)
 		close_neighsock(neigh_socket);
+	acm_shm_cleanup();
 	ssa_cleanup(&ssa);
 	ssa_close_log();
 	ssa_close_lock_file();
 	free(lid2guid_cached);
+	acm_ipdb_index_free(ipdb_index);
 	return 0;
 }
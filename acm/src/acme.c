@@ -145,6 +145,20 @@ static void gen_opts_temp(FILE *f)
 	fprintf(f, "\n");
 	fprintf(f, "log_flush 1\n");
 	fprintf(f, "\n");
+	fprintf(f, "# log_async:\n");
+	fprintf(f, "# Indicates whether log messages are written by a dedicated thread\n");
+	fprintf(f, "# 0 - each thread writes its messages to the log file\n");
+	fprintf(f, "# 1 - messages are queued and written by the log thread (default)\n");
+	fprintf(f, "\n");
+	fprintf(f, "log_async 1\n");
+	fprintf(f, "\n");
+	fprintf(f, "# log_rate_limit:\n");
+	fprintf(f, "# Maximum number of messages per second written from a single\n");
+	fprintf(f, "# high rate call site (such as per consumer PRDB computation).\n");
+	fprintf(f, "# 0 disables the limit (default is 100)\n");
+	fprintf(f, "\n");
+	fprintf(f, "log_rate_limit 100\n");
+	fprintf(f, "\n");
 	fprintf(f, "# lock_file:\n");
 	fprintf(f, "# Specifies the location of the ACM lock file used to ensure that only a\n");
 	fprintf(f, "# single instance of ACM is running.\n");
@@ -192,6 +206,14 @@ static void gen_opts_temp(FILE *f)
 	fprintf(f, "\n");
 	fprintf(f, "route_timeout -1\n");
 	fprintf(f, "\n");
+	fprintf(f, "# neg_timeout:\n");
+	fprintf(f, "# Number of milliseconds an unresolvable destination is remembered\n");
+	fprintf(f, "# (SSA mode only).  Requests for it during that time fail without\n");
+	fprintf(f, "# a lookup.  Remembered destinations are also forgotten when a new\n");
+	fprintf(f, "# PRDB is received.  A value of 0 disables the negative cache.\n");
+	fprintf(f, "\n");
+	fprintf(f, "neg_timeout 1000\n");
+	fprintf(f, "\n");
 	fprintf(f, "# loopback_prot:\n");
 	fprintf(f, "# Address and route resolution protocol to resolve local addresses\n");
 	fprintf(f, "# Supported protocols are:\n");
@@ -213,6 +235,19 @@ static void gen_opts_temp(FILE *f)
 	fprintf(f, "\n");
 	fprintf(f, "prdb_port 7476\n");
 	fprintf(f, "\n");
+	fprintf(f, "# metrics_port:\n");
+	fprintf(f, "# TCP port on which metrics are exported in the Prometheus text\n");
+	fprintf(f, "# format (plain HTTP/1.0, any path).\n");
+	fprintf(f, "# 0 disables the TCP listener (default)\n");
+	fprintf(f, "\n");
+	fprintf(f, "metrics_port 0\n");
+	fprintf(f, "\n");
+	fprintf(f, "# metrics_socket:\n");
+	fprintf(f, "# Unix domain socket on which the same metrics are exported.\n");
+	fprintf(f, "# none disables the socket listener (default)\n");
+	fprintf(f, "\n");
+	fprintf(f, "metrics_socket none\n");
+	fprintf(f, "\n");
 	fprintf(f, "# prdb_dump:\n");
 	fprintf(f, "# Indicates whether to dump PRDB. Should be\n");
 	fprintf(f, "# one of the following values:\n");
@@ -220,6 +255,7 @@ static void gen_opts_temp(FILE *f)
 	fprintf(f, "# 1 - dump in binary mode\n");
 	fprintf(f, "# 2 - dump in debug mode\n");
 	fprintf(f, "# 3 - dump in human readable mode\n");
+	fprintf(f, "# 4 - dump in single file binary mode (fast to load)\n");
 	fprintf(f, "\n");
 	fprintf(f, "prdb_dump 0\n");
 	fprintf(f, "\n");
@@ -404,6 +440,33 @@ static void gen_opts_temp(FILE *f)
 	fprintf(f, "# 1 - continue to read IP addresses from ibacm_addr.data\n");
 	fprintf(f, "# Default is 0 (no)\n");
 	fprintf(f, "# support_ips_in_addr_cfg 0\n");
+	fprintf(f, "\n");
+	fprintf(f, "# prdb_direct:\n");
+	fprintf(f, "# Specifies whether the PRDB received from the access layer (or loaded\n");
+	fprintf(f, "# with route_preload access_v1) is used directly as the path lookup\n");
+	fprintf(f, "# index, instead of creating a cached destination for every path record.\n");
+	fprintf(f, "# Path records are then built on demand when a request is resolved.\n");
+	fprintf(f, "# 0 - disabled (default)\n");
+	fprintf(f, "# 1 - enabled\n");
+	fprintf(f, "\n");
+	fprintf(f, "prdb_direct 0\n");
+	fprintf(f, "\n");
+	fprintf(f, "# shm_cache:\n");
+	fprintf(f, "# Specifies whether resolved paths are published in shared memory\n");
+	fprintf(f, "# (SSA mode only) so local libacm clients can resolve without\n");
+	fprintf(f, "# a request to ibacm.\n");
+	fprintf(f, "# 0 - disabled\n");
+	fprintf(f, "# 1 - enabled (default)\n");
+	fprintf(f, "\n");
+	fprintf(f, "shm_cache 1\n");
+	fprintf(f, "\n");
+	fprintf(f, "# shm_cache_size:\n");
+	fprintf(f, "# Number of entries in the shared memory path cache (rounded up\n");
+	fprintf(f, "# to a power of 2). Each destination takes one entry per address\n");
+	fprintf(f, "# type (LID, GID, IP, name).\n");
+	fprintf(f, "# Default is 131072\n");
+	fprintf(f, "\n");
+	fprintf(f, "shm_cache_size 131072\n");
 }
 
 static int open_dir(void)
@@ -39,11 +39,17 @@
 #include <errno.h>
 #include <netdb.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <infiniband/umad.h>
+#include <acm_shm.h>
 
 static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
 static int sock = -1;
 static short server_port = 6125;
+static struct acm_shm_hdr *shm_hdr;
+static size_t shm_len;
 
 static void acm_set_server_port(void)
 {
@@ -55,6 +61,47 @@ static void acm_set_server_port(void)
 	}
 }
 
+/*
+ * Map the path cache published by a local ibacm, if any.  Lookups which
+ * miss in it are sent to the daemon.
+ */
+static void acm_shm_open(void)
+{
+	struct acm_shm_hdr hdr;
+	struct stat st;
+	void *addr;
+	int fd;
+
+	fd = shm_open(ACM_SHM_NAME, O_RDONLY, 0);
+	if (fd < 0)
+		return;
+
+	if (fstat(fd, &st) || st.st_size < sizeof(hdr))
+		goto out;
+
+	if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+	    hdr.magic != ACM_SHM_MAGIC || hdr.version != ACM_SHM_VERSION ||
+	    acm_shm_segment_size(hdr.size) > st.st_size)
+		goto out;
+
+	addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED)
+		goto out;
+
+	shm_hdr = addr;
+	shm_len = st.st_size;
+out:
+	close(fd);
+}
+
+static void acm_shm_close(void)
+{
+	if (shm_hdr) {
+		munmap(shm_hdr, shm_len);
+		shm_hdr = NULL;
+	}
+}
+
 int ib_acm_connect(char *dest)
 {
 	struct addrinfo hint, *res;
@@ -80,6 +127,7 @@ int ib_acm_connect(char *dest)
 		goto err2;
 
 	freeaddrinfo(res);
+	acm_shm_open();
 	return 0;
 
 err2:
@@ -92,6 +140,7 @@ err1:
 
 void ib_acm_disconnect(void)
 {
+	acm_shm_close();
 	if (sock != -1) {
 		shutdown(sock, SHUT_RDWR);
 		close(sock);
@@ -208,12 +257,47 @@ static int acm_error(uint8_t status)
 	}
 }
 
+/*
+ * Resolve from the shared memory cache.  Entries are keyed by
+ * destination only and hold the path last published for it by any
+ * local endpoint, so requests naming a source go to the daemon.
+ */
+static int acm_resolve_shm(uint8_t *dest, uint8_t type,
+	struct ibv_path_data **paths, int *count)
+{
+	struct acm_ep_addr_data data;
+	struct ibv_path_data *path_data;
+	struct ibv_path_record path;
+
+	memset(&data, 0, sizeof data);
+	if (acm_format_ep_addr(&data, dest, type, 0))
+		return -1;
+
+	if (acm_shm_lookup(shm_hdr, type, data.info.addr, &path))
+		return -1;
+
+	path_data = calloc(1, sizeof(*path_data));
+	if (!path_data)
+		return -1;
+
+	path_data->flags = IBV_PATH_FLAG_GMP | IBV_PATH_FLAG_PRIMARY |
+			   IBV_PATH_FLAG_BIDIRECTIONAL;
+	path_data->path = path;
+	*paths = path_data;
+	*count = 1;
+	return 0;
+}
+
 static int acm_resolve(uint8_t *src, uint8_t *dest, uint8_t type,
 	struct ibv_path_data **paths, int *count, uint32_t flags, int print)
 {
 	struct acm_msg msg;
 	int ret, cnt = 0;
 
+	if (shm_hdr && !src && !print &&
+	    !acm_resolve_shm(dest, type, paths, count))
+		return 0;
+
 	pthread_mutex_lock(&lock);
 	memset(&msg, 0, sizeof msg);
 	msg.hdr.version = ACM_VERSION;
@@ -271,12 +355,43 @@ int ib_acm_resolve_ip(struct sockaddr *src, struct sockaddr *dest,
 	}
 }
 
+static int acm_resolve_path_shm(struct ibv_path_record *path)
+{
+	uint8_t addr[ACM_MAX_ADDRESS] = { 0 };
+	struct ibv_path_record cached;
+	union ibv_gid any_gid;
+	int ret;
+
+	if (path->dlid) {
+		memcpy(addr, &path->dlid, sizeof path->dlid);
+		ret = acm_shm_lookup(shm_hdr, ACM_ADDRESS_LID, addr, &cached);
+	} else {
+		memcpy(addr, &path->dgid, sizeof path->dgid);
+		ret = acm_shm_lookup(shm_hdr, ACM_ADDRESS_GID, addr, &cached);
+	}
+	if (ret)
+		return ret;
+
+	memset(&any_gid, 0, sizeof any_gid);
+	if ((path->slid && path->slid != cached.slid) ||
+	    (memcmp(&path->sgid, &any_gid, sizeof any_gid) &&
+	     memcmp(&path->sgid, &cached.sgid, sizeof cached.sgid)))
+		return -1;
+
+	*path = cached;
+	return 0;
+}
+
 int ib_acm_resolve_path(struct ibv_path_record *path, uint32_t flags)
 {
 	struct acm_msg msg;
 	struct acm_ep_addr_data *data;
 	int ret;
 
+	if (shm_hdr && !(flags & ACM_FLAGS_QUERY_SA) &&
+	    !acm_resolve_path_shm(path))
+		return 0;
+
 	pthread_mutex_lock(&lock);
 	memset(&msg, 0, sizeof msg);
 	msg.hdr.version = ACM_VERSION;
@@ -356,6 +471,8 @@ const char *ib_acm_cntr_name(int index)
 		[ACM_CNTR_ADDR_CACHE]	= "Addr Cache Count",
 		[ACM_CNTR_ROUTE_QUERY]	= "Route Query Count",
 		[ACM_CNTR_ROUTE_CACHE]	= "Route Cache Count",
+		[ACM_CNTR_QUERY_SAVED]	= "Saved Query Count",
+		[ACM_CNTR_NEG_CACHE]	= "Negative Cache Count",
 	};
 
 	if (index < ACM_CNTR_ERROR || index > (ACM_MAX_COUNTER - 1))
@@ -54,15 +54,20 @@ static uint16_t dest_lid;
 static uint16_t pkey;
 static int timeout = 1000;
 static short recursive = ADMIN_RECURSION_NONE;
+static int concurrency = 64;
+static int json;
 
 struct cmd_struct admin_cmds[] = {
 	[SSA_ADMIN_CMD_COUNTER]= { "counter",     SSA_ADMIN_CMD_COUNTER,     CMD_TYPE_MONITOR },
 	[SSA_ADMIN_CMD_PING] = { "ping",        SSA_ADMIN_CMD_PING,        CMD_TYPE_DEBUG   },
 	[SSA_ADMIN_CMD_NONE] = { "help",        SSA_ADMIN_CMD_NONE,        CMD_TYPE_NONE    },
 	[SSA_ADMIN_CMD_NODE_INFO] = { "nodeinfo",        SSA_ADMIN_CMD_NODE_INFO, CMD_TYPE_MONITOR },
+	[SSA_ADMIN_CMD_HISTOGRAM] = { "histogram",       SSA_ADMIN_CMD_HISTOGRAM, CMD_TYPE_MONITOR },
+	[SSA_ADMIN_CMD_EPOCH_TRACE] = { "epochtrace",    SSA_ADMIN_CMD_EPOCH_TRACE, CMD_TYPE_MONITOR },
+	[SSA_ADMIN_CMD_AGGREGATE] = { "aggregate",     SSA_ADMIN_CMD_AGGREGATE,   CMD_TYPE_MONITOR },
 };
 
-static const char *const short_option = "rl:g:d:P:p:a:t:vh?";
+static const char *const short_option = "rl:g:d:P:p:a:t:j:Jvh?";
 static struct option long_option[] = {
 	{"lid",          required_argument, 0, 'l'},
 	{"gid",          required_argument, 0, 'g'},
@@ -74,6 +79,8 @@ static struct option long_option[] = {
 	{"help",         no_argument,       0, 'h'},
 	{"recursive",    optional_argument, 0, 'r'},
 	{"timeout",      required_argument, 0, 't'},
+	{"jobs",         required_argument, 0, 'j'},
+	{"json",         no_argument,       0, 'J'},
 	{0, 0, 0, 0}	/* Required at the end of the array */
 };
 
@@ -81,7 +88,8 @@ static const char admin_usage_string[] =
 	"ssadmin  [-v | --version] [-h | --help] [[-l | --lid] <dlid>] [[-g | --gid] <dgid>]\n"
 	"\t\t[[-d | --device] <device name>] [[-P | --Port] <CA port>] \n"
 	"\t\t[[-p | --pkey] <partition key>] [[-a | --admin_port] <admin server port>]\n"
-	"\t\t[[-t | --timeout] <operation timeout>] [-r | --recursive=[d|u]]";
+	"\t\t[[-t | --timeout] <operation timeout>] [-r | --recursive=[d|u]]\n"
+	"\t\t[[-j | --jobs] <parallel connections>] [-J | --json]";
 
 static const char admin_more_info_string[] =
 	"'ssadmin help <command>' shows specific subcommand "
@@ -343,6 +351,23 @@ static int parse_opts(int argc, char **argv, int *status)
 
 			timeout = tmp;
 			break;
+		case 'j':
+			tmp = strtol(optarg, &endptr, 10);
+			if (endptr == optarg || *endptr) {
+				fprintf(stderr, "ERROR - invalid value %s in option -%c\n", optarg, option);
+				ret = 1;
+				goto out;
+			}
+			if (tmp <= 0 || tmp > INT_MAX) {
+				fprintf(stderr, "ERROR - out of range in option -%c\n", option);
+				ret = 1;
+				goto out;
+			}
+			concurrency = tmp;
+			break;
+		case 'J':
+			json = 1;
+			break;
 		case 'p':
 			pkey = (uint16_t) strtoul(optarg, NULL, 0);
 			break;
@@ -463,6 +488,8 @@ int main(int argc, char **argv)
 	opts.admin_port = admin_port;
 	opts.pkey = pkey;
 	opts.timeout = timeout;
+	opts.concurrency = concurrency;
+	opts.json = json;
 
 	rsock = admin_connect(dest_addr, addr_type, &opts);
 	if (rsock < 0) {
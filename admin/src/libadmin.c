@@ -59,6 +59,24 @@ struct admin_count_command {
 	short include_list[COUNTER_ID_LAST];
 };
 
+struct admin_hist_command {
+	short print_all;
+	short include_list[HIST_ID_LAST];
+};
+
+struct epoch_trace_node {
+	union ibv_gid gid;
+	uint8_t node_type;
+	int n;
+	struct ssa_admin_epoch_trace_rec recs[SSA_ADMIN_EPOCH_TRACE_NUM];
+};
+
+struct admin_epoch_trace_command {
+	struct epoch_trace_node *nodes;
+	int nodes_num;
+	int nodes_size;
+};
+
 enum nodeinfo_mode {
 	NODEINFO_FULL = 0xFF,
 	NODEINFO_SINGLELINE = 0x1,
@@ -90,6 +108,8 @@ struct admin_command {
 	union {
 		struct admin_count_command count_cmd;
 		struct admin_nodeinfo_command nodeinfo_cmd;
+		struct admin_hist_command hist_cmd;
+		struct admin_epoch_trace_command epoch_trace_cmd;
 	} data;
 	short recursive;
 };
@@ -109,6 +129,11 @@ struct cmd_struct_impl {
 				const struct ssa_admin_msg *msg);
 	struct cmd_opts opts[MAX_COMMAND_OPTS];
 	struct cmd_help help;
+	/* called once all the nodes responded, may be NULL */
+	void (*report)(struct admin_command *cmd);
+	/* response as a JSON object for --json, may be NULL */
+	void (*json_output)(struct admin_command *cmd,
+			    const struct ssa_admin_msg *msg, FILE *out);
 };
 
 
@@ -139,6 +164,37 @@ static void node_info_command_output(struct admin_command *cmd,
 static int nodeinfo_handle_option(struct admin_command *admin_cmd,
 				  char option, const char *optarg);
 static void nodeinfo_print_help(FILE *stream);
+static int hist_init(struct admin_command *cmd);
+static int hist_handle_param(struct admin_command *cmd, const char *param);
+static void hist_print_help(FILE *stream);
+static void hist_command_output(struct admin_command *cmd,
+				struct cmd_exec_info *exec_info,
+				union ibv_gid remote_gid,
+				const struct ssa_admin_msg *msg);
+static void epoch_trace_destroy(struct admin_command *cmd);
+static void epoch_trace_print_help(FILE *stream);
+static void epoch_trace_command_output(struct admin_command *cmd,
+				       struct cmd_exec_info *exec_info,
+				       union ibv_gid remote_gid,
+				       const struct ssa_admin_msg *msg);
+static void epoch_trace_report(struct admin_command *cmd);
+static void counter_json_output(struct admin_command *cmd,
+				const struct ssa_admin_msg *msg, FILE *out);
+static void node_info_json_output(struct admin_command *cmd,
+				  const struct ssa_admin_msg *msg, FILE *out);
+static void hist_json_output(struct admin_command *cmd,
+			     const struct ssa_admin_msg *msg, FILE *out);
+static void epoch_trace_json_output(struct admin_command *cmd,
+				    const struct ssa_admin_msg *msg, FILE *out);
+static void aggregate_print_help(FILE *stream);
+static int aggregate_create_msg(struct admin_command *cmd,
+				struct ssa_admin_msg *msg);
+static void aggregate_command_output(struct admin_command *cmd,
+				     struct cmd_exec_info *exec_info,
+				     union ibv_gid remote_gid,
+				     const struct ssa_admin_msg *msg);
+static void aggregate_json_output(struct admin_command *cmd,
+				  const struct ssa_admin_msg *msg, FILE *out);
 
 static struct cmd_struct_impl admin_cmd_command_impls[] = {
 	[SSA_ADMIN_CMD_COUNTER] = {
@@ -150,6 +206,7 @@ static struct cmd_struct_impl admin_cmd_command_impls[] = {
 		{},
 		{ counter_print_help, default_print_usage,
 		  "Retrieve specific counter" },
+		NULL, counter_json_output
 	},
 	[SSA_ADMIN_CMD_PING]	= {
 		NULL,
@@ -172,7 +229,41 @@ static struct cmd_struct_impl admin_cmd_command_impls[] = {
 			{ { 0, 0, 0, 0 } }	/* Required at the end of the array */
 		},
 		{ NULL, nodeinfo_print_help,
-		  "Retrieve basic node info" }
+		  "Retrieve basic node info" },
+		NULL, node_info_json_output
+	},
+	[SSA_ADMIN_CMD_HISTOGRAM] = {
+		hist_init,
+		NULL, hist_handle_param,
+		default_destroy,
+		default_create_msg,
+		hist_command_output,
+		{},
+		{ hist_print_help, default_print_usage,
+		  "Retrieve latency percentiles" },
+		NULL, hist_json_output
+	},
+	[SSA_ADMIN_CMD_EPOCH_TRACE] = {
+		NULL,
+		NULL, NULL,
+		epoch_trace_destroy,
+		default_create_msg,
+		epoch_trace_command_output,
+		{},
+		{ epoch_trace_print_help, default_print_usage,
+		  "Trace database epoch propagation" },
+		epoch_trace_report, epoch_trace_json_output
+	},
+	[SSA_ADMIN_CMD_AGGREGATE] = {
+		NULL,
+		NULL, NULL,
+		default_destroy,
+		aggregate_create_msg,
+		aggregate_command_output,
+		{},
+		{ aggregate_print_help, default_print_usage,
+		  "Retrieve totals of the whole subtree below a node" },
+		NULL, aggregate_json_output
 	}
 };
 
@@ -767,6 +858,39 @@ struct ssa_admin_counter_descr {
 	const char *description;
 };
 
+static void json_print_string(FILE *out, const char *str, size_t len)
+{
+	size_t i;
+
+	fputc('"', out);
+	for (i = 0; i < len && str[i]; i++) {
+		if (str[i] == '"' || str[i] == '\\')
+			fprintf(out, "\\%c", str[i]);
+		else if ((unsigned char) str[i] < 0x20)
+			fprintf(out, "\\u%04x", (unsigned char) str[i]);
+		else
+			fputc(str[i], out);
+	}
+	fputc('"', out);
+}
+
+static void json_print_gid(FILE *out, const uint8_t *gid)
+{
+	char addr_buf[128];
+
+	ssa_format_addr(addr_buf, sizeof addr_buf, SSA_ADDR_GID, gid, 16);
+	fprintf(out, "\"%s\"", addr_buf);
+}
+
+/* msec offset from the node start time, as seconds since the Epoch */
+static void json_print_time(FILE *out, const struct timeval *start, long msec)
+{
+	int64_t t;
+
+	t = (int64_t) start->tv_sec * 1000 + start->tv_usec / 1000 + msec;
+	fprintf(out, "%" PRId64 ".%03d", t / 1000, (int) (t % 1000));
+}
+
 static void ping_command_output(struct admin_command *cmd,
 				struct cmd_exec_info *exec_info,
 				union ibv_gid remote_gid,
@@ -802,6 +926,8 @@ static struct ssa_admin_counter_descr counters_descr[] = {
 	[COUNTER_ID_TIME_LAST_SSA_MAD_RCV] = {"TIME_LAST_SSA_MAD_RCV", "Time of last MAD received" },
 	[COUNTER_ID_TIME_LAST_ERR] = {"TIME_LAST_ERR", "Time of last error" },
 	[COUNTER_ID_DB_EPOCH] = {"DB_EPOCH", "DB epoch" },
+	[COUNTER_ID_SMDB_EVENTS] = {"SMDB_EVENTS", "Number of subnet events triggering SMDB extraction" },
+	[COUNTER_ID_SMDB_EPOCHS] = {"SMDB_EPOCHS", "Number of SMDB epochs published" },
 };
 
 
@@ -936,6 +1062,41 @@ static void counter_command_output(struct admin_command *cmd,
 	}
 }
 
+static void counter_json_output(struct admin_command *cmd,
+				const struct ssa_admin_msg *msg, FILE *out)
+{
+	const struct ssa_admin_counter *counter_msg = &msg->data.counter;
+	struct admin_count_command *count_cmd = &cmd->data.count_cmd;
+	const char *sep = "";
+	struct timeval epoch;
+	int i, n;
+	long val;
+
+	n = min(COUNTER_ID_LAST, ntohs(counter_msg->n));
+
+	epoch.tv_sec = ntohll(counter_msg->epoch_tv_sec);
+	epoch.tv_usec = ntohll(counter_msg->epoch_tv_usec);
+
+	fprintf(out, "{");
+	for (i = 0; i < n; ++i) {
+		if (!count_cmd->include_list[i] ||
+		    ssa_admin_counters_type[i] == ssa_counter_obsolete)
+			continue;
+
+		val = ntohll(counter_msg->vals[i]);
+		if (val < 0 && ssa_admin_counters_type[i] != ssa_counter_signed_numeric)
+			continue;
+
+		fprintf(out, "%s\"%s\":", sep, counters_descr[i].name);
+		if (ssa_admin_counters_type[i] == ssa_counter_timestamp)
+			json_print_time(out, &epoch, val);
+		else
+			fprintf(out, "%ld", val);
+		sep = ",";
+	}
+	fprintf(out, "}");
+}
+
 static int nodeinfo_init(struct admin_command *cmd)
 {
 	cmd->data.nodeinfo_cmd.mode = NODEINFO_FULL;
@@ -1045,6 +1206,69 @@ static void node_info_command_output(struct admin_command *cmd,
 
 }
 
+static void node_info_json_connections(const struct ssa_admin_connection_info *connections,
+				       int n, uint16_t mode, FILE *out)
+{
+	const struct ssa_admin_connection_info *conn;
+	struct timeval since;
+	const char *sep = "";
+	int i;
+
+	fprintf(out, "[");
+	for (i = 0; i < n; ++i) {
+		conn = &connections[i];
+		if (!((conn->connection_type == SSA_CONN_TYPE_UPSTREAM &&
+		       (mode & NODEINFO_UP_CONN)) ||
+		      (conn->connection_type == SSA_CONN_TYPE_DOWNSTREAM &&
+		       (mode & NODEINFO_DOWN_CONN))))
+			continue;
+		if (conn->dbtype >= ARRAY_SIZE(ssa_database_type_names))
+			continue;
+
+		fprintf(out, "%s{\"gid\":", sep);
+		json_print_gid(out, conn->remote_gid);
+		fprintf(out, ",\"lid\":%u,\"type\":\"%s\",\"db\":\"%s\","
+			"\"node_type\":\"%s\",\"since\":",
+			ntohs(conn->remote_lid),
+			ssa_connection_type_names[conn->connection_type],
+			ssa_database_type_names[conn->dbtype],
+			ssa_node_type_str(conn->remote_type));
+		since.tv_sec = ntohll(conn->connection_tv_sec);
+		since.tv_usec = ntohll(conn->connection_tv_usec);
+		json_print_time(out, &since, 0);
+		fprintf(out, "}");
+		sep = ",";
+	}
+	fprintf(out, "]");
+}
+
+static void node_info_json_output(struct admin_command *cmd,
+				  const struct ssa_admin_msg *msg, FILE *out)
+{
+	const struct ssa_admin_node_info *node_info_msg = &msg->data.node_info;
+	int db_type;
+
+	if (node_info_msg->type == SSA_NODE_CONSUMER)
+		db_type = SSA_CONN_PRDB_TYPE;
+	else if (node_info_msg->type &
+		 (SSA_NODE_CORE | SSA_NODE_ACCESS | SSA_NODE_DISTRIBUTION))
+		db_type = SSA_CONN_SMDB_TYPE;
+	else
+		db_type = SSA_CONN_NODB_TYPE;
+
+	fprintf(out, "{\"node_type\":\"%s\",\"db\":\"%s\",\"db_epoch\":%" PRIu64
+		",\"version\":", ssa_node_type_str(node_info_msg->type),
+		ssa_database_type_names[db_type], ntohll(node_info_msg->db_epoch));
+	json_print_string(out, (const char *) node_info_msg->version,
+			  sizeof(node_info_msg->version));
+	fprintf(out, ",\"connections\":");
+	node_info_json_connections((const struct ssa_admin_connection_info *)
+				   node_info_msg->connections,
+				   ntohs(node_info_msg->connections_num),
+				   cmd->data.nodeinfo_cmd.mode, out);
+	fprintf(out, "}");
+}
+
 static int nodeinfo_handle_option(struct admin_command *admin_cmd,
 				  char option, const char *optarg)
 {
@@ -1082,169 +1306,797 @@ static void nodeinfo_print_help(FILE *stream)
 	fprintf(stream, "\n\n");
 }
 
-struct cmd_opts *admin_get_cmd_opts(int cmd)
+static struct ssa_admin_counter_descr hist_descr[] = {
+	[HIST_ID_SMDB_EXTRACT] = {"SMDB_EXTRACT", "SMDB extraction from the SM" },
+	[HIST_ID_SMDB_COMPARE] = {"SMDB_COMPARE", "SMDB comparison with the previous epoch" },
+	[HIST_ID_PRDB_CALC] = {"PRDB_CALC", "PRDB computation per consumer" },
+	[HIST_ID_DB_RECV] = {"DB_RECV", "Database transfer from upstream" },
+	[HIST_ID_DB_SEND] = {"DB_SEND", "Database transfer to a downstream node" },
+	[HIST_ID_ACM_CACHE_UPDATE] = {"ACM_CACHE_UPDATE", "ACM cache update from a PRDB" },
+};
+
+static int hist_init(struct admin_command *cmd)
 {
-	struct cmd_struct_impl *impl;
+	int j;
+	struct admin_hist_command *hist_cmd = &cmd->data.hist_cmd;
 
-	if (cmd <= SSA_ADMIN_CMD_NONE || cmd >= SSA_ADMIN_CMD_MAX) {
-		fprintf(stderr, "ERROR - command index %d is out of range\n", cmd);
-		return NULL;
-	}
+	for (j = 0; j < HIST_ID_LAST; ++j)
+		hist_cmd->include_list[j] = 1;
 
-	impl = &admin_cmd_command_impls[cmd];
+	hist_cmd->print_all = 1;
 
-	return impl->opts;
+	return 0;
 }
 
-const struct cmd_help *admin_cmd_help(int cmd)
+static int hist_handle_param(struct admin_command *cmd, const char *param)
 {
-	struct cmd_struct_impl *impl;
+	int j;
+	struct admin_hist_command *hist_cmd = &cmd->data.hist_cmd;
 
-	if (cmd <= SSA_ADMIN_CMD_NONE || cmd >= SSA_ADMIN_CMD_MAX) {
-		fprintf(stderr, "ERROR - command index %d is out of range\n", cmd);
-		return NULL;
+	if (hist_cmd->print_all) {
+		memset(hist_cmd->include_list, '\0', sizeof(hist_cmd->include_list));
+		hist_cmd->print_all = 0;
 	}
 
-	impl = &admin_cmd_command_impls[cmd];
+	for (j = 0; j < HIST_ID_LAST; ++j) {
+		if (!strcmp(param, hist_descr[j].name)) {
+			hist_cmd->include_list[j] = 1;
+			break;
+		}
+	}
+	if (j == HIST_ID_LAST) {
+		fprintf(stderr, "ERROR - Name %s isn't found in the histograms list\n", param);
+		return -1;
+	}
 
-	return &impl->help;
+	return 0;
 }
 
+static void hist_print_help(FILE *stream)
+{
+	unsigned int i;
 
-enum admin_connection_state {
-	ADM_CONN_CONNECTING,
-	ADM_CONN_NODEINFO,
-	ADM_CONN_COMMAND,
-};
+	fprintf(stream, "histogram is a command for gathering latency percentiles from a SSA node\n");
+	fprintf(stream, "Values are in microseconds, rounded up to the histogram bucket\n");
+	fprintf(stream, "Supported histograms:\n");
 
-struct admin_connection {
-	union ibv_gid remote_gid;
-	uint16_t remote_lid;
-	enum admin_connection_state state;
-	time_t epoch;
-	unsigned int slen, sleft;
-	struct ssa_admin_msg *smsg;
-	unsigned int rlen, rcount;
-	struct ssa_admin_msg *rmsg;
-	struct ssa_admin_msg_hdr rhdr;
-	struct cmd_exec_info exec_info;
-};
+	for (i = 0; i < ARRAY_SIZE(hist_descr); ++i)
+		fprintf(stream, "%-25s %s\n", hist_descr[i].name,
+			hist_descr[i].description);
 
-static int admin_recv_buff(int rsock, char *buf, unsigned int *rcount, unsigned int rlen)
+	fprintf(stream, "\n\n");
+}
+
+/* Inclusive upper bound of the bucket holding the given permille */
+static uint64_t hist_percentile(const uint64_t *buckets, uint64_t total,
+				int permille)
 {
-	int n;
+	uint64_t rank, count = 0;
+	int i;
 
-	while (*rcount < rlen) {
-		n = rrecv(rsock, buf + *rcount, rlen - *rcount, MSG_DONTWAIT);
-		if (n > 0)
-			*rcount += n;
-		else if (!n)
-			return -ECONNRESET;
-		else if (errno == EAGAIN || errno == EWOULDBLOCK)
-			return *rcount;
-		else
-			return n;
+	rank = (total * permille + 999) / 1000;
+	for (i = 0; i < SSA_ADMIN_HIST_BUCKETS - 1; i++) {
+		count += buckets[i];
+		if (count >= rank)
+			break;
 	}
-	return 0;
+
+	if (i == SSA_ADMIN_HIST_BUCKETS - 1)
+		return ssa_admin_hist_bucket_low(i);
+	return ssa_admin_hist_bucket_low(i + 1) - 1;
 }
 
-static int admin_recv_msg(struct pollfd *pfd, struct admin_connection *conn)
+static void hist_command_output(struct admin_command *cmd,
+				struct cmd_exec_info *exec_info,
+				union ibv_gid remote_gid,
+				const struct ssa_admin_msg *msg)
 {
-	int ret;
+	const struct ssa_admin_histogram *hist_msg = &msg->data.histogram;
+	struct admin_hist_command *hist_cmd = &cmd->data.hist_cmd;
+	uint64_t buckets[SSA_ADMIN_HIST_BUCKETS], total;
+	char addr_buf[128];
+	int i, j, n;
 
-	if (conn->rcount < sizeof(conn->rhdr)) {
-		ret = admin_recv_buff(pfd->fd, (char *) &conn->rhdr,
-				      &conn->rcount, sizeof(conn->rhdr));
-		if (ret == -ECONNRESET) {
-			fprintf(stderr, "ERROR - SSA node closed admin connection\n");
-			return -1;
-		} else if (ret < 0) {
-			fprintf(stderr,
-				"ERROR - rrecv failed: %d (%s) on rsock %d\n",
-				errno, strerror(errno), pfd->fd);
-			return ret;
-		}
-		if (conn->rcount < sizeof(conn->rhdr))
-			return 0;
+	(void)(exec_info);
+
+	if (ntohs(hist_msg->bucket_num) != SSA_ADMIN_HIST_BUCKETS) {
+		fprintf(stderr, "ERROR - unexpected number of histogram buckets %u\n",
+			ntohs(hist_msg->bucket_num));
+		return;
 	}
 
-	if (conn->rcount == sizeof(conn->rhdr)) {
-		if (conn->rhdr.status != SSA_ADMIN_STATUS_SUCCESS) {
-			fprintf(stderr, "ERROR - target SSA node failed to process request\n");
-			return -1;
-		} else if (conn->rhdr.method != SSA_ADMIN_METHOD_RESP) {
-			fprintf(stderr, "ERROR - response has wrong method\n");
-			return -1;
+	if (cmd->recursive) {
+		ssa_format_addr(addr_buf, sizeof addr_buf, SSA_ADDR_GID,
+				remote_gid.raw, sizeof remote_gid.raw);
+		strcat(addr_buf, ": ");
+	} else {
+		addr_buf[0] = '\0';
+	}
+
+	n = min(HIST_ID_LAST, ntohs(hist_msg->n));
+	for (i = 0; i < n; ++i) {
+		if (!hist_cmd->include_list[i])
+			continue;
+
+		total = 0;
+		for (j = 0; j < SSA_ADMIN_HIST_BUCKETS; j++) {
+			buckets[j] = ntohll(hist_msg->buckets[i * SSA_ADMIN_HIST_BUCKETS + j]);
+			total += buckets[j];
 		}
 
-		conn->rlen = ntohs(conn->rhdr.len);
-		conn->rmsg = (struct ssa_admin_msg *) malloc(max(sizeof(*conn->rmsg),
-								 conn->rlen));
-		if (!conn->rmsg) {
-			fprintf(stderr, "ERROR - failed allocate message buffer\n");
-			return -1;
+		if (!total) {
+			printf("%s%s count 0\n", addr_buf, hist_descr[i].name);
+			continue;
 		}
 
-		conn->rmsg->hdr = conn->rhdr;
+		printf("%s%s count %" PRIu64 " p50 %" PRIu64 " p90 %" PRIu64
+		       " p99 %" PRIu64 " max %" PRIu64 " usec\n",
+		       addr_buf, hist_descr[i].name, total,
+		       hist_percentile(buckets, total, 500),
+		       hist_percentile(buckets, total, 900),
+		       hist_percentile(buckets, total, 990),
+		       hist_percentile(buckets, total, 1000));
 	}
+}
 
-	ret = admin_recv_buff(pfd->fd, (char *) conn->rmsg,
-			      &conn->rcount, conn->rlen);
-	if (ret == -ECONNRESET) {
-		fprintf(stderr, "ERROR - SSA node closed admin connection\n");
-		return -1;
-	} else if (ret < 0) {
-		fprintf(stderr, "ERROR - rrecv failed: %d (%s) on rsock %d\n",
-			errno, strerror(errno), pfd->fd);
-		return ret;
-	}
+static void hist_json_output(struct admin_command *cmd,
+			     const struct ssa_admin_msg *msg, FILE *out)
+{
+	const struct ssa_admin_histogram *hist_msg = &msg->data.histogram;
+	struct admin_hist_command *hist_cmd = &cmd->data.hist_cmd;
+	uint64_t buckets[SSA_ADMIN_HIST_BUCKETS], total;
+	const char *sep = "";
+	int i, j, n;
+
+	fprintf(out, "{");
+	n = ntohs(hist_msg->bucket_num) == SSA_ADMIN_HIST_BUCKETS ?
+	    min(HIST_ID_LAST, ntohs(hist_msg->n)) : 0;
+	for (i = 0; i < n; ++i) {
+		if (!hist_cmd->include_list[i])
+			continue;
 
-	return 0;
+		total = 0;
+		for (j = 0; j < SSA_ADMIN_HIST_BUCKETS; j++) {
+			buckets[j] = ntohll(hist_msg->buckets[i * SSA_ADMIN_HIST_BUCKETS + j]);
+			total += buckets[j];
+		}
+
+		fprintf(out, "%s\"%s\":{\"count\":%" PRIu64, sep,
+			hist_descr[i].name, total);
+		if (total)
+			fprintf(out, ",\"p50\":%" PRIu64 ",\"p90\":%" PRIu64
+				",\"p99\":%" PRIu64 ",\"max\":%" PRIu64,
+				hist_percentile(buckets, total, 500),
+				hist_percentile(buckets, total, 900),
+				hist_percentile(buckets, total, 990),
+				hist_percentile(buckets, total, 1000));
+		fprintf(out, "}");
+		sep = ",";
+	}
+	fprintf(out, "}");
 }
 
-static int admin_send_msg(struct pollfd *pfd, struct admin_connection *conn)
+static void epoch_trace_destroy(struct admin_command *cmd)
 {
-	int sent = conn->slen - conn->sleft;
-	int n;
+	if (cmd)
+		free(cmd->data.epoch_trace_cmd.nodes);
+	free(cmd);
+}
 
-	while (conn->sleft) {
-		n  = rsend(pfd->fd, (char *) conn->smsg + sent, conn->sleft, MSG_DONTWAIT);
-		if (n < 0)
-			break;
-		conn->sleft -= n;
-		sent += n;
-	}
+static void epoch_trace_print_help(FILE *stream)
+{
+	fprintf(stream, "epochtrace is a command for tracing the propagation of database epochs\n");
+	fprintf(stream, "For each recent epoch the node reports when it arrived, was applied\n");
+	fprintf(stream, "and was forwarded downstream, in msec after the core published it\n");
+	fprintf(stream, "In recursive mode a per epoch report for the whole tree is printed at the end\n");
+	fprintf(stream, "Node clocks have to be synchronized for the times to be meaningful\n");
+}
 
-	if (!conn->sleft) {
-		return 0;
-	} else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-		return 0;
-	} else if (n < 0)
-		return n;
+/* Origin times are the low 32 bits of wall clock msec at the core */
+static void epoch_trace_format_origin(char *buf, size_t size,
+				      uint32_t origin_time)
+{
+	struct timeval now;
+	struct tm tm;
+	time_t sec;
+	int64_t msec;
+	size_t n;
+
+	gettimeofday(&now, NULL);
+	msec = (int64_t) now.tv_sec * 1000 + now.tv_usec / 1000;
+	msec -= (int32_t) ((uint32_t) msec - origin_time);
+	sec = msec / 1000;
+	localtime_r(&sec, &tm);
+	n = strftime(buf, size, "%H:%M:%S", &tm);
+	snprintf(buf + n, size - n, ".%03d", (int) (msec % 1000));
+}
 
-	return 0;
+static void epoch_trace_format_stage(char *buf, size_t size,
+				     uint32_t origin_time, uint32_t stage_time)
+{
+	if (stage_time)
+		snprintf(buf, size, "%+d ms",
+			 (int32_t) (stage_time - origin_time));
+	else
+		snprintf(buf, size, "-");
 }
 
-static void admin_update_connection_state(struct admin_connection *conn,
-					  enum admin_connection_state state,
-					  struct ssa_admin_msg *msg)
+static void epoch_trace_command_output(struct admin_command *cmd,
+				       struct cmd_exec_info *exec_info,
+				       union ibv_gid remote_gid,
+				       const struct ssa_admin_msg *msg)
 {
-	conn->state = state;
-	conn->epoch  = time(NULL);
+	const struct ssa_admin_epoch_trace *trace_msg = &msg->data.epoch_trace;
+	struct admin_epoch_trace_command *trace_cmd = &cmd->data.epoch_trace_cmd;
+	const struct ssa_admin_epoch_trace_rec *rec;
+	struct epoch_trace_node *node, *tmp;
+	char addr_buf[128], origin_buf[32];
+	char stage_buf[SSA_EPOCH_STAGE_NUM][32];
+	uint32_t origin_time;
+	int i, j, n;
 
-	free(conn->rmsg);
-	conn->rmsg = NULL;
-	conn->rlen = 0;
-	conn->rcount = 0;
+	(void)(exec_info);
 
-	if (state == ADM_CONN_CONNECTING) {
-		conn->smsg = NULL;
-		conn->slen = 0;
-		conn->sleft = 0;
+	if (cmd->recursive) {
+		ssa_format_addr(addr_buf, sizeof addr_buf, SSA_ADDR_GID,
+				remote_gid.raw, sizeof remote_gid.raw);
+		strcat(addr_buf, ": ");
 	} else {
-		conn->smsg = msg;
-		conn->slen = ntohs(msg->hdr.len);
-		conn->sleft = conn->slen;
+		addr_buf[0] = '\0';
+	}
+
+	n = min(SSA_ADMIN_EPOCH_TRACE_NUM, ntohs(trace_msg->n));
+	if (!n)
+		printf("%s%s no traced epochs\n", addr_buf,
+		       ssa_node_type_str(trace_msg->node_type));
+
+	for (i = 0; i < n; i++) {
+		rec = &trace_msg->recs[i];
+		origin_time = ntohl(rec->origin_time);
+		epoch_trace_format_origin(origin_buf, sizeof origin_buf,
+					  origin_time);
+		for (j = 0; j < SSA_EPOCH_STAGE_NUM; j++)
+			epoch_trace_format_stage(stage_buf[j], sizeof stage_buf[j],
+						 origin_time,
+						 ntohl(rec->stage_time[j]));
+		printf("%s%s epoch 0x%" PRIx64 " origin %s arrive %s apply %s forward %s\n",
+		       addr_buf, ssa_node_type_str(trace_msg->node_type),
+		       ntohll(rec->epoch), origin_buf,
+		       stage_buf[SSA_EPOCH_ARRIVE], stage_buf[SSA_EPOCH_APPLY],
+		       stage_buf[SSA_EPOCH_FORWARD]);
+	}
+
+	if (!cmd->recursive)
+		return;
+
+	if (trace_cmd->nodes_num == trace_cmd->nodes_size) {
+		tmp = realloc(trace_cmd->nodes,
+			      (trace_cmd->nodes_size * 2 + 16) * sizeof(*tmp));
+		if (!tmp) {
+			fprintf(stderr, "ERROR - failed to reallocate epoch trace nodes\n");
+			return;
+		}
+		trace_cmd->nodes = tmp;
+		trace_cmd->nodes_size = trace_cmd->nodes_size * 2 + 16;
+	}
+
+	node = &trace_cmd->nodes[trace_cmd->nodes_num++];
+	node->gid = remote_gid;
+	node->node_type = trace_msg->node_type;
+	node->n = n;
+	memcpy(node->recs, trace_msg->recs, n * sizeof(node->recs[0]));
+}
+
+static void epoch_trace_json_output(struct admin_command *cmd,
+				    const struct ssa_admin_msg *msg, FILE *out)
+{
+	static const char *stage_names[SSA_EPOCH_STAGE_NUM] = {
+		[SSA_EPOCH_ARRIVE] = "arrive_ms",
+		[SSA_EPOCH_APPLY] = "apply_ms",
+		[SSA_EPOCH_FORWARD] = "forward_ms"
+	};
+	const struct ssa_admin_epoch_trace *trace_msg = &msg->data.epoch_trace;
+	const struct ssa_admin_epoch_trace_rec *rec;
+	uint32_t origin_time, stage_time;
+	int i, j, n;
+
+	(void)(cmd);
+
+	fprintf(out, "{\"node_type\":\"%s\",\"epochs\":[",
+		ssa_node_type_str(trace_msg->node_type));
+	n = min(SSA_ADMIN_EPOCH_TRACE_NUM, ntohs(trace_msg->n));
+	for (i = 0; i < n; i++) {
+		rec = &trace_msg->recs[i];
+		origin_time = ntohl(rec->origin_time);
+		fprintf(out, "%s{\"epoch\":%" PRIu64 ",\"origin\":%u",
+			i ? "," : "", ntohll(rec->epoch), origin_time);
+		for (j = 0; j < SSA_EPOCH_STAGE_NUM; j++) {
+			stage_time = ntohl(rec->stage_time[j]);
+			if (stage_time)
+				fprintf(out, ",\"%s\":%d", stage_names[j],
+					(int32_t) (stage_time - origin_time));
+			else
+				fprintf(out, ",\"%s\":null", stage_names[j]);
+		}
+		fprintf(out, "}");
+	}
+	fprintf(out, "]}");
+}
+
+static int epoch_trace_origin_cmp(const void *a, const void *b)
+{
+	int32_t diff = (int32_t) (*(const uint32_t *) b - *(const uint32_t *) a);
+
+	/* most recent first, with 32 bit msec wrap around */
+	return diff > 0 ? 1 : (diff < 0 ? -1 : 0);
+}
+
+/*
+ * Per epoch propagation report: how many of the responding nodes an
+ * epoch reached and which node applied it last.  The slowest node
+ * points at the subtree to look at.
+ */
+static void epoch_trace_report(struct admin_command *cmd)
+{
+	struct admin_epoch_trace_command *trace_cmd = &cmd->data.epoch_trace_cmd;
+	const struct ssa_admin_epoch_trace_rec *rec;
+	const struct epoch_trace_node *node, *slowest;
+	uint32_t origins[SSA_ADMIN_EPOCH_TRACE_NUM * 4];
+	uint32_t origin_time, stage_time;
+	int32_t delay, max_delay;
+	char addr_buf[128], origin_buf[32];
+	int i, j, k, origins_num = 0, reached;
+
+	if (!cmd->recursive || !trace_cmd->nodes_num)
+		return;
+
+	for (i = 0; i < trace_cmd->nodes_num; i++) {
+		node = &trace_cmd->nodes[i];
+		for (j = 0; j < node->n; j++) {
+			origin_time = ntohl(node->recs[j].origin_time);
+			for (k = 0; k < origins_num && origins[k] != origin_time; k++);
+			if (k == origins_num && origins_num < ARRAY_SIZE(origins))
+				origins[origins_num++] = origin_time;
+		}
+	}
+
+	qsort(origins, origins_num, sizeof(origins[0]), epoch_trace_origin_cmp);
+
+	printf("\nEpoch propagation over %d nodes\n", trace_cmd->nodes_num);
+	for (k = 0; k < origins_num && k < SSA_ADMIN_EPOCH_TRACE_NUM; k++) {
+		origin_time = origins[k];
+		reached = 0;
+		max_delay = INT32_MIN;
+		slowest = NULL;
+
+		for (i = 0; i < trace_cmd->nodes_num; i++) {
+			node = &trace_cmd->nodes[i];
+			for (j = 0; j < node->n; j++) {
+				if (ntohl(node->recs[j].origin_time) == origin_time)
+					break;
+			}
+			if (j == node->n)
+				continue;
+
+			reached++;
+			rec = &node->recs[j];
+			stage_time = ntohl(rec->stage_time[SSA_EPOCH_APPLY]);
+			if (!stage_time)
+				stage_time = ntohl(rec->stage_time[SSA_EPOCH_ARRIVE]);
+			if (!stage_time)
+				continue;
+
+			delay = (int32_t) (stage_time - origin_time);
+			if (delay > max_delay) {
+				max_delay = delay;
+				slowest = node;
+			}
+		}
+
+		epoch_trace_format_origin(origin_buf, sizeof origin_buf,
+					  origin_time);
+		printf("origin %s reached %d of %d nodes", origin_buf,
+		       reached, trace_cmd->nodes_num);
+		if (slowest) {
+			ssa_format_addr(addr_buf, sizeof addr_buf, SSA_ADDR_GID,
+					slowest->gid.raw, sizeof slowest->gid.raw);
+			printf(" slowest %s %s applied %+d ms", addr_buf,
+			       ssa_node_type_str(slowest->node_type), max_delay);
+		}
+		printf("\n");
+	}
+}
+
+static void aggregate_print_help(FILE *stream)
+{
+	fprintf(stream, "aggregate is a command for gathering fleet wide totals in a single query\n");
+	fprintf(stream, "Each node forwards the query to its downstream nodes and merges their answers\n");
+	fprintf(stream, "with its own counters and latency histograms\n");
+	fprintf(stream, "Counters are reported with the number of nodes they are set on, their sum,\n");
+	fprintf(stream, "minimum and maximum\n");
+	fprintf(stream, "DB_EPOCH covers the SMDB epoch of core, distribution and access nodes which\n");
+	fprintf(stream, "already hold one; ACMs (PRDB epochs) are left out. DB_EPOCH_LAG is its spread\n");
+	fprintf(stream, "Nodes that did not answer within the timeout are counted as failed\n");
+}
+
+static int aggregate_create_msg(struct admin_command *cmd,
+				struct ssa_admin_msg *msg)
+{
+	struct ssa_admin_aggregate *aggr_msg = &msg->data.aggregate;
+	uint16_t n;
+
+	(void)(cmd);
+
+	aggr_msg->depth = htons(SSA_ADMIN_AGGR_DEPTH);
+	/* leave the root node time to answer before the client gives up */
+	aggr_msg->timeout = htonl(timeout < 0 ? UINT32_MAX : timeout * 3 / 4);
+	n = ntohs(msg->hdr.len) + sizeof(*aggr_msg);
+	msg->hdr.len = htons(n);
+
+	return 0;
+}
+
+/* Returns the histogram buckets following the counters, NULL if truncated */
+static const be64_t *aggregate_msg_buckets(const struct ssa_admin_msg *msg)
+{
+	const struct ssa_admin_aggregate *aggr_msg = &msg->data.aggregate;
+	size_t len = ntohs(msg->hdr.len);
+	int n;
+
+	if (len < sizeof(msg->hdr) + sizeof(*aggr_msg))
+		return NULL;
+
+	n = ntohs(aggr_msg->n);
+	if (len < sizeof(msg->hdr) + sizeof(*aggr_msg) +
+		  n * sizeof(aggr_msg->counters[0]) +
+		  ntohs(aggr_msg->hist_n) * ntohs(aggr_msg->bucket_num) *
+		  sizeof(be64_t))
+		return NULL;
+
+	return (const be64_t *) &aggr_msg->counters[n];
+}
+
+static void aggregate_command_output(struct admin_command *cmd,
+				     struct cmd_exec_info *exec_info,
+				     union ibv_gid remote_gid,
+				     const struct ssa_admin_msg *msg)
+{
+	const struct ssa_admin_aggregate *aggr_msg = &msg->data.aggregate;
+	const struct ssa_admin_aggr_counter *counter;
+	uint64_t buckets[SSA_ADMIN_HIST_BUCKETS], total;
+	const be64_t *msg_buckets;
+	char addr_buf[128];
+	uint32_t nodes;
+	int i, j, n, hist_n;
+
+	(void)(exec_info);
+
+	msg_buckets = aggregate_msg_buckets(msg);
+	if (!msg_buckets) {
+		fprintf(stderr, "ERROR - truncated aggregate response\n");
+		return;
+	}
+
+	if (cmd->recursive) {
+		ssa_format_addr(addr_buf, sizeof addr_buf, SSA_ADDR_GID,
+				remote_gid.raw, sizeof remote_gid.raw);
+		strcat(addr_buf, ": ");
+	} else {
+		addr_buf[0] = '\0';
+	}
+
+	printf("%snodes %u failed %u", addr_buf, ntohl(aggr_msg->nodes),
+	       ntohl(aggr_msg->failed));
+	for (i = 0; i < SSA_ADMIN_AGGR_NODE_TYPES; i++)
+		printf(" %s %u", ssa_node_type_str(1 << i),
+		       ntohl(aggr_msg->type_nodes[i]));
+	printf("\n");
+
+	n = min(COUNTER_ID_LAST, ntohs(aggr_msg->n));
+	for (i = 0; i < n; ++i) {
+		counter = &aggr_msg->counters[i];
+		nodes = ntohl(counter->nodes);
+		if (!nodes || ssa_admin_counters_type[i] == ssa_counter_obsolete)
+			continue;
+
+		printf("%s%s nodes %u", addr_buf, counters_descr[i].name, nodes);
+		switch (ssa_admin_counters_type[i]) {
+		case ssa_counter_timestamp:
+			printf(" oldest ");
+			ssa_write_date(stdout, ntohll(counter->min) / 1000,
+				       (ntohll(counter->min) % 1000) * 1000);
+			printf(" newest ");
+			ssa_write_date(stdout, ntohll(counter->max) / 1000,
+				       (ntohll(counter->max) % 1000) * 1000);
+			break;
+		case ssa_counter_signed_numeric:
+			printf(" min %" PRId64 " max %" PRId64,
+			       (int64_t) ntohll(counter->min),
+			       (int64_t) ntohll(counter->max));
+			break;
+		default:
+			printf(" sum %" PRIu64 " min %" PRIu64 " max %" PRIu64,
+			       ntohll(counter->sum), ntohll(counter->min),
+			       ntohll(counter->max));
+			break;
+		}
+		printf("\n");
+
+		if (i == COUNTER_ID_DB_EPOCH)
+			printf("%sDB_EPOCH_LAG %" PRIu64 "\n", addr_buf,
+			       ntohll(counter->max) - ntohll(counter->min));
+	}
+
+	if (ntohs(aggr_msg->bucket_num) != SSA_ADMIN_HIST_BUCKETS)
+		return;
+
+	hist_n = min(HIST_ID_LAST, ntohs(aggr_msg->hist_n));
+	for (i = 0; i < hist_n; ++i) {
+		total = 0;
+		for (j = 0; j < SSA_ADMIN_HIST_BUCKETS; j++) {
+			buckets[j] = ntohll(msg_buckets[i * SSA_ADMIN_HIST_BUCKETS + j]);
+			total += buckets[j];
+		}
+		if (!total)
+			continue;
+
+		printf("%s%s count %" PRIu64 " p50 %" PRIu64 " p90 %" PRIu64
+		       " p99 %" PRIu64 " max %" PRIu64 " usec\n",
+		       addr_buf, hist_descr[i].name, total,
+		       hist_percentile(buckets, total, 500),
+		       hist_percentile(buckets, total, 900),
+		       hist_percentile(buckets, total, 990),
+		       hist_percentile(buckets, total, 1000));
+	}
+}
+
+static void aggregate_json_output(struct admin_command *cmd,
+				  const struct ssa_admin_msg *msg, FILE *out)
+{
+	const struct ssa_admin_aggregate *aggr_msg = &msg->data.aggregate;
+	const struct ssa_admin_aggr_counter *counter;
+	uint64_t buckets[SSA_ADMIN_HIST_BUCKETS], total;
+	const struct timeval zero = { 0, 0 };
+	const be64_t *msg_buckets;
+	const char *sep = "";
+	uint32_t nodes;
+	int i, j, n, hist_n;
+
+	(void)(cmd);
+
+	msg_buckets = aggregate_msg_buckets(msg);
+	if (!msg_buckets) {
+		fprintf(out, "{}");
+		return;
+	}
+
+	fprintf(out, "{\"nodes\":%u,\"failed\":%u,\"node_types\":{",
+		ntohl(aggr_msg->nodes), ntohl(aggr_msg->failed));
+	for (i = 0; i < SSA_ADMIN_AGGR_NODE_TYPES; i++)
+		fprintf(out, "%s\"%s\":%u", i ? "," : "",
+			ssa_node_type_str(1 << i), ntohl(aggr_msg->type_nodes[i]));
+
+	fprintf(out, "},\"counters\":{");
+	n = min(COUNTER_ID_LAST, ntohs(aggr_msg->n));
+	for (i = 0; i < n; ++i) {
+		counter = &aggr_msg->counters[i];
+		nodes = ntohl(counter->nodes);
+		if (!nodes || ssa_admin_counters_type[i] == ssa_counter_obsolete)
+			continue;
+
+		fprintf(out, "%s\"%s\":{\"nodes\":%u", sep,
+			counters_descr[i].name, nodes);
+		switch (ssa_admin_counters_type[i]) {
+		case ssa_counter_timestamp:
+			fprintf(out, ",\"min\":");
+			json_print_time(out, &zero, ntohll(counter->min));
+			fprintf(out, ",\"max\":");
+			json_print_time(out, &zero, ntohll(counter->max));
+			break;
+		case ssa_counter_signed_numeric:
+			fprintf(out, ",\"min\":%" PRId64 ",\"max\":%" PRId64,
+				(int64_t) ntohll(counter->min),
+				(int64_t) ntohll(counter->max));
+			break;
+		default:
+			fprintf(out, ",\"sum\":%" PRIu64 ",\"min\":%" PRIu64
+				",\"max\":%" PRIu64, ntohll(counter->sum),
+				ntohll(counter->min), ntohll(counter->max));
+			break;
+		}
+		fprintf(out, "}");
+		sep = ",";
+	}
+
+	fprintf(out, "},\"histograms\":{");
+	sep = "";
+	hist_n = ntohs(aggr_msg->bucket_num) == SSA_ADMIN_HIST_BUCKETS ?
+		 min(HIST_ID_LAST, ntohs(aggr_msg->hist_n)) : 0;
+	for (i = 0; i < hist_n; ++i) {
+		total = 0;
+		for (j = 0; j < SSA_ADMIN_HIST_BUCKETS; j++) {
+			buckets[j] = ntohll(msg_buckets[i * SSA_ADMIN_HIST_BUCKETS + j]);
+			total += buckets[j];
+		}
+
+		fprintf(out, "%s\"%s\":{\"count\":%" PRIu64, sep,
+			hist_descr[i].name, total);
+		if (total)
+			fprintf(out, ",\"p50\":%" PRIu64 ",\"p90\":%" PRIu64
+				",\"p99\":%" PRIu64 ",\"max\":%" PRIu64,
+				hist_percentile(buckets, total, 500),
+				hist_percentile(buckets, total, 900),
+				hist_percentile(buckets, total, 990),
+				hist_percentile(buckets, total, 1000));
+		fprintf(out, "}");
+		sep = ",";
+	}
+	fprintf(out, "}}");
+}
+
+struct cmd_opts *admin_get_cmd_opts(int cmd)
+{
+	struct cmd_struct_impl *impl;
+
+	if (cmd <= SSA_ADMIN_CMD_NONE || cmd >= SSA_ADMIN_CMD_MAX) {
+		fprintf(stderr, "ERROR - command index %d is out of range\n", cmd);
+		return NULL;
+	}
+
+	impl = &admin_cmd_command_impls[cmd];
+
+	return impl->opts;
+}
+
+const struct cmd_help *admin_cmd_help(int cmd)
+{
+	struct cmd_struct_impl *impl;
+
+	if (cmd <= SSA_ADMIN_CMD_NONE || cmd >= SSA_ADMIN_CMD_MAX) {
+		fprintf(stderr, "ERROR - command index %d is out of range\n", cmd);
+		return NULL;
+	}
+
+	impl = &admin_cmd_command_impls[cmd];
+
+	return &impl->help;
+}
+
+
+enum admin_connection_state {
+	ADM_CONN_CONNECTING,
+	ADM_CONN_NODEINFO,
+	ADM_CONN_COMMAND,
+};
+
+struct admin_connection {
+	union ibv_gid remote_gid;
+	uint16_t remote_lid;
+	enum admin_connection_state state;
+	uint64_t last_active;	/* usec */
+	unsigned int slen, sleft;
+	struct ssa_admin_msg *smsg;
+	unsigned int rlen, rcount;
+	struct ssa_admin_msg *rmsg;
+	struct ssa_admin_msg_hdr rhdr;
+	struct cmd_exec_info exec_info;
+};
+
+static int admin_recv_buff(int rsock, char *buf, unsigned int *rcount, unsigned int rlen)
+{
+	int n;
+
+	while (*rcount < rlen) {
+		n = rrecv(rsock, buf + *rcount, rlen - *rcount, MSG_DONTWAIT);
+		if (n > 0)
+			*rcount += n;
+		else if (!n)
+			return -ECONNRESET;
+		else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return *rcount;
+		else
+			return n;
+	}
+	return 0;
+}
+
+static int admin_recv_msg(struct pollfd *pfd, struct admin_connection *conn)
+{
+	int ret;
+
+	if (conn->rcount < sizeof(conn->rhdr)) {
+		ret = admin_recv_buff(pfd->fd, (char *) &conn->rhdr,
+				      &conn->rcount, sizeof(conn->rhdr));
+		if (ret == -ECONNRESET) {
+			fprintf(stderr, "ERROR - SSA node closed admin connection\n");
+			return -1;
+		} else if (ret < 0) {
+			fprintf(stderr,
+				"ERROR - rrecv failed: %d (%s) on rsock %d\n",
+				errno, strerror(errno), pfd->fd);
+			return ret;
+		}
+		if (conn->rcount < sizeof(conn->rhdr))
+			return 0;
+	}
+
+	if (conn->rcount == sizeof(conn->rhdr)) {
+		if (conn->rhdr.status != SSA_ADMIN_STATUS_SUCCESS) {
+			fprintf(stderr, "ERROR - target SSA node failed to process request\n");
+			return -1;
+		} else if (conn->rhdr.method != SSA_ADMIN_METHOD_RESP) {
+			fprintf(stderr, "ERROR - response has wrong method\n");
+			return -1;
+		}
+
+		conn->rlen = ntohs(conn->rhdr.len);
+		conn->rmsg = (struct ssa_admin_msg *) malloc(max(sizeof(*conn->rmsg),
+								 conn->rlen));
+		if (!conn->rmsg) {
+			fprintf(stderr, "ERROR - failed allocate message buffer\n");
+			return -1;
+		}
+
+		conn->rmsg->hdr = conn->rhdr;
+	}
+
+	ret = admin_recv_buff(pfd->fd, (char *) conn->rmsg,
+			      &conn->rcount, conn->rlen);
+	if (ret == -ECONNRESET) {
+		fprintf(stderr, "ERROR - SSA node closed admin connection\n");
+		return -1;
+	} else if (ret < 0) {
+		fprintf(stderr, "ERROR - rrecv failed: %d (%s) on rsock %d\n",
+			errno, strerror(errno), pfd->fd);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int admin_send_msg(struct pollfd *pfd, struct admin_connection *conn)
+{
+	int sent = conn->slen - conn->sleft;
+	int n;
+
+	while (conn->sleft) {
+		n  = rsend(pfd->fd, (char *) conn->smsg + sent, conn->sleft, MSG_DONTWAIT);
+		if (n < 0)
+			break;
+		conn->sleft -= n;
+		sent += n;
+	}
+
+	if (!conn->sleft) {
+		return 0;
+	} else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		return 0;
+	} else if (n < 0)
+		return n;
+
+	return 0;
+}
+
+static void admin_update_connection_state(struct admin_connection *conn,
+					  enum admin_connection_state state,
+					  struct ssa_admin_msg *msg)
+{
+	conn->state = state;
+	conn->last_active = get_timestamp();
+
+	free(conn->rmsg);
+	conn->rmsg = NULL;
+	conn->rlen = 0;
+	conn->rcount = 0;
+
+	if (state == ADM_CONN_CONNECTING) {
+		conn->smsg = NULL;
+		conn->slen = 0;
+		conn->sleft = 0;
+	} else {
+		conn->smsg = msg;
+		conn->slen = ntohs(msg->hdr.len);
+		conn->sleft = conn->slen;
 	}
 
 	conn->exec_info.stime = get_timestamp();
@@ -1263,77 +2115,369 @@ static void admin_close_connection(struct pollfd *pfd,
 	conn->rmsg = NULL;
 }
 
-static int admin_connect_new_nodes(struct pollfd **fds,
-				   struct admin_connection **admin_conns,
-				   enum admin_recursion_mode mode,
-				   int *admin_conns_num,
-				   const struct ssa_admin_msg *rmsg)
+/* Node discovered through nodeinfo, waiting for a connection slot */
+struct admin_node {
+	union ibv_gid gid;
+	uint16_t lid;
+};
+
+/*
+ * State of a (recursive) command execution.  Connection slots are
+ * reused, so the tables grow up to the concurrency limit only, while
+ * the nodes still to be visited wait in the pending queue.
+ */
+struct admin_exec {
+	int cmd;
+	enum admin_recursion_mode mode;
+	struct admin_command *admin_cmd;
+	const struct cmd_struct_impl *cmd_impl;
+	struct ssa_admin_msg *nodeinfo_msg;
+	struct ssa_admin_msg *msg;
+	struct pollfd *fds;
+	struct admin_connection *conns;
+	int size;		/* allocated slots */
+	int used;		/* slots below the highest one in use */
+	int active;
+	struct admin_node *pending;
+	int pending_head, pending_num, pending_size;
+	void *visited;		/* GIDs queued so far */
+	int failed;
+};
+
+static int admin_gid_cmp(const void *a, const void *b)
 {
-	int i, slot, node_conns_num, rsock;
-	char addr_buf[128];
-	struct ssa_admin_node_info *node_info = (struct ssa_admin_node_info *) &rmsg->data.node_info;
-	struct ssa_admin_connection_info *node_conns =
-		(struct ssa_admin_connection_info *) node_info->connections;
-	void *tmp;
-	int type;
+	return memcmp(a, b, sizeof(union ibv_gid));
+}
 
-	node_conns_num = ntohs(node_info->connections_num);
-	if (node_conns_num < 0) {
-		fprintf(stderr, "ERROR - Negative number of SSA node's connections\n");
+static void admin_gid_free(void *gid)
+{
+	free(gid);
+}
+
+static int admin_exec_grow(struct admin_exec *exec)
+{
+	struct pollfd *fds;
+	struct admin_connection *conns;
+	int i, size = exec->size ? exec->size * 2 : 64;
+
+	fds = realloc(exec->fds, size * sizeof(*fds));
+	if (!fds) {
+		fprintf(stderr, "ERROR - failed to reallocate pfds array\n");
 		return -1;
-	} else if (node_conns_num  == 0) {
-		return 0;
 	}
+	exec->fds = fds;
+
+	conns = realloc(exec->conns, size * sizeof(*conns));
+	if (!conns) {
+		fprintf(stderr, "ERROR - failed to reallocate connections array\n");
+		return -1;
+	}
+	exec->conns = conns;
+
+	for (i = exec->size; i < size; i++) {
+		fds[i].fd = -1;
+		fds[i].events = 0;
+		fds[i].revents = 0;
+		memset(&conns[i], 0, sizeof(conns[i]));
+	}
+	exec->size = size;
+
+	return 0;
+}
+
+static int admin_exec_get_slot(struct admin_exec *exec)
+{
+	int i;
+
+	for (i = 0; i < exec->used && exec->fds[i].fd >= 0; i++);
+	if (i == exec->size && admin_exec_grow(exec))
+		return -1;
+	if (i == exec->used)
+		exec->used++;
+
+	return i;
+}
+
+/* Returns 1 if the GID was already seen, -1 on error */
+static int admin_exec_visit(struct admin_exec *exec, const union ibv_gid *gid)
+{
+	union ibv_gid *key, **node;
+
+	key = malloc(sizeof(*key));
+	if (!key) {
+		fprintf(stderr, "ERROR - failed to allocate visited node\n");
+		return -1;
+	}
+	*key = *gid;
+
+	node = tsearch(key, &exec->visited, admin_gid_cmp);
+	if (!node) {
+		free(key);
+		fprintf(stderr, "ERROR - failed to insert visited node\n");
+		return -1;
+	}
+	if (*node != key) {
+		free(key);
+		return 1;
+	}
+
+	return 0;
+}
+
+static void admin_exec_report_error(struct admin_exec *exec,
+				    const union ibv_gid *gid, uint16_t lid,
+				    const char *error)
+{
+	char addr_buf[128];
+
+	exec->failed++;
+	if (!global_opts.json)
+		return;
 
-	if (mode == ADMIN_RECURSION_DOWN)
+	ssa_format_addr(addr_buf, sizeof addr_buf, SSA_ADDR_GID,
+			gid->raw, sizeof gid->raw);
+	printf("{\"gid\":\"%s\"", addr_buf);
+	if (lid)
+		printf(",\"lid\":%u", lid);
+	printf(",\"command\":\"%s\",\"error\":\"%s\"}\n",
+	       exec->admin_cmd->cmd->cmd, error);
+	fflush(stdout);
+}
+
+static void admin_exec_close(struct admin_exec *exec, int i)
+{
+	admin_close_connection(&exec->fds[i], &exec->conns[i]);
+	exec->active--;
+}
+
+static void admin_exec_fail(struct admin_exec *exec, int i, const char *error)
+{
+	admin_exec_report_error(exec, &exec->conns[i].remote_gid,
+				exec->conns[i].remote_lid, error);
+	admin_exec_close(exec, i);
+}
+
+static void admin_exec_output(struct admin_exec *exec,
+			      struct admin_connection *conn)
+{
+	char addr_buf[128];
+
+	if (!global_opts.json) {
+		exec->cmd_impl->handle_response(exec->admin_cmd, &conn->exec_info,
+						conn->remote_gid, conn->rmsg);
+		fflush(stdout);
+		return;
+	}
+
+	ssa_format_addr(addr_buf, sizeof addr_buf, SSA_ADDR_GID,
+			conn->remote_gid.raw, sizeof conn->remote_gid.raw);
+	printf("{\"gid\":\"%s\"", addr_buf);
+	if (conn->remote_lid)
+		printf(",\"lid\":%u", conn->remote_lid);
+	printf(",\"command\":\"%s\",\"time_ms\":%g,\"data\":",
+	       exec->admin_cmd->cmd->cmd,
+	       1e-3 * (conn->exec_info.etime - conn->exec_info.stime));
+	if (exec->cmd_impl->json_output)
+		exec->cmd_impl->json_output(exec->admin_cmd, conn->rmsg, stdout);
+	else
+		printf("{}");
+	printf("}\n");
+	fflush(stdout);
+}
+
+static int admin_exec_queue_nodes(struct admin_exec *exec,
+				  const struct ssa_admin_msg *rmsg)
+{
+	const struct ssa_admin_node_info *node_info = &rmsg->data.node_info;
+	const struct ssa_admin_connection_info *node_conns =
+		(const struct ssa_admin_connection_info *) node_info->connections;
+	struct admin_node *node;
+	int i, ret, type, node_conns_num;
+
+	node_conns_num = ntohs(node_info->connections_num);
+
+	if (exec->mode == ADMIN_RECURSION_DOWN)
 		type = SSA_CONN_TYPE_DOWNSTREAM;
 	else
 		type = SSA_CONN_TYPE_UPSTREAM;
 
-	slot = 0;
 	for (i = 0; i < node_conns_num; ++i) {
-		if (node_conns[i].connection_type == type) {
-			for (; slot < *admin_conns_num && (*fds)[slot].fd > 0; slot++);
-
-			if (slot == *admin_conns_num) {
-				tmp = realloc(*fds, 2 * *admin_conns_num * sizeof(**fds));
-				if (!tmp) {
-					fprintf(stderr, "ERROR - failed to reallocate pfds array\n");
-					return -1;
-				}
+		if (node_conns[i].connection_type != type)
+			continue;
 
-				*fds = (struct pollfd *) tmp;
+		ret = admin_exec_visit(exec, (const union ibv_gid *)
+					     node_conns[i].remote_gid);
+		if (ret > 0)
+			continue;
+		else if (ret < 0)
+			return -1;
 
-				tmp = realloc(*admin_conns, 2 * *admin_conns_num * sizeof(**admin_conns));
-				if (!tmp) {
-					fprintf(stderr, "ERROR - failed to reallocate connections array\n");
-					return -1;
-				}
+		if (exec->pending_num == exec->pending_size) {
+			node = realloc(exec->pending, (exec->pending_size * 2 + 64) *
+						      sizeof(*node));
+			if (!node) {
+				fprintf(stderr, "ERROR - failed to reallocate pending nodes\n");
+				return -1;
+			}
+			exec->pending = node;
+			exec->pending_size = exec->pending_size * 2 + 64;
+		}
 
-				*admin_conns_num *= 2;
+		node = &exec->pending[exec->pending_num++];
+		memcpy(node->gid.raw, node_conns[i].remote_gid, sizeof(node->gid.raw));
+		node->lid = ntohs(node_conns[i].remote_lid);
+	}
+
+	return 0;
+}
+
+/* Connect pending nodes while fewer than the concurrency limit are active */
+static void admin_exec_start_pending(struct admin_exec *exec)
+{
+	struct admin_node *node;
+	char addr_buf[128];
+	int slot, rsock;
+
+	while (exec->pending_head < exec->pending_num &&
+	       (global_opts.concurrency <= 0 ||
+		exec->active < global_opts.concurrency)) {
+		node = &exec->pending[exec->pending_head++];
+
+		ssa_format_addr(addr_buf, sizeof addr_buf, SSA_ADDR_GID,
+				node->gid.raw, sizeof node->gid.raw);
+		rsock = admin_connect_init(addr_buf, ADMIN_ADDR_TYPE_GID, &global_opts);
+		if (rsock < 0 && (errno != EINPROGRESS)) {
+			fprintf(stderr, "ERROR - Unable connect to %s\n", addr_buf);
+			admin_exec_report_error(exec, &node->gid, node->lid,
+						"connect");
+			continue;
+		}
+
+		slot = admin_exec_get_slot(exec);
+		if (slot < 0) {
+			rclose(rsock);
+			admin_exec_report_error(exec, &node->gid, node->lid,
+						"no memory");
+			continue;
+		}
+
+		exec->fds[slot].fd = rsock;
+		exec->fds[slot].events = POLLOUT;
+		exec->fds[slot].revents = 0;
+
+		admin_update_connection_state(&exec->conns[slot], ADM_CONN_CONNECTING, NULL);
+		exec->conns[slot].remote_lid = node->lid;
+		exec->conns[slot].remote_gid = node->gid;
+		exec->active++;
+	}
+
+	if (exec->pending_head == exec->pending_num)
+		exec->pending_head = exec->pending_num = 0;
+}
+
+static void admin_exec_expire(struct admin_exec *exec)
+{
+	uint64_t now;
+	int i;
+
+	if (timeout < 0)
+		return;
+
+	now = get_timestamp();
+	for (i = 0; i < exec->used; ++i) {
+		if (exec->fds[i].fd >= 0 &&
+		    now - exec->conns[i].last_active >= (uint64_t) timeout * 1000) {
+			fprintf(stderr, "ERROR - timeout expired\n");
+			admin_exec_fail(exec, i, "timeout");
+		}
+	}
+}
+
+static void admin_exec_handle(struct admin_exec *exec, int i)
+{
+	struct pollfd *pfd = &exec->fds[i];
+	struct admin_connection *conn = &exec->conns[i];
+	unsigned int len;
+	int ret, revents, err;
+
+	revents = pfd->revents;
+	pfd->revents = 0;
+
+	conn->last_active = get_timestamp();
+
+	if (revents & (POLLERR /*| POLLHUP */| POLLNVAL)) {
+		char event_str[128] = {};
+
+		ssa_format_event(event_str, sizeof(event_str), revents);
+		fprintf(stderr,
+			"ERROR - error event 0x%x (%s) on rsock %d\n",
+			revents, event_str, pfd->fd);
+		admin_exec_fail(exec, i, "connection error");
+		return;
+	}
+
+	if (revents & POLLIN) {
+		ret = admin_recv_msg(pfd, conn);
+		if (ret) {
+			admin_exec_fail(exec, i, "receive");
+			return;
+		} else if (conn->rcount != conn->rlen) {
+			return;
+		}
+
+		SSA_ADMIN_REPORT_MSG(conn->rmsg);
+		conn->exec_info.etime = get_timestamp();
+		if (ntohs(conn->rmsg->hdr.opcode) == SSA_ADMIN_CMD_NODE_INFO &&
+		    conn->state == ADM_CONN_NODEINFO) {
+			if (admin_exec_queue_nodes(exec, conn->rmsg))
+				fprintf(stderr, "WARNING - failed to connect downstream nodes\n");
+			if (exec->cmd != SSA_ADMIN_CMD_NODE_INFO) {
+				admin_update_connection_state(conn, ADM_CONN_COMMAND, exec->msg);
+				pfd->events = POLLOUT;
+				return;
 			}
+		}
+		admin_exec_output(exec, conn);
+		admin_exec_close(exec, i);
+		return;
+	}
 
-			ssa_format_addr(addr_buf, sizeof addr_buf, SSA_ADDR_GID,
-					node_conns[i].remote_gid,
-					sizeof node_conns[i].remote_gid);
-			rsock = admin_connect_init(addr_buf, ADMIN_ADDR_TYPE_GID, &global_opts);
-			if (rsock < 0 && (errno != EINPROGRESS)) {
-				fprintf(stderr, "ERROR - Unable connect to %s\n", addr_buf);
-				continue;
+	if (revents & POLLOUT) {
+		if (conn->state == ADM_CONN_CONNECTING) {
+			len = sizeof(err);
+			ret = rgetsockopt(pfd->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+			if (ret) {
+				fprintf(stderr,
+					"rgetsockopt rsock %d ERROR %d (%s)\n",
+					pfd->fd, errno, strerror(errno));
+				admin_exec_fail(exec, i, "connect");
+				return;
+			}
+			if (err) {
+				errno = err;
+				fprintf(stderr,
+					"ERROR - async rconnect rsock %d ERROR %d (%s)\n",
+					pfd->fd, errno, strerror(errno));
+				admin_exec_fail(exec, i, "connect");
+				return;
 			}
 
-			(*fds)[slot].fd = rsock;
-			(*fds)[slot].events = POLLOUT;
-			(*fds)[slot].revents = 0;
+			admin_update_connection_state(conn, ADM_CONN_NODEINFO,
+						      exec->nodeinfo_msg);
+		}
 
-			admin_update_connection_state(*admin_conns + slot, ADM_CONN_CONNECTING, NULL);
-			(*admin_conns)[slot].remote_lid = ntohs(node_conns[i].remote_lid);
-			memcpy((*admin_conns)[slot].remote_gid.raw,
-			       &node_conns[i].remote_gid,
-			       sizeof((*admin_conns)[slot].remote_gid.raw));
+		ret = admin_send_msg(pfd, conn);
+		if (ret) {
+			fprintf(stderr, "ERROR - failed to send request on rsock %d\n",
+				pfd->fd);
+			admin_exec_fail(exec, i, "send");
+			return;
 		}
+
+		SSA_ADMIN_REPORT_MSG(conn->smsg);
+		if (!conn->sleft)
+			pfd->events = POLLIN;
 	}
-	return 0;
 }
 
 int admin_exec_recursive(int rsock, int cmd, enum admin_recursion_mode mode,
@@ -1342,12 +2486,8 @@ int admin_exec_recursive(int rsock, int cmd, enum admin_recursion_mode mode,
 	struct cmd_struct_impl *nodeinfo_impl;
 	struct admin_command *nodeinfo_cmd;
 	struct ssa_admin_msg nodeinfo_msg, msg;
-	struct admin_command *admin_cmd = NULL;
-	struct cmd_struct_impl *cmd_impl = NULL;
-	int n = 1024, ret, i, revents, err;
-	struct pollfd *fds;
-	unsigned int len;
-	struct admin_connection *connections;
+	struct admin_exec exec;
+	int ret = -1, i, slot;
 	struct sockaddr_ib peer_addr;
 	socklen_t peer_len;
 
@@ -1356,221 +2496,126 @@ int admin_exec_recursive(int rsock, int cmd, enum admin_recursion_mode mode,
 		return -1;
 	}
 
-	fds = (struct pollfd *) malloc(n * sizeof(*fds));
-	if (!fds) {
-		fprintf(stderr, "ERROR - failed to allocate pollfd array\n");
-		return -1;
-	}
-
-	for (i = 0; i < n; ++i) {
-		fds[i].fd = -1;
-		fds[i].events = 0;
-		fds[i].revents = 0;
-	}
-
-	connections = (struct admin_connection *) malloc(n * sizeof(*connections));
-	if (!connections) {
-		fprintf(stderr, "ERROR - failed to allocate admin connections array\n");
-		free(fds);
-		return -1;
-	}
-
-	memset(connections, 0, n * sizeof(*connections));
+	memset(&exec, 0, sizeof(exec));
+	exec.cmd = cmd;
+	exec.mode = mode;
+	exec.nodeinfo_msg = &nodeinfo_msg;
+	exec.msg = &msg;
 
 	nodeinfo_impl = &admin_cmd_command_impls[SSA_ADMIN_CMD_NODE_INFO];
 	nodeinfo_cmd = default_init(SSA_ADMIN_CMD_NODE_INFO, 0, NULL);
 	if (!nodeinfo_cmd) {
 		fprintf(stderr, "ERROR - failed to create nodeinfo command\n");
-		free(connections);
-		free(fds);
 		return -1;
 	}
 
+	exec.cmd_impl = &admin_cmd_command_impls[cmd];
+	if (!exec.cmd_impl->destroy ||
+	    !exec.cmd_impl->create_request || !exec.cmd_impl->handle_response) {
+		fprintf(stderr, "ERROR - command creation error\n");
+		goto err1;
+	}
+
 	memset(&nodeinfo_msg, 0, sizeof(nodeinfo_msg));
 	nodeinfo_msg.hdr.version= SSA_ADMIN_PROTOCOL_VERSION;
 	nodeinfo_msg.hdr.method	= SSA_ADMIN_METHOD_GET;
 	nodeinfo_msg.hdr.opcode	= htons(SSA_ADMIN_CMD_NODE_INFO);
 	nodeinfo_msg.hdr.len	= htons(sizeof(nodeinfo_msg.hdr));
 
-	ret = nodeinfo_impl->create_request(nodeinfo_cmd, &nodeinfo_msg);
-	if (ret < 0) {
+	if (nodeinfo_impl->create_request(nodeinfo_cmd, &nodeinfo_msg) < 0) {
 		fprintf(stderr, "ERROR - message creation error\n");
-		goto err;
-	}
-	cmd_impl = &admin_cmd_command_impls[cmd];
-
-	if (!cmd_impl->destroy ||
-	    !cmd_impl->create_request || !cmd_impl->handle_response) {
-		fprintf(stderr, "ERROR - command creation error\n");
-		goto err;
+		goto err1;
 	}
 
-	admin_cmd = default_init(cmd, argc, argv);
-	if (!admin_cmd) {
+	exec.admin_cmd = default_init(cmd, argc, argv);
+	if (!exec.admin_cmd) {
 		fprintf(stderr, "ERROR - command creation error\n");
-		goto err;
+		goto err1;
 	}
 
 	memset(&msg, 0, sizeof(msg));
 	msg.hdr.version	= SSA_ADMIN_PROTOCOL_VERSION;
 	msg.hdr.method	= SSA_ADMIN_METHOD_GET;
-	msg.hdr.opcode	= htons(admin_cmd->cmd->id);
+	msg.hdr.opcode	= htons(exec.admin_cmd->cmd->id);
 	msg.hdr.len	= htons(sizeof(msg.hdr));
 
-	ret = admin_cmd->impl->create_request(admin_cmd, &msg);
-	if (ret < 0) {
+	if (exec.admin_cmd->impl->create_request(exec.admin_cmd, &msg) < 0) {
 		fprintf(stderr, "ERROR - message creation error\n");
-		goto err;
+		goto err2;
 	}
 
-	fds[0].fd = rsock;
-	fds[0].events = POLLOUT;
-	fds[0].revents = 0;
-
-	if (mode == ADMIN_RECURSION_NONE) {
-		admin_cmd->recursive = 0;
-		admin_update_connection_state(&connections[0], ADM_CONN_COMMAND,
-				&msg);
-	} else {
-		admin_cmd->recursive = 1;
-		admin_update_connection_state(&connections[0], ADM_CONN_NODEINFO,
-				&nodeinfo_msg);
-	}
+	slot = admin_exec_get_slot(&exec);
+	if (slot < 0)
+		goto err2;
 
 	peer_len = sizeof(peer_addr);
 	if (!rgetpeername(rsock, (struct sockaddr *) &peer_addr, &peer_len)) {
 		if (peer_addr.sib_family == AF_IB) {
-			memcpy(&connections[0].remote_gid,
+			memcpy(&exec.conns[slot].remote_gid,
 			       &peer_addr.sib_addr, sizeof(union ibv_gid));
 		} else {
 			fprintf(stderr, "ERROR - "
 				"rgetpeername fd %d family %d not AF_IB\n",
 				rsock, peer_addr.sib_family);
-			goto err;
+			goto err2;
 		}
 	} else {
 		fprintf(stderr, "ERROR - "
 			"rgetpeername rsock %d ERROR %d (%s)\n",
 			rsock, errno, strerror(errno));
-		goto err;
+		goto err2;
 	}
 
-	for(;;) {
-		for (i = 0; i < n && fds[i].fd < 0; ++i);
-		if (i == n)
-			break;
+	if (admin_exec_visit(&exec, &exec.conns[slot].remote_gid) < 0)
+		goto err2;
 
-		ret = rpoll(fds, n, timeout);
+	exec.fds[slot].fd = rsock;
+	exec.fds[slot].events = POLLOUT;
+	exec.fds[slot].revents = 0;
+	exec.active = 1;
+
+	if (mode == ADMIN_RECURSION_NONE) {
+		exec.admin_cmd->recursive = 0;
+		admin_update_connection_state(&exec.conns[slot], ADM_CONN_COMMAND,
+					      &msg);
+	} else {
+		exec.admin_cmd->recursive = 1;
+		admin_update_connection_state(&exec.conns[slot], ADM_CONN_NODEINFO,
+					      &nodeinfo_msg);
+	}
+
+	while (exec.active) {
+		ret = rpoll(exec.fds, exec.used, timeout);
 		if (ret < 0) {
 			fprintf(stderr, "ERROR - rpoll rsock %d ERROR %d (%s)\n",
 				rsock, errno, strerror(errno));
-			goto err;
-
-		} else if (ret == 0) {
-			time_t now_epoch = time(NULL);
-
-			for (i = 0; i < n; ++i) {
-				if (fds[i].fd >= 0 && connections[i].epoch - now_epoch >= timeout) {
-					fprintf(stderr, "ERROR - timeout expired\n");
-					admin_close_connection(&fds[i], &connections[i]);
-				}
-			}
-			continue;
+			goto err2;
 		}
 
-		for (i = 0; i < n; ++i) {
-			if (fds[i].fd < 0 || !fds[i].revents)
-				continue;
-
-			revents = fds[i].revents;
-			fds[i].revents = 0;
-
-			connections[i].epoch = time(NULL);
-
-			if (revents & (POLLERR /*| POLLHUP */| POLLNVAL)) {
-				char event_str[128] = {};
-
-				ssa_format_event(event_str, sizeof(event_str), revents);
-				fprintf(stderr,
-					"ERROR - error event 0x%x (%s) on rsock %d\n",
-					fds[i].revents, event_str, fds[i].fd);
-				admin_close_connection(&fds[i], &connections[i]);
-				continue;
-			}
-
-			if (revents & POLLIN) {
-				ret = admin_recv_msg(&fds[i], &connections[i]);
-				if (ret) {
-					admin_close_connection(&fds[i], &connections[i]);
-					continue;
-				} else if (connections[i].rcount != connections[i].rlen) {
-					continue;
-				}
-
-				SSA_ADMIN_REPORT_MSG(connections[i].rmsg);
-				ret = 0;
-				connections[i].exec_info.etime = get_timestamp();
-				if (ntohs(connections[i].rmsg->hdr.opcode) == SSA_ADMIN_CMD_NODE_INFO &&
-				    connections[i].state == ADM_CONN_NODEINFO) {
-					ret = admin_connect_new_nodes(&fds, &connections, mode, &n, connections[i].rmsg);
-					if (ret) {
-						fprintf(stderr, "WARNING - failed to connect downstream nodes\n");
-						continue;
-					}
-					if (cmd != SSA_ADMIN_CMD_NODE_INFO) {
-						admin_update_connection_state(&connections[i], ADM_CONN_COMMAND, &msg);
-						fds[i].events = POLLOUT;
-						continue;
-					}
-				}
-				cmd_impl->handle_response(admin_cmd, &connections[i].exec_info,
-						connections[i].remote_gid, connections[i].rmsg);
-				admin_close_connection(&fds[i], &connections[i]);
-				continue;
-			}
-			if (revents & POLLOUT) {
-				if (connections[i].state == ADM_CONN_CONNECTING) {
-					len = sizeof(err);
-					ret = rgetsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &err, &len);
-					if (ret) {
-						fprintf(stderr,
-							"rgetsockopt rsock %d ERROR %d (%s)\n",
-							fds[i].fd, errno,
-							strerror(errno));
-						admin_close_connection(&fds[i], &connections[i]);
-						continue;
-					}
-					if (err) {
-						ret = -1;
-						errno = err;
-						fprintf(stderr,
-							"ERROR - async rconnect rsock %d ERROR %d (%s)\n",
-							fds[i].fd, errno,
-							strerror(errno));
-						admin_close_connection(&fds[i], &connections[i]);
-						continue;
-					}
-
-					admin_update_connection_state(&connections[i], ADM_CONN_NODEINFO, &nodeinfo_msg);
-				}
+		for (i = 0; ret > 0 && i < exec.used; ++i) {
+			if (exec.fds[i].fd >= 0 && exec.fds[i].revents)
+				admin_exec_handle(&exec, i);
+		}
 
-				ret = admin_send_msg(&fds[i], &connections[i]);
-				if (ret) {
-					fprintf(stderr, "ERROR - response has wrong method\n");
-					admin_close_connection(&fds[i],  &connections[i]);
-				}
+		admin_exec_expire(&exec);
+		admin_exec_start_pending(&exec);
+	}
 
-				SSA_ADMIN_REPORT_MSG(connections[i].smsg);
-				if (!connections[i].sleft)
-					fds[i].events = POLLIN;
-			}
-		}
+	if (exec.cmd_impl->report && !global_opts.json)
+		exec.cmd_impl->report(exec.admin_cmd);
+	ret = exec.failed ? -1 : 0;
+err2:
+	for (i = 0; i < exec.used; ++i) {
+		if (exec.fds[i].fd >= 0)
+			admin_close_connection(&exec.fds[i], &exec.conns[i]);
 	}
-err:
-	cmd_impl->destroy(admin_cmd);
+	exec.cmd_impl->destroy(exec.admin_cmd);
+err1:
 	nodeinfo_impl->destroy(nodeinfo_cmd);
-	free(connections);
-	free(fds);
+	tdestroy(exec.visited, admin_gid_free);
+	free(exec.pending);
+	free(exec.conns);
+	free(exec.fds);
 
 	return ret;
 }
@@ -65,6 +65,8 @@ struct admin_opts {
 	int		admin_port;
 	uint16_t	pkey;
 	int		timeout;
+	int		concurrency;	/* max parallel connections, <= 0 unlimited */
+	int		json;
 };
 
 struct cmd_opts {
@@ -55,6 +55,8 @@ static char log_file[128] = "/var/log/ibssa.log";
 static char lock_file[128] = "/var/run/ibssa.pid";
 
 extern int log_flush;
+extern int log_async;
+extern int log_rate_limit;
 extern int accum_log_file;
 extern int smdb_dump;
 extern int err_smdb_dump;
@@ -64,6 +66,8 @@ extern char prdb_dump_dir[128];
 extern short smdb_port;
 extern short prdb_port;
 extern short admin_port;
+extern short metrics_port;
+extern char metrics_socket[128];
 extern int keepalive;
 #ifdef SIM_SUPPORT_FAKE_ACM
 extern int fake_acm_num;
@@ -248,6 +252,10 @@ static void distrib_set_options(void)
 			ssa_set_log_level(atoi(value));
 		else if (!strcasecmp("log_flush", opt))
 			log_flush = atoi(value);
+		else if (!strcasecmp("log_async", opt))
+			log_async = atoi(value);
+		else if (!strcasecmp("log_rate_limit", opt))
+			log_rate_limit = atoi(value);
 		else if (!strcasecmp("accum_log_file", opt))
 			accum_log_file = atoi(value);
 		else if (!strcasecmp("lock_file", opt))
@@ -268,6 +276,10 @@ static void distrib_set_options(void)
 			smdb_port = (short) atoi(value);
 		else if (!strcasecmp("prdb_port", opt))
 			prdb_port = (short) atoi(value);
+		else if (!strcasecmp("metrics_port", opt))
+			metrics_port = (short) atoi(value);
+		else if (!strcasecmp("metrics_socket", opt))
+			strcpy(metrics_socket, value);
 		else if (!strcasecmp("keepalive", opt))
 			keepalive = atoi(value);
 #ifdef SIM_SUPPORT_FAKE_ACM
@@ -280,6 +292,10 @@ static void distrib_set_options(void)
 			 reconnect_timeout = atoi(value);
 		else if (!strcasecmp("rejoin_timeout", opt))
 			 rejoin_timeout = atoi(value);
+		else if (!strcasecmp("db_hugepages", opt))
+			db_hugepages = atoi(value);
+		else if (!strcasecmp("db_numa_interleave", opt))
+			db_numa_interleave = atoi(value);
 	}
 
 	fclose(f);
@@ -300,6 +316,8 @@ static void distrib_log_options(void)
 	ssa_log(SSA_LOG_DEFAULT, "smdb port %u\n", smdb_port);
 	ssa_log(SSA_LOG_DEFAULT, "prdb port %u\n", prdb_port);
 	ssa_log(SSA_LOG_DEFAULT, "admin port %u\n", admin_port);
+	ssa_log(SSA_LOG_DEFAULT, "metrics port %u\n", metrics_port);
+	ssa_log(SSA_LOG_DEFAULT, "metrics socket %s\n", metrics_socket);
 	ssa_log(SSA_LOG_DEFAULT, "keepalive time %d\n", keepalive);
 #ifdef SIM_SUPPORT_FAKE_ACM
 	if (node_type & SSA_NODE_ACCESS) {
@@ -324,6 +342,9 @@ static void distrib_log_options(void)
 		ssa_log(SSA_LOG_DEFAULT, "rejoin to distribution tree after previous request failure disabled\n");
 	else
 		ssa_log(SSA_LOG_DEFAULT, "timeout before next join request (in sec.) %d\n", rejoin_timeout );
+
+	ssa_log(SSA_LOG_DEFAULT, "db hugepages %d\n", db_hugepages);
+	ssa_log(SSA_LOG_DEFAULT, "db numa interleave %d\n", db_numa_interleave);
 }
 
 static void *distrib_construct(int node_type, unsigned short daemon)
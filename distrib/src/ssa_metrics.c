@@ -0,0 +1 @@
+../../shared/ssa_metrics.c
\ No newline at end of file
@@ -80,6 +80,7 @@ struct ssa_class;
 struct ssa_device;
 struct ssa_port;
 struct ssa_svc;
+struct ssa_admin_epoch_trace_rec;
 
 enum ssa_addr_type {
 	SSA_ADDR_NAME,
@@ -214,6 +215,7 @@ struct ssa_conn {
 	uint32_t		epoch_len;
 	uint16_t		remote_lid;
 	int			reconnect_count;
+	struct timeval		xfer_start;	/* of current DB transfer */
 };
 
 enum ssa_svc_state {
@@ -353,6 +355,13 @@ long  ssa_get_runtime_counter(int id);
 long  ssa_inc_runtime_counter(int id);
 void ssa_set_runtime_counter_time(int id);
 int ssa_get_runtime_counter_time(int id, struct timeval *time_stamp);
+void ssa_hist_record(int id, uint64_t usec);
+void ssa_hist_record_since(int id, const struct timeval *start);
+void ssa_hist_get(int id, uint64_t *buckets);
+uint64_t ssa_hist_get_sum(int id);
+uint32_t ssa_epoch_trace_time(void);
+void ssa_epoch_trace(uint64_t epoch, uint32_t origin_time, int stage);
+int ssa_epoch_trace_get(struct ssa_admin_epoch_trace_rec *recs, int n);
 void ssa_db_update_change_counters(uint64_t epoch);
 
 const char *month_str[12];
@@ -94,7 +94,7 @@ struct db_def {
 	char		name[DB_NAME_LEN];
 	be64_t		epoch;
 	be32_t		table_def_size;
-	uint8_t		reserved2[4];
+	be32_t		origin_time;	/* epoch publish time at the core, msec (low 32 bits) */
 };
 
 enum {
@@ -328,6 +328,8 @@ void ssa_db_field_def_insert(struct db_field_def * p_tbl,
  * @pp_field_tables - database tables fields definitions
  * @p_db_tables - datasets of database data tables
  * @pp_tables - database data tables
+ * @p_map - file mapping holding the data and field tables, if any
+ * @map_len - length of the file mapping
  *
  * All data that belongs to a certain database is unified under
  * a single "ssa_db" structure. It includes:
@@ -395,6 +397,11 @@ void ssa_db_field_def_insert(struct db_field_def * p_tbl,
  * [3] ssa_db_init() method has to be called with the arguments that
  *     were defined at stage 1.
  *
+ * ssa_db_alloc() places the ssa_db structure, its definition tables and
+ * all of its data and field tables in one allocation, so an ssa_db is
+ * destroyed with a single free and copied with a single memcpy.  Tables
+ * attached later (ssa_db_attach) are allocated on their own.
+ *
  */
 struct ssa_db {
 	struct db_def		db_def;
@@ -408,8 +415,31 @@ struct ssa_db {
 	struct db_dataset	*p_db_tables;
 	void			**pp_tables;
 	uint64_t		data_tbl_cnt;
+
+	void			*p_map;
+	size_t			map_len;
+
+	/* single allocation holding this structure and its tables */
+	void			*p_arena;
+	size_t			arena_len;
+	size_t			arena_map_len;	/* 0 when malloc'ed */
 };
 
+/*
+ * Memory policy for large SSA DB tables - set through ibssa_opts.cfg.
+ */
+enum ssa_db_hugepages {
+	SSA_DB_HUGEPAGES_NONE = 0,
+	SSA_DB_HUGEPAGES_THP,		/* transparent hugepages */
+	SSA_DB_HUGEPAGES_2M,		/* hugetlbfs 2 MB pages */
+	SSA_DB_HUGEPAGES_1G		/* hugetlbfs 1 GB pages */
+};
+
+extern int db_hugepages;
+extern int db_numa_interleave;
+
+void ssa_db_tbl_advise(void *tbl, size_t len);
+
 struct ssa_db *ssa_db_alloc(uint64_t * p_num_recs_arr,
 			    size_t * p_recs_size_arr,
 			    uint64_t * p_num_field_recs_arr,
@@ -430,6 +460,8 @@ uint64_t ssa_db_calculate_data_tbl_num(const struct ssa_db *p_ssa_db);
 uint64_t ssa_db_get_epoch(const struct ssa_db *p_ssa_db, uint8_t tbl_id);
 uint64_t ssa_db_set_epoch(struct ssa_db *p_ssa_db, uint8_t tbl_id, uint64_t epoch);
 uint64_t ssa_db_increment_epoch(struct ssa_db *p_ssa_db, uint8_t tbl_id);
+uint32_t ssa_db_get_origin_time(const struct ssa_db *p_ssa_db);
+void ssa_db_set_origin_time(struct ssa_db *p_ssa_db, uint32_t origin_time);
 
 /**
  * ssa_db_attach():
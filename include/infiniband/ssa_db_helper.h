@@ -49,9 +49,18 @@ BEGIN_C_DECLS
 enum ssa_db_helper_mode {
 	SSA_DB_HELPER_STANDARD = 1,
 	SSA_DB_HELPER_DEBUG,
-	SSA_DB_HELPER_HUMAN
+	SSA_DB_HELPER_HUMAN,
+	SSA_DB_HELPER_MMAP
 };
 
+/*
+ * SSA_DB_HELPER_MMAP mode keeps the whole SSA DB in a single versioned
+ * binary file inside the DB directory.  On load the file is mapped
+ * (private, copy on write) and the data and field tables point directly
+ * into the mapping, which is released by ssa_db_destroy().
+ */
+#define SSA_DB_HELPER_MMAP_NAME		"ssa_db.bin"
+
 
 /****f* SSA DB helper
  * NAME
@@ -101,7 +110,9 @@ struct ssa_db *ssa_db_load(const char *path_dir, enum ssa_db_helper_mode mode);
 *		[in] The mode of data loaded from disk
 *
 * RETURN VALUE
-*	This function returns ssa_db structure with loaded data
+*	This function returns ssa_db structure with loaded data,
+*	or NULL if it could not be loaded (in SSA_DB_HELPER_MMAP mode
+*	also if the DB file is missing or corrupted)
 *
 * SEE ALSO
 *
@@ -109,6 +109,18 @@ extern ssa_pr_status_t ssa_pr_whole_world(struct ssa_db *p_ssa_db_smdb,
 					  ssa_pr_path_dump_t dump_clbk,
 					  void *clbk_prm);
 
+/* ssa_pr_path_hops function returns the number of switches the LFTs
+ * 					route through from source LID to destination LID.
+ * @p_ssa_db_smdb	- input smdb database
+ * @p_ctnx			- context, as for ssa_pr_half_world
+ * @source_lid		- source port LID in network order
+ * @dest_lid		- destination port LID in network order
+ *
+ * @return value: number of hops, < 0 - no path or port is absent
+ */
+extern int ssa_pr_path_hops(struct ssa_db *p_ssa_db_smdb, void *p_ctnx,
+			    be16_t source_lid, be16_t dest_lid);
+
 #ifdef __cplusplus
 }
 #endif
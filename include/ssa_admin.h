@@ -52,6 +52,9 @@ enum {
 	SSA_ADMIN_CMD_COUNTER,
 	SSA_ADMIN_CMD_PING,
 	SSA_ADMIN_CMD_NODE_INFO,
+	SSA_ADMIN_CMD_HISTOGRAM,
+	SSA_ADMIN_CMD_EPOCH_TRACE,
+	SSA_ADMIN_CMD_AGGREGATE,
 	SSA_ADMIN_CMD_MAX
 };
 
@@ -69,6 +72,8 @@ enum ssa_admin_counter_id {
 	COUNTER_ID_TIME_LAST_SSA_MAD_RCV,
 	COUNTER_ID_TIME_LAST_ERR,
 	COUNTER_ID_DB_EPOCH,
+	COUNTER_ID_SMDB_EVENTS,
+	COUNTER_ID_SMDB_EPOCHS,
 	COUNTER_ID_LAST
 };
 
@@ -92,9 +97,118 @@ static const enum ssa_counter_type ssa_admin_counters_type[] = {
 	[COUNTER_ID_TIME_LAST_DOWNSTR_CONN] = ssa_counter_timestamp,
 	[COUNTER_ID_TIME_LAST_SSA_MAD_RCV] = ssa_counter_timestamp,
 	[COUNTER_ID_TIME_LAST_ERR] = ssa_counter_timestamp,
-	[COUNTER_ID_DB_EPOCH] =ssa_counter_numeric
+	[COUNTER_ID_DB_EPOCH] =ssa_counter_numeric,
+	[COUNTER_ID_SMDB_EVENTS] = ssa_counter_numeric,
+	[COUNTER_ID_SMDB_EPOCHS] = ssa_counter_numeric
 };
 
+enum ssa_admin_hist_id {
+	HIST_ID_SMDB_EXTRACT = 0,
+	HIST_ID_SMDB_COMPARE,
+	HIST_ID_PRDB_CALC,
+	HIST_ID_DB_RECV,
+	HIST_ID_DB_SEND,
+	HIST_ID_ACM_CACHE_UPDATE,
+	HIST_ID_LAST
+};
+
+/*
+ * Latency histograms count microseconds in log-linear buckets: values
+ * below 4 have a bucket each, above that each power of two is split
+ * into 4 buckets.  The last bucket also counts everything beyond it
+ * (above about two hours).
+ */
+#define SSA_ADMIN_HIST_BUCKETS	128
+
+static inline int ssa_admin_hist_bucket(uint64_t usec)
+{
+	int exp, bucket;
+
+	if (usec < 4)
+		return (int) usec;
+
+	exp = 63 - __builtin_clzll(usec);
+	bucket = (exp - 1) * 4 + (int) ((usec >> (exp - 2)) & 3);
+	return bucket < SSA_ADMIN_HIST_BUCKETS ?
+	       bucket : SSA_ADMIN_HIST_BUCKETS - 1;
+}
+
+/* Lowest value counted in the bucket */
+static inline uint64_t ssa_admin_hist_bucket_low(int bucket)
+{
+	if (bucket < 4)
+		return bucket;
+
+	return (uint64_t) (4 + bucket % 4) << (bucket / 4 - 1);
+}
+
+/*
+ * Epoch propagation trace.  The core stamps each SMDB epoch with its
+ * publish time (db_def origin_time, low 32 bits of wall clock msec),
+ * which PRDBs computed from that SMDB inherit.  Every node records,
+ * per origin time, when the epoch arrived, when it was applied (the
+ * last PRDB computed on access nodes) and when it was last forwarded
+ * downstream.  Times are comparable across nodes with synchronized
+ * clocks.
+ */
+#define SSA_ADMIN_EPOCH_TRACE_NUM	16
+
+enum ssa_epoch_trace_stage {
+	SSA_EPOCH_ARRIVE = 0,
+	SSA_EPOCH_APPLY,
+	SSA_EPOCH_FORWARD,
+	SSA_EPOCH_STAGE_NUM
+};
+
+struct ssa_admin_epoch_trace_rec {
+	be64_t		epoch;		/* of the database held by the node */
+	be32_t		origin_time;
+	be32_t		stage_time[SSA_EPOCH_STAGE_NUM];	/* 0 if not reached */
+};
+
+struct ssa_admin_epoch_trace {
+	uint8_t		node_type;
+	uint8_t		reserved;
+	be16_t		n;
+	uint8_t		reserved2[4];
+	struct ssa_admin_epoch_trace_rec recs[0];
+};
+
+/*
+ * Aggregate query.  Every node forwards the request to the admin port
+ * of its downstream nodes, merges their answers with its own counters
+ * and histograms and answers upward, so the client gets the totals of
+ * the whole subtree from a single connection.  Each level passes on
+ * 3/4 of the time it was given.  Timestamp counters are carried as
+ * wall clock msec, counters that were never set are left out.
+ *
+ * The request holds the header only.  A response is followed by n
+ * counters and hist_n * bucket_num histogram buckets, summed over the
+ * subtree.
+ */
+#define SSA_ADMIN_AGGR_DEPTH		16
+#define SSA_ADMIN_AGGR_NODE_TYPES	4	/* one per SSA_NODE_xxx bit */
+
+struct ssa_admin_aggr_counter {
+	be64_t		sum;
+	be64_t		min;
+	be64_t		max;
+	be32_t		nodes;		/* nodes the counter is set on */
+	uint8_t		reserved[4];
+};
+
+struct ssa_admin_aggregate {
+	be16_t		depth;		/* levels left to forward the request */
+	be16_t		n;
+	be32_t		timeout;	/* msec left to answer */
+	be32_t		nodes;		/* nodes that answered */
+	be32_t		failed;		/* downstream nodes that did not */
+	be32_t		type_nodes[SSA_ADMIN_AGGR_NODE_TYPES];
+	be16_t		hist_n;
+	be16_t		bucket_num;
+	uint8_t		reserved[4];
+	struct ssa_admin_aggr_counter counters[0];
+};
 
 struct ssa_admin_counter {
 	be16_t		n;
@@ -125,6 +239,14 @@ struct ssa_admin_node_info {
 	uint8_t		connections[0];
 };
 
+/* n histograms of bucket_num bucket counts each follow the header */
+struct ssa_admin_histogram {
+	be16_t		n;
+	be16_t		bucket_num;
+	uint8_t		reserved[4];
+	be64_t		buckets[0];
+};
+
 /*
  * ssa_admin_msg_hdr:
  * @version   - version of this structure
@@ -155,6 +277,9 @@ struct ssa_admin_msg {
 	union {
 		struct ssa_admin_counter	counter;
 		struct ssa_admin_node_info	node_info;
+		struct ssa_admin_histogram	histogram;
+		struct ssa_admin_epoch_trace	epoch_trace;
+		struct ssa_admin_aggregate	aggregate;
 	} data;
 };
 
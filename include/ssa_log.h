@@ -36,6 +36,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -51,21 +52,57 @@ enum {
 	SSA_LOG_ALL		= 0xFFFFFFFF,
 };
 
+/*
+ * Levels built into the binary.  Release builds (SSA_LOG_RELEASE)
+ * compile verbose and control messages out altogether.
+ */
+#ifdef SSA_LOG_RELEASE
+#define SSA_LOG_COMPILED	(SSA_LOG_ALL & ~(SSA_LOG_VERBOSE | SSA_LOG_CTRL))
+#else
+#define SSA_LOG_COMPILED	SSA_LOG_ALL
+#endif
+
+/* Current log level, use ssa_set_log_level to change it */
+extern int ssa_log_mask;
+
+#define ssa_log_enabled(level) \
+	(((level) & SSA_LOG_COMPILED) && ((level) & ssa_log_mask))
+
 void ssa_set_log_level(int level);
 int ssa_get_log_level(void);
 int  ssa_open_log(char *log_file);
 void ssa_close_log(void);
 void ssa_write_log(int level, const char *format, ...);
 void ssa_report_error(int level, int error, const char *format, ...);
+/* Arguments are only evaluated if the level is enabled */
 #define ssa_log(level, format, ...) \
-	ssa_write_log(level, "%s: "format, __func__, ## __VA_ARGS__)
-#define ssa_log_func(level) ssa_log(level, "\n");
+	do { \
+		if (ssa_log_enabled(level)) \
+			ssa_write_log(level, "%s: "format, __func__, ## __VA_ARGS__); \
+	} while (0)
+#define ssa_log_func(level) ssa_log(level, "\n")
 #define ssa_log_err(level, format, ...) \
 	ssa_report_error(level | SSA_LOG_DEFAULT, errno, "%s: ERROR - "format, __func__, ## __VA_ARGS__)
 #define ssa_log_warn(level, format, ...) \
-	ssa_write_log(level | SSA_LOG_DEFAULT, "%s: WARNING - "format, __func__, ## __VA_ARGS__)
+	ssa_log(level | SSA_LOG_DEFAULT, "WARNING - "format, ## __VA_ARGS__)
+
+struct ssa_log_ratelimit {
+	time_t		interval_start;
+	uint32_t	printed;
+	uint32_t	suppressed;
+};
+
+/* At most log_rate_limit messages per second from a call site */
+int ssa_log_ratelimit(struct ssa_log_ratelimit *rl, int level,
+		      const char *func);
+void ssa_flush_log(void);
 void ssa_sprint_addr(int level, char *str, size_t str_size,
 		     int addr_type, uint8_t *addr, size_t addr_size);
+#define ssa_sprint_addr(level, ...) \
+	do { \
+		if (ssa_log_enabled(level)) \
+			(ssa_sprint_addr)(level, __VA_ARGS__); \
+	} while (0)
 void ssa_log_options(void);
 
 #ifdef __cplusplus
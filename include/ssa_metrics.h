@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2015 Mellanox Technologies LTD. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef _SSA_METRICS_H
+#define _SSA_METRICS_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Metrics export in the Prometheus text exposition format.  When
+ * metrics_port and/or metrics_socket are configured, a METRICS thread
+ * answers every connection with a plain HTTP/1.0 response holding the
+ * runtime counters, latency histograms, sizes of the last SMDB/PRDB
+ * and whatever the registered callbacks print.
+ *
+ * Scrapes only read atomics and snapshots taken when a DB is applied,
+ * so they never take a lock used on the data path.
+ */
+#define SSA_METRICS_CB_MAX	8
+
+enum {
+	SSA_METRICS_SMDB = 0,
+	SSA_METRICS_PRDB,
+	SSA_METRICS_DB_NUM
+};
+
+struct ssa_db;
+
+typedef void (*ssa_metrics_cb)(FILE *out, void *context);
+
+int ssa_metrics_register(ssa_metrics_cb cb, void *context);
+void ssa_metrics_set_db(int db, const struct ssa_db *ssa_db);
+void ssa_metrics_header(FILE *out, const char *name, const char *type,
+			const char *help);
+int ssa_metrics_start(int node_type);
+void ssa_metrics_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SSA_METRICS_H */
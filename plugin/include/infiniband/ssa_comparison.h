@@ -53,24 +53,24 @@ struct ssa_db_diff {
 	struct ssa_db		*p_smdb;
 
 	/***** guid_to_lid_tbl changes tracking **********/
-	cl_qmap_t ep_guid_to_lid_tbl_added;
-	cl_qmap_t ep_guid_to_lid_tbl_removed;
+	struct ep_idx_tbl ep_guid_to_lid_tbl_added;
+	struct ep_idx_tbl ep_guid_to_lid_tbl_removed;
 	/*************************************************/
 	/********* node_tbl  changes tracking ************/
-	cl_qmap_t ep_node_tbl_added;
-	cl_qmap_t ep_node_tbl_removed;
+	struct ep_idx_tbl ep_node_tbl_added;
+	struct ep_idx_tbl ep_node_tbl_removed;
 	/*************************************************/
 	/********** port_tbl changes tracking ************/
-	cl_qmap_t ep_port_tbl_added;
-	cl_qmap_t ep_port_tbl_removed;
+	struct ep_idx_tbl ep_port_tbl_added;
+	struct ep_idx_tbl ep_port_tbl_removed;
 	/*************************************************/
 	/********** LFT changes tracking *****************/
 	cl_qmap_t ep_lft_block_tbl;
 	cl_qmap_t ep_lft_top_tbl;
 	/*************************************************/
 	/********** link_tbl changes tracking ************/
-	cl_qmap_t ep_link_tbl_added;
-	cl_qmap_t ep_link_tbl_removed;
+	struct ep_idx_tbl ep_link_tbl_added;
+	struct ep_idx_tbl ep_link_tbl_removed;
 	/*************************************************/
 
 	/* TODO: add support for changes in SLVL and in future for QoS and LFTs */
@@ -81,6 +81,8 @@ struct ssa_db_diff *ssa_db_diff_init(uint64_t epoch, uint64_t data_rec_cnt[SMDB_
 void ssa_db_diff_destroy(struct ssa_db_diff * p_ssa_db_diff);
 struct ssa_db_diff *ssa_db_compare(struct ssa_database * ssa_db,
 				   uint64_t epoch_prev, int first);
+struct ssa_db_diff *ssa_db_compare_lfts(struct ssa_database * ssa_db,
+					uint64_t epoch_prev);
 
 END_C_DECLS
 #endif				/* _SSA_COMPARISON_H_ */
@@ -53,6 +53,21 @@ struct ep_map_rec {
 	uint64_t	offset;
 };
 
+/*
+ * Flat key index over an extracted table.  Once sorted, two versions of
+ * a table are compared by a linear merge of their indexes.
+ */
+struct ep_rec_idx {
+	uint64_t	key;
+	uint64_t	offset;
+};
+
+struct ep_idx_tbl {
+	struct ep_rec_idx	*p_recs;
+	uint64_t		count;
+	uint64_t		max;
+};
+
 struct ssa_db_lft {
 	struct smdb_lft_top	*p_db_lft_top_tbl;
 	struct smdb_lft_block	*p_db_lft_block_tbl;
@@ -74,10 +89,10 @@ struct ssa_db_extract {
 	be16_t			*p_pkey_tbl;
 	uint64_t		pkey_tbl_rec_num;
 
-	cl_qmap_t ep_guid_to_lid_tbl;	/* port GUID -> offset */
-	cl_qmap_t ep_node_tbl;		/* node GUID -> offset */
-	cl_qmap_t ep_port_tbl;		/* LID + port_num based*/
-	cl_qmap_t ep_link_tbl;		/* LID + port_num based */
+	struct ep_idx_tbl ep_guid_to_lid_tbl;	/* port GUID -> offset */
+	struct ep_idx_tbl ep_node_tbl;		/* node GUID -> offset */
+	struct ep_idx_tbl ep_port_tbl;		/* LID + port_num based*/
+	struct ep_idx_tbl ep_link_tbl;		/* LID + port_num based */
 
 	/* Fabric/SM related */
 	be64_t subnet_prefix;		/* even if full PortInfo used */
@@ -90,6 +105,8 @@ struct ssa_db_extract {
 	uint8_t initialized;
 };
 
+#define SSA_DB_DIRTY_LIDS_MAX	64
+
 struct ssa_database {
 	/* mutex ??? */
 	struct ssa_db_extract *p_current_db;
@@ -98,6 +115,14 @@ struct ssa_database {
 	struct ssa_db_lft *p_lft_db;
 	pthread_mutex_t lft_rec_list_lock;
 	cl_qlist_t lft_rec_list;
+
+	/* ports reported changed by traps since the last extraction */
+	pthread_mutex_t dirty_lock;
+	uint16_t dirty_lids[SSA_DB_DIRTY_LIDS_MAX];	/* LIDs in host order */
+	int dirty_lid_cnt;
+	int dirty_full;		/* change not tied to a LID: full walk */
+	uint16_t last_dirty_lids[SSA_DB_DIRTY_LIDS_MAX];
+	int last_dirty_lid_cnt;
 };
 
 extern struct ssa_database *ssa_db;
@@ -115,5 +140,10 @@ void ep_map_rec_delete(struct ep_map_rec *p_map_rec);
 void ep_map_rec_delete_pfn(cl_map_item_t *p_map_item);
 void ep_qmap_clear(cl_qmap_t *p_map);
 void ssa_qmap_apply_func(cl_qmap_t *p_qmap, void (*destroy_pfn)(cl_map_item_t *));
+int ep_idx_tbl_init(struct ep_idx_tbl *p_tbl, uint64_t max);
+void ep_idx_tbl_destroy(struct ep_idx_tbl *p_tbl);
+int ep_idx_tbl_add(struct ep_idx_tbl *p_tbl, uint64_t key, uint64_t offset);
+void ep_idx_tbl_sort(struct ep_idx_tbl *p_tbl);
+struct ep_rec_idx *ep_idx_tbl_find(struct ep_idx_tbl *p_tbl, uint64_t key);
 END_C_DECLS
 #endif				/* _SSA_DATABASE_H_ */
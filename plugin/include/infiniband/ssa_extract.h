@@ -50,6 +50,7 @@ BEGIN_C_DECLS
 enum ssa_db_ctrl_msg_type {
 	SSA_DB_START_EXTRACT = 1,
 	SSA_DB_LFT_CHANGE,
+	SSA_DB_REROUTE,
 	SSA_DB_EXIT
 };
 
@@ -67,6 +68,12 @@ struct ssa_db_lft_change_rec {
 };
 
 struct ssa_db_extract *ssa_db_extract(osm_opensm_t *p_osm);
+struct ssa_db_extract *ssa_db_extract_incr(osm_opensm_t *p_osm,
+					   struct ssa_db_extract *p_prev,
+					   uint16_t *lids, int lid_cnt);
+void ssa_db_extract_sort(struct ssa_db_extract *p_ssa_db);
+void ssa_db_dirty_add(uint16_t lid);
+int ssa_db_dirty_get(uint16_t *lids);
 void ssa_db_validate(struct ssa_db_extract *p_ssa_db);
 void ssa_db_validate_lft(int first);
 void ssa_db_update(struct ssa_database *ssa_db);
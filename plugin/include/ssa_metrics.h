@@ -0,0 +1 @@
+../../include/ssa_metrics.h
\ No newline at end of file
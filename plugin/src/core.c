@@ -42,15 +42,18 @@
 #include <infiniband/ssa_mad.h>
 #include <infiniband/ssa_extract.h>
 #include <infiniband/ssa_comparison.h>
+#include <infiniband/ssa_path_record.h>
 #include <ssa_ctrl.h>
 #include <ssa_log.h>
 #include <infiniband/ssa_db_helper.h>
 #include <ssa_admin.h>
+#include <ssa_metrics.h>
 
 #define SSA_CORE_OPTS_FILE SSA_FILE_PREFIX "_core" SSA_OPTS_FILE_SUFFIX
 #define EXTRACT_TIMER_FD_SLOT		2
 #define TREE_BALANCE_TIMER_FD_SLOT	3
-#define FIRST_DOWNSTREAM_FD_SLOT	4
+#define EXTRACT_SCHED_TIMER_FD_SLOT	4
+#define FIRST_DOWNSTREAM_FD_SLOT	5
 
 #ifndef CORE_BALANCE_TIMEOUT
 #define CORE_BALANCE_TIMEOUT 300	/* 5 minutes in seconds */
@@ -62,6 +65,10 @@
 static char *opts_file = RDMA_CONF_DIR "/" SSA_CORE_OPTS_FILE;
 static int node_type = SSA_NODE_CORE;
 int smdb_deltas = 0;
+int smdb_diff_threads = 4;
+static int incremental_extract = 0;
+static int extract_min_interval = 0;	/* msec */
+static int extract_max_delay = 1000;	/* msec */
 static char log_file[128] = "/var/log/ibssa.log";
 static char lock_file[128] = "/var/run/ibssa.pid";
 char addr_data_file[128] = RDMA_CONF_DIR "/" SSA_HOSTS_FILE;
@@ -85,9 +92,13 @@ static int distrib_tree_level = SSA_DTREE_DEFAULT;
 static uint64_t dtree_epoch_cur = 0;
 static uint64_t dtree_epoch_prev = 0;
 static time_t join_timeout = 30; /* timeout for joining to original parent node in seconds */
+static int tree_hop_weight = 0;	/* children a parent may carry per extra switch hop */
+static int join_batch = 64;	/* joins placed per control handler wakeup */
 #endif
 
 extern int log_flush;
+extern int log_async;
+extern int log_rate_limit;
 extern int accum_log_file;
 extern int smdb_dump;
 extern int err_smdb_dump;
@@ -97,6 +108,8 @@ extern char prdb_dump_dir[128];
 extern short smdb_port;
 extern short prdb_port;
 extern short admin_port;
+extern short metrics_port;
+extern char metrics_socket[128];
 extern int keepalive;
 extern int sock_accessextract[2];
 #ifdef SIM_SUPPORT_FAKE_ACM
@@ -109,6 +122,29 @@ enum {
 	SSA_CHILD_PARENTED	= (1 << 0)
 };
 
+/* Core member lists; orphan, core and distrib lists share member entry */
+enum {
+	CORE_LIST_ORPHAN	= (1 << 0),
+	CORE_LIST_CORE		= (1 << 1),
+	CORE_LIST_DISTRIB	= (1 << 2),
+	CORE_LIST_ACCESS	= (1 << 3),
+	CORE_LIST_ENTRY		= CORE_LIST_ORPHAN | CORE_LIST_CORE | CORE_LIST_DISTRIB
+};
+
+/* Parent candidates of a layer, ordered by their number of children */
+enum {
+	CORE_HEAP_DISTRIB,	/* distrib list, keyed by child_num */
+	CORE_HEAP_ACCESS,	/* access list, keyed by access_child_num */
+	CORE_HEAP_MAX
+};
+
+struct core_heap {
+	struct ssa_member		**members;
+	int				count;
+	int				size;
+	int				layer;
+};
+
 struct ssa_member {
 	struct ssa_member_record	rec;
 	struct ssa_member		*primary;	/* parent */
@@ -118,12 +154,18 @@ struct ssa_member {
 	time_t				join_start_time;
 	uint16_t			lid;
 	uint8_t				sl;
+	uint8_t				lists;		/* CORE_LIST_* member is on */
 	atomic_t			child_num;
 	atomic_t			access_child_num; /* used when combined or access node type */
 	DLIST_ENTRY			child_list;
 	DLIST_ENTRY			access_child_list; /* used when combined or access node type */
 	DLIST_ENTRY			entry;
 	DLIST_ENTRY			access_entry;
+	struct ssa_member		*charged;	/* parent counting this member as child */
+	uint8_t				charged_type;	/* node type when charged */
+	DLIST_ENTRY			child_entry;	/* on charged parent child list */
+	int				heap_idx[CORE_HEAP_MAX];
+	int				moved_in;	/* children sent here by the current rebalance pass */
 };
 
 struct ssa_core {
@@ -134,6 +176,13 @@ struct ssa_core {
 	DLIST_ENTRY			core_list;
 	DLIST_ENTRY			distrib_list;
 	DLIST_ENTRY			access_list;
+	int				core_num;
+	int				distrib_num;
+	int				access_num;
+	struct core_heap		heap[CORE_HEAP_MAX];
+	void				*hop_context; /* LFT walk over the published SMDB */
+	struct ssa_ctrl_msg_buf		*batch; /* joins and SA responses awaiting placement */
+	int				batch_num;
 };
 
 struct ssa_extract_data {
@@ -144,7 +193,8 @@ struct ssa_extract_data {
 
 enum core_tree_action {
 	CORE_TREE_NODE_TYPE_COUNT,
-	CORE_TREE_NODE_PARENT_TEST
+	CORE_TREE_NODE_PARENT_TEST,
+	CORE_TREE_NODE_DISTANCE_TEST
 };
 
 struct core_tree_context {
@@ -171,7 +221,7 @@ static const union ibv_gid zero_gid = { {0} };
 
 /* Forward declarations */
 #ifdef SIM_SUPPORT_SMDB
-static int ssa_extract_process(osm_opensm_t *p_osm, struct ssa_db *p_ref_smdb,
+static int ssa_extract_process(osm_opensm_t *p_osm, struct ssa_db **pp_ref_smdb,
 			       int *outstanding_count);
 #endif
 
@@ -188,27 +238,264 @@ static int is_gid_not_zero(union ibv_gid *gid)
 	return ret;
 }
 
-/* Should the following two DList routines go into a new dlist.c in shared ? */
-static DLIST_ENTRY *DListFind(DLIST_ENTRY *entry, DLIST_ENTRY *list)
+static long core_heap_key(struct core_heap *heap, struct ssa_member *member)
 {
-	DLIST_ENTRY *cur_entry;
+	if (heap->layer == CORE_HEAP_ACCESS)
+		return atomic_get(&member->access_child_num);
+	return atomic_get(&member->child_num);
+}
+
+static void core_heap_set(struct core_heap *heap, int idx,
+			  struct ssa_member *member)
+{
+	heap->members[idx] = member;
+	member->heap_idx[heap->layer] = idx;
+}
 
-	for (cur_entry = list->Next; cur_entry != list;
-	     cur_entry = cur_entry->Next) {
-		if (cur_entry == entry)
-			return entry;
+static void core_heap_sift_up(struct core_heap *heap, int idx)
+{
+	struct ssa_member *member = heap->members[idx];
+	long key = core_heap_key(heap, member);
+	int parent;
+
+	while (idx > 0) {
+		parent = (idx - 1) / 2;
+		if (core_heap_key(heap, heap->members[parent]) <= key)
+			break;
+		core_heap_set(heap, idx, heap->members[parent]);
+		idx = parent;
 	}
-	return NULL;
+	core_heap_set(heap, idx, member);
 }
 
-static int DListCount(DLIST_ENTRY *list)
+static void core_heap_sift_down(struct core_heap *heap, int idx)
 {
-	DLIST_ENTRY *entry;
-	int count = 0;
+	struct ssa_member *member = heap->members[idx];
+	long key = core_heap_key(heap, member);
+	int child;
+
+	while ((child = 2 * idx + 1) < heap->count) {
+		if (child + 1 < heap->count &&
+		    core_heap_key(heap, heap->members[child + 1]) <
+		    core_heap_key(heap, heap->members[child]))
+			child++;
+		if (key <= core_heap_key(heap, heap->members[child]))
+			break;
+		core_heap_set(heap, idx, heap->members[child]);
+		idx = child;
+	}
+	core_heap_set(heap, idx, member);
+}
 
-	for (entry = list->Next; entry != list; entry = entry->Next)
-		count++;
-	return count;
+static void core_heap_insert(struct core_heap *heap, struct ssa_member *member)
+{
+	struct ssa_member **members;
+	int size;
+
+	if (heap->count == heap->size) {
+		size = heap->size ? heap->size * 2 : 64;
+		members = realloc(heap->members, size * sizeof(*members));
+		if (!members) {
+			ssa_log_err(SSA_LOG_CTRL,
+				    "unable to grow parent heap to %d\n", size);
+			return;
+		}
+		heap->members = members;
+		heap->size = size;
+	}
+	core_heap_set(heap, heap->count++, member);
+	core_heap_sift_up(heap, heap->count - 1);
+}
+
+static void core_heap_remove(struct core_heap *heap, struct ssa_member *member)
+{
+	int idx = member->heap_idx[heap->layer];
+
+	if (idx < 0)
+		return;
+
+	member->heap_idx[heap->layer] = -1;
+	if (idx == --heap->count)
+		return;
+
+	core_heap_set(heap, idx, heap->members[heap->count]);
+	core_heap_sift_up(heap, idx);
+	core_heap_sift_down(heap, heap->members[idx]->heap_idx[heap->layer]);
+}
+
+/* Restore heap order after the children counters of member changed */
+static void core_heap_update(struct ssa_core *core, struct ssa_member *member)
+{
+	struct core_heap *heap;
+	int i;
+
+	for (i = 0; i < CORE_HEAP_MAX; i++) {
+		heap = &core->heap[i];
+		if (member->heap_idx[i] < 0)
+			continue;
+		core_heap_sift_up(heap, member->heap_idx[i]);
+		core_heap_sift_down(heap, member->heap_idx[i]);
+	}
+}
+
+/*
+ * Least loaded candidate of a layer, skipping the parent the child
+ * reported as bad.  When the root is excluded, the next least loaded
+ * candidate is one of its two children.
+ */
+static struct ssa_member *core_heap_best(struct core_heap *heap,
+					 struct ssa_member *child)
+{
+	struct ssa_member *best = NULL, *member;
+	int i;
+
+	for (i = 0; i < 3 && i < heap->count; i++) {
+		member = heap->members[i];
+		if (child->rec.bad_parent &&
+		    !memcmp(child->rec.parent_gid, member->rec.port_gid, 16))
+			continue;
+		if (!best || core_heap_key(heap, member) < core_heap_key(heap, best))
+			best = member;
+		if (i == 0 && best)
+			break;
+	}
+	return best;
+}
+
+static void core_list_del(struct ssa_core *core, struct ssa_member *member,
+			  int list)
+{
+	if (!(member->lists & list))
+		return;
+
+	switch (list) {
+	case CORE_LIST_ORPHAN:
+		DListRemove(&member->entry);
+		break;
+	case CORE_LIST_CORE:
+		DListRemove(&member->entry);
+		core->core_num--;
+		break;
+	case CORE_LIST_DISTRIB:
+		DListRemove(&member->entry);
+		core->distrib_num--;
+		core_heap_remove(&core->heap[CORE_HEAP_DISTRIB], member);
+		break;
+	case CORE_LIST_ACCESS:
+		DListRemove(&member->access_entry);
+		core->access_num--;
+		core_heap_remove(&core->heap[CORE_HEAP_ACCESS], member);
+		break;
+	}
+	member->lists &= ~list;
+}
+
+/*
+ * Membership is tracked in the member itself, so adding and removing
+ * do not scan the lists.  A member is on at most one of the lists
+ * sharing its entry, so adding it to one moves it off the others.
+ */
+static void core_list_add(struct ssa_core *core, struct ssa_member *member,
+			  int list)
+{
+	if (member->lists & list)
+		return;
+
+	if (list & CORE_LIST_ENTRY) {
+		core_list_del(core, member, CORE_LIST_ORPHAN);
+		core_list_del(core, member, CORE_LIST_CORE);
+		core_list_del(core, member, CORE_LIST_DISTRIB);
+	}
+
+	switch (list) {
+	case CORE_LIST_ORPHAN:
+		DListInsertBefore(&member->entry, &core->orphan_list);
+		break;
+	case CORE_LIST_CORE:
+		DListInsertBefore(&member->entry, &core->core_list);
+		core->core_num++;
+		break;
+	case CORE_LIST_DISTRIB:
+		DListInsertBefore(&member->entry, &core->distrib_list);
+		core->distrib_num++;
+		core_heap_insert(&core->heap[CORE_HEAP_DISTRIB], member);
+		break;
+	case CORE_LIST_ACCESS:
+		DListInsertBefore(&member->access_entry, &core->access_list);
+		core->access_num++;
+		core_heap_insert(&core->heap[CORE_HEAP_ACCESS], member);
+		break;
+	}
+	member->lists |= list;
+}
+
+/*
+ * Count child as one of parent's children, or of none when parent is
+ * NULL.  The charge follows the child until it is moved or leaves, so
+ * rejoins to the same parent and departures keep the counters exact.
+ * Core nodes are not counted as children.
+ */
+static void core_charge_parent(struct ssa_core *core, struct ssa_member *child,
+			       struct ssa_member *parent)
+{
+	struct ssa_member *old = child->charged;
+
+	if (parent && (child->rec.node_type & SSA_NODE_CORE))
+		parent = NULL;
+	if (old == parent)
+		return;
+
+	if (old) {
+		DListRemove(&child->child_entry);
+		if (child->charged_type == SSA_NODE_CONSUMER)
+			atomic_dec(&old->access_child_num);
+		else
+			atomic_dec(&old->child_num);
+		core_heap_update(core, old);
+	}
+
+	child->charged = parent;
+	if (!parent)
+		return;
+
+	child->charged_type = child->rec.node_type;
+	if (child->charged_type == SSA_NODE_CONSUMER) {
+		DListInsertBefore(&child->child_entry, &parent->access_child_list);
+		atomic_inc(&parent->access_child_num);
+	} else {
+		DListInsertBefore(&child->child_entry, &parent->child_list);
+		atomic_inc(&parent->child_num);
+	}
+	core_heap_update(core, parent);
+}
+
+/* Drop all references to a member which is leaving the tree */
+static void core_release_children(struct ssa_core *core,
+				  struct ssa_member *parent)
+{
+	DLIST_ENTRY *lists[2] = { &parent->child_list, &parent->access_child_list };
+	DLIST_ENTRY *entry, *list;
+	struct ssa_member *child;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		list = lists[i];
+		entry = list->Next;
+		while (entry != list) {
+			child = container_of(entry, struct ssa_member, child_entry);
+			entry = entry->Next;
+
+			core_charge_parent(core, child, NULL);
+			if (child->primary == parent) {
+				child->primary = NULL;
+				child->primary_state = SSA_CHILD_IDLE;
+			}
+			if (child->secondary == parent) {
+				child->secondary = NULL;
+				child->secondary_state = SSA_CHILD_IDLE;
+			}
+		}
+	}
 }
 
 /*
@@ -239,25 +526,76 @@ static int DListCount(DLIST_ENTRY *list)
  * access node, this is an error and the child needs to
  * rety the join.
  *
- * Subsequent version may be based on some maximum number of hops
- * allowed between child and parent but this requires similar
- * expensive calculations like routing.
- *
- * A simpler approach would be to support a configuration file for this.
+ * When tree_hop_weight is set, the switch hops between parent and
+ * child, as routed by the LFTs of the last published (full) SMDB, are
+ * weighed together with the load: each hop beyond the first switch
+ * costs as much as tree_hop_weight children, so a parent on the
+ * child's own leaf switch is preferred unless it is that much busier.
  *
  * Another mechanism to influence the algorithm is weighting for
  * combined nodes so these handler fewer access nodes than a "pure"
  * access node when subnet has a mix of such nodes.
  */
+static int core_parent_hops(struct ssa_core *core, struct ssa_member *parent,
+			    struct ssa_member *child)
+{
+	int hops = -1;
+
+	if (!parent->lid || !child->lid)
+		return -1;
+
+	if (!core->hop_context) {
+		core->hop_context = ssa_pr_create_context();
+		if (!core->hop_context)
+			return -1;
+	}
+
+	pthread_mutex_lock(&ssa_db_diff_lock);
+	if (ssa_db_diff && ssa_db_diff->p_smdb)
+		hops = ssa_pr_path_hops(ssa_db_diff->p_smdb, core->hop_context,
+					htons(parent->lid), htons(child->lid));
+	pthread_mutex_unlock(&ssa_db_diff_lock);
+
+	return hops;
+}
+
+/*
+ * Cost of adding child to a parent which already has load children.
+ * Without a route between them (or before the first SMDB is published)
+ * only the load counts.
+ */
+static int core_parent_score(struct ssa_core *core, struct ssa_member *parent,
+			     struct ssa_member *child, int load)
+{
+	int hops;
+
+	if (!tree_hop_weight)
+		return load;
+
+	hops = core_parent_hops(core, parent, child);
+	if (hops > 1)
+		load += tree_hop_weight * (hops - 1);
+
+	return load;
+}
+
+static int core_parent_load(struct ssa_member *parent, struct ssa_member *child)
+{
+	if (child->rec.node_type == SSA_NODE_CONSUMER)
+		return atomic_get(&parent->access_child_num);
+	return atomic_get(&parent->child_num);
+}
+
 static union ibv_gid *find_best_parent(struct ssa_core *core,
 				       struct ssa_member *child,
 				       time_t join_time_passed)
 {
 	struct ssa_svc *svc;
 	DLIST_ENTRY *list = NULL, *entry;
+	struct core_heap *heap = NULL;
 	struct ssa_member *member;
 	union ibv_gid *parentgid = NULL;
-	int least_child_num;
+	int least_score, score;
 	uint8_t node_type;
 
 	if (child->primary && !child->rec.bad_parent)
@@ -287,9 +625,10 @@ static union ibv_gid *find_best_parent(struct ssa_core *core,
 		}
 
 		/* If no distribution nodes yet, parent is core */
-		if (DListCount(&core->distrib_list))
+		if (core->distrib_num) {
 			list = &core->distrib_list;
-		else {
+			heap = &core->heap[CORE_HEAP_DISTRIB];
+		} else {
 			list = NULL;
 			parentgid = &svc->port->gid;
 		}
@@ -297,43 +636,91 @@ static union ibv_gid *find_best_parent(struct ssa_core *core,
 	case SSA_NODE_CONSUMER:
 		/* If child is consumer, parent is access */
 		list = &core->access_list;
+		heap = &core->heap[CORE_HEAP_ACCESS];
 		break;
 	}
 
-	if (list) {
-		least_child_num = INT_MAX;
+	if (list && !tree_hop_weight) {
+		member = core_heap_best(heap, child);
+		parentgid = member ? (union ibv_gid *) member->rec.port_gid : NULL;
+	} else if (list) {
+		least_score = INT_MAX;
 		parentgid = NULL;
 		for (entry = list->Next; entry != list; entry = entry->Next) {
-			if (node_type == SSA_NODE_CONSUMER) {
+			if (node_type == SSA_NODE_CONSUMER)
 				member = container_of(entry, struct ssa_member,
 						      access_entry);
-				if (child->rec.bad_parent &&
-				    !memcmp(child->rec.parent_gid, member->rec.port_gid, 16))
-						continue;
-				if (atomic_get(&member->access_child_num) < least_child_num) {
-					parentgid = (union ibv_gid *) member->rec.port_gid;
-					least_child_num = atomic_get(&member->access_child_num);
-					if (!least_child_num)
-						break;
-				}
-			} else {
+			else
 				member = container_of(entry, struct ssa_member,
 						      entry);
-				if (child->rec.bad_parent &&
-				    !memcmp(child->rec.parent_gid, member->rec.port_gid, 16))
-						continue;
-				if (atomic_get(&member->child_num) < least_child_num) {
-					parentgid = (union ibv_gid *) member->rec.port_gid;
-					least_child_num = atomic_get(&member->child_num);
-					if (!least_child_num)
-						break;
-				}
+			if (child->rec.bad_parent &&
+			    !memcmp(child->rec.parent_gid, member->rec.port_gid, 16))
+					continue;
+			score = core_parent_score(core, member, child,
+						  core_parent_load(member, child));
+			if (score < least_score) {
+				parentgid = (union ibv_gid *) member->rec.port_gid;
+				least_score = score;
+				if (!least_score)
+					break;
 			}
 		}
 	}
 	return parentgid;
 }
 
+/*
+ * Cheapest node of the same layer to move child to from parent, or NULL
+ * if none is strictly cheaper than staying.  Both sides are scored with
+ * the loads as they stand at this point of the pass: children already
+ * orphaned are off their old parents, children already sent somewhere
+ * count in the target's moved_in, and the child's own share of the
+ * current parent is discounted.  The caller must charge the returned
+ * node, otherwise one cheap node attracts the whole layer at once.
+ *
+ * This only keeps a single pass from overcommitting a node.  The orphans
+ * are placed afterwards by find_best_parent, which may pick another node
+ * than the one charged, and hop counts change with the SMDB, so repeated
+ * passes are not guaranteed to settle.
+ */
+static struct ssa_member *core_closer_parent(struct ssa_core *core,
+					     struct ssa_member *child,
+					     struct ssa_member *parent)
+{
+	DLIST_ENTRY *list, *entry;
+	struct ssa_member *member, *best = NULL;
+	int cur_score, score;
+
+	if (child->rec.node_type == SSA_NODE_CONSUMER)
+		list = &core->access_list;
+	else
+		list = &core->distrib_list;
+
+	cur_score = core_parent_score(core, parent, child,
+				      core_parent_load(parent, child) +
+				      parent->moved_in - 1);
+	if (cur_score <= 0)
+		return NULL;
+
+	for (entry = list->Next; entry != list; entry = entry->Next) {
+		if (child->rec.node_type == SSA_NODE_CONSUMER)
+			member = container_of(entry, struct ssa_member,
+					      access_entry);
+		else
+			member = container_of(entry, struct ssa_member, entry);
+		if (member == parent)
+			continue;
+		score = core_parent_score(core, member, child,
+					  core_parent_load(member, child) +
+					  member->moved_in);
+		if (score < cur_score) {
+			best = member;
+			cur_score = score;
+		}
+	}
+	return best;
+}
+
 static void core_clean_tree(struct ssa_svc *svc)
 {
 	struct ssa_core *core = container_of(svc, struct ssa_core, svc);
@@ -348,6 +735,9 @@ static void core_clean_tree(struct ssa_svc *svc)
 	DListInit(&core->core_list);
 	DListInit(&core->distrib_list);
 	DListInit(&core->access_list);
+	core->core_num = core->distrib_num = core->access_num = 0;
+	core->heap[CORE_HEAP_DISTRIB].count = 0;
+	core->heap[CORE_HEAP_ACCESS].count = 0;
 }
 
 static void core_update_children_counter(struct ssa_core *core, union ibv_gid *parentgid,
@@ -356,7 +746,6 @@ static void core_update_children_counter(struct ssa_core *core, union ibv_gid *p
 	struct ssa_member_record *rec;
 	struct ssa_member *parent, *child;
 	uint8_t **member;
-	atomic_t *children_num = NULL;
 
 	member = tfind(parentgid, &core->member_map, ssa_compare_gid);
 	if (!member) {
@@ -382,17 +771,10 @@ static void core_update_children_counter(struct ssa_core *core, union ibv_gid *p
 			rec = container_of(*member, struct ssa_member_record, port_gid);
 			child = container_of(rec, struct ssa_member, rec);
 
-			if (child->rec.node_type == SSA_NODE_CONSUMER)
-				children_num = &parent->access_child_num;
-			else if ((child->rec.node_type & SSA_NODE_CORE) != SSA_NODE_CORE)
-				children_num = &parent->child_num;
-
-			if (children_num) {
-				if (increment)
-					atomic_inc(children_num);
-				else
-					atomic_dec(children_num);
-			}
+			if (increment)
+				core_charge_parent(core, child, parent);
+			else if (child->charged == parent)
+				core_charge_parent(core, child, NULL);
 		}
 	}
 }
@@ -411,24 +793,16 @@ static int core_build_tree(struct ssa_core *core, struct ssa_member *child,
 		if (parentgid)
 			ret = ssa_svc_query_path(svc, parentgid, gid);
 		if (parentgid && !ret) {
-			if (!DListFind(&child->entry, &core->distrib_list))
-				DListInsertBefore(&child->entry,
-						  &core->distrib_list);
-			if (node_type & SSA_NODE_ACCESS) {
-				if (!DListFind(&child->access_entry,
-					       &core->access_list))
-					DListInsertBefore(&child->access_entry,
-							  &core->access_list);
-			}
+			core_list_add(core, child, CORE_LIST_DISTRIB);
+			if (node_type & SSA_NODE_ACCESS)
+				core_list_add(core, child, CORE_LIST_ACCESS);
 		}
 		break;
 	case SSA_NODE_ACCESS:
 		if (parentgid)
 			ret = ssa_svc_query_path(svc, parentgid, gid);
-		if (parentgid && !ret &&
-		    !DListFind(&child->access_entry, &core->access_list))
-			DListInsertBefore(&child->access_entry,
-					  &core->access_list);
+		if (parentgid && !ret)
+			core_list_add(core, child, CORE_LIST_ACCESS);
 		break;
 	case (SSA_NODE_CORE | SSA_NODE_ACCESS):
 	case SSA_NODE_CORE:
@@ -436,14 +810,9 @@ static int core_build_tree(struct ssa_core *core, struct ssa_member *child,
 		if (parentgid)
 			ret = ssa_svc_query_path(svc, parentgid, gid);
 		if (parentgid && !ret) {
-			if (!DListFind(&child->entry, &core->core_list))
-				DListInsertBefore(&child->entry, &core->core_list);
-			if ((node_type & SSA_NODE_ACCESS) &&
-			    (!DListFind(&child->access_entry,
-					&core->access_list))) {
-				DListInsertBefore(&child->access_entry,
-						  &core->access_list);
-			}
+			core_list_add(core, child, CORE_LIST_CORE);
+			if (node_type & SSA_NODE_ACCESS)
+				core_list_add(core, child, CORE_LIST_ACCESS);
 		}
 		break;
 	case SSA_NODE_CONSUMER:
@@ -464,50 +833,16 @@ static int core_build_tree(struct ssa_core *core, struct ssa_member *child,
 static void core_update_tree(struct ssa_core *core, struct ssa_member *child,
 			     union ibv_gid *gid)
 {
-	struct ssa_member_record *rec;
-	struct ssa_member *parent;
-	uint8_t **tgid;
-	uint8_t node_type;
-
 	if (!child)
 		return;
 
 	/*
-	 * Find parent of child being removed from tree and
-	 * update the number of children.
-	 *
-	 * No way to force children to reconnect currently.
+	 * Update the number of children of the parent of the child
+	 * being removed from tree, and forget the child in its own
+	 * children, which reconnect by themselves.
 	 */
-	node_type = child->rec.node_type;
-	if (node_type & SSA_NODE_CORE)
-		return;
-	if (!child->primary) {
-		ssa_sprint_addr(SSA_LOG_DEFAULT | SSA_LOG_CTRL, log_data,
-				sizeof log_data, SSA_ADDR_GID,
-				(uint8_t *) &child->rec.port_gid,
-				sizeof child->rec.port_gid);
-		ssa_log(SSA_LOG_DEFAULT | SSA_LOG_CTRL,
-			"ERROR - no parent for GID %s\n", log_data);
-		return;
-	}
-
-	/* Should something else be done with children whose parent goes away ? */
-	tgid = tfind(&child->primary->rec.port_gid, &core->member_map, ssa_compare_gid);
-	if (!tgid) {
-		ssa_sprint_addr(SSA_LOG_DEFAULT | SSA_LOG_CTRL, log_data,
-				sizeof log_data, SSA_ADDR_GID,
-				(uint8_t *) &child->primary->rec.port_gid,
-				sizeof child->primary->rec.port_gid);
-		ssa_log(SSA_LOG_DEFAULT | SSA_LOG_CTRL,
-			"ERROR - couldn't find parent GID %s\n", log_data);
-		return;
-	}
-	rec = container_of(*tgid, struct ssa_member_record, port_gid);
-	parent = container_of(rec, struct ssa_member, rec);
-	if (node_type & SSA_NODE_CONSUMER)
-		atomic_dec(&parent->access_child_num);
-	else if ((node_type & SSA_NODE_CORE) != SSA_NODE_CORE)
-		atomic_dec(&parent->child_num);
+	core_charge_parent(core, child, NULL);
+	core_release_children(core, child);
 	child->primary = NULL;
 	child->primary_state = SSA_CHILD_IDLE;
 }
@@ -578,18 +913,13 @@ static void core_dump_tree(struct ssa_core *core, char *svc_name)
 	if (distrib_tree_level == SSA_DTREE_DEFAULT)
 		return;
 
-	list = &core->core_list;
-	for (entry = list->Next; entry != list; entry = entry->Next)
-		core_cnt++;
-
-	list = &core->distrib_list;
-	for (entry = list->Next; entry != list; entry = entry->Next)
-		distrib_cnt++;
+	core_cnt = core->core_num;
+	distrib_cnt = core->distrib_num;
+	access_cnt = core->access_num;
 
 	list = &core->access_list;
 	for (entry = list->Next; entry != list; entry = entry->Next) {
 		member = container_of(entry, struct ssa_member, access_entry);
-		access_cnt++;
 		child_list = &member->access_child_list;
 		for (child_entry = child_list->Next; child_entry != child_list;
 		     child_entry = child_entry->Next)
@@ -672,7 +1002,7 @@ static void core_dump_tree(struct ssa_core *core, char *svc_name)
 /* Caller must hold list lock. */
 static void core_adopt_orphans(DLIST_ENTRY *orphan_list, int node_type)
 {
-	DLIST_ENTRY *entry, tmp;
+	DLIST_ENTRY *entry;
 	struct ssa_core *core =
 		container_of(orphan_list, struct ssa_core, orphan_list);
 	struct ssa_member *member;
@@ -684,8 +1014,6 @@ static void core_adopt_orphans(DLIST_ENTRY *orphan_list, int node_type)
 		entry = orphan_list->Next;
 		while (entry != orphan_list) {
 			member = container_of(entry, struct ssa_member, entry);
-
-			tmp = *entry;
 			entry = entry->Next;
 
 			if (!(member->rec.node_type & node_type))
@@ -695,10 +1023,14 @@ static void core_adopt_orphans(DLIST_ENTRY *orphan_list, int node_type)
 				join_time_passed = time(NULL) - member->join_start_time;
 
 			parentgid = find_best_parent(core, member, join_time_passed);
+			core_list_del(core, member, CORE_LIST_ORPHAN);
 			ret = core_build_tree(core, member, parentgid);
 			if (!ret) {
-				DListRemove(&tmp);
 				changed = 1;
+			} else {
+				/* keep its place, ahead of the next orphan */
+				DListInsertBefore(&member->entry, entry);
+				member->lists |= CORE_LIST_ORPHAN;
 			}
 		}
 		if (changed)
@@ -716,10 +1048,30 @@ static void core_process_orphans(struct ssa_core *core)
 	pthread_mutex_unlock(&core->list_lock);
 }
 
+/* Detach child from its parent so it is adopted again */
+static void core_orphan_child(struct ssa_core *core, struct ssa_member *child,
+			      struct ssa_member *parent)
+{
+	/* Combined distribution nodes are placed with their own layer */
+	if (child->lists & (CORE_LIST_CORE | CORE_LIST_DISTRIB))
+		return;
+
+	core_charge_parent(core, child, NULL);
+
+	child->primary		= NULL;
+	child->secondary	= NULL;
+	child->primary_state	= SSA_CHILD_IDLE;
+	child->secondary_state	= SSA_CHILD_IDLE;
+	memset(child->rec.parent_gid, 0, 16);
+
+	core_list_add(core, child, CORE_LIST_ORPHAN);
+	core_list_del(core, child, CORE_LIST_ACCESS);
+}
+
 static void core_handle_node(struct ssa_member_record *rec,
 			     struct core_tree_context *context)
 {
-	struct ssa_member *parent = NULL, *child = NULL;
+	struct ssa_member *parent = NULL, *child = NULL, *closer;
 	int *context_num = NULL;
 
 	if (!(context->node_type & rec->node_type))
@@ -741,32 +1093,32 @@ static void core_handle_node(struct ssa_member_record *rec,
 			int parent_children_num = 0;
 
 			context_num = (int *) context->priv;
-			if (child->rec.node_type & SSA_NODE_ACCESS) {
+			if (child->rec.node_type & SSA_NODE_ACCESS)
 				parent_children_num = atomic_get(&parent->child_num);
-				if (*context_num < parent_children_num)
-					atomic_dec(&parent->child_num);
-			} else if (child->rec.node_type & SSA_NODE_CONSUMER) {
+			else if (child->rec.node_type & SSA_NODE_CONSUMER)
 				parent_children_num = atomic_get(&parent->access_child_num);
-				if (*context_num < parent_children_num)
-					atomic_dec(&parent->access_child_num);
-			}
 
-			if (*context_num < parent_children_num) {
-				child->primary		= NULL;
-				child->secondary	= NULL;
-				child->primary_state	= SSA_CHILD_IDLE;
-				child->secondary_state	= SSA_CHILD_IDLE;
-				memset(child->rec.parent_gid, 0, 16);
+			if (*context_num < parent_children_num)
+				core_orphan_child(context->core, child, parent);
+		}
+		break;
+	case CORE_TREE_NODE_DISTANCE_TEST:
+		child = container_of(rec, struct ssa_member, rec);
+		if (child->primary_state & SSA_CHILD_PARENTED)
+			parent = child->primary;
+		else if (child->secondary_state & SSA_CHILD_PARENTED)
+			parent = child->secondary;
 
-				DListInsertBefore(&child->entry,
-						  &context->core->orphan_list);
+		/* combined nodes stay with their own layer, see core_orphan_child */
+		if (child->lists & (CORE_LIST_CORE | CORE_LIST_DISTRIB))
+			break;
 
-				if (child->rec.node_type & SSA_NODE_ACCESS) {
-					if (DListFind(&child->access_entry,
-						      &context->core->access_list))
-						DListRemove(&child->access_entry);
-				}
-			}
+		if (parent &&
+		    (closer = core_closer_parent(context->core, child, parent))) {
+			context_num = (int *) context->priv;
+			*context_num = *context_num + 1;
+			closer->moved_in++;
+			core_orphan_child(context->core, child, parent);
 		}
 		break;
 	default:
@@ -822,6 +1174,36 @@ static void core_rebalance_tree_layer(struct ssa_core *core, int max_children,
 		child_type, ssa_node_type_str(child_type), max_children);
 }
 
+static void core_rebalance_tree_distance(struct ssa_core *core, int child_type)
+{
+	struct core_tree_context context;
+	DLIST_ENTRY *list, *entry;
+	struct ssa_member *member;
+	int moved = 0;
+
+	list = child_type == SSA_NODE_CONSUMER ?
+	       &core->access_list : &core->distrib_list;
+	for (entry = list->Next; entry != list; entry = entry->Next) {
+		if (child_type == SSA_NODE_CONSUMER)
+			member = container_of(entry, struct ssa_member,
+					      access_entry);
+		else
+			member = container_of(entry, struct ssa_member, entry);
+		member->moved_in = 0;
+	}
+
+	context.core		= core;
+	context.node_type	= child_type;
+	context.action		= CORE_TREE_NODE_DISTANCE_TEST;
+	context.priv		= &moved;
+
+	ssa_twalk(core->member_map, core_tree_callback, &context);
+
+	ssa_log(SSA_LOG_DEFAULT,
+		"child type %d (%s) %d children moved to closer parents\n",
+		child_type, ssa_node_type_str(child_type), moved);
+}
+
 /*
  * Current algorithm for distribution tree rebalancing
  * is to balance the number of children for distribution
@@ -846,6 +1228,13 @@ static void core_rebalance_tree_layer(struct ssa_core *core, int max_children,
  * Algorithm purpose is to keep ssa distribution tree
  * balanced in case of unordered ssa fabric bringup.
  *
+ * With tree_hop_weight set, the fanout limit is replaced by
+ * the cost used in find_best_parent: a child is orphaned
+ * when another parent of the layer is cheaper for it, so
+ * children drift to parents on their own leaf switch as far
+ * as the load allows.  Each move is charged to the chosen
+ * parent for the rest of the pass.
+ *
  * IMPORTANT NOTE:
  * Current rebalancing mechanism is currently only accurate at
  * initial ssa bring-up phase, because it relies
@@ -863,8 +1252,8 @@ static void core_rebalance_tree(struct ssa_core *core)
 
 	pthread_mutex_lock(&core->list_lock);
 
-	distrib_num	= DListCount(&core->distrib_list);
-	access_num	= DListCount(&core->access_list);
+	distrib_num	= core->distrib_num;
+	access_num	= core->access_num;
 
 	context.core		= core;
 	context.node_type	= SSA_NODE_CONSUMER;
@@ -873,6 +1262,14 @@ static void core_rebalance_tree(struct ssa_core *core)
 
 	ssa_twalk(core->member_map, core_tree_callback, &context);
 
+	if (tree_hop_weight) {
+		if (distrib_num > 0)
+			core_rebalance_tree_distance(core, SSA_NODE_ACCESS);
+		if (access_num > 0)
+			core_rebalance_tree_distance(core, SSA_NODE_CONSUMER);
+		goto adopt;
+	}
+
 	if (distrib_num > 0) {
 		distrib_child_max = access_num / distrib_num;
 		if (access_num % distrib_num)
@@ -893,6 +1290,7 @@ static void core_rebalance_tree(struct ssa_core *core)
 						  SSA_NODE_CONSUMER);
 	}
 
+adopt:
 	core_adopt_orphans(&core->orphan_list, SSA_NODE_ACCESS);
 	core_adopt_orphans(&core->orphan_list, SSA_NODE_CONSUMER);
 
@@ -901,17 +1299,20 @@ static void core_rebalance_tree(struct ssa_core *core)
 
 /*
  * Process received SSA membership requests.  On errors, we simply drop
- * the request and let the remote node retry.
+ * the request and let the remote node retry.  The response status is
+ * left in the MAD; the caller sends it.  Returns the orphan node types
+ * which may now be adopted by the joined member.
+ *
+ * Caller must hold list lock.
  */
-static void core_process_join(struct ssa_core *core, struct ssa_umad *umad)
+static int core_process_join(struct ssa_core *core, struct ssa_umad *umad)
 {
 	struct ssa_member_record *rec, *umad_rec;
 	struct ssa_member *member;
 	union ibv_gid *parentgid = NULL;
-	DLIST_ENTRY *entry;
 	uint8_t **tgid, node_type;
 	time_t join_time_passed = 0;
-	int ret;
+	int ret, adopt = 0;
 
 	/* TODO: verify ssa_key with core nodes */
 	umad_rec = rec = &umad->packet.ssa_mad.member;
@@ -936,7 +1337,7 @@ static void core_process_join(struct ssa_core *core, struct ssa_umad *umad)
 		ssa_log(SSA_LOG_CTRL, "adding new member\n");
 		member = calloc(1, sizeof *member);
 		if (!member)
-			return;
+			return -1;
 
 		member->rec = *rec;
 		member->lid = ntohs(umad->umad.addr.lid);
@@ -945,17 +1346,18 @@ static void core_process_join(struct ssa_core *core, struct ssa_umad *umad)
 		atomic_init(&member->access_child_num);
 		DListInit(&member->child_list);
 		DListInit(&member->access_child_list);
+		member->heap_idx[CORE_HEAP_DISTRIB] = -1;
+		member->heap_idx[CORE_HEAP_ACCESS] = -1;
 		if (!tsearch(&member->rec.port_gid, &core->member_map, ssa_compare_gid)) {
 			free(member);
-			return;
+			return -1;
 		}
 	} else {
 		rec = container_of(*tgid, struct ssa_member_record, port_gid);
 		member = container_of(rec, struct ssa_member, rec);
-		entry = DListFind(&member->entry, &core->orphan_list);
-		if (entry) {
+		if (member->lists & CORE_LIST_ORPHAN) {
 			ssa_log(SSA_LOG_CTRL, "removing member in orphan list\n");
-			DListRemove(&member->entry);
+			core_list_del(core, member, CORE_LIST_ORPHAN);
 		}
 		member->rec = *umad_rec;
 		/* Need to handle child_list/access_child_list */
@@ -979,31 +1381,34 @@ static void core_process_join(struct ssa_core *core, struct ssa_umad *umad)
 		}
 	}
 
-	ssa_log(SSA_LOG_CTRL, "sending join response: MAD status 0x%x\n",
-		ntohs(umad->packet.mad_hdr.status));
-	umad->packet.mad_hdr.method = UMAD_METHOD_GET_RESP;
-	umad_send(core->svc.port->mad_portid, core->svc.port->mad_agentid,
-		  (void *) umad, sizeof umad->packet, 0, 0);
-
 	if (first_extraction) {
 		/* member is orphaned */
-		DListInsertBefore(&member->entry, &core->orphan_list);
+		core_list_add(core, member, CORE_LIST_ORPHAN);
 	} else {
 		ret = core_build_tree(core, member, parentgid);
 		if (ret) {
 			ssa_log(SSA_LOG_CTRL, "core_build_tree failed %d\n", ret);
 			/* member is orphaned */
-			DListInsertBefore(&member->entry, &core->orphan_list);
+			core_list_add(core, member, CORE_LIST_ORPHAN);
 		} else {
-			if (member->rec.node_type & SSA_NODE_DISTRIBUTION) {
-				/* list lock is held in core_process_ssa_mad() */
-				core_adopt_orphans(&core->orphan_list, SSA_NODE_ACCESS);
-				core_adopt_orphans(&core->orphan_list, SSA_NODE_CONSUMER);
-			} else if (member->rec.node_type & SSA_NODE_ACCESS)
-				core_adopt_orphans(&core->orphan_list, SSA_NODE_CONSUMER);
+			if (member->rec.node_type & SSA_NODE_DISTRIBUTION)
+				adopt = SSA_NODE_ACCESS | SSA_NODE_CONSUMER;
+			else if (member->rec.node_type & SSA_NODE_ACCESS)
+				adopt = SSA_NODE_CONSUMER;
 			dtree_epoch_cur++;
 		}
 	}
+
+	return adopt;
+}
+
+static void core_send_join_resp(struct ssa_core *core, struct ssa_umad *umad)
+{
+	ssa_log(SSA_LOG_CTRL, "sending join response: MAD status 0x%x\n",
+		ntohs(umad->packet.mad_hdr.status));
+	umad->packet.mad_hdr.method = UMAD_METHOD_GET_RESP;
+	umad_send(core->svc.port->mad_portid, core->svc.port->mad_agentid,
+		  (void *) umad, sizeof umad->packet, 0, 0);
 }
 
 static void core_process_leave(struct ssa_core *core, struct ssa_umad *umad)
@@ -1011,8 +1416,6 @@ static void core_process_leave(struct ssa_core *core, struct ssa_umad *umad)
 	struct ssa_member_record *rec;
 	struct ssa_member *member;
 	uint8_t **tgid;
-	DLIST_ENTRY *entry;
-	uint8_t node_type;
 
 	rec = &umad->packet.ssa_mad.member;
 	ssa_sprint_addr(SSA_LOG_VERBOSE | SSA_LOG_CTRL, log_data, sizeof log_data,
@@ -1024,34 +1427,18 @@ static void core_process_leave(struct ssa_core *core, struct ssa_umad *umad)
 		ssa_log(SSA_LOG_CTRL, "removing member\n");
 		rec = container_of(*tgid, struct ssa_member_record, port_gid);
 		member = container_of(rec, struct ssa_member, rec);
-		entry = DListFind(&member->entry, &core->orphan_list);
-		if (entry) {
+		if (member->lists & CORE_LIST_ORPHAN)
 			ssa_log(SSA_LOG_CTRL, "in orphan list\n");
-			DListRemove(&member->entry);
-		}
-		node_type = member->rec.node_type;
-		if (node_type & SSA_NODE_CORE) {
-			entry = DListFind(&member->entry, &core->core_list);
-			if (entry) {
-				ssa_log(SSA_LOG_CTRL, "in core list\n");
-				DListRemove(&member->entry);	
-			}
-		}
-		if (node_type & SSA_NODE_DISTRIBUTION) {
-			entry = DListFind(&member->entry, &core->distrib_list);
-			if (entry) {
-				ssa_log(SSA_LOG_CTRL, "in distrib list\n");
-				DListRemove(&member->entry);
-			}
-		}
-		if (node_type & SSA_NODE_ACCESS) {
-			entry = DListFind(&member->access_entry,
-					  &core->access_list);
-			if (entry) {
-				ssa_log(SSA_LOG_CTRL, "in access list\n");
-				DListRemove(&member->access_entry);
-			}
-		}
+		if (member->lists & CORE_LIST_CORE)
+			ssa_log(SSA_LOG_CTRL, "in core list\n");
+		if (member->lists & CORE_LIST_DISTRIB)
+			ssa_log(SSA_LOG_CTRL, "in distrib list\n");
+		if (member->lists & CORE_LIST_ACCESS)
+			ssa_log(SSA_LOG_CTRL, "in access list\n");
+		core_list_del(core, member, CORE_LIST_ORPHAN);
+		core_list_del(core, member, CORE_LIST_CORE);
+		core_list_del(core, member, CORE_LIST_DISTRIB);
+		core_list_del(core, member, CORE_LIST_ACCESS);
 		core_update_tree(core, member, (union ibv_gid *) rec->port_gid);
 		tdelete(rec->port_gid, &core->member_map, ssa_compare_gid);
 		free(member);
@@ -1163,6 +1550,89 @@ static void core_process_path_rec(struct ssa_core *core, struct sa_umad *umad)
 			"ERROR - failed to send set parent\n");
 }
 
+/*
+ * Joins and the SA PathRecord responses which complete them are queued
+ * while further control messages are pending, so a join storm (e.g.
+ * after SM failover) is placed under a single list lock pass, with one
+ * orphan adoption pass per batch instead of one per join.  The join
+ * responses and parent set MADs are then sent back to back.
+ */
+static int core_batch_msg(struct ssa_ctrl_msg_buf *msg)
+{
+	struct ssa_mad_packet *mad;
+
+	switch (msg->hdr.type) {
+	case SSA_CTRL_MAD:
+		mad = &msg->data.umad.packet;
+		return !msg->data.umad.umad.status &&
+		       mad->mad_hdr.method == UMAD_METHOD_SET &&
+		       ntohs(mad->mad_hdr.attr_id) == SSA_ATTR_MEMBER_REC;
+	case SSA_SA_MAD:
+		return !msg->data.umad_sa.umad.status &&
+		       msg->data.umad_sa.sa_mad.packet.mad_hdr.method ==
+		       UMAD_METHOD_GET_RESP &&
+		       ntohs(msg->data.umad_sa.sa_mad.packet.mad_hdr.attr_id) ==
+		       UMAD_SA_ATTR_PATH_REC;
+	default:
+		return 0;
+	}
+}
+
+static int core_msg_pending(struct ssa_svc *svc)
+{
+	struct pollfd fd;
+
+	fd.fd = svc->sock_upctrl[1];
+	fd.events = POLLIN;
+	fd.revents = 0;
+	return poll(&fd, 1, 0) > 0;
+}
+
+static void core_flush_batch(struct ssa_core *core)
+{
+	struct ssa_ctrl_msg_buf *msg;
+	int i, ret, adopt = 0;
+
+	if (!core->batch_num)
+		return;
+
+	ssa_log(SSA_LOG_VERBOSE | SSA_LOG_CTRL, "%s placing %d messages\n",
+		core->svc.name, core->batch_num);
+
+	pthread_mutex_lock(&core->list_lock);
+	for (i = 0; i < core->batch_num; i++) {
+		msg = &core->batch[i];
+		if (msg->hdr.type == SSA_SA_MAD) {
+			core_process_path_rec(core, &msg->data.umad_sa);
+			continue;
+		}
+		ret = core_process_join(core, &msg->data.umad);
+		if (ret < 0)
+			msg->hdr.type = SSA_CTRL_ACK;	/* dropped */
+		else
+			adopt |= ret;
+	}
+	if (adopt & SSA_NODE_ACCESS)
+		core_adopt_orphans(&core->orphan_list, SSA_NODE_ACCESS);
+	if (adopt & SSA_NODE_CONSUMER)
+		core_adopt_orphans(&core->orphan_list, SSA_NODE_CONSUMER);
+	pthread_mutex_unlock(&core->list_lock);
+
+	for (i = 0; i < core->batch_num; i++) {
+		msg = &core->batch[i];
+		if (msg->hdr.type == SSA_CTRL_MAD)
+			core_send_join_resp(core, &msg->data.umad);
+	}
+	core->batch_num = 0;
+}
+
+static void core_queue_msg(struct ssa_core *core, struct ssa_ctrl_msg_buf *msg)
+{
+	memcpy(&core->batch[core->batch_num++], msg, msg->hdr.len);
+	if (core->batch_num >= join_batch || !core_msg_pending(&core->svc))
+		core_flush_batch(core);
+}
+
 static int core_process_sa_mad(struct ssa_svc *svc, struct ssa_ctrl_msg_buf *msg)
 {
 	struct ibv_path_record *path;
@@ -1181,7 +1651,9 @@ static int core_process_sa_mad(struct ssa_svc *svc, struct ssa_ctrl_msg_buf *msg
 		    UMAD_SA_ATTR_PATH_REC) {
 			core = container_of(svc, struct ssa_core, svc);
 			path = &umad_sa->sa_mad.path_rec.path;
+			pthread_mutex_lock(&core->list_lock);
 			core_update_children_counter(core, &path->dgid, &path->sgid, 0);
+			pthread_mutex_unlock(&core->list_lock);
 		}
 
 		return 1;
@@ -1193,7 +1665,9 @@ static int core_process_sa_mad(struct ssa_svc *svc, struct ssa_ctrl_msg_buf *msg
 	case UMAD_METHOD_GET_RESP:
 		if (ntohs(umad_sa->sa_mad.packet.mad_hdr.attr_id) ==
 		    UMAD_SA_ATTR_PATH_REC) {
+			pthread_mutex_lock(&core->list_lock);
 			core_process_path_rec(core, umad_sa);
+			pthread_mutex_unlock(&core->list_lock);
 			return 1;
 		}
 		break;
@@ -1228,14 +1702,6 @@ static int core_process_ssa_mad(struct ssa_svc *svc, struct ssa_ctrl_msg_buf *ms
 	core = container_of(svc, struct ssa_core, svc);
 
 	switch (umad->packet.mad_hdr.method) {
-	case UMAD_METHOD_SET:
-		if (ntohs(umad->packet.mad_hdr.attr_id) == SSA_ATTR_MEMBER_REC) {
-			pthread_mutex_lock(&core->list_lock);
-			core_process_join(core, umad);
-			pthread_mutex_unlock(&core->list_lock);
-			return 1;
-		}
-		break;
 	case SSA_METHOD_DELETE:
 		if (ntohs(umad->packet.mad_hdr.attr_id) == SSA_ATTR_MEMBER_REC) {
 			pthread_mutex_lock(&core->list_lock);
@@ -1280,7 +1746,17 @@ static int core_process_dev_event(struct ssa_svc *svc, struct ssa_ctrl_msg_buf *
 
 static int core_process_msg(struct ssa_svc *svc, struct ssa_ctrl_msg_buf *msg)
 {
+	struct ssa_core *core = container_of(svc, struct ssa_core, svc);
+
 	ssa_log(SSA_LOG_VERBOSE | SSA_LOG_CTRL, "%s\n", svc->name);
+	if (core_batch_msg(msg)) {
+		core_queue_msg(core, msg);
+		return 1;
+	}
+
+	/* keep ordering with respect to queued joins */
+	core_flush_batch(core);
+
 	switch(msg->hdr.type) {
 	case SSA_CTRL_MAD:
 		return core_process_ssa_mad(svc, msg);
@@ -1328,6 +1804,18 @@ static int core_init_svc(struct ssa_svc *svc)
 	DListInit(&core->core_list);
 	DListInit(&core->distrib_list);
 	DListInit(&core->access_list);
+	core->heap[CORE_HEAP_DISTRIB].layer = CORE_HEAP_DISTRIB;
+	core->heap[CORE_HEAP_ACCESS].layer = CORE_HEAP_ACCESS;
+
+	if (join_batch < 1)
+		join_batch = 1;
+	core->batch = calloc(join_batch, sizeof(*core->batch));
+	if (!core->batch) {
+		ssa_log_err(SSA_LOG_DEFAULT,
+			    "unable to allocate join batch of %d\n", join_batch);
+		pthread_mutex_destroy(&core->list_lock);
+		return -1;
+	}
 	return 0;
 }
 
@@ -1346,6 +1834,11 @@ static void core_destroy_svc(struct ssa_svc *svc)
 	ssa_log_func(SSA_LOG_CTRL);
 	if (core->member_map)
 		tdestroy(core->member_map, core_free_member);
+	if (core->hop_context)
+		ssa_pr_destroy_context(core->hop_context);
+	free(core->heap[CORE_HEAP_DISTRIB].members);
+	free(core->heap[CORE_HEAP_ACCESS].members);
+	free(core->batch);
 	pthread_mutex_destroy(&core->list_lock);
 }
 #endif
@@ -1373,6 +1866,24 @@ static void handle_trap_event(ib_mad_notice_attr_t *p_ntc)
 			ib_notice_get_type(p_ntc),
 			ntohs(p_ntc->g_or_v.generic.trap_num),
 			ntohs(p_ntc->issuer_lid));
+
+		/* remember the port so the next extraction may skip the walk */
+		switch (ntohs(p_ntc->g_or_v.generic.trap_num)) {
+		case 128:
+			ssa_db_dirty_add(ntohs(p_ntc->data_details.ntc_128.sw_lid));
+			break;
+		case 129:
+		case 130:
+		case 131:
+			ssa_db_dirty_add(ntohs(p_ntc->data_details.ntc_129_131.lid));
+			break;
+		case 144:
+			ssa_db_dirty_add(ntohs(p_ntc->data_details.ntc_144.lid));
+			break;
+		default:
+			ssa_db_dirty_add(0);
+			break;
+		}
 	} else {
 		ssa_log(SSA_LOG_DEFAULT | SSA_LOG_VERBOSE,
 			"Vendor trap type %d from LID %u\n",
@@ -1477,8 +1988,52 @@ static void ssa_extract_db_update(struct ssa_db *db, int db_changed)
 }
 #endif
 
+/*
+ * Stamp a new SMDB epoch with its publish time, which is carried down
+ * the tree so every node can report how long the epoch took to reach it.
+ */
+static void core_stamp_epoch(struct ssa_db *smdb)
+{
+	uint64_t epoch = ssa_db_get_epoch(smdb, DB_DEF_TBL_ID);
+	uint32_t origin_time = ssa_epoch_trace_time();
+
+	ssa_db_set_origin_time(smdb, origin_time);
+	ssa_epoch_trace(epoch, origin_time, SSA_EPOCH_ARRIVE);
+	ssa_epoch_trace(epoch, origin_time, SSA_EPOCH_APPLY);
+}
+
+/*
+ * Tree membership and joins waiting for placement.  Counts are read
+ * without list_lock, a scrape may be off by a join in progress.
+ */
+static void core_metrics(FILE *out, void *context)
+{
+	struct ssa_core *core;
+	int i;
+
+	ssa_metrics_header(out, "ssa_core_members", "gauge",
+			   "Nodes in the distribution tree");
+	for (i = 0; i < extract_data.num_svcs; i++) {
+		core = (struct ssa_core *) extract_data.svcs[i];
+		fprintf(out, "ssa_core_members{svc=\"%s\",node_type=\"core\"} %d\n",
+			core->svc.name, core->core_num);
+		fprintf(out, "ssa_core_members{svc=\"%s\",node_type=\"distrib\"} %d\n",
+			core->svc.name, core->distrib_num);
+		fprintf(out, "ssa_core_members{svc=\"%s\",node_type=\"access\"} %d\n",
+			core->svc.name, core->access_num);
+	}
+
+	ssa_metrics_header(out, "ssa_core_join_batch", "gauge",
+			   "Joins awaiting placement");
+	for (i = 0; i < extract_data.num_svcs; i++) {
+		core = (struct ssa_core *) extract_data.svcs[i];
+		fprintf(out, "ssa_core_join_batch{svc=\"%s\"} %d\n",
+			core->svc.name, core->batch_num);
+	}
+}
+
 #ifdef SIM_SUPPORT_SMDB
-static int ssa_extract_load_smdb(osm_opensm_t *p_osm, struct ssa_db *p_ref_smdb,
+static int ssa_extract_load_smdb(osm_opensm_t *p_osm, struct ssa_db **pp_ref_smdb,
 				 int *outstanding_count, struct timespec *last_mtime)
 {
 	struct stat smdb_dir_stats;
@@ -1510,7 +2065,7 @@ static int ssa_extract_load_smdb(osm_opensm_t *p_osm, struct ssa_db *p_ref_smdb,
 	}
 
 	if (memcmp(&smdb_dir_stats.st_mtime, last_mtime, sizeof(*last_mtime))) {
-		ssa_extract_process(p_osm, p_ref_smdb, outstanding_count);
+		ssa_extract_process(p_osm, pp_ref_smdb, outstanding_count);
 		memcpy(last_mtime, &smdb_dir_stats.st_mtime,
 		       sizeof(*last_mtime));
 	}
@@ -1531,6 +2086,11 @@ static int ssa_extract_process_smdb(struct ssa_db **pp_smdb)
 		return -1;
 	}
 
+	/* a loaded SMDB is a new epoch just as an extracted one is */
+	ssa_inc_runtime_counter(COUNTER_ID_SMDB_EPOCHS);
+	core_stamp_epoch(p_smdb);
+	ssa_metrics_set_db(SSA_METRICS_SMDB, p_smdb);
+
 	if (pp_smdb) {
 		if (*pp_smdb)
 			ssa_db_destroy(*pp_smdb);
@@ -1540,22 +2100,15 @@ static int ssa_extract_process_smdb(struct ssa_db **pp_smdb)
 	return 0;
 }
 #else
-static void core_extract_db(osm_opensm_t *p_osm)
+/*
+ * Compare the current SMDB with the previous one, or with itself when only
+ * the LFTs changed, and push the result to the distribution tree.
+ */
+static void core_publish_db(int lft_only)
 {
 	struct ssa_db_diff *ssa_db_diff_old = NULL;
 	uint64_t epoch_prev = DB_EPOCH_INVALID;
-
-	CL_PLOCK_ACQUIRE(&p_osm->lock);
-	ssa_db->p_dump_db = ssa_db_extract(p_osm);
-	ssa_db_lft_handle();
-	CL_PLOCK_RELEASE(&p_osm->lock);
-
-	/* For validation */
-	ssa_db_validate(ssa_db->p_dump_db);
-	ssa_db_validate_lft(first_extraction);
-
-	/* Update SMDB versions */
-	ssa_db_update(ssa_db);
+	struct timeval start;
 
 	pthread_mutex_lock(&ssa_db_diff_lock);
 	/* Clear previous version */
@@ -1564,11 +2117,20 @@ static void core_extract_db(osm_opensm_t *p_osm)
 
 	ssa_db_diff_old = ssa_db_diff;
 
-	ssa_db_diff = ssa_db_compare(ssa_db, epoch_prev, first_extraction);
+	gettimeofday(&start, NULL);
+	if (lft_only)
+		ssa_db_diff = ssa_db_compare_lfts(ssa_db, epoch_prev);
+	else
+		ssa_db_diff = ssa_db_compare(ssa_db, epoch_prev,
+					     first_extraction);
+	ssa_hist_record_since(HIST_ID_SMDB_COMPARE, &start);
 	if (ssa_db_diff) {
-		if (ssa_db_diff->dirty)
+		if (ssa_db_diff->dirty) {
 		    ssa_db_diff_destroy(ssa_db_diff_old);
-		else if (ssa_db_diff_old) {
+		    ssa_inc_runtime_counter(COUNTER_ID_SMDB_EPOCHS);
+		    core_stamp_epoch(ssa_db_diff->p_smdb);
+		    ssa_metrics_set_db(SSA_METRICS_SMDB, ssa_db_diff->p_smdb);
+		} else if (ssa_db_diff_old) {
 		    ssa_db_diff_destroy(ssa_db_diff);
 		    ssa_db_diff = ssa_db_diff_old;
 		    ssa_db_diff->dirty = 0;
@@ -1592,12 +2154,68 @@ static void core_extract_db(osm_opensm_t *p_osm)
 	}
 	pthread_mutex_unlock(&ssa_db_diff_lock);
 }
+
+/*
+ * A reroute only changes LFTs, which are already queued by the LFT change
+ * events, so they are published on top of the current SMDB.
+ */
+static void core_reroute_db(void)
+{
+	if (!ssa_db->p_current_db->initialized)
+		return;
+
+	ssa_db_lft_handle();
+	core_publish_db(1);
+}
+
+static void core_extract_db(osm_opensm_t *p_osm)
+{
+	struct ssa_db_extract *p_ssa = NULL;
+	uint16_t dirty_lids[SSA_DB_DIRTY_LIDS_MAX];
+	struct timeval start;
+	int dirty_cnt;
+
+	/*
+	 * Ports reported by traps since the last extraction are extracted
+	 * on top of the current SMDB.  Anything else, including the first
+	 * extraction after becoming master, walks the whole subnet.
+	 */
+	dirty_cnt = ssa_db_dirty_get(dirty_lids);
+
+	/*
+	 * Only copying the records out of the subnet needs the plock;
+	 * indexing them and the queued LFT changes are handled after
+	 * it is released.
+	 */
+	CL_PLOCK_ACQUIRE(&p_osm->lock);
+	gettimeofday(&start, NULL);
+	if (incremental_extract && !first_extraction && dirty_cnt > 0)
+		p_ssa = ssa_db_extract_incr(p_osm, ssa_db->p_current_db,
+					    dirty_lids, dirty_cnt);
+	if (!p_ssa)
+		p_ssa = ssa_db_extract(p_osm);
+	ssa_hist_record_since(HIST_ID_SMDB_EXTRACT, &start);
+	ssa_db->p_dump_db = p_ssa;
+	CL_PLOCK_RELEASE(&p_osm->lock);
+
+	ssa_db_extract_sort(ssa_db->p_dump_db);
+	ssa_db_lft_handle();
+
+	/* For validation */
+	ssa_db_validate(ssa_db->p_dump_db);
+	ssa_db_validate_lft(first_extraction);
+
+	/* Update SMDB versions */
+	ssa_db_update(ssa_db);
+
+	core_publish_db(0);
+}
 #endif
 
 #ifndef SIM_SUPPORT
 #ifdef SIM_SUPPORT_SMDB
 static void ssa_extract_update_ready_process(osm_opensm_t *p_osm,
-					     struct ssa_db *p_ref_smdb,
+					     struct ssa_db **pp_ref_smdb,
 					     int *outstanding_count)
 {
 	if (*outstanding_count > 0) {
@@ -1613,23 +2231,23 @@ static void ssa_extract_update_ready_process(osm_opensm_t *p_osm,
 				return;
 			}
 
-			if (!ssa_extract_process_smdb(&p_ref_smdb))
-				ssa_extract_db_update(p_ref_smdb, 1); /* 1 indicates that smdb was changed */
+			if (!ssa_extract_process_smdb(pp_ref_smdb))
+				ssa_extract_db_update(*pp_ref_smdb, 1); /* 1 indicates that smdb was changed */
 			lockf(smdb_lock_fd, F_ULOCK, 0);
 		}
 	}
 }
 
-static int ssa_extract_process(osm_opensm_t *p_osm, struct ssa_db *p_ref_smdb,
+static int ssa_extract_process(osm_opensm_t *p_osm, struct ssa_db **pp_ref_smdb,
 			       int *outstanding_count)
 {
 	if (*outstanding_count == 0) {
-		if (p_ref_smdb)
-			*outstanding_count = ssa_extract_db_update_prepare(p_ref_smdb);
+		if (*pp_ref_smdb)
+			*outstanding_count = ssa_extract_db_update_prepare(*pp_ref_smdb);
 ssa_log(SSA_LOG_DEFAULT, "%d DB update prepare msgs sent\n", *outstanding_count);
 		if (*outstanding_count == 0) {
-			if (!ssa_extract_process_smdb(&p_ref_smdb))
-				ssa_extract_db_update(p_ref_smdb, 1); /* 1 indicates that smdb was changed */
+			if (!ssa_extract_process_smdb(pp_ref_smdb))
+				ssa_extract_db_update(*pp_ref_smdb, 1); /* 1 indicates that smdb was changed */
 ssa_log(SSA_LOG_DEFAULT, "DB extracted and DB update msgs sent\n");
 		}
 else ssa_log(SSA_LOG_DEFAULT, "extract event but extract now pending with outstanding count %d\n", *outstanding_count);
@@ -1639,29 +2257,46 @@ else ssa_log(SSA_LOG_DEFAULT, "extract event with extract already pending\n");
 	return 0;
 }
 #else
+/* pending update only carries LFT changes (reroute) */
+static int extract_lft_only;
+
+static void ssa_extract_do(osm_opensm_t *p_osm)
+{
+	if (extract_lft_only)
+		core_reroute_db();
+	else
+		core_extract_db(p_osm);
+}
+
 static void ssa_extract_update_ready_process(osm_opensm_t *p_osm,
 					     int *outstanding_count)
 {
 	if (*outstanding_count > 0) {
 		if (--(*outstanding_count) == 0) {
-			core_extract_db(p_osm);
+			ssa_extract_do(p_osm);
 		}
 	}
 }
 
-static int ssa_extract_process(osm_opensm_t *p_osm, int *outstanding_count)
+static int ssa_extract_process(osm_opensm_t *p_osm, int *outstanding_count,
+			       int lft_only)
 {
 	if (*outstanding_count == 0) {
+		extract_lft_only = lft_only;
 		if (ssa_db_diff)
 			*outstanding_count = ssa_extract_db_update_prepare(ssa_db_diff->p_smdb);
 ssa_log(SSA_LOG_DEFAULT, "%d DB update prepare msgs sent\n", *outstanding_count);
 		if (*outstanding_count == 0) {
-			core_extract_db(p_osm);
+			ssa_extract_do(p_osm);
 ssa_log(SSA_LOG_DEFAULT, "DB extracted and DB update msgs sent\n");
 		}
 else ssa_log(SSA_LOG_DEFAULT, "extract event but extract now pending with outstanding count %d\n", *outstanding_count);
+	} else {
+		/* a full extraction covers the LFT changes too */
+		if (!lft_only)
+			extract_lft_only = 0;
+		ssa_log(SSA_LOG_DEFAULT, "extract event with extract already pending\n");
 	}
-else ssa_log(SSA_LOG_DEFAULT, "extract event with extract already pending\n");
 
 	return 0;
 }
@@ -1725,6 +2360,116 @@ static void core_start_timer(struct pollfd **fds, int fd_slot,
 }
 #endif
 
+/*
+ * Extraction scheduler: with extract_min_interval set, extraction events
+ * are held until no new event arrived for that long, but no longer than
+ * extract_max_delay after the first one, and then handled as one.
+ */
+static struct {
+	int		full;		/* SSA_DB_START_EXTRACT pending */
+	int		lft_only;	/* SSA_DB_REROUTE pending */
+	struct timespec	first;
+} extract_sched;
+
+static long core_elapsed_msec(struct timespec *since)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec) * 1000 +
+	       (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+static void core_sched_arm(struct pollfd **fds, long delay_msec)
+{
+	struct itimerspec timer;
+	struct pollfd *pfd;
+
+	memset(&timer, 0, sizeof(timer));
+	timer.it_value.tv_sec	= delay_msec / 1000;
+	timer.it_value.tv_nsec	= (delay_msec % 1000) * 1000000;
+	if (!timer.it_value.tv_sec && !timer.it_value.tv_nsec)
+		timer.it_value.tv_nsec = 1;	/* zero disarms the timer */
+
+	pfd = (struct pollfd *)(fds + EXTRACT_SCHED_TIMER_FD_SLOT);
+	if (timerfd_settime(pfd->fd, 0, &timer, NULL)) {
+		ssa_log_err(SSA_LOG_CTRL, "timerfd_settime %d (%s)\n",
+			    errno, strerror(errno));
+		return;
+	}
+	pfd->events = POLLIN;
+	pfd->revents = 0;
+}
+
+/*
+ * Returns 1 if the event was queued, 0 if it is to be handled now.
+ */
+static int core_sched_event(struct pollfd **fds,
+			    enum ssa_db_ctrl_msg_type type)
+{
+	long delay, elapsed;
+
+	if (extract_min_interval <= 0)
+		return 0;
+
+	if (!extract_sched.full && !extract_sched.lft_only)
+		clock_gettime(CLOCK_MONOTONIC, &extract_sched.first);
+
+	if (type == SSA_DB_REROUTE)
+		extract_sched.lft_only = 1;
+	else
+		extract_sched.full = 1;
+
+	delay = extract_min_interval;
+	if (extract_max_delay > 0) {
+		elapsed = core_elapsed_msec(&extract_sched.first);
+		if (elapsed + delay > extract_max_delay)
+			delay = max(extract_max_delay - elapsed, 0L);
+	}
+	core_sched_arm(fds, delay);
+	return 1;
+}
+
+static void core_extract_run(osm_opensm_t *p_osm,
+			     struct ssa_extract_data *p_extract_data,
+			     struct pollfd **fds, int *timeout_msec,
+			     int *outstanding_count, int lft_only)
+{
+	if (lft_only) {
+		/* the next full extraction picks the LFTs up */
+		if (first_extraction)
+			return;
+		ssa_log(SSA_LOG_VERBOSE, "Start handling reroute event\n");
+#ifdef SIM_SUPPORT
+		core_reroute_db();
+#elif !defined(SIM_SUPPORT_SMDB)
+		ssa_extract_process(p_osm, outstanding_count, 1);
+#endif
+		return;
+	}
+
+#ifndef SIM_SUPPORT
+	if (first_extraction) {
+		core_process_extract_data(p_extract_data);
+		core_start_timer(fds, TREE_BALANCE_TIMER_FD_SLOT, CORE_BALANCE_TIMEOUT, 0);
+	}
+#endif
+#ifdef SIM_SUPPORT
+	core_extract_db(p_osm);
+#elif !defined(SIM_SUPPORT_SMDB)
+	ssa_extract_process(p_osm, outstanding_count, 0);
+#endif
+	if (first_extraction)
+		first_extraction = 0;
+
+#ifndef SIM_SUPPORT
+	if (core_has_orphans(p_extract_data))
+		*timeout_msec = 1000;
+
+	core_start_timer(fds, EXTRACT_TIMER_FD_SLOT, 1, 1);
+#endif
+}
+
 static void *core_extract_handler(void *context)
 {
 	struct ssa_extract_data *p_extract_data = (struct ssa_extract_data *) context;
@@ -1734,9 +2479,7 @@ static void *core_extract_handler(void *context)
 	struct ssa_db_ctrl_msg msg;
 	struct ssa_ctrl_msg_buf msg2;
 	int ret, i, timeout_msec = -1;
-#ifndef SIM_SUPPORT
 	int outstanding_count = 0;
-#endif
 #ifdef SIM_SUPPORT_SMDB
 	struct timespec smdb_last_mtime;
 #endif
@@ -1783,6 +2526,15 @@ static void *core_extract_handler(void *context)
 	}
 	pfd->events = 0;
 	pfd->revents = 0;
+	pfd = (struct pollfd *)(fds + EXTRACT_SCHED_TIMER_FD_SLOT);
+	pfd->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if (pfd->fd < 0) {
+		ssa_log_err(SSA_LOG_CTRL, "timerfd_create %d (%s)\n",
+			    errno, strerror(errno));
+		goto out;
+	}
+	pfd->events = 0;
+	pfd->revents = 0;
 	for (i = 0; i < p_extract_data->num_svcs; i++) {
 		pfd = (struct pollfd *)(fds + i + FIRST_DOWNSTREAM_FD_SLOT);
 		pfd->fd = p_extract_data->svcs[i]->sock_extractdown[1];
@@ -1806,7 +2558,7 @@ static void *core_extract_handler(void *context)
 				timeout_msec = -1;
 #endif
 #ifdef SIM_SUPPORT_SMDB
-			if (ssa_extract_load_smdb(p_osm, p_ref_smdb,
+			if (ssa_extract_load_smdb(p_osm, &p_ref_smdb,
 						  &outstanding_count,
 						  &smdb_last_mtime) < 0)
 				goto out;
@@ -1821,26 +2573,14 @@ static void *core_extract_handler(void *context)
 			read(sock_coreextract[1], (char *) &msg, sizeof(msg));
 			switch (msg.type) {
 			case SSA_DB_START_EXTRACT:
-#ifndef SIM_SUPPORT
-				if (first_extraction) {
-					core_process_extract_data(p_extract_data);
-					core_start_timer(fds, TREE_BALANCE_TIMER_FD_SLOT, CORE_BALANCE_TIMEOUT, 0);
-				}
-#endif
-#ifdef SIM_SUPPORT
-				core_extract_db(p_osm);
-#elif !defined(SIM_SUPPORT_SMDB)
-				ssa_extract_process(p_osm, &outstanding_count);
-#endif
-				if (first_extraction)
-					first_extraction = 0;
-
-#ifndef SIM_SUPPORT
-				if (core_has_orphans(p_extract_data))
-					timeout_msec = 1000;
-
-				core_start_timer(fds, EXTRACT_TIMER_FD_SLOT, 1, 1);
-#endif
+			case SSA_DB_REROUTE:
+				ssa_inc_runtime_counter(COUNTER_ID_SMDB_EVENTS);
+				if (core_sched_event(fds, msg.type))
+					break;
+				core_extract_run(p_osm, p_extract_data, fds,
+						 &timeout_msec,
+						 &outstanding_count,
+						 msg.type == SSA_DB_REROUTE);
 				break;
 			case SSA_DB_LFT_CHANGE:
 				ssa_log(SSA_LOG_VERBOSE,
@@ -1873,7 +2613,7 @@ static void *core_extract_handler(void *context)
 ssa_log(SSA_LOG_DEFAULT, "SSA_DB_UPDATE_READY from access with outstanding count %d\n", outstanding_count);
 #ifdef SIM_SUPPORT_SMDB
 				ssa_extract_update_ready_process(p_osm,
-								 p_ref_smdb,
+								 &p_ref_smdb,
 								 &outstanding_count);
 #else
 				ssa_extract_update_ready_process(p_osm,
@@ -1920,6 +2660,30 @@ ssa_log(SSA_LOG_DEFAULT, "SSA_DB_UPDATE_READY from access with outstanding count
 			pfd->revents = 0;
 		}
 
+		pfd = (struct pollfd *)(fds + EXTRACT_SCHED_TIMER_FD_SLOT);
+		if (pfd->revents & POLLIN) {
+			ssize_t s;
+			uint64_t exp;
+
+			s = read(pfd->fd, &exp, sizeof exp);
+			if (s != sizeof exp) {
+				ssa_log_err(SSA_LOG_DEFAULT,
+					    "%" PRId64 " bytes read\n", s);
+			} else if (extract_sched.full || extract_sched.lft_only) {
+				ssa_log(SSA_LOG_VERBOSE,
+					"handling events held for %ld msec\n",
+					core_elapsed_msec(&extract_sched.first));
+				core_extract_run(p_osm, p_extract_data, fds,
+						 &timeout_msec,
+						 &outstanding_count,
+						 !extract_sched.full);
+				extract_sched.full = 0;
+				extract_sched.lft_only = 0;
+			}
+
+			pfd->revents = 0;
+		}
+
 		pfd = (struct pollfd *)(fds + TREE_BALANCE_TIMER_FD_SLOT);
 		if (pfd->revents & POLLIN) {
 			ssize_t s;
@@ -1969,7 +2733,7 @@ ssa_log(SSA_LOG_DEFAULT, "SSA_DB_UPDATE_READY from access with outstanding count
 ssa_log(SSA_LOG_DEFAULT, "SSA_DB_UPDATE_READY on pfds[%u] with outstanding count %d\n", i, outstanding_count);
 #ifdef SIM_SUPPORT_SMDB
 					ssa_extract_update_ready_process(p_osm,
-									 p_ref_smdb,
+									 &p_ref_smdb,
 									 &outstanding_count);
 #else
 					ssa_extract_update_ready_process(p_osm,
@@ -1988,6 +2752,13 @@ ssa_log(SSA_LOG_DEFAULT, "SSA_DB_UPDATE_READY on pfds[%u] with outstanding count
 		}
 	}
 out:
+	pfd = (struct pollfd *)(fds + EXTRACT_SCHED_TIMER_FD_SLOT);
+	if (pfd->fd >= 0) {
+		close(pfd->fd);
+		pfd->events = 0;
+		pfd->revents = 0;
+	}
+
 	pfd = (struct pollfd *)(fds + TREE_BALANCE_TIMER_FD_SLOT);
 	if (pfd->fd >= 0) {
 		close(pfd->fd);
@@ -2123,9 +2894,9 @@ static void core_report(void *context, osm_epi_event_id_t event_id, void *event_
 		ucast_routing_flag = (osm_epi_ucast_routing_flags_t) event_data;
 		if (ucast_routing_flag == UCAST_ROUTING_REROUTE) {
 			/* We get here in case of subnet rerouting not followed by SUBNET_UP */
-			/* TODO: notify the distribution thread and push the LFT changes */
 			ssa_log(SSA_LOG_VERBOSE,
-				"Unicast rerouting completed event - not implemented yet\n");
+				"Unicast rerouting completed event\n");
+			core_send_msg(SSA_DB_REROUTE);
 		}
 		break;
 	case OSM_EVENT_ID_SUBNET_UP:
@@ -2189,9 +2960,17 @@ static void core_set_options(void)
 			distrib_tree_level = atoi(value);
 		else if (!strcasecmp("join_timeout", opt))
 			join_timeout = atoi(value);
+		else if (!strcasecmp("tree_hop_weight", opt))
+			tree_hop_weight = atoi(value);
+		else if (!strcasecmp("join_batch", opt))
+			join_batch = atoi(value);
 #endif
 		else if (!strcasecmp("log_flush", opt))
 			log_flush = atoi(value);
+		else if (!strcasecmp("log_async", opt))
+			log_async = atoi(value);
+		else if (!strcasecmp("log_rate_limit", opt))
+			log_rate_limit = atoi(value);
 		else if (!strcasecmp("accum_log_file", opt))
 			accum_log_file = atoi(value);
 		else if (!strcasecmp("lock_file", opt))
@@ -2206,6 +2985,10 @@ static void core_set_options(void)
 			smdb_port = (short) atoi(value);
 		else if (!strcasecmp("prdb_port", opt))
 			prdb_port = (short) atoi(value);
+		else if (!strcasecmp("metrics_port", opt))
+			metrics_port = (short) atoi(value);
+		else if (!strcasecmp("metrics_socket", opt))
+			strcpy(metrics_socket, value);
 		else if (!strcasecmp("smdb_dump", opt))
 			smdb_dump = atoi(value);
 		else if (!strcasecmp("err_smdb_dump", opt))
@@ -2214,6 +2997,14 @@ static void core_set_options(void)
 			prdb_dump = atoi(value);
 		else if (!strcasecmp("smdb_deltas", opt))
 			smdb_deltas = atoi(value);
+		else if (!strcasecmp("smdb_diff_threads", opt))
+			smdb_diff_threads = atoi(value);
+		else if (!strcasecmp("incremental_extract", opt))
+			incremental_extract = atoi(value);
+		else if (!strcasecmp("extract_min_interval", opt))
+			extract_min_interval = atoi(value);
+		else if (!strcasecmp("extract_max_delay", opt))
+			extract_max_delay = atoi(value);
 		else if (!strcasecmp("keepalive", opt))
 			keepalive = atoi(value);
 #ifdef SIM_SUPPORT_FAKE_ACM
@@ -2239,12 +3030,20 @@ static void core_log_options(void)
 	ssa_log(SSA_LOG_DEFAULT, "smdb port %u\n", smdb_port);
 	ssa_log(SSA_LOG_DEFAULT, "prdb port %u\n", prdb_port);
 	ssa_log(SSA_LOG_DEFAULT, "admin port %u\n", admin_port);
+	ssa_log(SSA_LOG_DEFAULT, "metrics port %u\n", metrics_port);
+	ssa_log(SSA_LOG_DEFAULT, "metrics socket %s\n", metrics_socket);
 	ssa_log(SSA_LOG_DEFAULT, "smdb dump %d\n", smdb_dump);
 	ssa_log(SSA_LOG_DEFAULT, "err smdb dump %d\n", err_smdb_dump);
 	ssa_log(SSA_LOG_DEFAULT, "smdb dump dir %s\n", smdb_dump_dir);
 	ssa_log(SSA_LOG_DEFAULT, "prdb dump %d\n", prdb_dump);
 	ssa_log(SSA_LOG_DEFAULT, "prdb dump dir %s\n", prdb_dump_dir);
 	ssa_log(SSA_LOG_DEFAULT, "smdb deltas %d\n", smdb_deltas);
+	ssa_log(SSA_LOG_DEFAULT, "smdb diff threads %d\n", smdb_diff_threads);
+	ssa_log(SSA_LOG_DEFAULT, "incremental extract %d\n", incremental_extract);
+	ssa_log(SSA_LOG_DEFAULT, "extract min interval %d msec\n",
+		extract_min_interval);
+	ssa_log(SSA_LOG_DEFAULT, "extract max delay %d msec\n",
+		extract_max_delay);
 	ssa_log(SSA_LOG_DEFAULT, "keepalive time %d\n", keepalive);
 #ifndef SIM_SUPPORT
 	ssa_log(SSA_LOG_DEFAULT, "distrib tree level 0x%x\n", distrib_tree_level);
@@ -2265,6 +3064,8 @@ static void core_log_options(void)
 #endif
 #ifndef SIM_SUPPORT
 	ssa_log(SSA_LOG_DEFAULT, "join timeout %d\n", join_timeout);
+	ssa_log(SSA_LOG_DEFAULT, "tree hop weight %d\n", tree_hop_weight);
+	ssa_log(SSA_LOG_DEFAULT, "join batch %d\n", join_batch);
 #endif
 	ssa_log(SSA_LOG_DEFAULT, "addr preload %d\n", addr_preload);
 	ssa_log(SSA_LOG_DEFAULT, "addr data file %s\n", addr_data_file);
@@ -2292,6 +3093,12 @@ static void *core_construct(osm_opensm_t *opensm)
 	}
 #endif
 
+#if defined(SIM_SUPPORT) || defined (SIM_SUPPORT_SMDB)
+	/* simulation runs point the core at their own options file */
+	if (opensm->subn.opt.event_plugin_options &&
+	    opensm->subn.opt.event_plugin_options[0])
+		opts_file = opensm->subn.opt.event_plugin_options;
+#endif
 	core_set_options();
 
 	ssa_open_log(log_file);
@@ -2307,6 +3114,20 @@ static void *core_construct(osm_opensm_t *opensm)
 			     "SSA DB updates.\n");
 	}
 
+#ifndef SIM_SUPPORT
+	/*
+	 * Hops are walked on the published SMDB, which only holds the
+	 * changed records when deltas are published.
+	 */
+	if (tree_hop_weight && smdb_deltas) {
+		tree_hop_weight = 0;
+		ssa_log_warn(SSA_LOG_DEFAULT,
+			     "tree_hop_weight requires full SMDB updates "
+			     "(smdb_deltas 0). Falling back to load only "
+			     "tree balancing.\n");
+	}
+#endif
+
 	ssa_set_ssa_signal_handler();
 
 	ret = ssa_init(&ssa, node_type, sizeof(struct ssa_device),
@@ -2404,6 +3225,7 @@ static void *core_construct(osm_opensm_t *opensm)
 	}
 #endif
 
+	ssa_metrics_register(core_metrics, NULL);
 	ret = ssa_start_admin(&ssa);
 	if (ret) {
 		ssa_log(SSA_LOG_DEFAULT, "ERROR starting admin thread\n");
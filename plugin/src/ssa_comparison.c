@@ -32,6 +32,8 @@
  */
 
 #include <stdlib.h>
+#include <stddef.h>
+#include <pthread.h>
 #include <asm/byteorder.h>
 #include <common.h>
 #include <infiniband/ssa_database.h>
@@ -39,6 +41,7 @@
 #include <ssa_log.h>
 
 extern int smdb_deltas;
+extern int smdb_diff_threads;
 extern int addr_preload;
 extern char addr_data_file[128];
 extern struct ssa_db *ipdb;
@@ -56,14 +59,6 @@ ssa_db_diff_init(uint64_t epoch, uint64_t data_rec_cnt[SMDB_TBL_ID_MAX])
 	if (p_ssa_db_diff) {
 		p_ssa_db_diff->p_smdb = ssa_db_smdb_init(epoch, data_rec_cnt);
 
-		cl_qmap_init(&p_ssa_db_diff->ep_guid_to_lid_tbl_added);
-		cl_qmap_init(&p_ssa_db_diff->ep_node_tbl_added);
-		cl_qmap_init(&p_ssa_db_diff->ep_port_tbl_added);
-		cl_qmap_init(&p_ssa_db_diff->ep_link_tbl_added);
-		cl_qmap_init(&p_ssa_db_diff->ep_guid_to_lid_tbl_removed);
-		cl_qmap_init(&p_ssa_db_diff->ep_node_tbl_removed);
-		cl_qmap_init(&p_ssa_db_diff->ep_port_tbl_removed);
-		cl_qmap_init(&p_ssa_db_diff->ep_link_tbl_removed);
 		cl_qmap_init(&p_ssa_db_diff->ep_lft_block_tbl);
 		cl_qmap_init(&p_ssa_db_diff->ep_lft_top_tbl);
 	}
@@ -78,35 +73,19 @@ void ssa_db_diff_destroy(struct ssa_db_diff * p_ssa_db_diff)
 		ssa_db_smdb_destroy(p_ssa_db_diff->p_smdb);
 		p_ssa_db_diff->p_smdb = NULL;
 
-		ssa_qmap_apply_func(&p_ssa_db_diff->ep_guid_to_lid_tbl_added,
-				   ep_map_rec_delete_pfn);
-		ssa_qmap_apply_func(&p_ssa_db_diff->ep_guid_to_lid_tbl_removed,
-				   ep_map_rec_delete_pfn);
-		ssa_qmap_apply_func(&p_ssa_db_diff->ep_node_tbl_added,
-				   ep_map_rec_delete_pfn);
-		ssa_qmap_apply_func(&p_ssa_db_diff->ep_node_tbl_removed,
-				   ep_map_rec_delete_pfn);
-		ssa_qmap_apply_func(&p_ssa_db_diff->ep_port_tbl_added,
-				   ep_map_rec_delete_pfn);
-		ssa_qmap_apply_func(&p_ssa_db_diff->ep_port_tbl_removed,
-				   ep_map_rec_delete_pfn);
-		ssa_qmap_apply_func(&p_ssa_db_diff->ep_link_tbl_added,
-				   ep_map_rec_delete_pfn);
-		ssa_qmap_apply_func(&p_ssa_db_diff->ep_link_tbl_removed,
-				   ep_map_rec_delete_pfn);
+		ep_idx_tbl_destroy(&p_ssa_db_diff->ep_guid_to_lid_tbl_added);
+		ep_idx_tbl_destroy(&p_ssa_db_diff->ep_guid_to_lid_tbl_removed);
+		ep_idx_tbl_destroy(&p_ssa_db_diff->ep_node_tbl_added);
+		ep_idx_tbl_destroy(&p_ssa_db_diff->ep_node_tbl_removed);
+		ep_idx_tbl_destroy(&p_ssa_db_diff->ep_port_tbl_added);
+		ep_idx_tbl_destroy(&p_ssa_db_diff->ep_port_tbl_removed);
+		ep_idx_tbl_destroy(&p_ssa_db_diff->ep_link_tbl_added);
+		ep_idx_tbl_destroy(&p_ssa_db_diff->ep_link_tbl_removed);
 		ssa_qmap_apply_func(&p_ssa_db_diff->ep_lft_block_tbl,
 				   ep_map_rec_delete_pfn);
 		ssa_qmap_apply_func(&p_ssa_db_diff->ep_lft_top_tbl,
 				   ep_map_rec_delete_pfn);
 
-		cl_qmap_remove_all(&p_ssa_db_diff->ep_guid_to_lid_tbl_added);
-		cl_qmap_remove_all(&p_ssa_db_diff->ep_node_tbl_added);
-		cl_qmap_remove_all(&p_ssa_db_diff->ep_port_tbl_added);
-		cl_qmap_remove_all(&p_ssa_db_diff->ep_link_tbl_added);
-		cl_qmap_remove_all(&p_ssa_db_diff->ep_guid_to_lid_tbl_removed);
-		cl_qmap_remove_all(&p_ssa_db_diff->ep_node_tbl_removed);
-		cl_qmap_remove_all(&p_ssa_db_diff->ep_port_tbl_removed);
-		cl_qmap_remove_all(&p_ssa_db_diff->ep_link_tbl_removed);
 		cl_qmap_remove_all(&p_ssa_db_diff->ep_lft_block_tbl);
 		cl_qmap_remove_all(&p_ssa_db_diff->ep_lft_top_tbl);
 		free(p_ssa_db_diff);
@@ -190,129 +169,39 @@ Exit:
 
 /** =========================================================================
  */
-static void smdb_guid2lid_insert(cl_qmap_t *p_map,
-				 struct db_dataset *p_dataset,
-				 void **p_data_tbl,
-				 uint64_t key,
-				 cl_map_item_t * p_item,
-				 void * p_data_tbl_src)
+static void smdb_rec_insert(struct ep_idx_tbl *p_idx,
+			    struct db_dataset *p_dataset,
+			    void **p_data_tbl,
+			    size_t rec_size,
+			    struct ep_rec_idx *p_rec,
+			    void *p_data_tbl_src)
 {
-	struct ep_map_rec *p_map_rec_new, *p_map_rec_old;
-	struct smdb_guid2lid *p_guid2lid_dest;
-	struct smdb_guid2lid *p_guid2lid_src;
+	uint8_t *p_rec_dest = (uint8_t *) *p_data_tbl;
+	uint8_t *p_rec_src = (uint8_t *) p_data_tbl_src;
 	uint64_t set_size, set_count;
 
-	p_guid2lid_dest = (struct smdb_guid2lid *) *p_data_tbl;
-	p_guid2lid_src = (struct smdb_guid2lid *) p_data_tbl_src;
-
-	if (!p_guid2lid_dest) {
+	if (!p_rec_dest) {
 		ssa_log_err(SSA_LOG_DEFAULT,
-			    "uninitialized guid2lid records destination table\n");
+			    "uninitialized records destination table\n");
 		return;
 	}
 
-	if (!p_guid2lid_src) {
+	if (!p_rec_src) {
 		ssa_log_err(SSA_LOG_DEFAULT,
-			    "uninitialized guid2lid records source table\n");
+			    "uninitialized records source table\n");
 		return;
 	}
 
-	p_map_rec_new = (struct ep_map_rec *) malloc(sizeof(*p_map_rec_new));
-	if (!p_map_rec_new) {
-		ssa_log_err(SSA_LOG_DEFAULT,
-			    "unable to allocate offset object\n");
-		return;
-	}
 	set_size = ntohll(p_dataset->set_size);
 	set_count = ntohll(p_dataset->set_count);
 
-	p_map_rec_new->offset = set_count;
-	cl_qmap_insert(p_map, key, &p_map_rec_new->map_item);
-
-	p_map_rec_old = (struct ep_map_rec *) p_item;
-	memcpy(&p_guid2lid_dest[set_count],
-	       &p_guid2lid_src[p_map_rec_old->offset],
-	       sizeof(*p_guid2lid_dest));
-	*p_data_tbl = p_guid2lid_dest;
-	set_size += sizeof(*p_guid2lid_dest);
-	set_count++;
-
-	p_dataset->set_count = htonll(set_count);
-	p_dataset->set_size = htonll(set_size);
-}
-
-/** =========================================================================
- */
-static int smdb_guid2lid_cmp(cl_map_item_t * p_item_old,
-			     void *p_data_tbl_old,
-			     cl_map_item_t * p_item_new,
-			     void *p_data_tbl_new)
-{
-	struct ep_map_rec *p_map_rec_old = (struct ep_map_rec *) p_item_old;
-	struct ep_map_rec *p_map_rec_new = (struct ep_map_rec *) p_item_new;
-	struct smdb_guid2lid *p_tbl_rec_old =
-			(struct smdb_guid2lid *) p_data_tbl_old;
-	struct smdb_guid2lid *p_tbl_rec_new =
-			(struct smdb_guid2lid *) p_data_tbl_new;
-	int res = 0;
-
-	p_tbl_rec_old += p_map_rec_old->offset;
-	p_tbl_rec_new += p_map_rec_new->offset;
-
-	if (p_tbl_rec_old->lid != p_tbl_rec_new->lid ||
-	    p_tbl_rec_old->lmc != p_tbl_rec_new->lmc ||
-	    p_tbl_rec_old->is_switch != p_tbl_rec_new->is_switch)
-		res = 1;
-
-	return res;
-}
-
-/** =========================================================================
- */
-static void smdb_node_insert(cl_qmap_t *p_map,
-			     struct db_dataset *p_dataset,
-			     void **p_data_tbl,
-			     uint64_t key,
-			     cl_map_item_t * p_item,
-			     void *p_data_tbl_src)
-{
-	struct ep_map_rec *p_map_rec_new, *p_map_rec_old;
-	struct smdb_node *p_node_dest;
-	struct smdb_node *p_node_src;
-	uint64_t set_size, set_count;
-
-	p_node_dest = (struct smdb_node *) *p_data_tbl;
-	p_node_src = (struct smdb_node *) p_data_tbl_src;
-
-	if (!p_node_dest) {
-		ssa_log_err(SSA_LOG_DEFAULT,
-			    "uninitialized node records destination table\n");
-		return;
-	}
-
-	if (!p_node_src) {
-		ssa_log_err(SSA_LOG_DEFAULT,
-			    "uninitialized node records source table\n");
-		return;
-	}
-
-	p_map_rec_new = (struct ep_map_rec *) malloc(sizeof(*p_map_rec_new));
-	if (!p_map_rec_new) {
+	if (ep_idx_tbl_add(p_idx, p_rec->key, set_count))
 		ssa_log_err(SSA_LOG_DEFAULT,
 			    "unable to allocate offset object\n");
-		return;
-	}
-	set_size = ntohll(p_dataset->set_size);
-	set_count = ntohll(p_dataset->set_count);
 
-	p_map_rec_new->offset = set_count;
-	cl_qmap_insert(p_map, key, &p_map_rec_new->map_item);
-
-	p_map_rec_old = (struct ep_map_rec *) p_item;
-	memcpy(&p_node_dest[set_count], &p_node_src[p_map_rec_old->offset],
-	       sizeof(*p_node_dest));
-	*p_data_tbl = p_node_dest;
-	set_size += sizeof(*p_node_dest);
+	memcpy(p_rec_dest + set_count * rec_size,
+	       p_rec_src + p_rec->offset * rec_size, rec_size);
+	set_size += rec_size;
 	set_count++;
 
 	p_dataset->set_count = htonll(set_count);
@@ -321,308 +210,158 @@ static void smdb_node_insert(cl_qmap_t *p_map,
 
 /** =========================================================================
  */
-static int smdb_node_cmp(cl_map_item_t * p_item_old,
-			 void *p_data_tbl_old,
-			 cl_map_item_t * p_item_new,
-			 void *p_data_tbl_new)
-{
-	struct ep_map_rec *p_map_rec_old = (struct ep_map_rec *) p_item_old;
-	struct ep_map_rec *p_map_rec_new = (struct ep_map_rec *) p_item_new;
-	struct smdb_node *p_tbl_rec_old = (struct smdb_node *) p_data_tbl_old;
-	struct smdb_node *p_tbl_rec_new = (struct smdb_node *) p_data_tbl_new;
-	int res = 0;
-
-	p_tbl_rec_old += p_map_rec_old->offset;
-	p_tbl_rec_new += p_map_rec_new->offset;
-
-	if (p_tbl_rec_old->is_enhanced_sp0 != p_tbl_rec_new->is_enhanced_sp0 ||
-	    p_tbl_rec_old->node_type != p_tbl_rec_new->node_type ||
-	    memcmp(p_tbl_rec_old->description, p_tbl_rec_new->description,
-		   IB_NODE_DESCRIPTION_SIZE))
-		res = 1;
-
-	return res;
-}
-
-/** =========================================================================
- */
-static void smdb_port_insert(cl_qmap_t *p_map,
+static void smdb_port_insert(struct ep_idx_tbl *p_idx,
 			     struct db_dataset *p_dataset,
 			     void **p_data_tbl,
 			     struct db_dataset *p_ref_dataset,
 			     void **p_data_ref_tbl,
 			     uint64_t *p_offset,
-			     uint64_t key,
-			     cl_map_item_t * p_item,
+			     struct ep_rec_idx *p_rec,
 			     void *p_data_tbl_src,
 			     void *p_data_ref_tbl_src)
 {
-	struct ep_map_rec *p_map_rec_new, *p_map_rec_old;
 	struct smdb_port *p_port_dest;
 	struct smdb_port *p_port_src;
-	uint64_t set_size, set_count;
+	uint64_t set_count;
 	uint64_t offset_src;
 	uint16_t size_pkey_tbl_src;
 	uint8_t *p_pkey_tbl_dest;
 	uint8_t *p_pkey_tbl_src;
 
-	p_port_dest = (struct smdb_port *) *p_data_tbl;
-	p_port_src = (struct smdb_port *) p_data_tbl_src;
-
-	if (!p_port_dest) {
-		ssa_log_err(SSA_LOG_DEFAULT,
-			    "uninitialized port records destination table\n");
-		return;
-	}
-
-	if (!p_port_src) {
-		ssa_log_err(SSA_LOG_DEFAULT,
-			    "uninitialized port records source table\n");
+	set_count = ntohll(p_dataset->set_count);
+	smdb_rec_insert(p_idx, p_dataset, p_data_tbl, sizeof(*p_port_dest),
+			p_rec, p_data_tbl_src);
+	if (ntohll(p_dataset->set_count) == set_count)
 		return;
-	}
 
-	p_map_rec_new = (struct ep_map_rec *) malloc(sizeof(*p_map_rec_new));
-	if (!p_map_rec_new) {
-		ssa_log_err(SSA_LOG_DEFAULT,
-			    "unable to allocate offset object\n");
+	if (!p_data_ref_tbl || !p_ref_dataset ||
+	    !p_data_ref_tbl_src || !p_offset)
 		return;
-	}
-	set_size = ntohll(p_dataset->set_size);
-	set_count = ntohll(p_dataset->set_count);
-
-	p_map_rec_new->offset = set_count;
-	cl_qmap_insert(p_map, key, &p_map_rec_new->map_item);
-
-	p_map_rec_old = (struct ep_map_rec *) p_item;
-	memcpy(&p_port_dest[set_count], &p_port_src[p_map_rec_old->offset],
-	       sizeof(*p_port_dest));
-	*p_data_tbl = p_port_dest;
-	set_size += sizeof(*p_port_dest);
-	set_count++;
-
-	if (p_data_ref_tbl && p_ref_dataset &&
-	    p_data_ref_tbl_src && p_offset) {
-		p_pkey_tbl_dest = (uint8_t *) *p_data_ref_tbl;
-		p_pkey_tbl_src = (uint8_t *) p_data_ref_tbl_src;
 
-		offset_src = ntohll(p_port_src[p_map_rec_old->offset].pkey_tbl_offset);
-		size_pkey_tbl_src = ntohs(p_port_src[p_map_rec_old->offset].pkey_tbl_size);
-
-		if (size_pkey_tbl_src == 0) {
-			p_dataset->set_count = htonll(set_count);
-			p_dataset->set_size = htonll(set_size);
-			return;
-		}
+	p_port_dest = (struct smdb_port *) *p_data_tbl;
+	p_port_src = (struct smdb_port *) p_data_tbl_src;
+	p_pkey_tbl_dest = (uint8_t *) *p_data_ref_tbl;
+	p_pkey_tbl_src = (uint8_t *) p_data_ref_tbl_src;
 
-		memcpy(&p_pkey_tbl_dest[*p_offset], &p_pkey_tbl_src[offset_src],
-		       size_pkey_tbl_src);
-		p_port_dest[set_count - 1].pkey_tbl_offset = htonll(*p_offset);
-		p_port_dest[set_count - 1].pkey_tbl_size = htons(size_pkey_tbl_src);
-		p_ref_dataset->set_size = htonll(ntohll(p_ref_dataset->set_size)
-						 + size_pkey_tbl_src);
-		*p_offset += size_pkey_tbl_src;
-	}
+	offset_src = ntohll(p_port_src[p_rec->offset].pkey_tbl_offset);
+	size_pkey_tbl_src = ntohs(p_port_src[p_rec->offset].pkey_tbl_size);
+	if (size_pkey_tbl_src == 0)
+		return;
 
-	p_dataset->set_count = htonll(set_count);
-	p_dataset->set_size = htonll(set_size);
+	memcpy(&p_pkey_tbl_dest[*p_offset], &p_pkey_tbl_src[offset_src],
+	       size_pkey_tbl_src);
+	p_port_dest[set_count].pkey_tbl_offset = htonll(*p_offset);
+	p_port_dest[set_count].pkey_tbl_size = htons(size_pkey_tbl_src);
+	p_ref_dataset->set_size = htonll(ntohll(p_ref_dataset->set_size)
+					 + size_pkey_tbl_src);
+	*p_offset += size_pkey_tbl_src;
 }
 
 /** =========================================================================
  */
-static int smdb_port_cmp(cl_map_item_t * p_item_old,
-			 void *p_data_tbl_old,
+static int smdb_port_cmp(struct smdb_port *p_tbl_rec_old,
 			 void *p_data_ref_tbl_old,
-			 cl_map_item_t * p_item_new,
-			 void *p_data_tbl_new,
+			 struct smdb_port *p_tbl_rec_new,
 			 void *p_data_ref_tbl_new)
 {
-	struct ep_map_rec *p_map_rec_old = (struct ep_map_rec *) p_item_old;
-	struct ep_map_rec *p_map_rec_new = (struct ep_map_rec *) p_item_new;
-	struct smdb_port *p_tbl_rec_old = (struct smdb_port *) p_data_tbl_old;
-	struct smdb_port *p_tbl_rec_new = (struct smdb_port *) p_data_tbl_new;
 	uint8_t *p_tbl_ref_rec_old = (uint8_t *) p_data_ref_tbl_old;
 	uint8_t *p_tbl_ref_rec_new = (uint8_t *) p_data_ref_tbl_new;
-	int res = 0;
 
-	p_tbl_rec_old += p_map_rec_old->offset;
-	p_tbl_rec_new += p_map_rec_new->offset;
-	p_tbl_ref_rec_old += ntohll(p_tbl_rec_old->pkey_tbl_offset);
-	p_tbl_ref_rec_new += ntohll(p_tbl_rec_new->pkey_tbl_offset);
-
-	if ((p_tbl_rec_old->pkey_tbl_size != p_tbl_rec_new->pkey_tbl_size) ||
-	    (p_tbl_rec_old->port_lid != p_tbl_rec_new->port_lid) ||
-	    (p_tbl_rec_old->mtu_cap != p_tbl_rec_new->mtu_cap) ||
-	    (p_tbl_rec_old->rate != p_tbl_rec_new->rate) ||
-	    (p_tbl_rec_old->vl_enforce != p_tbl_rec_new->vl_enforce))
-		res = 1;
+	/* everything but the pkey table offset, which moves between dumps */
+	if (memcmp(&p_tbl_rec_old->pkey_tbl_size, &p_tbl_rec_new->pkey_tbl_size,
+		   sizeof(*p_tbl_rec_old) -
+		   offsetof(struct smdb_port, pkey_tbl_size)))
+		return 1;
 
 	/* comparing pkeys */
-	if (res == 0 && p_data_ref_tbl_old && p_data_ref_tbl_new &&
-	    memcmp(p_tbl_ref_rec_old, p_tbl_ref_rec_new,
+	if (p_data_ref_tbl_old && p_data_ref_tbl_new &&
+	    memcmp(p_tbl_ref_rec_old + ntohll(p_tbl_rec_old->pkey_tbl_offset),
+		   p_tbl_ref_rec_new + ntohll(p_tbl_rec_new->pkey_tbl_offset),
 		   ntohs(p_tbl_rec_old->pkey_tbl_size)))
-		res = 1;
-
-	return res;
-}
-
-/** =========================================================================
- */
-static void smdb_link_insert(cl_qmap_t *p_map,
-			     struct db_dataset *p_dataset,
-			     void **p_data_tbl,
-			     uint64_t key,
-			     cl_map_item_t * p_item,
-			     void *p_data_tbl_src)
-{
-	struct ep_map_rec *p_map_rec_new, *p_map_rec_old;
-	struct smdb_link *p_link_dest, *p_link_src;
-	uint64_t set_size, set_count;
-
-	p_link_dest = (struct smdb_link *) *p_data_tbl;
-	p_link_src = (struct smdb_link *) p_data_tbl_src;
-
-	if (!p_link_dest) {
-		ssa_log_err(SSA_LOG_DEFAULT,
-			    "uninitialized link records destination table\n");
-		return;
-	}
-
-	if (!p_link_src) {
-		ssa_log_err(SSA_LOG_DEFAULT,
-			    "uninitialized link records source table\n");
-		return;
-	}
+		return 1;
 
-	p_map_rec_new = (struct ep_map_rec *) malloc(sizeof(*p_map_rec_new));
-	if (!p_map_rec_new) {
-		ssa_log_err(SSA_LOG_DEFAULT,
-			    "unable to allocate offset object\n");
-		return;
-	}
-	set_size = ntohll(p_dataset->set_size);
-	set_count = ntohll(p_dataset->set_count);
-
-	p_map_rec_new->offset = set_count;
-	cl_qmap_insert(p_map, key, &p_map_rec_new->map_item);
-
-	p_map_rec_old = (struct ep_map_rec *) p_item;
-	memcpy(&p_link_dest[set_count], &p_link_src[p_map_rec_old->offset],
-	       sizeof(*p_link_dest));
-	*p_data_tbl = p_link_dest;
-	set_size += sizeof(*p_link_dest);
-	set_count++;
-
-	p_dataset->set_count = htonll(set_count);
-	p_dataset->set_size = htonll(set_size);
+	return 0;
 }
 
 /** =========================================================================
  */
-static int smdb_link_cmp(cl_map_item_t * p_item_old,
-			 void *p_data_tbl_old,
-			 cl_map_item_t * p_item_new,
-			 void *p_data_tbl_new)
-{
-	struct ep_map_rec *p_map_rec_old = (struct ep_map_rec *) p_item_old;
-	struct ep_map_rec *p_map_rec_new = (struct ep_map_rec *) p_item_new;
-	struct smdb_link *p_tbl_rec_old = (struct smdb_link *) p_data_tbl_old;
-	struct smdb_link *p_tbl_rec_new = (struct smdb_link *) p_data_tbl_new;
-	int res = 0;
-
-	p_tbl_rec_old += p_map_rec_old->offset;
-	p_tbl_rec_new += p_map_rec_new->offset;
-
-	if ((p_tbl_rec_old->from_lid != p_tbl_rec_new->from_lid) ||
-	    (p_tbl_rec_old->to_lid != p_tbl_rec_new->to_lid) ||
-	    (p_tbl_rec_old->from_port_num != p_tbl_rec_new->from_port_num) ||
-	    (p_tbl_rec_old->to_port_num != p_tbl_rec_new->to_port_num))
-		res = 1;
-
-	return res;
-}
-
- /** =========================================================================
-  */
-static uint8_t ssa_db_diff_table_cmp(cl_qmap_t * p_map_old,
-				     cl_qmap_t * p_map_new,
+static uint8_t ssa_db_diff_table_cmp(struct ep_idx_tbl *p_idx_old,
+				     struct ep_idx_tbl *p_idx_new,
 				     void *p_data_tbl_old,
 				     void *p_data_tbl_new,
-				     void (*qmap_insert_pfn)
-				            (cl_qmap_t *,
-					     struct db_dataset *,
-					     void **, uint64_t,
-					     cl_map_item_t *,
-					     void *),
-				     int (*cmp_pfn)
-					(cl_map_item_t *, void *,
-					 cl_map_item_t *, void *),
-				     cl_qmap_t * p_map_added,
-				     cl_qmap_t * p_map_removed,
+				     size_t rec_size,
+				     struct ep_idx_tbl *p_idx_added,
+				     struct ep_idx_tbl *p_idx_removed,
 				     struct db_dataset *p_dataset,
 				     void **p_data_tbl)
 {
-	cl_map_item_t *p_item_old, *p_item_new;
-	uint64_t key_old, key_new;
+	struct ep_rec_idx *p_rec_old, *p_rec_new;
+	struct ep_rec_idx *p_end_old, *p_end_new;
 	uint8_t dirty = 0;
 
+	/*
+	 * Both indexes are sorted by key, so this is a single merge pass.
+	 * Extracted records have their pad bytes cleared, hence records
+	 * with the same key can be compared as a whole.
+	 */
+	p_rec_old = p_idx_old->p_recs;
+	p_end_old = p_rec_old + p_idx_old->count;
+	p_rec_new = p_idx_new->p_recs;
+	p_end_new = p_rec_new + p_idx_new->count;
+
 	if (!smdb_deltas) {
-		for (p_item_new = cl_qmap_head(p_map_new);
-		     p_item_new != cl_qmap_end(p_map_new);
-		     p_item_new = cl_qmap_next(p_item_new)) {
-			key_new = cl_qmap_key(p_item_new);
-			qmap_insert_pfn(p_map_added, p_dataset, p_data_tbl,
-					key_new, p_item_new, p_data_tbl_new);
-		}
+		for (; p_rec_new < p_end_new; p_rec_new++)
+			smdb_rec_insert(p_idx_added, p_dataset, p_data_tbl,
+					rec_size, p_rec_new, p_data_tbl_new);
+		p_rec_new = p_idx_new->p_recs;
 	}
 
-	p_item_old = cl_qmap_head(p_map_old);
-	p_item_new = cl_qmap_head(p_map_new);
-	while (p_item_old != cl_qmap_end(p_map_old) &&
-	       p_item_new != cl_qmap_end(p_map_new)) {
-		key_old = cl_qmap_key(p_item_old);
-		key_new = cl_qmap_key(p_item_new);
-		if (key_old < key_new) {
+	while (p_rec_old < p_end_old && p_rec_new < p_end_new) {
+		if (p_rec_old->key < p_rec_new->key) {
 			if (smdb_deltas)
-				qmap_insert_pfn(p_map_removed, p_dataset, p_data_tbl,
-						key_old, p_item_old, p_data_tbl_old);
-			p_item_old = cl_qmap_next(p_item_old);
+				smdb_rec_insert(p_idx_removed, p_dataset,
+						p_data_tbl, rec_size, p_rec_old,
+						p_data_tbl_old);
+			p_rec_old++;
 			dirty = 1;
-		} else if (key_old > key_new) {
+		} else if (p_rec_old->key > p_rec_new->key) {
 			if (smdb_deltas)
-				qmap_insert_pfn(p_map_added, p_dataset, p_data_tbl,
-						key_new, p_item_new, p_data_tbl_new);
-			p_item_new = cl_qmap_next(p_item_new);
+				smdb_rec_insert(p_idx_added, p_dataset,
+						p_data_tbl, rec_size, p_rec_new,
+						p_data_tbl_new);
+			p_rec_new++;
 			dirty = 1;
 		} else {
-			if (cmp_pfn(p_item_old, p_data_tbl_old, p_item_new, p_data_tbl_new)) {
+			if (memcmp((uint8_t *) p_data_tbl_old +
+				   p_rec_old->offset * rec_size,
+				   (uint8_t *) p_data_tbl_new +
+				   p_rec_new->offset * rec_size, rec_size)) {
 				if (smdb_deltas) {
-					qmap_insert_pfn(p_map_removed, p_dataset, p_data_tbl,
-							key_old, p_item_old, p_data_tbl_old);
-					qmap_insert_pfn(p_map_added, p_dataset, p_data_tbl,
-							key_new, p_item_new, p_data_tbl_new);
+					smdb_rec_insert(p_idx_removed, p_dataset,
+							p_data_tbl, rec_size,
+							p_rec_old, p_data_tbl_old);
+					smdb_rec_insert(p_idx_added, p_dataset,
+							p_data_tbl, rec_size,
+							p_rec_new, p_data_tbl_new);
 				}
 				dirty = 1;
 			}
-			p_item_old = cl_qmap_next(p_item_old);
-			p_item_new = cl_qmap_next(p_item_new);
+			p_rec_old++;
+			p_rec_new++;
 		}
 	}
 
-	while (p_item_new != cl_qmap_end(p_map_new)) {
-		key_new = cl_qmap_key(p_item_new);
+	for (; p_rec_new < p_end_new; p_rec_new++) {
 		if (smdb_deltas)
-			qmap_insert_pfn(p_map_added, p_dataset, p_data_tbl,
-					key_new, p_item_new, p_data_tbl_new);
-		p_item_new = cl_qmap_next(p_item_new);
+			smdb_rec_insert(p_idx_added, p_dataset, p_data_tbl,
+					rec_size, p_rec_new, p_data_tbl_new);
 		dirty = 1;
 	}
 
-	while (p_item_old != cl_qmap_end(p_map_old)) {
-		key_old = cl_qmap_key(p_item_old);
+	for (; p_rec_old < p_end_old; p_rec_old++) {
 		if (smdb_deltas)
-			qmap_insert_pfn(p_map_removed, p_dataset, p_data_tbl,
-					key_old, p_item_old, p_data_tbl_old);
-		p_item_old = cl_qmap_next(p_item_old);
+			smdb_rec_insert(p_idx_removed, p_dataset, p_data_tbl,
+					rec_size, p_rec_old, p_data_tbl_old);
 		dirty = 1;
 	}
 
@@ -631,99 +370,93 @@ static uint8_t ssa_db_diff_table_cmp(cl_qmap_t * p_map_old,
 
 /** =========================================================================
  */
-static uint8_t ssa_db_diff_var_size_table_cmp(cl_qmap_t * p_map_old,
-					      cl_qmap_t * p_map_new,
-					      void *p_data_tbl_old,
-					      void *p_data_ref_tbl_old,
-					      void *p_data_tbl_new,
-					      void *p_data_ref_tbl_new,
-					      void (*qmap_insert_pfn)
-						       (cl_qmap_t *, struct db_dataset *,
-							void **, struct db_dataset *,
-							void **, uint64_t *, uint64_t,
-							cl_map_item_t *,
-							void *, void *),
-					      int (*cmp_pfn)
-							(cl_map_item_t *, void *,
-							 void *, cl_map_item_t *,
-							 void *, void *),
-					      cl_qmap_t * p_map_added,
-					      cl_qmap_t * p_map_removed,
-					      struct db_dataset *p_dataset,
-					      void **p_data_tbl,
-					      struct db_dataset *p_ref_dataset,
-					      void **p_data_ref_tbl)
+static uint8_t ssa_db_diff_port_table_cmp(struct ep_idx_tbl *p_idx_old,
+					  struct ep_idx_tbl *p_idx_new,
+					  struct smdb_port *p_port_tbl_old,
+					  void *p_data_ref_tbl_old,
+					  struct smdb_port *p_port_tbl_new,
+					  void *p_data_ref_tbl_new,
+					  struct ep_idx_tbl *p_idx_added,
+					  struct ep_idx_tbl *p_idx_removed,
+					  struct db_dataset *p_dataset,
+					  void **p_data_tbl,
+					  struct db_dataset *p_ref_dataset,
+					  void **p_data_ref_tbl)
 {
-	cl_map_item_t *p_item_old, *p_item_new;
-	uint64_t key_old, key_new;
+	struct ep_rec_idx *p_rec_old, *p_rec_new;
+	struct ep_rec_idx *p_end_old, *p_end_new;
 	uint64_t ref_tbl_offset = 0;
 	uint8_t dirty = 0;
 
+	p_rec_old = p_idx_old->p_recs;
+	p_end_old = p_rec_old + p_idx_old->count;
+	p_rec_new = p_idx_new->p_recs;
+	p_end_new = p_rec_new + p_idx_new->count;
+
 	if (!smdb_deltas) {
-		for (p_item_new = cl_qmap_head(p_map_new);
-		     p_item_new != cl_qmap_end(p_map_new);
-		     p_item_new = cl_qmap_next(p_item_new)) {
-			key_new = cl_qmap_key(p_item_new);
-			qmap_insert_pfn(p_map_added, p_dataset, p_data_tbl, p_ref_dataset,
-					p_data_ref_tbl, &ref_tbl_offset, key_new,
-					p_item_new, p_data_tbl_new, p_data_ref_tbl_new);
-		}
+		for (; p_rec_new < p_end_new; p_rec_new++)
+			smdb_port_insert(p_idx_added, p_dataset, p_data_tbl,
+					 p_ref_dataset, p_data_ref_tbl,
+					 &ref_tbl_offset, p_rec_new,
+					 p_port_tbl_new, p_data_ref_tbl_new);
+		p_rec_new = p_idx_new->p_recs;
 	}
 
-	p_item_old = cl_qmap_head(p_map_old);
-	p_item_new = cl_qmap_head(p_map_new);
-	while (p_item_old != cl_qmap_end(p_map_old) && p_item_new != cl_qmap_end(p_map_new)) {
-		key_old = cl_qmap_key(p_item_old);
-		key_new = cl_qmap_key(p_item_new);
-		if (key_old < key_new) {
+	while (p_rec_old < p_end_old && p_rec_new < p_end_new) {
+		if (p_rec_old->key < p_rec_new->key) {
 			if (smdb_deltas)
-				qmap_insert_pfn(p_map_removed, p_dataset, p_data_tbl, NULL,
-						NULL, NULL, key_old, p_item_old,
-						p_data_tbl_old, NULL);
-			p_item_old = cl_qmap_next(p_item_old);
+				smdb_port_insert(p_idx_removed, p_dataset,
+						 p_data_tbl, NULL, NULL, NULL,
+						 p_rec_old, p_port_tbl_old, NULL);
+			p_rec_old++;
 			dirty = 1;
-		} else if (key_old > key_new) {
+		} else if (p_rec_old->key > p_rec_new->key) {
 			if (smdb_deltas)
-				qmap_insert_pfn(p_map_added, p_dataset, p_data_tbl, p_ref_dataset,
-						p_data_ref_tbl, &ref_tbl_offset, key_new,
-						p_item_new, p_data_tbl_new, p_data_ref_tbl_new);
-			p_item_new = cl_qmap_next(p_item_new);
+				smdb_port_insert(p_idx_added, p_dataset,
+						 p_data_tbl, p_ref_dataset,
+						 p_data_ref_tbl, &ref_tbl_offset,
+						 p_rec_new, p_port_tbl_new,
+						 p_data_ref_tbl_new);
+			p_rec_new++;
 			dirty = 1;
 		} else {
-			if (cmp_pfn(p_item_old, p_data_tbl_old, p_data_ref_tbl_old,
-				    p_item_new, p_data_tbl_new, p_data_ref_tbl_new)) {
+			if (smdb_port_cmp(&p_port_tbl_old[p_rec_old->offset],
+					  p_data_ref_tbl_old,
+					  &p_port_tbl_new[p_rec_new->offset],
+					  p_data_ref_tbl_new)) {
 				if (smdb_deltas) {
-					qmap_insert_pfn(p_map_removed, p_dataset, p_data_tbl, NULL,
-							NULL, NULL, key_old, p_item_old,
-							p_data_tbl_old, NULL);
-					qmap_insert_pfn(p_map_added, p_dataset, p_data_tbl, p_ref_dataset,
-							p_data_ref_tbl, &ref_tbl_offset, key_new,
-							p_item_new, p_data_tbl_new, p_data_ref_tbl_new);
+					smdb_port_insert(p_idx_removed, p_dataset,
+							 p_data_tbl, NULL, NULL,
+							 NULL, p_rec_old,
+							 p_port_tbl_old, NULL);
+					smdb_port_insert(p_idx_added, p_dataset,
+							 p_data_tbl, p_ref_dataset,
+							 p_data_ref_tbl,
+							 &ref_tbl_offset, p_rec_new,
+							 p_port_tbl_new,
+							 p_data_ref_tbl_new);
 				}
 				dirty = 1;
 			}
-			p_item_old = cl_qmap_next(p_item_old);
-			p_item_new = cl_qmap_next(p_item_new);
+			p_rec_old++;
+			p_rec_new++;
 		}
 	}
 
-	while (p_item_new != cl_qmap_end(p_map_new)) {
-		key_new = cl_qmap_key(p_item_new);
+	for (; p_rec_new < p_end_new; p_rec_new++) {
 		if (smdb_deltas)
-			qmap_insert_pfn(p_map_added, p_dataset, p_data_tbl, p_ref_dataset,
-					p_data_ref_tbl, &ref_tbl_offset, key_new,
-					p_item_new, p_data_tbl_new, p_data_ref_tbl_new);
-		p_item_new = cl_qmap_next(p_item_new);
+			smdb_port_insert(p_idx_added, p_dataset, p_data_tbl,
+					 p_ref_dataset, p_data_ref_tbl,
+					 &ref_tbl_offset, p_rec_new,
+					 p_port_tbl_new, p_data_ref_tbl_new);
 		dirty = 1;
 	}
 
-	while (p_item_old != cl_qmap_end(p_map_old)) {
-		key_old = cl_qmap_key(p_item_old);
+	for (; p_rec_old < p_end_old; p_rec_old++) {
 		if (smdb_deltas)
-			qmap_insert_pfn(p_map_removed, p_dataset, p_data_tbl, NULL,
-					NULL, NULL, key_old, p_item_old,
-					p_data_tbl_old, NULL);
-		p_item_old = cl_qmap_next(p_item_old);
+			smdb_port_insert(p_idx_removed, p_dataset, p_data_tbl,
+					 NULL, NULL, NULL, p_rec_old,
+					 p_port_tbl_old, NULL);
 		dirty = 1;
 	}
 
@@ -732,11 +465,13 @@ static uint8_t ssa_db_diff_var_size_table_cmp(cl_qmap_t * p_map_old,
 
 /** =========================================================================
  */
-static void ssa_db_diff_compare_subnet_tables(struct ssa_db_extract * p_previous_db,
-					      struct ssa_db_extract * p_current_db,
-					      struct ssa_db_diff * const p_ssa_db_diff,
-					      boolean_t *tbl_changed)
+static uint8_t ssa_db_diff_compare_subnet_table(struct ssa_db_extract * p_previous_db,
+						struct ssa_db_extract * p_current_db,
+						struct ssa_db_diff * const p_ssa_db_diff,
+						boolean_t *tbl_changed,
+						int tbl_id)
 {
+	struct ssa_db *p_smdb = p_ssa_db_diff->p_smdb;
 	uint8_t dirty = 0;
 
 	/*
@@ -761,87 +496,70 @@ static void ssa_db_diff_compare_subnet_tables(struct ssa_db_extract * p_previous
 	 *    and only afterwards the "added" records may be added,
 	 *    for LFT records there is only single map for changed
 	 *    blocks that need to be set)
+	 *
+	 * Every table is written to its own SMDB dataset only, so
+	 * the tables may be compared concurrently.
 	 */
-
-	/*
-	 * Comparing guid2lid records
-	 */
-	dirty |= ssa_db_diff_table_cmp(&p_previous_db->ep_guid_to_lid_tbl,
-				       &p_current_db->ep_guid_to_lid_tbl,
-				       p_previous_db->p_guid_to_lid_tbl,
-				       p_current_db->p_guid_to_lid_tbl,
-				       smdb_guid2lid_insert,
-				       smdb_guid2lid_cmp,
-				       &p_ssa_db_diff->ep_guid_to_lid_tbl_added,
-				       &p_ssa_db_diff->ep_guid_to_lid_tbl_removed,
-				       &p_ssa_db_diff->p_smdb->p_db_tables[SMDB_TBL_ID_GUID2LID],
-				       (void **) &p_ssa_db_diff->p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID]);
-
-	if (dirty & 1)
-		tbl_changed[SMDB_TBL_ID_GUID2LID] = TRUE;
-
-	dirty = dirty << 1;
-	/*
-	 * Comparing ep_node_rec records
-	 */
-	dirty |= ssa_db_diff_table_cmp(&p_previous_db->ep_node_tbl,
-				       &p_current_db->ep_node_tbl,
-				       p_previous_db->p_node_tbl,
-				       p_current_db->p_node_tbl,
-				       smdb_node_insert,
-				       smdb_node_cmp,
-				       &p_ssa_db_diff->ep_node_tbl_added,
-				       &p_ssa_db_diff->ep_node_tbl_removed,
-				       &p_ssa_db_diff->p_smdb->p_db_tables[SMDB_TBL_ID_NODE],
-				       (void **) &p_ssa_db_diff->p_smdb->pp_tables[SMDB_TBL_ID_NODE]);
-
-	if (dirty & 1)
-		tbl_changed[SMDB_TBL_ID_NODE] = TRUE;
-
-	dirty = dirty << 1;
-	/*
-	 * Comparing ep_link_rec records
-	 */
-	dirty |= ssa_db_diff_table_cmp(&p_previous_db->ep_link_tbl,
-				       &p_current_db->ep_link_tbl,
-				       p_previous_db->p_link_tbl,
-				       p_current_db->p_link_tbl,
-				       smdb_link_insert,
-				       smdb_link_cmp,
-				       &p_ssa_db_diff->ep_link_tbl_added,
-				       &p_ssa_db_diff->ep_link_tbl_removed,
-				       &p_ssa_db_diff->p_smdb->p_db_tables[SMDB_TBL_ID_LINK],
-				       (void **) &p_ssa_db_diff->p_smdb->pp_tables[SMDB_TBL_ID_LINK]);
-
-	if (dirty & 1)
-		tbl_changed[SMDB_TBL_ID_LINK] = TRUE;
-
-	dirty = dirty << 1;
-	/*
-	 * Comparing ep_port_rec records
-	 */
-	dirty |= ssa_db_diff_var_size_table_cmp(&p_previous_db->ep_port_tbl,
-						&p_current_db->ep_port_tbl,
-						p_previous_db->p_port_tbl,
-						p_previous_db->p_pkey_tbl,
-						p_current_db->p_port_tbl,
-						p_current_db->p_pkey_tbl,
-						smdb_port_insert,
-						smdb_port_cmp,
-						&p_ssa_db_diff->ep_port_tbl_added,
-						&p_ssa_db_diff->ep_port_tbl_removed,
-						&p_ssa_db_diff->p_smdb->p_db_tables[SMDB_TBL_ID_PORT],
-						(void **) &p_ssa_db_diff->p_smdb->pp_tables[SMDB_TBL_ID_PORT],
-						&p_ssa_db_diff->p_smdb->p_db_tables[SMDB_TBL_ID_PKEY],
-						(void **) &p_ssa_db_diff->p_smdb->pp_tables[SMDB_TBL_ID_PKEY]);
-
-	if (dirty & 1) {
-		tbl_changed[SMDB_TBL_ID_PORT] = TRUE;
-		tbl_changed[SMDB_TBL_ID_PKEY] = TRUE;
+	switch (tbl_id) {
+	case SMDB_TBL_ID_GUID2LID:
+		dirty = ssa_db_diff_table_cmp(&p_previous_db->ep_guid_to_lid_tbl,
+					      &p_current_db->ep_guid_to_lid_tbl,
+					      p_previous_db->p_guid_to_lid_tbl,
+					      p_current_db->p_guid_to_lid_tbl,
+					      sizeof(struct smdb_guid2lid),
+					      &p_ssa_db_diff->ep_guid_to_lid_tbl_added,
+					      &p_ssa_db_diff->ep_guid_to_lid_tbl_removed,
+					      &p_smdb->p_db_tables[SMDB_TBL_ID_GUID2LID],
+					      (void **) &p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID]);
+		break;
+	case SMDB_TBL_ID_NODE:
+		dirty = ssa_db_diff_table_cmp(&p_previous_db->ep_node_tbl,
+					      &p_current_db->ep_node_tbl,
+					      p_previous_db->p_node_tbl,
+					      p_current_db->p_node_tbl,
+					      sizeof(struct smdb_node),
+					      &p_ssa_db_diff->ep_node_tbl_added,
+					      &p_ssa_db_diff->ep_node_tbl_removed,
+					      &p_smdb->p_db_tables[SMDB_TBL_ID_NODE],
+					      (void **) &p_smdb->pp_tables[SMDB_TBL_ID_NODE]);
+		break;
+	case SMDB_TBL_ID_LINK:
+		dirty = ssa_db_diff_table_cmp(&p_previous_db->ep_link_tbl,
+					      &p_current_db->ep_link_tbl,
+					      p_previous_db->p_link_tbl,
+					      p_current_db->p_link_tbl,
+					      sizeof(struct smdb_link),
+					      &p_ssa_db_diff->ep_link_tbl_added,
+					      &p_ssa_db_diff->ep_link_tbl_removed,
+					      &p_smdb->p_db_tables[SMDB_TBL_ID_LINK],
+					      (void **) &p_smdb->pp_tables[SMDB_TBL_ID_LINK]);
+		break;
+	case SMDB_TBL_ID_PORT:
+		/* pkey records are referenced by the port records */
+		dirty = ssa_db_diff_port_table_cmp(&p_previous_db->ep_port_tbl,
+						   &p_current_db->ep_port_tbl,
+						   p_previous_db->p_port_tbl,
+						   p_previous_db->p_pkey_tbl,
+						   p_current_db->p_port_tbl,
+						   p_current_db->p_pkey_tbl,
+						   &p_ssa_db_diff->ep_port_tbl_added,
+						   &p_ssa_db_diff->ep_port_tbl_removed,
+						   &p_smdb->p_db_tables[SMDB_TBL_ID_PORT],
+						   (void **) &p_smdb->pp_tables[SMDB_TBL_ID_PORT],
+						   &p_smdb->p_db_tables[SMDB_TBL_ID_PKEY],
+						   (void **) &p_smdb->pp_tables[SMDB_TBL_ID_PKEY]);
+		if (dirty)
+			tbl_changed[SMDB_TBL_ID_PKEY] = TRUE;
+		break;
+	default:
+		ssa_log_err(SSA_LOG_DEFAULT, "unexpected table id %d\n", tbl_id);
+		break;
 	}
 
 	if (dirty)
-		p_ssa_db_diff->dirty = 1;
+		tbl_changed[tbl_id] = TRUE;
+
+	return dirty;
 }
 
 /** =========================================================================
@@ -905,9 +623,8 @@ static void ssa_db_diff_dump_field(void * p_tbl, uint16_t max_rec)
 
 /** =========================================================================
  */
-static void ssa_db_diff_dump_node(cl_map_item_t * p_item, void * p_tbl)
+static void ssa_db_diff_dump_node(struct ep_rec_idx * p_map_rec, void * p_tbl)
 {
-	struct ep_map_rec *p_map_rec = (struct ep_map_rec *) p_item;
 	struct smdb_node *p_node_tbl, *p_node;
 	char buffer[64];
 
@@ -928,16 +645,15 @@ static void ssa_db_diff_dump_node(cl_map_item_t * p_item, void * p_tbl)
 
 /** =========================================================================
  */
-static void ssa_db_diff_dump_guid2lid(cl_map_item_t * p_item, void * p_tbl)
+static void ssa_db_diff_dump_guid2lid(struct ep_rec_idx * p_map_rec, void * p_tbl)
 {
-	struct ep_map_rec *p_map_rec = (struct ep_map_rec *) p_item;
-	struct smdb_guid2lid *p_guid2lid_tbl, *p_guid2lid_tbl;
+	struct smdb_guid2lid *p_guid2lid_tbl, *p_guid2lid;
 
 	assert(p_map_rec);
 
 	if (p_tbl) {
 		p_guid2lid_tbl = (struct smdb_guid2lid *) p_tbl;
-		p_guid2lid_tbl_rec = &p_guid2lid_tbl[p_map_rec->offset];
+		p_guid2lid = &p_guid2lid_tbl[p_map_rec->offset];
 		ssa_log(SSA_LOG_VERBOSE, "Port GUID 0x%" PRIx64 " LID %u LMC %u is_switch %d\n",
 			ntohll(p_guid2lid->guid), ntohs(p_guid2lid->lid),
 			p_guid2lid->lmc, p_guid2lid->is_switch);
@@ -946,9 +662,8 @@ static void ssa_db_diff_dump_guid2lid(cl_map_item_t * p_item, void * p_tbl)
 
 /** =========================================================================
  */
-static void ssa_db_diff_dump_port(cl_map_item_t * p_item, void * p_tbl)
+static void ssa_db_diff_dump_port(struct ep_rec_idx * p_map_rec, void * p_tbl)
 {
-	struct ep_map_rec *p_map_rec = (struct ep_map_rec *) p_item;
 	struct smdb_port *p_port_tbl, *p_port;
 
 	if (!p_map_rec)
@@ -1007,9 +722,8 @@ static void ssa_db_diff_dump_lft_block(cl_map_item_t * p_item, void * p_tbl)
 
 /** =========================================================================
  */
-static void ssa_db_diff_dump_link(cl_map_item_t * p_item, void * p_tbl)
+static void ssa_db_diff_dump_link(struct ep_rec_idx * p_map_rec, void * p_tbl)
 {
-	struct ep_map_rec *p_map_rec = (struct ep_map_rec *) p_item;
 	struct smdb_link *p_link_tbl, *p_link;
 
 	if (!p_map_rec)
@@ -1045,6 +759,21 @@ static void ssa_db_diff_dump_qmap(cl_qmap_t * p_qmap,
 		ssa_log(SSA_LOG_VERBOSE, "No changes\n");
 }
 
+/** =========================================================================
+ */
+static void ssa_db_diff_dump_idx(struct ep_idx_tbl * p_idx,
+				 void (*pfn_dump)(struct ep_rec_idx *, void *),
+				 void * p_tbl)
+{
+	uint64_t i;
+
+	for (i = 0; i < p_idx->count; i++)
+		pfn_dump(&p_idx->p_recs[i], p_tbl);
+
+	if (!p_idx->count)
+		ssa_log(SSA_LOG_VERBOSE, "No changes\n");
+}
+
 /** =========================================================================
  */
 static void ssa_db_diff_dump(struct ssa_db_diff * p_ssa_db_diff)
@@ -1071,13 +800,13 @@ static void ssa_db_diff_dump(struct ssa_db_diff * p_ssa_db_diff)
 			       SMDB_FIELD_ID_NODE_MAX);
 	ssa_log(ssa_log_level, "-----------------------------------\n");
 	ssa_log(ssa_log_level, "Added records:\n");
-	ssa_db_diff_dump_qmap(&p_ssa_db_diff->ep_node_tbl_added,
-			      ssa_db_diff_dump_node,
-			      p_smdb->pp_tables[SMDB_TBL_ID_NODE]);
+	ssa_db_diff_dump_idx(&p_ssa_db_diff->ep_node_tbl_added,
+			     ssa_db_diff_dump_node,
+			     p_smdb->pp_tables[SMDB_TBL_ID_NODE]);
 	ssa_log(ssa_log_level, "Removed records:\n");
-	ssa_db_diff_dump_qmap(&p_ssa_db_diff->ep_node_tbl_removed,
-			      ssa_db_diff_dump_node,
-			      p_smdb->pp_tables[SMDB_TBL_ID_NODE]);
+	ssa_db_diff_dump_idx(&p_ssa_db_diff->ep_node_tbl_removed,
+			     ssa_db_diff_dump_node,
+			     p_smdb->pp_tables[SMDB_TBL_ID_NODE]);
 
 	ssa_log(ssa_log_level, "-----------------------------------\n");
 	ssa_log(ssa_log_level, "GUID to LID records:\n");
@@ -1087,13 +816,13 @@ static void ssa_db_diff_dump(struct ssa_db_diff * p_ssa_db_diff)
 			       SMDB_FIELD_ID_GUID_TO_LID_MAX);
 	ssa_log(ssa_log_level, "-----------------------------------\n");
 	ssa_log(ssa_log_level, "Added records:\n");
-	ssa_db_diff_dump_qmap(&p_ssa_db_diff->ep_guid_to_lid_tbl_added,
-			      ssa_db_diff_dump_guid2lid,
-			      p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID]);
+	ssa_db_diff_dump_idx(&p_ssa_db_diff->ep_guid_to_lid_tbl_added,
+			     ssa_db_diff_dump_guid2lid,
+			     p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID]);
 	ssa_log(ssa_log_level, "Removed records:\n");
-	ssa_db_diff_dump_qmap(&p_ssa_db_diff->ep_guid_to_lid_tbl_removed,
-			      ssa_db_diff_dump_guid2lid,
-			      p_smdb->pp_tables[SMDB_TBL_ID_GUID_TO_LID]);
+	ssa_db_diff_dump_idx(&p_ssa_db_diff->ep_guid_to_lid_tbl_removed,
+			     ssa_db_diff_dump_guid2lid,
+			     p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID]);
 
 	ssa_log(ssa_log_level, "-----------------------------------\n");
 	ssa_log(ssa_log_level, "PORT records:\n");
@@ -1103,13 +832,13 @@ static void ssa_db_diff_dump(struct ssa_db_diff * p_ssa_db_diff)
 			       SMDB_FIELD_ID_PORT_MAX);
 	ssa_log(ssa_log_level, "-----------------------------------\n");
 	ssa_log(ssa_log_level, "Added records:\n");
-	ssa_db_diff_dump_qmap(&p_ssa_db_diff->ep_port_tbl_added,
-			      ssa_db_diff_dump_port,
-			      p_smdb->pp_tables[SMDB_TBL_ID_PORT]);
+	ssa_db_diff_dump_idx(&p_ssa_db_diff->ep_port_tbl_added,
+			     ssa_db_diff_dump_port,
+			     p_smdb->pp_tables[SMDB_TBL_ID_PORT]);
 	ssa_log(ssa_log_level, "Removed records:\n");
-	ssa_db_diff_dump_qmap(&p_ssa_db_diff->ep_port_tbl_removed,
-			      ssa_db_diff_dump_port,
-			      p_smdb->pp_tables[SMDB_TBL_ID_PORT]);
+	ssa_db_diff_dump_idx(&p_ssa_db_diff->ep_port_tbl_removed,
+			     ssa_db_diff_dump_port,
+			     p_smdb->pp_tables[SMDB_TBL_ID_PORT]);
 
 	ssa_log(ssa_log_level, "-----------------------------------\n");
 	ssa_log(ssa_log_level, "LFT block records:\n");
@@ -1141,13 +870,13 @@ static void ssa_db_diff_dump(struct ssa_db_diff * p_ssa_db_diff)
 			       SMDB_FIELD_ID_LINK_MAX);
 	ssa_log(ssa_log_level, "-----------------------------------\n");
 	ssa_log(ssa_log_level, "Added records:\n");
-	ssa_db_diff_dump_qmap(&p_ssa_db_diff->ep_link_tbl_added,
-			      ssa_db_diff_dump_link,
-			      p_smdb->pp_tables[SMDB_TBL_ID_LINK]);
+	ssa_db_diff_dump_idx(&p_ssa_db_diff->ep_link_tbl_added,
+			     ssa_db_diff_dump_link,
+			     p_smdb->pp_tables[SMDB_TBL_ID_LINK]);
 	ssa_log(ssa_log_level, "Removed records:\n");
-	ssa_db_diff_dump_qmap(&p_ssa_db_diff->ep_link_tbl_removed,
-			      ssa_db_diff_dump_link,
-			      p_smdb->pp_tables[SMDB_TBL_ID_LINK]);
+	ssa_db_diff_dump_idx(&p_ssa_db_diff->ep_link_tbl_removed,
+			     ssa_db_diff_dump_link,
+			     p_smdb->pp_tables[SMDB_TBL_ID_LINK]);
 	ssa_log(ssa_log_level, "-----------------------------------\n");
 	ssa_log(ssa_log_level, "===================================\n");
 }
@@ -1348,7 +1077,7 @@ ssa_db_diff_update_epoch(struct ssa_db_diff *p_ssa_db_diff,
 
 /** =========================================================================
  */
-static void
+static uint8_t
 ssa_db_diff_update_lfts(struct ssa_database *ssa_db, struct ssa_db_diff *p_ssa_db_diff,
 			boolean_t tbl_changed[], int smdb_deltas, int first)
 {
@@ -1422,9 +1151,105 @@ ssa_db_diff_update_lfts(struct ssa_database *ssa_db, struct ssa_db_diff *p_ssa_d
 		ep_qmap_clear(&ssa_db->p_lft_db->ep_dump_lft_top_tbl);
 	}
 
-	if (tbl_changed[SMDB_TBL_ID_LFT_BLOCK] == TRUE ||
-	    tbl_changed[SMDB_TBL_ID_LFT_TOP] == TRUE)
-		p_ssa_db_diff->dirty = 1;
+	return (tbl_changed[SMDB_TBL_ID_LFT_BLOCK] == TRUE ||
+		tbl_changed[SMDB_TBL_ID_LFT_TOP] == TRUE);
+}
+
+/*
+ * Tables compared by ssa_db_diff_compare_tables().  LFT_BLOCK stands for
+ * both LFT tables and PORT for both port and pkey tables.
+ */
+static const int ssa_db_diff_tbls[] = {
+	SMDB_TBL_ID_PORT,
+	SMDB_TBL_ID_LFT_BLOCK,
+	SMDB_TBL_ID_LINK,
+	SMDB_TBL_ID_GUID2LID,
+	SMDB_TBL_ID_NODE
+};
+
+struct ssa_db_diff_ctx {
+	struct ssa_database	*ssa_db;
+	struct ssa_db_extract	*p_previous_db;
+	struct ssa_db_diff	*p_ssa_db_diff;
+	boolean_t		*tbl_changed;
+	int			first;
+	atomic_t		next;
+	uint8_t			dirty[ARRAY_SIZE(ssa_db_diff_tbls)];
+};
+
+/** =========================================================================
+ */
+static void *ssa_db_diff_worker(void *context)
+{
+	struct ssa_db_diff_ctx *ctx = (struct ssa_db_diff_ctx *) context;
+	int i, tbl_id;
+
+	while ((i = atomic_inc(&ctx->next) - 1) < ARRAY_SIZE(ssa_db_diff_tbls)) {
+		tbl_id = ssa_db_diff_tbls[i];
+		if (tbl_id == SMDB_TBL_ID_LFT_BLOCK)
+			ctx->dirty[i] = ssa_db_diff_update_lfts(ctx->ssa_db,
+								ctx->p_ssa_db_diff,
+								ctx->tbl_changed,
+								smdb_deltas,
+								ctx->first);
+		else if (smdb_deltas &&
+			 ctx->p_previous_db == ctx->ssa_db->p_current_db)
+			continue;	/* no subnet changes to look for */
+		else
+			ctx->dirty[i] =
+				ssa_db_diff_compare_subnet_table(ctx->p_previous_db,
+								 ctx->ssa_db->p_current_db,
+								 ctx->p_ssa_db_diff,
+								 ctx->tbl_changed,
+								 tbl_id);
+	}
+
+	return NULL;
+}
+
+/** =========================================================================
+ */
+static void
+ssa_db_diff_compare_tables(struct ssa_database *ssa_db,
+			   struct ssa_db_extract *p_previous_db,
+			   struct ssa_db_diff *p_ssa_db_diff,
+			   boolean_t tbl_changed[], int first)
+{
+	struct ssa_db_diff_ctx ctx;
+	pthread_t threads[ARRAY_SIZE(ssa_db_diff_tbls)];
+	int i, nthreads;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.ssa_db = ssa_db;
+	ctx.p_previous_db = p_previous_db;
+	ctx.p_ssa_db_diff = p_ssa_db_diff;
+	ctx.tbl_changed = tbl_changed;
+	ctx.first = first;
+	atomic_init(&ctx.next);
+
+	/*
+	 * Biggest tables go first; the calling thread takes jobs too,
+	 * so a single thread (or a failure to start any) runs the
+	 * comparison serially.
+	 */
+	nthreads = min(smdb_diff_threads, (int) ARRAY_SIZE(ssa_db_diff_tbls)) - 1;
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, ssa_db_diff_worker, &ctx)) {
+			ssa_log_warn(SSA_LOG_DEFAULT,
+				     "unable to start SMDB diff thread %d\n", i);
+			break;
+		}
+	}
+	nthreads = i;
+
+	ssa_db_diff_worker(&ctx);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < ARRAY_SIZE(ssa_db_diff_tbls); i++)
+		if (ctx.dirty[i])
+			p_ssa_db_diff->dirty = 1;
 }
 
 static void ipdb_add_addrs(struct ssa_db *ipdb, struct host_addr *addrs,
@@ -1590,8 +1415,10 @@ out:
 
 /** =========================================================================
  */
-struct ssa_db_diff *
-ssa_db_compare(struct ssa_database * ssa_db, uint64_t epoch_prev, int first)
+static struct ssa_db_diff *
+ssa_db_compare_dbs(struct ssa_database * ssa_db,
+		   struct ssa_db_extract * p_previous_db,
+		   uint64_t epoch_prev, int first)
 {
 	struct ssa_db_diff *p_ssa_db_diff = NULL;
 	boolean_t tbl_changed[SMDB_TBL_ID_MAX] = { FALSE };
@@ -1599,7 +1426,7 @@ ssa_db_compare(struct ssa_database * ssa_db, uint64_t epoch_prev, int first)
 
 	ssa_log(SSA_LOG_VERBOSE, "[\n");
 
-	if (!ssa_db || !ssa_db->p_previous_db ||
+	if (!ssa_db || !p_previous_db ||
 	    !ssa_db->p_current_db || !ssa_db->p_dump_db ||
 	    !ssa_db->p_lft_db) {
 		ssa_log_err(SSA_LOG_DEFAULT, "bad arguments\n");
@@ -1608,17 +1435,17 @@ ssa_db_compare(struct ssa_database * ssa_db, uint64_t epoch_prev, int first)
 
 	data_rec_cnt[SMDB_TBL_ID_SUBNET_OPTS] = 1;
 	data_rec_cnt[SMDB_TBL_ID_GUID2LID] =
-		cl_qmap_count(&ssa_db->p_current_db->ep_guid_to_lid_tbl) +
-		cl_qmap_count(&ssa_db->p_previous_db->ep_guid_to_lid_tbl);
+		ssa_db->p_current_db->ep_guid_to_lid_tbl.count +
+		p_previous_db->ep_guid_to_lid_tbl.count;
 	data_rec_cnt[SMDB_TBL_ID_NODE] =
-		cl_qmap_count(&ssa_db->p_current_db->ep_node_tbl) +
-		cl_qmap_count(&ssa_db->p_previous_db->ep_node_tbl);
+		ssa_db->p_current_db->ep_node_tbl.count +
+		p_previous_db->ep_node_tbl.count;
 	data_rec_cnt[SMDB_TBL_ID_LINK] =
-		cl_qmap_count(&ssa_db->p_current_db->ep_link_tbl) +
-		cl_qmap_count(&ssa_db->p_previous_db->ep_link_tbl);
+		ssa_db->p_current_db->ep_link_tbl.count +
+		p_previous_db->ep_link_tbl.count;
 	data_rec_cnt[SMDB_TBL_ID_PORT] =
-		cl_qmap_count(&ssa_db->p_current_db->ep_port_tbl) +
-		cl_qmap_count(&ssa_db->p_previous_db->ep_port_tbl);
+		ssa_db->p_current_db->ep_port_tbl.count +
+		p_previous_db->ep_port_tbl.count;
 	data_rec_cnt[SMDB_TBL_ID_PKEY] =
 		ssa_db->p_current_db->pkey_tbl_rec_num;
 	data_rec_cnt[SMDB_TBL_ID_LFT_TOP] =
@@ -1635,11 +1462,10 @@ ssa_db_compare(struct ssa_database * ssa_db, uint64_t epoch_prev, int first)
 		goto Exit;
 	}
 
-	ssa_db_diff_compare_subnet_opts(ssa_db->p_previous_db, ssa_db->p_current_db,
+	ssa_db_diff_compare_subnet_opts(p_previous_db, ssa_db->p_current_db,
 					p_ssa_db_diff, tbl_changed);
-	ssa_db_diff_compare_subnet_tables(ssa_db->p_previous_db, ssa_db->p_current_db,
-					  p_ssa_db_diff, tbl_changed);
-	ssa_db_diff_update_lfts(ssa_db, p_ssa_db_diff, tbl_changed, smdb_deltas, first);
+	ssa_db_diff_compare_tables(ssa_db, p_previous_db, p_ssa_db_diff,
+				   tbl_changed, first);
 
 	if (addr_preload)
 		update_addr_tables(p_ssa_db_diff, tbl_changed);
@@ -1658,3 +1484,32 @@ Exit:
 
 	return p_ssa_db_diff;
 }
+
+/** =========================================================================
+ */
+struct ssa_db_diff *
+ssa_db_compare(struct ssa_database * ssa_db, uint64_t epoch_prev, int first)
+{
+	if (!ssa_db)
+		return NULL;
+
+	return ssa_db_compare_dbs(ssa_db, ssa_db->p_previous_db,
+				  epoch_prev, first);
+}
+
+/** =========================================================================
+ */
+/*
+ * Build the next SMDB from the current extraction and the LFT changes
+ * queued since, without a new extraction.  Used on reroutes, where the
+ * subnet itself is unchanged.
+ */
+struct ssa_db_diff *
+ssa_db_compare_lfts(struct ssa_database * ssa_db, uint64_t epoch_prev)
+{
+	if (!ssa_db)
+		return NULL;
+
+	return ssa_db_compare_dbs(ssa_db, ssa_db->p_current_db,
+				  epoch_prev, 0);
+}
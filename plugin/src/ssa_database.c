@@ -87,6 +87,7 @@ struct ssa_database *ssa_database_init(void)
 
 	cl_qlist_init(&p_ssa_database->lft_rec_list);
 	pthread_mutex_init(&p_ssa_database->lft_rec_list_lock, NULL);
+	pthread_mutex_init(&p_ssa_database->dirty_lock, NULL);
 
 	p_ssa_database->p_lft_db = ssa_database_lft_init();
 	if (!p_ssa_database->p_lft_db)
@@ -112,6 +113,7 @@ err4:
 err3:
 	ssa_database_lft_delete(p_ssa_database->p_lft_db);
 err2:
+	pthread_mutex_destroy(&p_ssa_database->dirty_lock);
 	pthread_mutex_destroy(&p_ssa_database->lft_rec_list_lock);
 	free(p_ssa_database);
 err1:
@@ -127,6 +129,7 @@ void ssa_database_delete(struct ssa_database *p_ssa_db)
 	ssa_db_extract_delete(p_ssa_db->p_previous_db);
 	ssa_db_extract_delete(p_ssa_db->p_current_db);
 	ssa_database_lft_delete(p_ssa_db->p_lft_db);
+	pthread_mutex_destroy(&p_ssa_db->dirty_lock);
 	pthread_mutex_destroy(&p_ssa_db->lft_rec_list_lock);
 	free(p_ssa_db);
 }
@@ -136,12 +139,6 @@ struct ssa_db_extract *ssa_db_extract_init(void)
 	struct ssa_db_extract *p_ssa_db;
 
 	p_ssa_db = (struct ssa_db_extract *) calloc(1, sizeof(*p_ssa_db));
-	if (p_ssa_db) {
-		cl_qmap_init(&p_ssa_db->ep_guid_to_lid_tbl);
-		cl_qmap_init(&p_ssa_db->ep_node_tbl);
-		cl_qmap_init(&p_ssa_db->ep_port_tbl);
-		cl_qmap_init(&p_ssa_db->ep_link_tbl);
-	}
 	return p_ssa_db;
 }
 
@@ -154,15 +151,10 @@ void ssa_db_extract_delete(struct ssa_db_extract *p_ssa_db)
 		free(p_ssa_db->p_guid_to_lid_tbl);
 		free(p_ssa_db->p_node_tbl);
 
-		ssa_qmap_apply_func(&p_ssa_db->ep_guid_to_lid_tbl, ep_map_rec_delete_pfn);
-		ssa_qmap_apply_func(&p_ssa_db->ep_node_tbl, ep_map_rec_delete_pfn);
-		ssa_qmap_apply_func(&p_ssa_db->ep_port_tbl, ep_map_rec_delete_pfn);
-		ssa_qmap_apply_func(&p_ssa_db->ep_link_tbl, ep_map_rec_delete_pfn);
-
-		cl_qmap_remove_all(&p_ssa_db->ep_node_tbl);
-		cl_qmap_remove_all(&p_ssa_db->ep_guid_to_lid_tbl);
-		cl_qmap_remove_all(&p_ssa_db->ep_port_tbl);
-		cl_qmap_remove_all(&p_ssa_db->ep_link_tbl);
+		ep_idx_tbl_destroy(&p_ssa_db->ep_guid_to_lid_tbl);
+		ep_idx_tbl_destroy(&p_ssa_db->ep_node_tbl);
+		ep_idx_tbl_destroy(&p_ssa_db->ep_port_tbl);
+		ep_idx_tbl_destroy(&p_ssa_db->ep_link_tbl);
 		free(p_ssa_db);
 	}
 }
@@ -213,6 +205,109 @@ void ep_qmap_clear(cl_qmap_t * p_map)
 	}
 }
 
+/*
+ * Reserve room for max records and empty the index.
+ */
+int ep_idx_tbl_init(struct ep_idx_tbl *p_tbl, uint64_t max)
+{
+	struct ep_rec_idx *p_recs;
+
+	p_tbl->count = 0;
+	if (max <= p_tbl->max)
+		return 0;
+
+	p_recs = (struct ep_rec_idx *) realloc(p_tbl->p_recs,
+					       max * sizeof(*p_recs));
+	if (!p_recs)
+		return -1;
+
+	p_tbl->p_recs = p_recs;
+	p_tbl->max = max;
+	return 0;
+}
+
+void ep_idx_tbl_destroy(struct ep_idx_tbl *p_tbl)
+{
+	free(p_tbl->p_recs);
+	p_tbl->p_recs = NULL;
+	p_tbl->count = p_tbl->max = 0;
+}
+
+int ep_idx_tbl_add(struct ep_idx_tbl *p_tbl, uint64_t key, uint64_t offset)
+{
+	struct ep_rec_idx *p_recs;
+	uint64_t max;
+
+	if (p_tbl->count == p_tbl->max) {
+		max = p_tbl->max ? p_tbl->max * 2 : SSA_TABLE_BLOCK_SIZE;
+		p_recs = (struct ep_rec_idx *) realloc(p_tbl->p_recs,
+						       max * sizeof(*p_recs));
+		if (!p_recs)
+			return -1;
+		p_tbl->p_recs = p_recs;
+		p_tbl->max = max;
+	}
+
+	p_tbl->p_recs[p_tbl->count].key = key;
+	p_tbl->p_recs[p_tbl->count].offset = offset;
+	p_tbl->count++;
+	return 0;
+}
+
+static int ep_rec_idx_cmp(const void *p1, const void *p2)
+{
+	const struct ep_rec_idx *p_rec1 = p1, *p_rec2 = p2;
+
+	if (p_rec1->key != p_rec2->key)
+		return p_rec1->key < p_rec2->key ? -1 : 1;
+	if (p_rec1->offset != p_rec2->offset)
+		return p_rec1->offset < p_rec2->offset ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Sort the index by key.  As with cl_qmap_insert(), only the first record
+ * added for a key is kept.
+ */
+void ep_idx_tbl_sort(struct ep_idx_tbl *p_tbl)
+{
+	uint64_t i, n;
+
+	for (i = 1; i < p_tbl->count; i++)
+		if (p_tbl->p_recs[i - 1].key >= p_tbl->p_recs[i].key)
+			break;
+	if (i >= p_tbl->count)
+		return;
+
+	qsort(p_tbl->p_recs, p_tbl->count, sizeof(*p_tbl->p_recs),
+	      ep_rec_idx_cmp);
+
+	for (i = 1, n = 1; i < p_tbl->count; i++)
+		if (p_tbl->p_recs[i].key != p_tbl->p_recs[n - 1].key)
+			p_tbl->p_recs[n++] = p_tbl->p_recs[i];
+	p_tbl->count = n;
+}
+
+/*
+ * Lookup a key in a sorted index.
+ */
+struct ep_rec_idx *ep_idx_tbl_find(struct ep_idx_tbl *p_tbl, uint64_t key)
+{
+	uint64_t lo = 0, hi = p_tbl->count, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (p_tbl->p_recs[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < p_tbl->count && p_tbl->p_recs[lo].key == key)
+		return &p_tbl->p_recs[lo];
+	return NULL;
+}
+
 void ssa_qmap_apply_func(cl_qmap_t *p_qmap, void (*pfn_func)(cl_map_item_t *))
 {
 	cl_map_item_t *p_map_item, *p_map_item_next;
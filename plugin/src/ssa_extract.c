@@ -43,6 +43,7 @@
 #include <poll.h>
 
 #define SSA_EXTRACT_PKEYS_MAX	(1 << 15)
+#define SSA_EXTRACT_DIRTY_MAX	256
 
 const char *port_state_str[] = {
 	"No change",
@@ -178,8 +179,19 @@ extract_alloc_tbls(osm_subn_t *p_subn, struct ssa_db_extract *p_ssa_db)
 	}
 	p_ssa_db->pkey_tbl_rec_num = pkey_cnt;
 
+	if (ep_idx_tbl_init(&p_ssa_db->ep_node_tbl, nodes) ||
+	    ep_idx_tbl_init(&p_ssa_db->ep_guid_to_lid_tbl, guids) ||
+	    ep_idx_tbl_init(&p_ssa_db->ep_port_tbl, ports) ||
+	    ep_idx_tbl_init(&p_ssa_db->ep_link_tbl, links)) {
+		ssa_log(SSA_LOG_DEFAULT,
+			"ERROR - unable to allocate table indexes\n");
+		goto err7;
+	}
+
 	return 0;
 
+err7:
+	free(p_ssa_db->p_pkey_tbl);
 err6:
 	free(p_ssa_db->p_port_tbl);
 err5:
@@ -201,7 +213,6 @@ err0:
 static void extract_node(osm_node_t *p_node, uint64_t *p_offset,
 			 struct ssa_db_extract *p_ssa_db)
 {
-	struct ep_map_rec *p_map_rec;
 #ifdef SSA_PLUGIN_VERBOSE_LOGGING
 	char buffer[64];
 	if (osm_node_get_type(p_node) == IB_NODE_TYPE_SWITCH)
@@ -217,16 +228,9 @@ static void extract_node(osm_node_t *p_node, uint64_t *p_offset,
 
 	smdb_node_init(p_node, &p_ssa_db->p_node_tbl[*p_offset]);
 
-	p_map_rec = ep_map_rec_init(*p_offset);
-	if (!p_map_rec) {
-		/* add memory allocation failure handling */
-		ssa_log(SSA_LOG_VERBOSE,
-			"Quick MAP rec memory allocation failed\n");
-	}
-
-	cl_qmap_insert(&p_ssa_db->ep_node_tbl,
-		       osm_node_get_node_guid(p_node),
-		       &p_map_rec->map_item);
+	if (ep_idx_tbl_add(&p_ssa_db->ep_node_tbl,
+			   osm_node_get_node_guid(p_node), *p_offset))
+		ssa_log_err(SSA_LOG_DEFAULT, "unable to index node record\n");
 
 	*p_offset = *p_offset + 1;
 }
@@ -268,7 +272,6 @@ static void extract_lft(osm_switch_t *p_sw, uint64_t *p_top_offset,
 static void extract_guid2lid(osm_port_t *p_port, uint64_t *p_offset,
 			     struct ssa_db_extract *p_ssa_db)
 {
-	struct ep_map_rec *p_map_rec;
 #ifdef SSA_PLUGIN_VERBOSE_LOGGING
 	uint8_t is_fdr10_active;
 
@@ -295,14 +298,10 @@ static void extract_guid2lid(osm_port_t *p_port, uint64_t *p_offset,
 	}
 
 	smdb_guid2lid_init(p_port, &p_ssa_db->p_guid_to_lid_tbl[*p_offset]);
-	p_map_rec = ep_map_rec_init(*p_offset);
-	if (!p_map_rec) {
-		/* add memory allocation failure handling */
-		ssa_log(SSA_LOG_VERBOSE, "Quick MAP rec memory allocation failed\n");
-	}
-	cl_qmap_insert(&p_ssa_db->ep_guid_to_lid_tbl,
-		       osm_physp_get_port_guid(p_port->p_physp),
-		       &p_map_rec->map_item);
+	if (ep_idx_tbl_add(&p_ssa_db->ep_guid_to_lid_tbl,
+			   osm_physp_get_port_guid(p_port->p_physp), *p_offset))
+		ssa_log_err(SSA_LOG_DEFAULT,
+			    "unable to index GUID to LID record\n");
 
 	*p_offset = *p_offset + 1;
 }
@@ -314,7 +313,6 @@ static void extract_port(osm_physp_t *p_physp, uint16_t *p_lid_ho,
 			 uint64_t *p_port_offset,
 			 struct ssa_db_extract *p_ssa_db)
 {
-	struct ep_map_rec *p_map_rec;
 	uint64_t rec_key;
 	uint16_t lid_ho;
 
@@ -332,9 +330,8 @@ static void extract_port(osm_physp_t *p_physp, uint16_t *p_lid_ho,
 	smdb_port_init(p_physp, pkey_base_offset, pkey_tbl_size,
 			     htons(lid_ho),
 			     &p_ssa_db->p_port_tbl[*p_port_offset]);
-	p_map_rec = ep_map_rec_init(*p_port_offset);
-	cl_qmap_insert(&p_ssa_db->ep_port_tbl, rec_key,
-		       &p_map_rec->map_item);
+	if (ep_idx_tbl_add(&p_ssa_db->ep_port_tbl, rec_key, *p_port_offset))
+		ssa_log_err(SSA_LOG_DEFAULT, "unable to index port record\n");
 	*p_port_offset = *p_port_offset + 1;
 }
 
@@ -344,7 +341,6 @@ static void extract_link(osm_physp_t *p_physp, uint16_t *p_lid_ho,
 			      uint64_t *p_link_offset,
 			      struct ssa_db_extract *p_ssa_db)
 {
-	struct ep_map_rec *p_map_rec;
 	uint64_t rec_key;
 
 	if (p_lid_ho)
@@ -355,8 +351,8 @@ static void extract_link(osm_physp_t *p_physp, uint16_t *p_lid_ho,
 					 osm_physp_get_port_num(p_physp));
 
 	smdb_link_init(p_physp, &p_ssa_db->p_link_tbl[*p_link_offset]);
-	p_map_rec = ep_map_rec_init(*p_link_offset);
-	cl_qmap_insert(&p_ssa_db->ep_link_tbl, rec_key, &p_map_rec->map_item);
+	if (ep_idx_tbl_add(&p_ssa_db->ep_link_tbl, rec_key, *p_link_offset))
+		ssa_log_err(SSA_LOG_DEFAULT, "unable to index link record\n");
 	*p_link_offset = *p_link_offset + 1;
 }
 
@@ -628,6 +624,424 @@ struct ssa_db_extract *ssa_db_extract(osm_opensm_t *p_osm)
 	return p_ssa;
 }
 
+/** ===========================================================================
+ */
+/*
+ * Sort the record indexes of an extracted SMDB.  This does not touch the
+ * subnet, so it is done after the OpenSM lock is released.  Node and port
+ * GUID records come out in key order already, port and link records are
+ * keyed by LID and need sorting.
+ */
+void ssa_db_extract_sort(struct ssa_db_extract *p_ssa_db)
+{
+	if (!p_ssa_db)
+		return;
+
+	ep_idx_tbl_sort(&p_ssa_db->ep_node_tbl);
+	ep_idx_tbl_sort(&p_ssa_db->ep_guid_to_lid_tbl);
+	ep_idx_tbl_sort(&p_ssa_db->ep_port_tbl);
+	ep_idx_tbl_sort(&p_ssa_db->ep_link_tbl);
+}
+
+/** ===========================================================================
+ */
+/*
+ * Record a port reported changed by a trap, so the next extraction may
+ * re-extract it alone.  lid 0 means the change can't be tied to a port
+ * and the whole subnet has to be walked.
+ */
+void ssa_db_dirty_add(uint16_t lid)
+{
+	int i;
+
+	pthread_mutex_lock(&ssa_db->dirty_lock);
+	if (!lid || ssa_db->dirty_lid_cnt == SSA_DB_DIRTY_LIDS_MAX) {
+		ssa_db->dirty_full = 1;
+		goto out;
+	}
+
+	for (i = 0; i < ssa_db->dirty_lid_cnt; i++)
+		if (ssa_db->dirty_lids[i] == lid)
+			goto out;
+	ssa_db->dirty_lids[ssa_db->dirty_lid_cnt++] = lid;
+out:
+	pthread_mutex_unlock(&ssa_db->dirty_lock);
+}
+
+/** ===========================================================================
+ */
+/*
+ * Take the ports changed since the last extraction.  A trap may arrive
+ * before the sweep handling it completes, so the ports taken by the
+ * previous extraction are returned again.  Returns -1 if a full walk is
+ * needed.
+ */
+int ssa_db_dirty_get(uint16_t *lids)
+{
+	int i, k, cnt;
+
+	pthread_mutex_lock(&ssa_db->dirty_lock);
+	cnt = ssa_db->dirty_lid_cnt;
+	memcpy(lids, ssa_db->dirty_lids, cnt * sizeof(*lids));
+	for (i = 0; i < ssa_db->last_dirty_lid_cnt && cnt >= 0; i++) {
+		for (k = 0; k < ssa_db->dirty_lid_cnt; k++)
+			if (ssa_db->last_dirty_lids[i] == ssa_db->dirty_lids[k])
+				break;
+		if (k < ssa_db->dirty_lid_cnt)
+			continue;
+		if (cnt == SSA_DB_DIRTY_LIDS_MAX)
+			cnt = -1;
+		else
+			lids[cnt++] = ssa_db->last_dirty_lids[i];
+	}
+	if (ssa_db->dirty_full)
+		cnt = -1;
+
+	memcpy(ssa_db->last_dirty_lids, ssa_db->dirty_lids,
+	       ssa_db->dirty_lid_cnt * sizeof(*lids));
+	ssa_db->last_dirty_lid_cnt = ssa_db->dirty_full ?
+				     0 : ssa_db->dirty_lid_cnt;
+	ssa_db->dirty_lid_cnt = 0;
+	ssa_db->dirty_full = 0;
+	pthread_mutex_unlock(&ssa_db->dirty_lock);
+
+	return cnt;
+}
+
+struct extract_dirty {
+	uint16_t	lids[SSA_EXTRACT_DIRTY_MAX];
+	be64_t		node_guids[SSA_EXTRACT_DIRTY_MAX];
+	be64_t		port_guids[SSA_EXTRACT_DIRTY_MAX];
+	int		lid_cnt;
+	int		node_cnt;
+	int		port_cnt;
+};
+
+static int extract_cmp_lid(const void *p1, const void *p2)
+{
+	return (int) *(const uint16_t *) p1 - (int) *(const uint16_t *) p2;
+}
+
+static int extract_cmp_guid(const void *p1, const void *p2)
+{
+	be64_t guid1 = *(const be64_t *) p1, guid2 = *(const be64_t *) p2;
+
+	return guid1 < guid2 ? -1 : guid1 > guid2;
+}
+
+static int extract_dirty_has_lid(struct extract_dirty *dirty, uint16_t lid)
+{
+	return bsearch(&lid, dirty->lids, dirty->lid_cnt, sizeof(lid),
+		       extract_cmp_lid) != NULL;
+}
+
+static int extract_dirty_has_guid(be64_t *guids, int cnt, be64_t guid)
+{
+	return bsearch(&guid, guids, cnt, sizeof(guid),
+		       extract_cmp_guid) != NULL;
+}
+
+/** ===========================================================================
+ */
+/*
+ * Add the port owning lid, and the node it belongs to, to the dirty set.
+ * Switch records are keyed by the switch base LID, so a switch is always
+ * extracted as a whole.
+ */
+static int extract_dirty_add(osm_subn_t *p_subn, struct ssa_db_extract *p_prev,
+			     struct extract_dirty *dirty, uint16_t lid)
+{
+	struct ep_rec_idx *p_rec;
+	osm_port_t *p_port;
+	be64_t guid;
+	int i;
+
+	p_port = osm_get_port_by_lid(p_subn, htons(lid));
+	if (!p_port)
+		return -1;
+
+	/* records of a port which changed its LID can't be found by LID */
+	guid = osm_physp_get_port_guid(p_port->p_physp);
+	p_rec = ep_idx_tbl_find(&p_prev->ep_guid_to_lid_tbl, guid);
+	if (!p_rec ||
+	    p_prev->p_guid_to_lid_tbl[p_rec->offset].lid != osm_port_get_base_lid(p_port))
+		return -1;
+
+	lid = ntohs(osm_port_get_base_lid(p_port));
+	for (i = 0; i < dirty->lid_cnt; i++)
+		if (dirty->lids[i] == lid)
+			return 0;
+
+	if (dirty->lid_cnt == SSA_EXTRACT_DIRTY_MAX)
+		return -1;
+	dirty->lids[dirty->lid_cnt++] = lid;
+	dirty->port_guids[dirty->port_cnt++] = guid;
+
+	guid = osm_node_get_node_guid(p_port->p_node);
+	for (i = 0; i < dirty->node_cnt; i++)
+		if (dirty->node_guids[i] == guid)
+			return 0;
+	dirty->node_guids[dirty->node_cnt++] = guid;
+
+	return 0;
+}
+
+/** ===========================================================================
+ */
+/*
+ * Link records are stored on both sides, so the peers of a changed port,
+ * before and after the change, are extracted as well.
+ */
+static int extract_dirty_add_peers(osm_subn_t *p_subn,
+				   struct ssa_db_extract *p_prev,
+				   struct extract_dirty *dirty)
+{
+	uint16_t peers[SSA_EXTRACT_DIRTY_MAX];
+	struct smdb_link *p_link;
+	osm_port_t *p_port;
+	osm_node_t *p_node;
+	osm_physp_t *p_physp, *p_remote;
+	uint64_t i;
+	int k, cnt = 0;
+
+	qsort(dirty->lids, dirty->lid_cnt, sizeof(*dirty->lids),
+	      extract_cmp_lid);
+
+	for (i = 0; i < p_prev->ep_link_tbl.count; i++) {
+		if (!extract_dirty_has_lid(dirty,
+					   p_prev->ep_link_tbl.p_recs[i].key & 0xFFFF))
+			continue;
+		if (cnt == SSA_EXTRACT_DIRTY_MAX)
+			return -1;
+		p_link = &p_prev->p_link_tbl[p_prev->ep_link_tbl.p_recs[i].offset];
+		peers[cnt++] = ntohs(p_link->to_lid);
+	}
+
+	for (k = 0; k < dirty->lid_cnt; k++) {
+		p_port = osm_get_port_by_lid(p_subn, htons(dirty->lids[k]));
+		p_node = p_port->p_node;
+		for (i = 0; i < p_node->physp_tbl_size; i++) {
+			p_physp = osm_node_get_physp_ptr(p_node, i);
+			if (!p_physp)
+				continue;
+			if (osm_node_get_type(p_node) != IB_NODE_TYPE_SWITCH &&
+			    p_physp != p_port->p_physp)
+				continue;
+			p_remote = osm_physp_get_remote(p_physp);
+			if (!p_remote)
+				continue;
+			if (cnt == SSA_EXTRACT_DIRTY_MAX)
+				return -1;
+			if (osm_node_get_type(p_remote->p_node) == IB_NODE_TYPE_SWITCH)
+				peers[cnt++] = ntohs(osm_node_get_base_lid(p_remote->p_node, 0));
+			else
+				peers[cnt++] = ntohs(osm_physp_get_base_lid(p_remote));
+		}
+	}
+
+	for (k = 0; k < cnt; k++)
+		if (extract_dirty_add(p_subn, p_prev, dirty, peers[k]))
+			return -1;
+
+	qsort(dirty->lids, dirty->lid_cnt, sizeof(*dirty->lids),
+	      extract_cmp_lid);
+	qsort(dirty->node_guids, dirty->node_cnt, sizeof(*dirty->node_guids),
+	      extract_cmp_guid);
+	qsort(dirty->port_guids, dirty->port_cnt, sizeof(*dirty->port_guids),
+	      extract_cmp_guid);
+	return 0;
+}
+
+/** ===========================================================================
+ */
+/*
+ * Copy the records of the previous extraction which don't belong to a
+ * changed port.  The source index is sorted, so the copy is too.
+ */
+static int extract_retain_recs(struct ep_idx_tbl *p_idx_src, void *p_tbl_src,
+			       struct ep_idx_tbl *p_idx_dest, void *p_tbl_dest,
+			       size_t rec_size, struct extract_dirty *dirty,
+			       be64_t *guids, int guid_cnt)
+{
+	struct ep_rec_idx *p_rec;
+	uint64_t i, offset;
+
+	for (i = 0; i < p_idx_src->count; i++) {
+		p_rec = &p_idx_src->p_recs[i];
+		if (guids ? extract_dirty_has_guid(guids, guid_cnt, p_rec->key) :
+			    extract_dirty_has_lid(dirty, p_rec->key & 0xFFFF))
+			continue;
+
+		offset = p_idx_dest->count;
+		if (offset == p_idx_dest->max)
+			return -1;
+		memcpy((uint8_t *) p_tbl_dest + offset * rec_size,
+		       (uint8_t *) p_tbl_src + p_rec->offset * rec_size,
+		       rec_size);
+		ep_idx_tbl_add(p_idx_dest, p_rec->key, offset);
+	}
+
+	return 0;
+}
+
+/** ===========================================================================
+ */
+static int extract_retain_ports(struct ssa_db_extract *p_prev,
+				struct ssa_db_extract *p_ssa,
+				struct extract_dirty *dirty,
+				uint64_t *p_pkey_base_offset)
+{
+	struct smdb_port *p_port;
+	uint64_t i, pkey_offset, pkey_cnt;
+
+	if (extract_retain_recs(&p_prev->ep_port_tbl, p_prev->p_port_tbl,
+				&p_ssa->ep_port_tbl, p_ssa->p_port_tbl,
+				sizeof(*p_ssa->p_port_tbl), dirty, NULL, 0))
+		return -1;
+
+	/* move the pkeys along, packed */
+	for (i = 0; i < p_ssa->ep_port_tbl.count; i++) {
+		p_port = &p_ssa->p_port_tbl[i];
+		pkey_cnt = ntohs(p_port->pkey_tbl_size) / sizeof(*p_ssa->p_pkey_tbl);
+		if (!pkey_cnt)
+			continue;
+		if (*p_pkey_base_offset + pkey_cnt > p_ssa->pkey_tbl_rec_num)
+			return -1;
+
+		pkey_offset = ntohll(p_port->pkey_tbl_offset) /
+			      sizeof(*p_ssa->p_pkey_tbl);
+		memcpy(&p_ssa->p_pkey_tbl[*p_pkey_base_offset],
+		       &p_prev->p_pkey_tbl[pkey_offset],
+		       pkey_cnt * sizeof(*p_ssa->p_pkey_tbl));
+		p_port->pkey_tbl_offset =
+			htonll(*p_pkey_base_offset * sizeof(*p_ssa->p_pkey_tbl));
+		*p_pkey_base_offset += pkey_cnt;
+	}
+
+	return 0;
+}
+
+/** ===========================================================================
+ */
+/*
+ * Build the next SMDB from the previous one, re-extracting only the ports
+ * in lids, their nodes and link peers.  Returns NULL when that is not
+ * possible (subnet membership or LIDs changed, too many changes), in which
+ * case the subnet has to be walked by ssa_db_extract().
+ */
+struct ssa_db_extract *ssa_db_extract_incr(osm_opensm_t *p_osm,
+					   struct ssa_db_extract *p_prev,
+					   uint16_t *lids, int lid_cnt)
+{
+	struct extract_dirty *dirty = NULL;
+	struct ssa_db_extract *p_ssa;
+	osm_subn_t *p_subn = &p_osm->subn;
+	osm_node_t *p_node;
+	osm_port_t *p_port;
+	const osm_pkey_tbl_t *p_pkey_tbl;
+	uint64_t node_offset, guid_to_lid_offset, port_offset, link_offset;
+	uint64_t pkey_base_offset = 0, pkey_cur_offset = 0;
+	uint64_t recs;
+	int i;
+
+	ssa_log(SSA_LOG_VERBOSE, "[\n");
+
+	if (!p_prev || !p_prev->initialized || lid_cnt <= 0)
+		goto fallback;
+
+	if (cl_qmap_count(&p_subn->node_guid_tbl) != p_prev->ep_node_tbl.count ||
+	    cl_qmap_count(&p_subn->port_guid_tbl) != p_prev->ep_guid_to_lid_tbl.count) {
+		ssa_log(SSA_LOG_VERBOSE, "subnet membership changed\n");
+		goto fallback;
+	}
+
+	dirty = (struct extract_dirty *) calloc(1, sizeof(*dirty));
+	if (!dirty)
+		goto fallback;
+
+	for (i = 0; i < lid_cnt; i++)
+		if (extract_dirty_add(p_subn, p_prev, dirty, lids[i]))
+			goto fallback;
+	if (extract_dirty_add_peers(p_subn, p_prev, dirty))
+		goto fallback;
+
+	p_ssa = ssa_db->p_dump_db;
+	extract_subnet_opts(p_subn, p_ssa);
+	if (extract_alloc_tbls(p_subn, p_ssa))
+		goto fallback;
+
+	if (extract_retain_recs(&p_prev->ep_node_tbl, p_prev->p_node_tbl,
+				&p_ssa->ep_node_tbl, p_ssa->p_node_tbl,
+				sizeof(*p_ssa->p_node_tbl), dirty,
+				dirty->node_guids, dirty->node_cnt) ||
+	    extract_retain_recs(&p_prev->ep_guid_to_lid_tbl,
+				p_prev->p_guid_to_lid_tbl,
+				&p_ssa->ep_guid_to_lid_tbl,
+				p_ssa->p_guid_to_lid_tbl,
+				sizeof(*p_ssa->p_guid_to_lid_tbl), dirty,
+				dirty->port_guids, dirty->port_cnt) ||
+	    extract_retain_recs(&p_prev->ep_link_tbl, p_prev->p_link_tbl,
+				&p_ssa->ep_link_tbl, p_ssa->p_link_tbl,
+				sizeof(*p_ssa->p_link_tbl), dirty, NULL, 0) ||
+	    extract_retain_ports(p_prev, p_ssa, dirty, &pkey_base_offset))
+		goto fallback;
+
+	node_offset = p_ssa->ep_node_tbl.count;
+	guid_to_lid_offset = p_ssa->ep_guid_to_lid_tbl.count;
+	port_offset = p_ssa->ep_port_tbl.count;
+	link_offset = p_ssa->ep_link_tbl.count;
+
+	for (i = 0; i < dirty->node_cnt; i++) {
+		p_node = osm_get_node_by_guid(p_subn, dirty->node_guids[i]);
+		if (!p_node || node_offset == p_ssa->ep_node_tbl.max)
+			goto fallback;
+		extract_node(p_node, &node_offset, p_ssa);
+	}
+
+	for (i = 0; i < dirty->port_cnt; i++) {
+		p_port = osm_get_port_by_guid(p_subn, dirty->port_guids[i]);
+		if (!p_port || guid_to_lid_offset == p_ssa->ep_guid_to_lid_tbl.max)
+			goto fallback;
+
+		recs = osm_node_get_type(p_port->p_node) == IB_NODE_TYPE_SWITCH ?
+		       p_port->p_node->physp_tbl_size : 1;
+		p_pkey_tbl = osm_physp_get_pkey_tbl(p_port->p_physp);
+		if (port_offset + recs > p_ssa->ep_port_tbl.max ||
+		    link_offset + recs > p_ssa->ep_link_tbl.max ||
+		    pkey_base_offset + cl_map_count((const cl_map_t *) &p_pkey_tbl->keys) >
+		    p_ssa->pkey_tbl_rec_num)
+			goto fallback;
+
+		extract_guid2lid(p_port, &guid_to_lid_offset, p_ssa);
+		if (osm_node_get_type(p_port->p_node) == IB_NODE_TYPE_SWITCH)
+			extract_switch_port(p_port, &pkey_base_offset,
+					    &pkey_cur_offset, &port_offset,
+					    &link_offset, p_ssa);
+		else
+			extract_host_port(p_port, &pkey_base_offset,
+					  &pkey_cur_offset, &port_offset,
+					  &link_offset, p_ssa);
+
+		pkey_base_offset += pkey_cur_offset;
+		pkey_cur_offset = 0;
+	}
+
+	ssa_log(SSA_LOG_DEFAULT | SSA_LOG_VERBOSE,
+		"incremental extraction of %d ports on %d nodes\n",
+		dirty->port_cnt, dirty->node_cnt);
+	free(dirty);
+
+	p_ssa->initialized = 1;
+	ssa_log(SSA_LOG_VERBOSE, "]\n");
+	return p_ssa;
+
+fallback:
+	ssa_log(SSA_LOG_VERBOSE, "falling back to full extraction\n");
+	free(dirty);
+	ssa_log(SSA_LOG_VERBOSE, "]\n");
+	return NULL;
+}
+
 /** ===========================================================================
  */
 void ssa_db_validate_lft(int first)
@@ -679,7 +1093,7 @@ void ssa_db_validate(struct ssa_db_extract *p_ssa_db)
 		p_ssa_db->lmc, p_ssa_db->subnet_timeout,
 		p_ssa_db->allow_both_pkeys ? "en" : "dis");
 
-	for (i = 0; i < cl_qmap_count(&p_ssa_db->ep_node_tbl); i++) {
+	for (i = 0; i < p_ssa_db->ep_node_tbl.count; i++) {
 		node = p_ssa_db->p_node_tbl[i];
 		if (node.node_type == IB_NODE_TYPE_SWITCH)
 			sprintf(buffer, " with %s Switch Port 0\n",
@@ -690,7 +1104,7 @@ void ssa_db_validate(struct ssa_db_extract *p_ssa_db)
 			ntohll(node.node_guid), node.node_type, buffer);
 	}
 
-	for (i = 0; i < cl_qmap_count(&p_ssa_db->ep_guid_to_lid_tbl); i++) {
+	for (i = 0; i < p_ssa_db->ep_guid_to_lid_tbl.count; i++) {
 		guid2lid = p_ssa_db->p_guid_to_lid_tbl[i];
 		ssa_log(SSA_LOG_DB,
 			"Port GUID 0x%" PRIx64 " LID %u LMC %u is_switch %d\n",
@@ -699,7 +1113,7 @@ void ssa_db_validate(struct ssa_db_extract *p_ssa_db)
 
 	}
 
-	for (i = 0; i < cl_qmap_count(&p_ssa_db->ep_port_tbl); i++) {
+	for (i = 0; i < p_ssa_db->ep_port_tbl.count; i++) {
 		port = p_ssa_db->p_port_tbl[i];
 		ssa_log(SSA_LOG_DB, "Port LID %u Port Num %u\n",
 			ntohs(port.port_lid), port.port_num);
@@ -713,7 +1127,7 @@ void ssa_db_validate(struct ssa_db_extract *p_ssa_db)
 			      sizeof(*p_ssa_db->p_pkey_tbl));
 	}
 
-	for (i = 0; i < cl_qmap_count(&p_ssa_db->ep_link_tbl); i++) {
+	for (i = 0; i < p_ssa_db->ep_link_tbl.count; i++) {
 		link = p_ssa_db->p_link_tbl[i];
 		ssa_log(SSA_LOG_DB,
 			"Link Record: from LID %u port %u to LID %u port %u\n",
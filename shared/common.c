@@ -176,7 +176,10 @@ static const char *admin_msg_operation_name[] = {
 	[SSA_ADMIN_CMD_NONE] = "NONE",
 	[SSA_ADMIN_CMD_COUNTER] = "COUNTER",
 	[SSA_ADMIN_CMD_PING] = "PING",
-	[SSA_ADMIN_CMD_NODE_INFO] = "NODEINFO"
+	[SSA_ADMIN_CMD_NODE_INFO] = "NODEINFO",
+	[SSA_ADMIN_CMD_HISTOGRAM] = "HISTOGRAM",
+	[SSA_ADMIN_CMD_EPOCH_TRACE] = "EPOCHTRACE",
+	[SSA_ADMIN_CMD_AGGREGATE] = "AGGREGATE"
 };
 
 void ssa_format_admin_msg(char *buf, size_t size, const struct ssa_admin_msg *msg)
@@ -229,6 +232,34 @@ void ssa_format_admin_msg(char *buf, size_t size, const struct ssa_admin_msg *ms
 			 ntohs(payload->connections_num));
 		}
 		break;
+	case SSA_ADMIN_CMD_HISTOGRAM:
+		{
+		const struct ssa_admin_histogram *payload = &msg->data.histogram;
+
+		snprintf(buf + strlen(buf), size - strlen(buf),
+			 "N: %d Buckets: %d", ntohs(payload->n),
+			 ntohs(payload->bucket_num));
+		}
+		break;
+	case SSA_ADMIN_CMD_EPOCH_TRACE:
+		{
+		const struct ssa_admin_epoch_trace *payload = &msg->data.epoch_trace;
+
+		snprintf(buf + strlen(buf), size - strlen(buf),
+			 "Type: %d N: %d", payload->node_type,
+			 ntohs(payload->n));
+		}
+		break;
+	case SSA_ADMIN_CMD_AGGREGATE:
+		{
+		const struct ssa_admin_aggregate *payload = &msg->data.aggregate;
+
+		snprintf(buf + strlen(buf), size - strlen(buf),
+			 "Depth: %d Timeout: %u Nodes: %u Failed: %u",
+			 ntohs(payload->depth), ntohl(payload->timeout),
+			 ntohl(payload->nodes), ntohl(payload->failed));
+		}
+		break;
 	case SSA_ADMIN_CMD_NONE:
 	default:
 		snprintf(buf + strlen(buf), size - strlen(buf), "Unknown message");
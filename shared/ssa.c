@@ -65,6 +65,7 @@
 #include <ssa_ctrl.h>
 #include <inttypes.h>
 #include <ssa_log.h>
+#include <ssa_metrics.h>
 #include <glib.h>
 
 /* not sure why this isn't in verbs.h but is in libibverbs.map */
@@ -107,6 +108,10 @@ extern int ibv_read_sysfs_file(const char *dir, const char *file,
 #define MAX_REJOIN_TIMEOUT_FACTOR 120
 #endif
 
+#ifndef SSA_CTRL_MAD_BURST
+#define SSA_CTRL_MAD_BURST 64 /* MADs received per port wakeup */
+#endif
+
 struct ssa_db_update_record {
 	DLIST_ENTRY		list_entry;
 	struct ssa_db_update	db_upd;
@@ -117,6 +122,7 @@ struct ssa_db_update_queue {
 	pthread_mutex_t		cond_lock;
 	pthread_cond_t		cond_var;
 	DLIST_ENTRY		list;
+	atomic_t		depth;
 };
 
 struct ssa_access_context {
@@ -127,6 +133,9 @@ struct ssa_access_context {
 	pthread_mutex_t		th_pool_mtx;
 	int			num_workers;
 	atomic_t		num_tasks;
+	atomic_t		busy_workers;
+	atomic_t		prdb_computed;
+	atomic_t		prdb_unchanged;
 };
 
 struct ssa_access_task {
@@ -1173,6 +1182,8 @@ static int ssa_upstream_handle_query_data(struct ssa_conn *conn,
 					conn->rbuf = buf;
 					conn->rsize = ntohl(hdr->len) - sizeof(*hdr);
 					conn->roffset = 0;
+					/* becomes pp_tables[] of the received DB */
+					ssa_db_tbl_advise(conn->rbuf, conn->rsize);
 					ret = rrecv(conn->rsock, conn->rbuf,
 						    conn->rsize, MSG_DONTWAIT);
 					if (ret > 0) {
@@ -1294,6 +1305,13 @@ static void ssa_upstream_send_db_update(struct ssa_svc *svc, struct ssa_db *db,
 	if (svc->process_msg)
 		svc->process_msg(svc, (struct ssa_ctrl_msg_buf *) &msg);
 	ssa_db_update_change_counters(epoch);
+	ssa_metrics_set_db(svc->port->dev->ssa->node_type == SSA_NODE_CONSUMER ?
+			   SSA_METRICS_PRDB : SSA_METRICS_SMDB, db);
+
+	/* Access nodes apply an epoch once the PRDBs are computed from it */
+	if (!(svc->port->dev->ssa->node_type & SSA_NODE_ACCESS))
+		ssa_epoch_trace(ssa_db_get_epoch(db, DB_DEF_TBL_ID),
+				ssa_db_get_origin_time(db), SSA_EPOCH_APPLY);
 }
 
 static short ssa_upstream_update_conn(struct ssa_svc *svc, short events)
@@ -1303,6 +1321,7 @@ static short ssa_upstream_update_conn(struct ssa_svc *svc, short events)
 
 	switch (svc->conn_dataup.phase) {
 	case SSA_DB_IDLE:
+		gettimeofday(&svc->conn_dataup.xfer_start, NULL);
 		revents = ssa_upstream_query(svc, SSA_MSG_DB_QUERY_DEF, events);
 		svc->conn_dataup.rindex = 0;
 		break;
@@ -1398,6 +1417,12 @@ ssa_log(SSA_LOG_DEFAULT, "SSA_DB_FIELD_DEFS index %d %p len %d rsock %d\n", svc-
 		if (svc->conn_dataup.rbuf == svc->conn_dataup.rhdr &&
 		    ntohs(((struct ssa_msg_hdr *)svc->conn_dataup.rhdr)->flags) & SSA_MSG_FLAG_END) {
 			svc->conn_dataup.phase = SSA_DB_IDLE;
+			ssa_hist_record_since(HIST_ID_DB_RECV,
+					      &svc->conn_dataup.xfer_start);
+			ssa_epoch_trace(ssa_db_get_epoch(svc->conn_dataup.ssa_db,
+							 DB_DEF_TBL_ID),
+					ssa_db_get_origin_time(svc->conn_dataup.ssa_db),
+					SSA_EPOCH_ARRIVE);
 			if (svc->conn_dataup.rindex != ssa_db_calculate_data_tbl_num(svc->conn_dataup.ssa_db))
 				ssa_log_err(SSA_LOG_DEFAULT,
 					    "SSA_DB_DATA protocol error - rindex %d num tables %d mismatch\n",
@@ -2417,6 +2442,7 @@ ssa_log(SSA_LOG_DEFAULT, "SMDB %p ref count was just incremented to %u\n", ssadb
 		conn->phase = SSA_DB_DEFS;
 		conn->rid = ntohl(hdr->id);
 		conn->roffset = 0;
+		gettimeofday(&conn->xfer_start, NULL);
 		revents = ssa_downstream_send(conn,
 					      SSA_MSG_DB_QUERY_DEF,
 					      SSA_MSG_FLAG_RESP,
@@ -2574,6 +2600,10 @@ ssa_log(SSA_LOG_DEFAULT, "pp_tables index %d epoch 0x%" PRIx64 " %p len %d rsock
 ssa_log(SSA_LOG_DEFAULT, "SMDB %p ref count was just decremented to %u\n", ssadb, smdb_refcnt);
 			}
 			conn->phase = SSA_DB_IDLE;
+			ssa_hist_record_since(HIST_ID_DB_SEND, &conn->xfer_start);
+			ssa_epoch_trace(ssa_db_get_epoch(ssadb, DB_DEF_TBL_ID),
+					ssa_db_get_origin_time(ssadb),
+					SSA_EPOCH_FORWARD);
 			revents = ssa_downstream_send(conn,
 						      SSA_MSG_DB_QUERY_DATA_DATASET,
 						      SSA_MSG_FLAG_END | SSA_MSG_FLAG_RESP,
@@ -3554,17 +3584,21 @@ static struct ssa_db *ssa_calculate_prdb(struct ssa_svc *svc,
 	struct ssa_db *prdb_copy = NULL;
 	int n, ret;
 	uint64_t epoch, prdb_epoch, actual_epoch;
+	uint32_t origin_time;
 	char dump_dir[1024];
 	struct stat dstat;
+	struct timeval start;
 
 	epoch = ssa_db_get_epoch(access_context.smdb, DB_DEF_TBL_ID);
 	prdb_epoch = ssa_db_get_epoch(consumer->prdb_current, DB_DEF_TBL_ID);
 
 	/* Call below "pulls" in access layer for any node type (if ACCESS defined) !!! */
+	gettimeofday(&start, NULL);
 	ret = ssa_pr_compute_half_world(access_context.smdb,
 					access_context.context,
 					consumer->gid.global.interface_id,
 					&prdb);
+	ssa_hist_record_since(HIST_ID_PRDB_CALC, &start);
 	if (ret == SSA_PR_PORT_ABSENT) {
 		ssa_sprint_addr(SSA_LOG_DEFAULT, log_data, sizeof log_data,
 				SSA_ADDR_GID, consumer->gid.raw,
@@ -3582,6 +3616,7 @@ static struct ssa_db *ssa_calculate_prdb(struct ssa_svc *svc,
 		if (consumer->prdb_current) {
 			ret = ssa_db_cmp(prdb, consumer->prdb_current);
 			if (!ret) {
+				atomic_inc(&access_context.prdb_unchanged);
 				ssa_sprint_addr(SSA_LOG_CTRL, log_data, sizeof log_data,
 						SSA_ADDR_GID, consumer->gid.raw,
 						sizeof consumer->gid.raw);
@@ -3675,6 +3710,7 @@ static struct ssa_db *ssa_calculate_prdb(struct ssa_svc *svc,
 
 skip_db_save:
 	if (prdb != NULL) {
+		atomic_inc(&access_context.prdb_computed);
 		if (++prdb_epoch == DB_EPOCH_INVALID)
 			prdb_epoch++;
 		actual_epoch = ssa_db_set_epoch(prdb, DB_DEF_TBL_ID, prdb_epoch);
@@ -3683,6 +3719,11 @@ skip_db_save:
 		actual_epoch = ssa_db_set_epoch(prdb_copy, DB_DEF_TBL_ID, prdb_epoch);
 		if (actual_epoch == DB_EPOCH_INVALID)
 			ssa_log(SSA_LOG_VERBOSE, "PRDB copy epoch set failed\n");
+		/* PRDBs carry the origin of the SMDB they are computed from */
+		origin_time = ssa_db_get_origin_time(access_context.smdb);
+		ssa_db_set_origin_time(prdb, origin_time);
+		ssa_db_set_origin_time(prdb_copy, origin_time);
+		ssa_epoch_trace(epoch, origin_time, SSA_EPOCH_APPLY);
 		consumer->smdb_epoch = epoch;
 		ssa_db_destroy(consumer->prdb_current);
 		consumer->prdb_current = prdb;
@@ -3733,6 +3774,7 @@ static int ssa_push_db_update(struct ssa_db_update_queue *p_queue,
 	pthread_mutex_lock(&p_queue->lock);
 	DListInsertTail(&p_rec->list_entry, &p_queue->list);
 	pthread_mutex_unlock(&p_queue->lock);
+	atomic_inc(&p_queue->depth);
 
 	/* send signal for start processing the queue */
 	pthread_mutex_lock(&p_queue->cond_lock);
@@ -3753,6 +3795,7 @@ static int ssa_pull_db_update(struct ssa_db_update_queue *p_queue,
 		head = p_queue->list.Next;
 		DListRemove(head);
 		pthread_mutex_unlock(&p_queue->lock);
+		atomic_dec(&p_queue->depth);
 		p_rec = container_of(head, struct ssa_db_update_record,
 				     list_entry);
 		*p_db_upd = p_rec->db_upd;
@@ -3766,12 +3809,14 @@ static int ssa_pull_db_update(struct ssa_db_update_queue *p_queue,
 
 static void g_al_callback(gpointer task, gpointer user_data)
 {
+	static struct ssa_log_ratelimit task_rl;
 	struct ssa_access_task *al_task;
 	struct ssa_svc *svc;
 	struct ssa_access_member *consumer;
 	struct ssa_db *prdb;
 	struct ssa_db_update db_upd;
 	long num_tasks;
+	int log_task;
 
 	(void) user_data;
 
@@ -3781,17 +3826,23 @@ static void g_al_callback(gpointer task, gpointer user_data)
 	al_task = (struct ssa_access_task *) task;
 	consumer = al_task->consumer;
 	svc = al_task->svc;
+	atomic_inc(&access_context.busy_workers);
 
-	ssa_sprint_addr(SSA_LOG_DEFAULT, log_data, sizeof log_data,
-			SSA_ADDR_GID, consumer->gid.raw,
-			sizeof consumer->gid.raw);
-	ssa_log(SSA_LOG_DEFAULT,
-		"calculating PRDB for GID %s LID %u client\n",
-		log_data, consumer->lid);
+	/* GID is only formatted for the messages the rate limit lets out */
+	log_task = ssa_log_ratelimit(&task_rl, SSA_LOG_DEFAULT, __func__);
+	if (log_task) {
+		ssa_sprint_addr(SSA_LOG_DEFAULT, log_data, sizeof log_data,
+				SSA_ADDR_GID, consumer->gid.raw,
+				sizeof consumer->gid.raw);
+		ssa_log(SSA_LOG_DEFAULT,
+			"calculating PRDB for GID %s LID %u client\n",
+			log_data, consumer->lid);
+	}
 	prdb = ssa_calculate_prdb(svc, consumer);
-	ssa_log(SSA_LOG_DEFAULT,
-		"GID %s LID %u rsock %d PRDB %p calculation complete\n",
-		log_data, consumer->lid, consumer->rsock, prdb);
+	if (log_task)
+		ssa_log(SSA_LOG_DEFAULT,
+			"GID %s LID %u rsock %d PRDB %p calculation complete\n",
+			log_data, consumer->lid, consumer->rsock, prdb);
 #ifdef SIM_SUPPORT_FAKE_ACM
 	if (ACM_FAKE_RSOCKET_ID == consumer->rsock) {
 		if (prdb)
@@ -3812,6 +3863,7 @@ static void g_al_callback(gpointer task, gpointer user_data)
 #ifdef SIM_SUPPORT_FAKE_ACM
 out:
 #endif
+	atomic_dec(&access_context.busy_workers);
 	pthread_mutex_lock(&access_context.th_pool_mtx);
 	num_tasks = atomic_dec(&access_context.num_tasks);
 	ssa_set_runtime_counter(COUNTER_ID_NUM_ACCESS_TASKS, num_tasks);
@@ -3825,6 +3877,7 @@ static void ssa_access_map_callback(const void *nodep, const VISIT which,
 {
 	struct ssa_access_member *consumer;
 	struct ssa_svc *svc = (struct ssa_svc *) priv;
+	static struct ssa_log_ratelimit map_rl;
 	const char *node_type = NULL;
 	struct ssa_access_task *task;
 	short update_prdb = 0;
@@ -3847,12 +3900,14 @@ static void ssa_access_map_callback(const void *nodep, const VISIT which,
 	if (update_prdb) {
 		consumer = container_of(* (struct ssa_access_member **) nodep,
 					struct ssa_access_member, gid);
-		ssa_sprint_addr(SSA_LOG_DEFAULT, log_data, sizeof log_data,
-				SSA_ADDR_GID, consumer->gid.raw,
-				sizeof consumer->gid.raw);
-		ssa_log(SSA_LOG_DEFAULT,
-			"%s GID %s LID %u rsock %d pushing task to access thread pool\n",
-			node_type, log_data, consumer->lid, consumer->rsock);
+		if (ssa_log_ratelimit(&map_rl, SSA_LOG_DEFAULT, __func__)) {
+			ssa_sprint_addr(SSA_LOG_DEFAULT, log_data, sizeof log_data,
+					SSA_ADDR_GID, consumer->gid.raw,
+					sizeof consumer->gid.raw);
+			ssa_log(SSA_LOG_DEFAULT,
+				"%s GID %s LID %u rsock %d pushing task to access thread pool\n",
+				node_type, log_data, consumer->lid, consumer->rsock);
+		}
 		task = calloc(1, sizeof(*task));
 		task->svc = svc;
 		task->consumer = consumer;
@@ -3881,9 +3936,33 @@ static void prdb_handler_cleanup(void *context)
 			free(p_rec);
 		}
 	}
+	atomic_set(&p_queue->depth, 0);
 	pthread_mutex_unlock(&p_queue->lock);
 }
 
+static void ssa_access_metrics(FILE *out, void *context)
+{
+	ssa_metrics_header(out, "ssa_access_workers", "gauge",
+			   "PRDB calculation threads");
+	fprintf(out, "ssa_access_workers %d\n", access_context.num_workers);
+	ssa_metrics_header(out, "ssa_access_busy_workers", "gauge",
+			   "PRDB calculation threads currently busy");
+	fprintf(out, "ssa_access_busy_workers %ld\n",
+		atomic_get(&access_context.busy_workers));
+	ssa_metrics_header(out, "ssa_prdb_computed_total", "counter",
+			   "PRDBs calculated and sent");
+	fprintf(out, "ssa_prdb_computed_total %ld\n",
+		atomic_get(&access_context.prdb_computed));
+	ssa_metrics_header(out, "ssa_prdb_unchanged_total", "counter",
+			   "PRDBs calculated equal to the previous one");
+	fprintf(out, "ssa_prdb_unchanged_total %ld\n",
+		atomic_get(&access_context.prdb_unchanged));
+	ssa_metrics_header(out, "ssa_prdb_update_queue_depth", "gauge",
+			   "PRDB updates waiting to be sent");
+	fprintf(out, "ssa_prdb_update_queue_depth %ld\n",
+		atomic_get(&update_queue.depth));
+}
+
 static void *ssa_access_prdb_handler(void *context)
 {
 	struct ssa_db_update db_upd;
@@ -4620,7 +4699,11 @@ static void ssa_ctrl_send_listen(struct ssa_svc *svc)
 			    ret, sizeof(msg));
 }
 
-static void ssa_ctrl_port(struct ssa_port *port)
+/*
+ * Receive one MAD and forward it to its service.  Later MADs of a burst
+ * find the (nonblocking) MAD fd drained, which is not an error.
+ */
+static int ssa_ctrl_port_recv(struct ssa_port *port, int burst)
 {
 	struct ssa_svc *svc;
 	struct ssa_ctrl_umad_msg msg;
@@ -4632,8 +4715,9 @@ static void ssa_ctrl_port(struct ssa_port *port)
 	len = sizeof msg.umad;
 	ret = umad_recv(port->mad_portid, (void *) &msg.umad, &len, 0);
 	if (ret < 0) {
-		ssa_log_warn(SSA_LOG_CTRL, "receive MAD failure\n");
-		return;
+		if (!burst || (errno != EAGAIN && errno != EWOULDBLOCK))
+			ssa_log_warn(SSA_LOG_CTRL, "receive MAD failure\n");
+		return -1;
 	}
 
 	if ((msg.umad.packet.mad_hdr.method & UMAD_METHOD_RESP_MASK) ||
@@ -4663,7 +4747,7 @@ static void ssa_ctrl_port(struct ssa_port *port)
 
 	if (!svc) {
 		ssa_log_err(SSA_LOG_CTRL, "no matching service for received MAD\n");
-		return;
+		return 0;
 	}
 
 	msg.hdr.len = sizeof msg;
@@ -4676,6 +4760,21 @@ static void ssa_ctrl_port(struct ssa_port *port)
 
 	if (parent && port->dev->ssa->node_type != SSA_NODE_CONSUMER)
 		ssa_ctrl_send_listen(svc);
+	return 0;
+}
+
+/*
+ * Drain the MADs queued on the port, so a join storm reaches the
+ * service back to back and may be handled in batches.
+ */
+static void ssa_ctrl_port(struct ssa_port *port)
+{
+	int i;
+
+	for (i = 0; i < SSA_CTRL_MAD_BURST; i++) {
+		if (ssa_ctrl_port_recv(port, i))
+			break;
+	}
 }
 
 static void ssa_upstream_conn(struct ssa_svc *svc, struct ssa_conn *conn,
@@ -5445,6 +5544,9 @@ static int ssa_access_thread_pool_init()
 	GError *g_error = NULL;
 
 	atomic_set(&access_context.num_tasks, 0);
+	atomic_init(&access_context.busy_workers);
+	atomic_init(&access_context.prdb_computed);
+	atomic_init(&access_context.prdb_unchanged);
 
 	ret = pthread_cond_init(&access_context.th_pool_cond, NULL);
 	if (ret) {
@@ -5564,6 +5666,7 @@ static int ssa_db_update_queue_init(struct ssa_db_update_queue *p_queue)
 	}
 
 	DListInit(&p_queue->list);
+	atomic_init(&p_queue->depth);
 	return ret;
 }
 
@@ -5630,6 +5733,7 @@ int ssa_start_access(struct ssa_class *ssa)
 		errno = ret;
 		goto err5;
 	}
+	ssa_metrics_register(ssa_access_metrics, NULL);
 #endif
 
 	access_thread = calloc(1, sizeof(*access_thread));
@@ -6471,6 +6575,74 @@ static struct ssa_admin_msg *ssa_admin_handle_node_info(struct ssa_admin_msg *ad
 	return response;
 }
 
+static struct ssa_admin_msg *ssa_admin_handle_histogram(struct ssa_admin_msg *admin_request)
+{
+	struct ssa_admin_msg *response;
+	struct ssa_admin_histogram *hist_msg;
+	uint64_t buckets[SSA_ADMIN_HIST_BUCKETS];
+	size_t len;
+	int i, j;
+
+	len = sizeof(response->hdr) + sizeof(*hist_msg) +
+	      HIST_ID_LAST * SSA_ADMIN_HIST_BUCKETS * sizeof(hist_msg->buckets[0]);
+	response = (struct ssa_admin_msg *) malloc(max(len, sizeof(*response)));
+	if (!response) {
+		ssa_log_err(SSA_LOG_CTRL, "admin response allocation failed\n");
+		return NULL;
+	}
+
+	response->hdr = admin_request->hdr;
+	response->hdr.status = SSA_ADMIN_STATUS_SUCCESS;
+	response->hdr.method = SSA_ADMIN_METHOD_RESP;
+	response->hdr.len = htons(len);
+
+	hist_msg = &response->data.histogram;
+	memset(hist_msg, 0, sizeof(*hist_msg));
+	hist_msg->n = htons(HIST_ID_LAST);
+	hist_msg->bucket_num = htons(SSA_ADMIN_HIST_BUCKETS);
+
+	for (i = 0; i < HIST_ID_LAST; i++) {
+		ssa_hist_get(i, buckets);
+		for (j = 0; j < SSA_ADMIN_HIST_BUCKETS; j++)
+			hist_msg->buckets[i * SSA_ADMIN_HIST_BUCKETS + j] =
+				htonll(buckets[j]);
+	}
+
+	return response;
+}
+
+static struct ssa_admin_msg *ssa_admin_handle_epoch_trace(struct ssa_admin_msg *admin_request,
+							  struct ssa_admin_handler_context *context)
+{
+	struct ssa_admin_msg *response;
+	struct ssa_admin_epoch_trace *trace_msg;
+	size_t len;
+	int n;
+
+	len = sizeof(response->hdr) + sizeof(*trace_msg) +
+	      SSA_ADMIN_EPOCH_TRACE_NUM * sizeof(trace_msg->recs[0]);
+	response = (struct ssa_admin_msg *) malloc(max(len, sizeof(*response)));
+	if (!response) {
+		ssa_log_err(SSA_LOG_CTRL, "admin response allocation failed\n");
+		return NULL;
+	}
+
+	trace_msg = &response->data.epoch_trace;
+	memset(trace_msg, 0, sizeof(*trace_msg));
+	n = ssa_epoch_trace_get(trace_msg->recs, SSA_ADMIN_EPOCH_TRACE_NUM);
+	trace_msg->node_type = context->ssa->node_type;
+	trace_msg->n = htons(n);
+
+	len = sizeof(response->hdr) + sizeof(*trace_msg) +
+	      n * sizeof(trace_msg->recs[0]);
+	response->hdr = admin_request->hdr;
+	response->hdr.status = SSA_ADMIN_STATUS_SUCCESS;
+	response->hdr.method = SSA_ADMIN_METHOD_RESP;
+	response->hdr.len = htons(len);
+
+	return response;
+}
+
 static struct ssa_admin_msg *ssa_admin_handle_message(struct ssa_admin_msg *admin_request,
 						      struct ssa_admin_handler_context *context)
 {
@@ -6486,6 +6658,12 @@ static struct ssa_admin_msg *ssa_admin_handle_message(struct ssa_admin_msg *admi
 	case SSA_ADMIN_CMD_NODE_INFO:
 		return ssa_admin_handle_node_info(admin_request, context);
 		break;
+	case SSA_ADMIN_CMD_HISTOGRAM:
+		return ssa_admin_handle_histogram(admin_request);
+		break;
+	case SSA_ADMIN_CMD_EPOCH_TRACE:
+		return ssa_admin_handle_epoch_trace(admin_request, context);
+		break;
 	default:
 		error = 1;
 	};
@@ -6611,6 +6789,572 @@ static void ssa_print_admin_msg(const struct ssa_admin_msg *msg)
 #define SSA_ADMIN_REPORT_MSG(msg)
 #endif
 
+/*
+ * Aggregate query state.  Answers are summed in host order and
+ * serialized once all the downstream nodes answered or the time given
+ * by the requester ran out.  At most ADMIN_AGGR_FANOUT downstream
+ * nodes are queried at once, each in its own pollfd slot after the
+ * service slots of the admin thread.
+ */
+#define ADMIN_AGGR_FANOUT	64
+#define ADMIN_AGGR_MIN_TIMEOUT	10	/* msec, below it stop forwarding */
+
+enum ssa_admin_aggr_state {
+	ADMIN_AGGR_IDLE = 0,
+	ADMIN_AGGR_CONNECTING,
+	ADMIN_AGGR_SEND,
+	ADMIN_AGGR_RECV
+};
+
+struct ssa_admin_aggr_slot {
+	enum ssa_admin_aggr_state state;
+	int sleft;
+	int rcount;
+	int rlen;
+	struct ssa_admin_msg_hdr hdr;
+	struct ssa_admin_msg *rmsg;
+};
+
+struct ssa_admin_aggr_totals {
+	uint32_t nodes;
+	uint32_t failed;
+	uint32_t type_nodes[SSA_ADMIN_AGGR_NODE_TYPES];
+	struct {
+		uint64_t sum;
+		uint64_t min;
+		uint64_t max;
+		uint32_t nodes;
+	} counters[COUNTER_ID_LAST];
+	uint64_t buckets[HIST_ID_LAST][SSA_ADMIN_HIST_BUCKETS];
+};
+
+struct ssa_admin_aggr {
+	int pending;
+	struct ssa_admin_msg_hdr hdr;		/* of the client request */
+	struct ssa_admin_msg request;		/* forwarded downstream */
+	union ibv_gid *children;
+	int child_num;
+	int child_next;
+	int active;
+	uint64_t deadline;			/* wall clock msec */
+	struct pollfd *fds;
+	struct ssa_admin_aggr_slot slots[ADMIN_AGGR_FANOUT];
+	struct ssa_admin_aggr_totals totals;
+};
+
+static uint64_t ssa_admin_time_msec(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (uint64_t) now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+static int ssa_admin_counter_less(int id, uint64_t a, uint64_t b)
+{
+	if (ssa_admin_counters_type[id] == ssa_counter_signed_numeric)
+		return (int64_t) a < (int64_t) b;
+	return a < b;
+}
+
+static void ssa_admin_aggr_add_counter(struct ssa_admin_aggr_totals *totals,
+				       int id, uint64_t sum, uint64_t min,
+				       uint64_t max, uint32_t nodes)
+{
+	if (!nodes || ssa_admin_counters_type[id] == ssa_counter_obsolete)
+		return;
+
+	if (!totals->counters[id].nodes ||
+	    ssa_admin_counter_less(id, min, totals->counters[id].min))
+		totals->counters[id].min = min;
+	if (!totals->counters[id].nodes ||
+	    ssa_admin_counter_less(id, totals->counters[id].max, max))
+		totals->counters[id].max = max;
+	totals->counters[id].sum += sum;
+	totals->counters[id].nodes += nodes;
+}
+
+static void ssa_admin_aggr_add_local(struct ssa_admin_aggr_totals *totals,
+				     int node_type)
+{
+	uint64_t buckets[SSA_ADMIN_HIST_BUCKETS], val;
+	struct timeval time_stamp;
+	int i, j;
+
+	totals->nodes++;
+	for (i = 0; i < SSA_ADMIN_AGGR_NODE_TYPES; i++) {
+		if (node_type & (1 << i))
+			totals->type_nodes[i]++;
+	}
+
+	for (i = 0; i < COUNTER_ID_LAST; i++) {
+		if (ssa_admin_counters_type[i] == ssa_counter_timestamp) {
+			if (ssa_get_runtime_counter_time(i, &time_stamp))
+				continue;
+			val = (uint64_t) time_stamp.tv_sec * 1000 +
+			      time_stamp.tv_usec / 1000;
+		} else {
+			val = (uint64_t) ssa_get_runtime_counter(i);
+		}
+		/*
+		 * Consumers count PRDB epochs, all other nodes the SMDB one,
+		 * so only the latter are comparable across the subtree.
+		 */
+		if (i == COUNTER_ID_DB_EPOCH &&
+		    (node_type == SSA_NODE_CONSUMER || val == DB_EPOCH_INVALID))
+			continue;
+		ssa_admin_aggr_add_counter(totals, i, val, val, val, 1);
+	}
+
+	for (i = 0; i < HIST_ID_LAST; i++) {
+		ssa_hist_get(i, buckets);
+		for (j = 0; j < SSA_ADMIN_HIST_BUCKETS; j++)
+			totals->buckets[i][j] += buckets[j];
+	}
+}
+
+static int ssa_admin_aggr_add_response(struct ssa_admin_aggr_totals *totals,
+				       const struct ssa_admin_msg *msg)
+{
+	const struct ssa_admin_aggregate *aggr_msg = &msg->data.aggregate;
+	const struct ssa_admin_aggr_counter *counter;
+	const be64_t *buckets;
+	size_t len;
+	int i, j, n, hist_n, bucket_num;
+
+	len = ntohs(msg->hdr.len);
+	if (ntohs(msg->hdr.opcode) != SSA_ADMIN_CMD_AGGREGATE ||
+	    msg->hdr.status != SSA_ADMIN_STATUS_SUCCESS ||
+	    len < sizeof(msg->hdr) + sizeof(*aggr_msg))
+		return -1;
+
+	n = ntohs(aggr_msg->n);
+	hist_n = ntohs(aggr_msg->hist_n);
+	bucket_num = ntohs(aggr_msg->bucket_num);
+	if (len < sizeof(msg->hdr) + sizeof(*aggr_msg) +
+		  n * sizeof(*counter) + hist_n * bucket_num * sizeof(*buckets))
+		return -1;
+
+	totals->nodes += ntohl(aggr_msg->nodes);
+	totals->failed += ntohl(aggr_msg->failed);
+	for (i = 0; i < SSA_ADMIN_AGGR_NODE_TYPES; i++)
+		totals->type_nodes[i] += ntohl(aggr_msg->type_nodes[i]);
+
+	for (i = 0; i < min(n, COUNTER_ID_LAST); i++) {
+		counter = &aggr_msg->counters[i];
+		ssa_admin_aggr_add_counter(totals, i, ntohll(counter->sum),
+					   ntohll(counter->min),
+					   ntohll(counter->max),
+					   ntohl(counter->nodes));
+	}
+
+	if (bucket_num != SSA_ADMIN_HIST_BUCKETS)
+		return 0;
+
+	buckets = (const be64_t *) &aggr_msg->counters[n];
+	for (i = 0; i < min(hist_n, HIST_ID_LAST); i++) {
+		for (j = 0; j < SSA_ADMIN_HIST_BUCKETS; j++)
+			totals->buckets[i][j] +=
+				ntohll(buckets[i * SSA_ADMIN_HIST_BUCKETS + j]);
+	}
+
+	return 0;
+}
+
+static struct ssa_admin_msg *ssa_admin_aggr_response(struct ssa_admin_aggr *aggr)
+{
+	struct ssa_admin_aggr_totals *totals = &aggr->totals;
+	struct ssa_admin_msg *response;
+	struct ssa_admin_aggregate *aggr_msg;
+	struct ssa_admin_aggr_counter *counter;
+	be64_t *buckets;
+	size_t len;
+	int i, j;
+
+	len = sizeof(response->hdr) + sizeof(*aggr_msg) +
+	      COUNTER_ID_LAST * sizeof(*counter) +
+	      HIST_ID_LAST * SSA_ADMIN_HIST_BUCKETS * sizeof(*buckets);
+	response = (struct ssa_admin_msg *) calloc(1, max(len, sizeof(*response)));
+	if (!response) {
+		ssa_log_err(SSA_LOG_CTRL, "admin response allocation failed\n");
+		return NULL;
+	}
+
+	response->hdr = aggr->hdr;
+	response->hdr.status = SSA_ADMIN_STATUS_SUCCESS;
+	response->hdr.method = SSA_ADMIN_METHOD_RESP;
+	response->hdr.len = htons(len);
+
+	aggr_msg = &response->data.aggregate;
+	aggr_msg->n = htons(COUNTER_ID_LAST);
+	aggr_msg->nodes = htonl(totals->nodes);
+	aggr_msg->failed = htonl(totals->failed);
+	for (i = 0; i < SSA_ADMIN_AGGR_NODE_TYPES; i++)
+		aggr_msg->type_nodes[i] = htonl(totals->type_nodes[i]);
+	aggr_msg->hist_n = htons(HIST_ID_LAST);
+	aggr_msg->bucket_num = htons(SSA_ADMIN_HIST_BUCKETS);
+
+	for (i = 0; i < COUNTER_ID_LAST; i++) {
+		counter = &aggr_msg->counters[i];
+		counter->sum = htonll(totals->counters[i].sum);
+		counter->min = htonll(totals->counters[i].min);
+		counter->max = htonll(totals->counters[i].max);
+		counter->nodes = htonl(totals->counters[i].nodes);
+	}
+
+	buckets = (be64_t *) &aggr_msg->counters[COUNTER_ID_LAST];
+	for (i = 0; i < HIST_ID_LAST; i++) {
+		for (j = 0; j < SSA_ADMIN_HIST_BUCKETS; j++)
+			buckets[i * SSA_ADMIN_HIST_BUCKETS + j] =
+				htonll(totals->buckets[i][j]);
+	}
+
+	return response;
+}
+
+static void ssa_admin_aggr_close_slot(struct ssa_admin_aggr *aggr, int i)
+{
+	if (aggr->fds[i].fd >= 0)
+		rclose(aggr->fds[i].fd);
+	aggr->fds[i].fd = -1;
+	aggr->fds[i].events = 0;
+	aggr->fds[i].revents = 0;
+
+	free(aggr->slots[i].rmsg);
+	memset(&aggr->slots[i], 0, sizeof(aggr->slots[i]));
+	aggr->active--;
+}
+
+static void ssa_admin_aggr_fail_slot(struct ssa_admin_aggr *aggr, int i)
+{
+	aggr->totals.failed++;
+	ssa_admin_aggr_close_slot(aggr, i);
+}
+
+static int ssa_admin_aggr_connect(const union ibv_gid *gid)
+{
+	struct sockaddr_ib dst_addr;
+	int rsock, ret, val = 1;
+
+	rsock = rsocket(AF_IB, SOCK_STREAM, 0);
+	if (rsock < 0) {
+		ssa_log(SSA_LOG_DEFAULT | SSA_LOG_CTRL,
+			"rsocket ERROR %d (%s)\n", errno, strerror(errno));
+		return -1;
+	}
+
+	ret = rsetsockopt(rsock, IPPROTO_TCP, TCP_NODELAY,
+			  (void *) &val, sizeof(val));
+	if (ret) {
+		ssa_log(SSA_LOG_DEFAULT | SSA_LOG_CTRL,
+			"rsetsockopt TCP_NODELAY ERROR %d (%s) on rsock %d\n",
+			errno, strerror(errno), rsock);
+		goto err;
+	}
+
+	ret = rfcntl(rsock, F_SETFL, O_NONBLOCK);
+	if (ret) {
+		ssa_log(SSA_LOG_DEFAULT | SSA_LOG_CTRL,
+			"rfcntl ERROR %d (%s) on rsock %d\n",
+			errno, strerror(errno), rsock);
+		goto err;
+	}
+
+	dst_addr.sib_family = AF_IB;
+	dst_addr.sib_pkey = 0xFFFF;
+	dst_addr.sib_flowinfo = 0;
+	dst_addr.sib_sid = htonll(((uint64_t) RDMA_PS_TCP << 16) + admin_port);
+	dst_addr.sib_sid_mask = htonll(RDMA_IB_IP_PS_MASK);
+	dst_addr.sib_scope_id = 0;
+	memcpy(&dst_addr.sib_addr, gid, sizeof(*gid));
+
+	ret = rconnect(rsock, (const struct sockaddr *) &dst_addr,
+		       sizeof(dst_addr));
+	if (ret && (errno != EINPROGRESS)) {
+		ssa_log(SSA_LOG_DEFAULT | SSA_LOG_CTRL,
+			"rconnect rsock %d ERROR %d (%s)\n",
+			rsock, errno, strerror(errno));
+		goto err;
+	}
+
+	return rsock;
+
+err:
+	rclose(rsock);
+	return -1;
+}
+
+/* Query the next downstream nodes while there are free slots */
+static void ssa_admin_aggr_start_children(struct ssa_admin_aggr *aggr)
+{
+	int i, rsock;
+
+	for (i = 0; i < ADMIN_AGGR_FANOUT &&
+		    aggr->child_next < aggr->child_num; i++) {
+		if (aggr->slots[i].state != ADMIN_AGGR_IDLE)
+			continue;
+
+		rsock = ssa_admin_aggr_connect(&aggr->children[aggr->child_next++]);
+		if (rsock < 0) {
+			aggr->totals.failed++;
+			continue;
+		}
+
+		aggr->fds[i].fd = rsock;
+		aggr->fds[i].events = POLLOUT;
+		aggr->fds[i].revents = 0;
+		aggr->slots[i].state = ADMIN_AGGR_CONNECTING;
+		aggr->slots[i].sleft = ntohs(aggr->request.hdr.len);
+		aggr->active++;
+	}
+}
+
+static void ssa_admin_aggr_cleanup(struct ssa_admin_aggr *aggr)
+{
+	int i;
+
+	for (i = 0; i < ADMIN_AGGR_FANOUT; i++) {
+		if (aggr->slots[i].state != ADMIN_AGGR_IDLE)
+			ssa_admin_aggr_close_slot(aggr, i);
+	}
+
+	free(aggr->children);
+	aggr->children = NULL;
+	aggr->child_num = 0;
+	aggr->child_next = 0;
+	aggr->active = 0;
+	aggr->pending = 0;
+}
+
+/*
+ * Returns the response right away when there is nobody to forward the
+ * request to, otherwise NULL with aggr->pending set.
+ */
+static struct ssa_admin_msg *ssa_admin_aggr_start(struct ssa_admin_aggr *aggr,
+						  const struct ssa_admin_msg *request,
+						  struct ssa_admin_handler_context *context)
+{
+	const struct ssa_admin_aggregate *aggr_req = &request->data.aggregate;
+	struct ssa_admin_connection_info *connection_info;
+	GHashTableIter iter;
+	gpointer key, value;
+	uint32_t timeout = 0;
+	int i, n, depth = 0;
+
+	ssa_admin_aggr_cleanup(aggr);
+	memset(&aggr->totals, 0, sizeof(aggr->totals));
+	aggr->hdr = request->hdr;
+
+	if (ntohs(request->hdr.len) >= sizeof(request->hdr) + sizeof(*aggr_req)) {
+		depth = ntohs(aggr_req->depth);
+		timeout = ntohl(aggr_req->timeout);
+	}
+
+	ssa_admin_aggr_add_local(&aggr->totals, context->ssa->node_type);
+
+	n = g_hash_table_size(context->connections_hash);
+	if (n) {
+		aggr->children = calloc(n, sizeof(*aggr->children));
+		if (!aggr->children) {
+			ssa_log_err(SSA_LOG_CTRL,
+				    "unable to allocate aggregate children\n");
+			n = 0;
+		}
+	}
+
+	g_hash_table_iter_init(&iter, context->connections_hash);
+	while (n && g_hash_table_iter_next(&iter, &key, &value)) {
+		connection_info = (struct ssa_admin_connection_info *) value;
+		if (connection_info->connection_type != SSA_CONN_TYPE_DOWNSTREAM)
+			continue;
+
+		for (i = 0; i < aggr->child_num; i++) {
+			if (!memcmp(&aggr->children[i], connection_info->remote_gid,
+				    sizeof(aggr->children[i])))
+				break;
+		}
+		if (i == aggr->child_num)
+			memcpy(&aggr->children[aggr->child_num++],
+			       connection_info->remote_gid,
+			       sizeof(aggr->children[0]));
+	}
+
+	if (aggr->child_num &&
+	    (!depth || timeout * 3 / 4 < ADMIN_AGGR_MIN_TIMEOUT)) {
+		ssa_log(SSA_LOG_VERBOSE | SSA_LOG_CTRL,
+			"aggregate not forwarded to %d nodes: depth %d timeout %u\n",
+			aggr->child_num, depth, timeout);
+		aggr->totals.failed += aggr->child_num;
+		aggr->child_num = 0;
+	}
+
+	if (!aggr->child_num) {
+		free(aggr->children);
+		aggr->children = NULL;
+		return ssa_admin_aggr_response(aggr);
+	}
+
+	memset(&aggr->request, 0, sizeof(aggr->request));
+	aggr->request.hdr = request->hdr;
+	aggr->request.hdr.len = htons(sizeof(aggr->request.hdr) +
+				      sizeof(aggr->request.data.aggregate));
+	aggr->request.data.aggregate.depth = htons(depth - 1);
+	aggr->request.data.aggregate.timeout = htonl(timeout * 3 / 4);
+
+	/* keep 1/8 of the time to collect and send the answer */
+	aggr->deadline = ssa_admin_time_msec() + timeout * 7 / 8;
+	aggr->pending = 1;
+
+	ssa_log(SSA_LOG_VERBOSE | SSA_LOG_CTRL,
+		"aggregate forwarded to %d nodes depth %d timeout %u\n",
+		aggr->child_num, depth - 1, timeout * 3 / 4);
+
+	ssa_admin_aggr_start_children(aggr);
+	return NULL;
+}
+
+static void ssa_admin_aggr_recv(struct ssa_admin_aggr *aggr, int i)
+{
+	struct ssa_admin_aggr_slot *slot = &aggr->slots[i];
+	int ret;
+
+	if (slot->rcount < sizeof(slot->hdr)) {
+		ret = ssa_admin_recv_buf(aggr->fds[i].fd, (char *) &slot->hdr,
+					 &slot->rcount, sizeof(slot->hdr));
+		if (ret < 0) {
+			ssa_admin_aggr_fail_slot(aggr, i);
+			return;
+		}
+		if (slot->rcount < sizeof(slot->hdr))
+			return;
+
+		slot->rlen = ntohs(slot->hdr.len);
+		if (slot->rlen < sizeof(slot->hdr)) {
+			ssa_admin_aggr_fail_slot(aggr, i);
+			return;
+		}
+		slot->rmsg = malloc(max(slot->rlen, sizeof(*slot->rmsg)));
+		if (!slot->rmsg) {
+			ssa_log_err(SSA_LOG_CTRL,
+				    "unable to allocate aggregate response\n");
+			ssa_admin_aggr_fail_slot(aggr, i);
+			return;
+		}
+		slot->rmsg->hdr = slot->hdr;
+	}
+
+	ret = ssa_admin_recv_buf(aggr->fds[i].fd, (char *) slot->rmsg,
+				 &slot->rcount, slot->rlen);
+	if (ret < 0) {
+		ssa_admin_aggr_fail_slot(aggr, i);
+		return;
+	}
+	if (slot->rcount < slot->rlen)
+		return;
+
+	if (ssa_admin_aggr_add_response(&aggr->totals, slot->rmsg)) {
+		ssa_log_warn(SSA_LOG_CTRL,
+			     "invalid aggregate response on rsock %d\n",
+			     aggr->fds[i].fd);
+		ssa_admin_aggr_fail_slot(aggr, i);
+		return;
+	}
+
+	ssa_admin_aggr_close_slot(aggr, i);
+}
+
+static void ssa_admin_aggr_process(struct ssa_admin_aggr *aggr)
+{
+	int i, ret, err, revents;
+	socklen_t len;
+
+	for (i = 0; i < ADMIN_AGGR_FANOUT; i++) {
+		if (aggr->slots[i].state == ADMIN_AGGR_IDLE ||
+		    !aggr->fds[i].revents)
+			continue;
+
+		revents = aggr->fds[i].revents;
+		aggr->fds[i].revents = 0;
+
+		if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			ssa_admin_aggr_fail_slot(aggr, i);
+			continue;
+		}
+
+		if (aggr->slots[i].state == ADMIN_AGGR_CONNECTING &&
+		    (revents & POLLOUT)) {
+			len = sizeof(err);
+			ret = rgetsockopt(aggr->fds[i].fd, SOL_SOCKET, SO_ERROR,
+					  &err, &len);
+			if (ret || err) {
+				ssa_log(SSA_LOG_VERBOSE | SSA_LOG_CTRL,
+					"aggregate rconnect rsock %d ERROR %d\n",
+					aggr->fds[i].fd, ret ? errno : err);
+				ssa_admin_aggr_fail_slot(aggr, i);
+				continue;
+			}
+			aggr->slots[i].state = ADMIN_AGGR_SEND;
+		}
+
+		if (aggr->slots[i].state == ADMIN_AGGR_SEND &&
+		    (revents & POLLOUT)) {
+			ret = ssa_admin_send_msg(aggr->fds[i].fd, &aggr->request,
+						 &aggr->slots[i].sleft,
+						 ntohs(aggr->request.hdr.len));
+			if (ret) {
+				ssa_admin_aggr_fail_slot(aggr, i);
+				continue;
+			}
+			if (!aggr->slots[i].sleft) {
+				aggr->slots[i].state = ADMIN_AGGR_RECV;
+				aggr->fds[i].events = POLLIN;
+			}
+		} else if (aggr->slots[i].state == ADMIN_AGGR_RECV &&
+			   (revents & POLLIN)) {
+			ssa_admin_aggr_recv(aggr, i);
+		}
+	}
+
+	ssa_admin_aggr_start_children(aggr);
+}
+
+/* Returns the response once every downstream node answered or timed out */
+static struct ssa_admin_msg *ssa_admin_aggr_check(struct ssa_admin_aggr *aggr)
+{
+	struct ssa_admin_msg *response;
+	int i;
+
+	if (aggr->active || aggr->child_next < aggr->child_num) {
+		if (ssa_admin_time_msec() < aggr->deadline)
+			return NULL;
+
+		ssa_log_warn(SSA_LOG_CTRL,
+			     "aggregate timed out waiting for %d downstream nodes\n",
+			     aggr->active + aggr->child_num - aggr->child_next);
+		for (i = 0; i < ADMIN_AGGR_FANOUT; i++) {
+			if (aggr->slots[i].state != ADMIN_AGGR_IDLE)
+				ssa_admin_aggr_fail_slot(aggr, i);
+		}
+		aggr->totals.failed += aggr->child_num - aggr->child_next;
+		aggr->child_next = aggr->child_num;
+	}
+
+	response = ssa_admin_aggr_response(aggr);
+	ssa_admin_aggr_cleanup(aggr);
+	return response;
+}
+
+static int ssa_admin_aggr_poll_timeout(struct ssa_admin_aggr *aggr)
+{
+	uint64_t now;
+
+	if (!aggr->pending)
+		return -1;
+
+	now = ssa_admin_time_msec();
+	return now < aggr->deadline ? (int) (aggr->deadline - now) : 0;
+}
+
 static void *ssa_admin_handler(void *context)
 {
 	struct ssa_class *ssa = context;
@@ -6618,9 +7362,11 @@ static void *ssa_admin_handler(void *context)
 	struct ssa_port *port;
 	struct ssa_ctrl_msg_buf msg;
 	struct ssa_admin_msg admin_request, *admin_response = NULL;
+	struct ssa_admin_msg *aggr_response;
+	struct ssa_admin_aggr aggr;
 	struct pollfd *fds = NULL;
 	int rsock = -1;
-	int val, ret, svc_cnt = 0;
+	int val, ret, svc_cnt = 0, nfds;
 	int i, d, p, s;
 	int rlen = 0, rcount;
 	int slen = 0, sleft = 0;
@@ -6631,6 +7377,8 @@ static void *ssa_admin_handler(void *context)
 
 	SET_THREAD_NAME(*admin_thread, "ADMIN");
 
+	memset(&aggr, 0, sizeof(aggr));
+
 	connections_hash = g_hash_table_new_full(NULL, NULL, NULL,
 						 ssa_destroy_connection_info);
 	if (!connections_hash) {
@@ -6659,13 +7407,17 @@ static void *ssa_admin_handler(void *context)
 	handler_context.svcs_hash = svcs_hash;
 	handler_context.ssa = ssa;
 
-	fds = calloc(ADMIN_FIRST_SERVICE_FD_SLOT + svc_cnt * ADMIN_FDS_PER_SERVICE,
-		     sizeof(*fds));
+	nfds = ADMIN_FIRST_SERVICE_FD_SLOT + svc_cnt * ADMIN_FDS_PER_SERVICE;
+	fds = calloc(nfds + ADMIN_AGGR_FANOUT, sizeof(*fds));
 	if (!fds) {
 		ssa_log_err(SSA_LOG_CTRL, "unable to allocate fds\n");
 		goto out;
 	}
 
+	aggr.fds = fds + nfds;
+	for (i = 0; i < ADMIN_AGGR_FANOUT; i++)
+		aggr.fds[i].fd = -1;
+
 	rsock = ssa_admin_listen(ssa, admin_port);
 
 	fds[0].fd = sock_adminctrl[1];
@@ -6715,15 +7467,28 @@ static void *ssa_admin_handler(void *context)
 		goto out;
 
 	for (;;) {
-		ret = rpoll(fds,
-			    ADMIN_FIRST_SERVICE_FD_SLOT + svc_cnt * ADMIN_FDS_PER_SERVICE,
-			    -1);
+		ret = rpoll(fds, nfds + (aggr.pending ? ADMIN_AGGR_FANOUT : 0),
+			    ssa_admin_aggr_poll_timeout(&aggr));
 		if (ret < 0) {
 			ssa_log_err(SSA_LOG_CTRL, "polling fds %d (%s)\n",
 				    errno, strerror(errno));
 			continue;
 		}
 
+		if (aggr.pending && fds[2].fd < 0) {
+			ssa_admin_aggr_cleanup(&aggr);
+		} else if (aggr.pending) {
+			ssa_admin_aggr_process(&aggr);
+			aggr_response = ssa_admin_aggr_check(&aggr);
+			if (aggr_response) {
+				free(admin_response);
+				admin_response = aggr_response;
+				fds[2].events = POLLOUT;
+				slen = ntohs(admin_response->hdr.len);
+				sleft = slen;
+			}
+		}
+
 		if (fds[0].revents) {
 			fds[0].revents = 0;
 			ret = read(sock_adminctrl[1], (char *) &msg,
@@ -6845,6 +7610,7 @@ static void *ssa_admin_handler(void *context)
 
 				free(admin_response);
 				admin_response = NULL;
+				ssa_admin_aggr_cleanup(&aggr);
 				fds[2].fd = rsock_data;
 				fds[2].events = POLLIN;
 				fds[2].revents = 0;
@@ -6938,6 +7704,16 @@ static void *ssa_admin_handler(void *context)
 						admin_response->hdr.status = SSA_ADMIN_STATUS_FAILURE;
 						admin_response->hdr.method = SSA_ADMIN_METHOD_RESP;
 						admin_response->hdr.len = htons(sizeof(*admin_response));
+					} else if (ntohs(admin_request.hdr.opcode) == SSA_ADMIN_CMD_AGGREGATE) {
+						free(admin_response);
+						admin_response = ssa_admin_aggr_start(&aggr, &admin_request,
+										      &handler_context);
+						if (aggr.pending) {
+							/* answered once the downstream nodes did */
+							fds[2].events = 0;
+							fds[2].revents = 0;
+							continue;
+						}
 					} else {
 						admin_response = ssa_admin_handle_message(&admin_request, &handler_context);
 					}
@@ -6955,7 +7731,7 @@ static void *ssa_admin_handler(void *context)
 		}
 
 
-		for (i = ADMIN_FIRST_SERVICE_FD_SLOT; i < ADMIN_FIRST_SERVICE_FD_SLOT + svc_cnt * ADMIN_FDS_PER_SERVICE; i++) {
+		for (i = ADMIN_FIRST_SERVICE_FD_SLOT; i < nfds; i++) {
 			if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
 				if (fds[i].revents & POLLERR) {
 					char event_str[128] = {};
@@ -7062,6 +7838,7 @@ static void *ssa_admin_handler(void *context)
 		}
 	}
 out:
+	ssa_admin_aggr_cleanup(&aggr);
 	free(fds);
 	if (rsock >= 0)
 		rclose(rsock);
@@ -7110,6 +7887,8 @@ int ssa_start_admin(struct ssa_class *ssa)
 		goto err4;
 	}
 
+	/* metrics are optional, the node runs without them */
+	ssa_metrics_start(ssa->node_type);
 	return 0;
 err4:
 	pthread_join(*admin_thread, NULL);
@@ -7129,6 +7908,8 @@ void ssa_stop_admin()
 
 	ssa_log_func(SSA_LOG_VERBOSE | SSA_LOG_CTRL);
 
+	ssa_metrics_stop();
+
 	msg.len = sizeof msg;
 	msg.type = SSA_CTRL_EXIT;
 	ret = write(sock_adminctrl[0], (char *) &msg, sizeof msg);
@@ -37,9 +37,27 @@
 #  include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <infiniband/ssa_db.h>
+#include <ssa_log.h>
+
+int db_hugepages = SSA_DB_HUGEPAGES_NONE;
+int db_numa_interleave = 0;
+
+#define SSA_DB_HUGEPAGE_SIZE	(2 * 1024 * 1024)
+#define SSA_DB_HUGEPAGE_1G_SIZE	(1024 * 1024 * 1024)
+
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE		3
+#endif
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT		26
+#endif
 
 static int get_table_id(const char *name, struct db_dataset *dataset,
 			struct db_table_def *tbl_def)
@@ -76,6 +94,7 @@ void ssa_db_def_init(struct db_def * p_db_def, uint8_t version,
 	strncpy(p_db_def->name, name, sizeof(p_db_def->name));
 	p_db_def->epoch			= htonll(epoch);
 	p_db_def->table_def_size	= htonl(table_def_size);
+	p_db_def->origin_time		= 0;
 }
 
 static int ssa_db_def_cmp(struct db_def const *db_def1,
@@ -281,88 +300,234 @@ uint64_t ssa_db_increment_epoch(struct ssa_db *p_ssa_db, uint8_t tbl_id)
 
 /** =========================================================================
  */
-struct ssa_db *ssa_db_alloc(uint64_t * p_num_recs_arr,
-			    size_t * p_data_recs_size_arr,
-			    uint64_t * p_num_field_recs_arr,
-			    uint64_t tbl_cnt)
+uint32_t ssa_db_get_origin_time(const struct ssa_db *p_ssa_db)
 {
-	struct ssa_db *p_db;
-	int i, k, size;
+	if (!p_ssa_db)
+		return 0;
 
-	p_db = (struct ssa_db *) calloc(1, sizeof(*p_db));
-	if (!p_db)
-		goto err1;
+	return ntohl(p_ssa_db->db_def.origin_time);
+}
 
+/** =========================================================================
+ */
+void ssa_db_set_origin_time(struct ssa_db *p_ssa_db, uint32_t origin_time)
+{
+	if (p_ssa_db)
+		p_ssa_db->db_def.origin_time = htonl(origin_time);
+}
+
+#define SSA_DB_ARENA_ALIGN(x)	(((x) + 7) & ~((size_t) 7))
+
+/*
+ * Layout of an ssa_db arena: offsets of every section, computed from the
+ * table sizes before anything is allocated.
+ */
+struct ssa_db_layout {
+	size_t	def_tbl;
+	size_t	db_tables;
+	size_t	db_field_tables;
+	size_t	pp_tables;
+	size_t	pp_field_tables;
+	size_t	data_start;
+	size_t	len;
+};
+
+static int ssa_db_arena_layout(struct ssa_db_layout *p_layout,
+			       uint64_t *p_num_recs_arr,
+			       size_t *p_data_recs_size_arr,
+			       uint64_t *p_num_field_recs_arr,
+			       uint64_t tbl_cnt)
+{
+	size_t off, size;
+	uint64_t i;
+
+	off = SSA_DB_ARENA_ALIGN(sizeof(struct ssa_db));
+	p_layout->def_tbl = off;
 	/* number of data & field tables = tbl_cnt * 2 */
-	p_db->p_def_tbl = (struct db_table_def *)
-				calloc(tbl_cnt * 2, sizeof(*p_db->p_def_tbl));
-	if (!p_db->p_def_tbl)
-		goto err2;
+	off += SSA_DB_ARENA_ALIGN(tbl_cnt * 2 * sizeof(struct db_table_def));
+	p_layout->db_tables = off;
+	off += SSA_DB_ARENA_ALIGN(tbl_cnt * sizeof(struct db_dataset));
+	p_layout->db_field_tables = off;
+	off += SSA_DB_ARENA_ALIGN(tbl_cnt * sizeof(struct db_dataset));
+	p_layout->pp_tables = off;
+	off += SSA_DB_ARENA_ALIGN(tbl_cnt * sizeof(void *));
+	p_layout->pp_field_tables = off;
+	off += SSA_DB_ARENA_ALIGN(tbl_cnt * sizeof(struct db_field_def *));
+	p_layout->data_start = off;
 
-	p_db->p_db_tables = (struct db_dataset *)
-				calloc(tbl_cnt, sizeof(*p_db->p_db_tables));
-	if (!p_db->p_db_tables)
-		goto err3;
+	for (i = 0; i < tbl_cnt; i++) {
+		size = p_data_recs_size_arr[i] * p_num_recs_arr[i];
+		if (p_num_recs_arr[i] && size / p_num_recs_arr[i] !=
+		    p_data_recs_size_arr[i])
+			return -1;
+		if (off + SSA_DB_ARENA_ALIGN(size) < off)
+			return -1;
+		off += SSA_DB_ARENA_ALIGN(size);
+	}
+
+	for (i = 0; i < tbl_cnt; i++) {
+		if (p_num_field_recs_arr[i] == DB_VARIABLE_SIZE)
+			continue;
+		off += SSA_DB_ARENA_ALIGN(p_num_field_recs_arr[i] *
+					  sizeof(struct db_field_def));
+	}
 
-	p_db->p_db_field_tables = (struct db_dataset *)
-				calloc(tbl_cnt, sizeof(*p_db->p_db_field_tables));
-	if (!p_db->p_db_field_tables)
-		goto err4;
+	p_layout->len = off;
+	return 0;
+}
 
-	p_db->pp_tables = (void **) calloc(tbl_cnt, sizeof(*p_db->pp_tables));
-	if (!p_db->pp_tables)
-		goto err5;
+/*
+ * Apply the configured memory policy to a table which was not yet
+ * touched: back it by transparent hugepages and/or spread its pages
+ * over all NUMA nodes, so access threads on every node see the same
+ * average latency.  Only whole pages inside the table are affected.
+ */
+void ssa_db_tbl_advise(void *tbl, size_t len)
+{
+	unsigned long nodemask = ~0UL;
+	uintptr_t start, end;
+	long page_size;
 
+	if (!tbl || len < SSA_DB_HUGEPAGE_SIZE ||
+	    (db_hugepages != SSA_DB_HUGEPAGES_THP && !db_numa_interleave))
+		return;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	start = ((uintptr_t) tbl + page_size - 1) & ~(page_size - 1);
+	end = ((uintptr_t) tbl + len) & ~(page_size - 1);
+	if (start >= end)
+		return;
+
+#ifdef MADV_HUGEPAGE
+	if (db_hugepages == SSA_DB_HUGEPAGES_THP)
+		madvise((void *) start, end - start, MADV_HUGEPAGE);
+#endif
+#ifdef SYS_mbind
+	/* nodes missing from the system are masked out by the kernel */
+	if (db_numa_interleave &&
+	    syscall(SYS_mbind, start, end - start, MPOL_INTERLEAVE,
+		    &nodemask, sizeof(nodemask) * 8, 0))
+		ssa_log_warn(SSA_LOG_DEFAULT,
+			     "mbind of %zu bytes ERROR %d (%s)\n",
+			     (size_t) (end - start), errno, strerror(errno));
+#endif
+}
+
+/*
+ * *p_map_len is set to the length actually mapped, or to 0 when the
+ * arena came from malloc.
+ */
+static void *ssa_db_arena_alloc(size_t len, size_t *p_map_len)
+{
+	size_t page_size = SSA_DB_HUGEPAGE_SIZE;
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	void *arena;
+
+	*p_map_len = 0;
+	if (len < SSA_DB_HUGEPAGE_SIZE ||
+	    db_hugepages < SSA_DB_HUGEPAGES_2M) {
+		arena = malloc(len);
+		ssa_db_tbl_advise(arena, len);
+		return arena;
+	}
+
+#ifdef MAP_HUGETLB
+	flags |= MAP_HUGETLB;
+	if (db_hugepages == SSA_DB_HUGEPAGES_1G) {
+		flags |= 30 << MAP_HUGE_SHIFT;
+		page_size = SSA_DB_HUGEPAGE_1G_SIZE;
+	}
+#endif
+	len = (len + page_size - 1) & ~(page_size - 1);
+	arena = mmap(NULL, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (arena == MAP_FAILED) {
+		/* no hugepages reserved: fall back to regular pages */
+		arena = malloc(len);
+		ssa_db_tbl_advise(arena, len);
+		return arena;
+	}
+
+	*p_map_len = len;
+	ssa_db_tbl_advise(arena, len);
+	return arena;
+}
+
+static void ssa_db_arena_free(void *arena, size_t map_len)
+{
+	if (map_len)
+		munmap(arena, map_len);
+	else
+		free(arena);
+}
+
+/* Checks whether the table was allocated as part of the SSA DB arena */
+static int ssa_db_tbl_in_arena(const struct ssa_db *p_ssa_db, const void *tbl)
+{
+	const uint8_t *arena = p_ssa_db->p_arena;
+
+	return arena && (const uint8_t *) tbl >= arena &&
+	       (const uint8_t *) tbl < arena + p_ssa_db->arena_len;
+}
+
+/** =========================================================================
+ */
+struct ssa_db *ssa_db_alloc(uint64_t * p_num_recs_arr,
+			    size_t * p_data_recs_size_arr,
+			    uint64_t * p_num_field_recs_arr,
+			    uint64_t tbl_cnt)
+{
+	struct ssa_db_layout layout;
+	struct ssa_db *p_db;
+	uint8_t *arena;
+	size_t off, size;
+	uint64_t i;
+	size_t map_len;
+
+	if (ssa_db_arena_layout(&layout, p_num_recs_arr, p_data_recs_size_arr,
+				p_num_field_recs_arr, tbl_cnt))
+		return NULL;
+
+	arena = ssa_db_arena_alloc(layout.len, &map_len);
+	if (!arena)
+		return NULL;
+
+	/* data tables are filled by the caller, everything else starts zeroed */
+	memset(arena, 0, layout.data_start);
+
+	p_db = (struct ssa_db *) arena;
+	p_db->p_arena = arena;
+	p_db->arena_len = layout.len;
+	p_db->arena_map_len = map_len;
+	p_db->p_def_tbl = (struct db_table_def *) (arena + layout.def_tbl);
+	p_db->p_db_tables = (struct db_dataset *) (arena + layout.db_tables);
+	p_db->p_db_field_tables =
+		(struct db_dataset *) (arena + layout.db_field_tables);
+	p_db->pp_tables = (void **) (arena + layout.pp_tables);
+	p_db->pp_field_tables =
+		(struct db_field_def **) (arena + layout.pp_field_tables);
+
+	off = layout.data_start;
 	for (i = 0; i < tbl_cnt; i++) {
 		size = p_data_recs_size_arr[i] * p_num_recs_arr[i];
 		if (!size)
 			continue;
-		p_db->pp_tables[i] = (void *) malloc(size);
-		if (!p_db->pp_tables[i]) {
-			for (k = i - 1; k >= 0; k--)
-				free(p_db->pp_tables[k]);
-			goto err6;
-		}
+		p_db->pp_tables[i] = arena + off;
+		off += SSA_DB_ARENA_ALIGN(size);
 	}
 
-	p_db->pp_field_tables = (struct db_field_def **)
-				calloc(tbl_cnt, sizeof(*p_db->pp_field_tables));
-	if (!p_db->pp_field_tables)
-		goto err7;
-
 	for (i = 0; i < tbl_cnt; i++) {
 		if (p_num_field_recs_arr[i] == DB_VARIABLE_SIZE)
 			continue;
 
-		p_db->pp_field_tables[i] = (struct db_field_def *)
-				calloc(p_num_field_recs_arr[i], sizeof(**(p_db->pp_field_tables)));
-		if (!p_db->pp_field_tables[i]) {
-			for (k = i - 1; k >= 0; k--)
-				free(p_db->pp_field_tables[k]);
-			goto err8;
-		}
+		size = p_num_field_recs_arr[i] * sizeof(struct db_field_def);
+		p_db->pp_field_tables[i] = (struct db_field_def *) (arena + off);
+		memset(p_db->pp_field_tables[i], 0, size);
+		off += SSA_DB_ARENA_ALIGN(size);
 	}
 
 	p_db->data_tbl_cnt = tbl_cnt;
 
 	return p_db;
-err8:
-	free(p_db->pp_field_tables);
-err7:
-	for (k = tbl_cnt - 1; k >= 0; k--)
-		free(p_db->pp_tables[k]);
-err6:
-	free(p_db->pp_tables);
-err5:
-	free(p_db->p_db_field_tables);
-err4:
-	free(p_db->p_db_tables);
-err3:
-	free(p_db->p_def_tbl);
-err2:
-	free(p_db);
-err1:
-	return NULL;
 }
 
 /** =========================================================================
@@ -450,6 +615,22 @@ void ssa_db_init(struct ssa_db * p_ssa_db, char * name,
         }
 }
 
+/* Checks whether the table is part of SSA DB file mapping */
+static int ssa_db_tbl_mapped(const struct ssa_db *p_ssa_db, const void *tbl)
+{
+	const uint8_t *map = p_ssa_db->p_map;
+
+	return map && (const uint8_t *) tbl >= map &&
+	       (const uint8_t *) tbl < map + p_ssa_db->map_len;
+}
+
+/* Checks whether the table was allocated on its own */
+static int ssa_db_tbl_owned(const struct ssa_db *p_ssa_db, const void *tbl)
+{
+	return tbl && !ssa_db_tbl_mapped(p_ssa_db, tbl) &&
+	       !ssa_db_tbl_in_arena(p_ssa_db, tbl);
+}
+
 /** =========================================================================
  */
 void ssa_db_destroy(struct ssa_db * p_ssa_db)
@@ -462,19 +643,30 @@ void ssa_db_destroy(struct ssa_db * p_ssa_db)
 
 	tbl_cnt = p_ssa_db->data_tbl_cnt;
 
-	for (i = tbl_cnt - 1; i >= 0; i--) {
-		if (!p_ssa_db->pp_field_tables[i])
-			continue;
-		free(p_ssa_db->pp_field_tables[i]);
+	for (i = tbl_cnt - 1; i >= 0 && p_ssa_db->pp_field_tables; i--) {
+		if (ssa_db_tbl_owned(p_ssa_db, p_ssa_db->pp_field_tables[i]))
+			free(p_ssa_db->pp_field_tables[i]);
 		p_ssa_db->pp_field_tables[i] = NULL;
 	}
-	free(p_ssa_db->pp_field_tables);
-	p_ssa_db->pp_field_tables = NULL;
 
-	for (i = tbl_cnt - 1; i >= 0; i--) {
-		free(p_ssa_db->pp_tables[i]);
+	for (i = tbl_cnt - 1; i >= 0 && p_ssa_db->pp_tables; i--) {
+		if (ssa_db_tbl_owned(p_ssa_db, p_ssa_db->pp_tables[i]))
+			free(p_ssa_db->pp_tables[i]);
 		p_ssa_db->pp_tables[i] = NULL;
 	}
+
+	if (p_ssa_db->p_map) {
+		munmap(p_ssa_db->p_map, p_ssa_db->map_len);
+		p_ssa_db->p_map = NULL;
+	}
+
+	if (p_ssa_db->p_arena) {
+		ssa_db_arena_free(p_ssa_db->p_arena, p_ssa_db->arena_map_len);
+		return;
+	}
+
+	free(p_ssa_db->pp_field_tables);
+	p_ssa_db->pp_field_tables = NULL;
 	free(p_ssa_db->pp_tables);
 	p_ssa_db->pp_tables = NULL;
 
@@ -618,6 +810,67 @@ out:
 	return ret;
 }
 
+#define SSA_DB_ARENA_RELOC(p, from, to) \
+	((p) ? (void *) ((uint8_t *) (to) + ((uint8_t *) (p) - (uint8_t *) (from))) : NULL)
+
+/*
+ * Copy an SSA DB whose tables all live in its arena with one memcpy,
+ * moving the table pointers over to the new arena.
+ */
+static struct ssa_db *ssa_db_arena_copy(struct ssa_db const * const ssa_db)
+{
+	struct ssa_db *ssa_db_copy;
+	void *from = ssa_db->p_arena, *to;
+	uint64_t i;
+	size_t map_len;
+
+	to = ssa_db_arena_alloc(ssa_db->arena_len, &map_len);
+	if (!to)
+		return NULL;
+
+	memcpy(to, from, ssa_db->arena_len);
+
+	ssa_db_copy = (struct ssa_db *) to;
+	ssa_db_copy->p_arena = to;
+	ssa_db_copy->arena_map_len = map_len;
+	ssa_db_copy->p_def_tbl = SSA_DB_ARENA_RELOC(ssa_db->p_def_tbl, from, to);
+	ssa_db_copy->p_db_tables =
+		SSA_DB_ARENA_RELOC(ssa_db->p_db_tables, from, to);
+	ssa_db_copy->p_db_field_tables =
+		SSA_DB_ARENA_RELOC(ssa_db->p_db_field_tables, from, to);
+	ssa_db_copy->pp_tables = SSA_DB_ARENA_RELOC(ssa_db->pp_tables, from, to);
+	ssa_db_copy->pp_field_tables =
+		SSA_DB_ARENA_RELOC(ssa_db->pp_field_tables, from, to);
+
+	for (i = 0; i < ssa_db->data_tbl_cnt; i++) {
+		ssa_db_copy->pp_tables[i] =
+			SSA_DB_ARENA_RELOC(ssa_db->pp_tables[i], from, to);
+		ssa_db_copy->pp_field_tables[i] =
+			SSA_DB_ARENA_RELOC(ssa_db->pp_field_tables[i], from, to);
+	}
+
+	return ssa_db_copy;
+}
+
+static int ssa_db_is_contiguous(struct ssa_db const * const ssa_db)
+{
+	uint64_t i;
+
+	if (!ssa_db->p_arena || ssa_db->p_map)
+		return 0;
+
+	for (i = 0; i < ssa_db->data_tbl_cnt; i++) {
+		if (ssa_db->pp_tables[i] &&
+		    !ssa_db_tbl_in_arena(ssa_db, ssa_db->pp_tables[i]))
+			return 0;
+		if (ssa_db->pp_field_tables[i] &&
+		    !ssa_db_tbl_in_arena(ssa_db, ssa_db->pp_field_tables[i]))
+			return 0;
+	}
+
+	return 1;
+}
+
 struct ssa_db *ssa_db_copy(struct ssa_db const * const ssa_db)
 {
 	uint64_t *field_cnt = NULL, *rec_cnt = NULL;
@@ -630,6 +883,9 @@ struct ssa_db *ssa_db_copy(struct ssa_db const * const ssa_db)
 	    !ssa_db->p_db_tables || !ssa_db->pp_tables)
 		goto out;
 
+	if (ssa_db_is_contiguous(ssa_db))
+		return ssa_db_arena_copy(ssa_db);
+
 	tbl_cnt = ssa_db->data_tbl_cnt;
 
 	field_cnt = (uint64_t *) malloc(tbl_cnt * sizeof(*field_cnt));
@@ -645,8 +901,11 @@ struct ssa_db *ssa_db_copy(struct ssa_db const * const ssa_db)
 		goto err2;
 
 	for (i = 0; i < tbl_cnt; i++) {
-		field_cnt[i] = ntohll(ssa_db->p_db_field_tables[i].set_count);
+		field_cnt[i] = ssa_db->pp_field_tables[i] ?
+			       ntohll(ssa_db->p_db_field_tables[i].set_count) :
+			       DB_VARIABLE_SIZE;
 		rec_cnt[i] = ntohll(ssa_db->p_db_tables[i].set_count);
+		rec_size[i] = 0;
 
 		for (j = 0; j < ntohll(ssa_db->db_table_def.set_count); j++) {
 			if (ssa_db->p_def_tbl[j].id.table ==
@@ -655,6 +914,12 @@ struct ssa_db *ssa_db_copy(struct ssa_db const * const ssa_db)
 				break;
 			}
 		}
+
+		/* variable size records are copied as set_size bytes */
+		if (rec_size[i] == DB_VARIABLE_SIZE) {
+			rec_cnt[i] = ntohll(ssa_db->p_db_tables[i].set_size);
+			rec_size[i] = 1;
+		}
 	}
 
 	ssa_db_copy = ssa_db_alloc(rec_cnt, rec_size, field_cnt, tbl_cnt);
@@ -772,7 +1037,8 @@ void ssa_db_detach(struct ssa_db *ssa_db, const char *tbl_name)
 	if (!ssa_db->pp_tables[id])
 		goto out;
 
-	free(ssa_db->pp_tables[id]);
+	if (ssa_db_tbl_owned(ssa_db, ssa_db->pp_tables[id]))
+		free(ssa_db->pp_tables[id]);
 	ssa_db->pp_tables[id] = NULL;
 out:
 	return;
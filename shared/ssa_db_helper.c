@@ -42,6 +42,8 @@
 #include <string.h>
 #include <inttypes.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <ssa_log.h>
@@ -830,6 +832,402 @@ static void mkpath(const char *dir, mode_t mode)
 			dir, errno, strerror(errno));
 }
 
+/*
+ * SSA_DB_HELPER_MMAP file layout:
+ *
+ *	struct ssa_db_bin_hdr
+ *	struct ssa_db_bin_section	[tbl_cnt]
+ *	struct db_table_def		[def_cnt]	(aligned)
+ *	data and field tables				(each aligned)
+ *
+ * Header fields are stored in network byte order.  Table contents are
+ * stored as they are kept in memory, so on load pp_tables[] and
+ * pp_field_tables[] point straight into the file mapping.
+ */
+#define SSA_DB_BIN_MAGIC	"SSADBBIN"
+#define SSA_DB_BIN_VERSION	1
+#define SSA_DB_BIN_ALIGN	64
+
+struct ssa_db_bin_hdr {
+	char			magic[8];
+	be32_t			version;
+	be32_t			hdr_size;
+	be64_t			file_size;
+	be64_t			tbl_cnt;
+	be64_t			def_cnt;
+	be64_t			def_offset;
+	be32_t			def_crc;
+	be32_t			hdr_crc;	/* header and section index */
+	struct db_def		db_def;
+	struct db_dataset	db_table_def;
+};
+
+struct ssa_db_bin_section {
+	struct db_dataset	dataset;
+	struct db_dataset	field_dataset;
+	be64_t			data_offset;
+	be64_t			data_size;
+	be64_t			field_offset;
+	be64_t			field_size;
+	be32_t			data_crc;
+	be32_t			field_crc;
+};
+
+static const uint32_t ssa_db_crc32_tbl[256] = {
+	0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
+	0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
+	0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
+	0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+	0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
+	0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
+	0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
+	0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+	0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
+	0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
+	0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
+	0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+	0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
+	0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
+	0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
+	0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+	0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
+	0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
+	0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
+	0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+	0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
+	0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
+	0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
+	0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+	0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
+	0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
+	0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
+	0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+	0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
+	0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
+	0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
+	0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+	0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
+	0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
+	0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
+	0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+	0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
+	0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
+	0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
+	0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+	0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
+	0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
+	0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
+};
+
+static uint32_t ssa_db_crc32(uint32_t crc, const void *buf, uint64_t len)
+{
+	const uint8_t *p = buf;
+
+	crc = ~crc;
+	while (len--)
+		crc = ssa_db_crc32_tbl[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static uint64_t ssa_db_bin_align(uint64_t offset)
+{
+	return (offset + SSA_DB_BIN_ALIGN - 1) & ~((uint64_t) SSA_DB_BIN_ALIGN - 1);
+}
+
+static uint64_t ssa_db_bin_data_size(const struct ssa_db *p_ssa_db, uint64_t i)
+{
+	const struct db_dataset *p_dataset = &p_ssa_db->p_db_tables[i];
+	uint64_t j, tbls_n = ntohll(p_ssa_db->db_table_def.set_count);
+
+	if (!p_ssa_db->pp_tables[i])
+		return 0;
+
+	for (j = 0; j < tbls_n; j++) {
+		if (p_ssa_db->p_def_tbl[j].type != DBT_TYPE_DATA ||
+		    p_ssa_db->p_def_tbl[j].id.table != p_dataset->id.table)
+			continue;
+		if (ntohl(p_ssa_db->p_def_tbl[j].record_size) == DB_VARIABLE_SIZE)
+			break;
+		return ntohll(p_dataset->set_count) *
+		       ntohl(p_ssa_db->p_def_tbl[j].record_size);
+	}
+
+	return ntohll(p_dataset->set_size);
+}
+
+static int ssa_db_bin_write(FILE *fd, uint64_t *p_offset, uint64_t offset,
+			    const void *buf, uint64_t size)
+{
+	static const uint8_t pad[SSA_DB_BIN_ALIGN];
+
+	if (fwrite(pad, 1, offset - *p_offset, fd) != offset - *p_offset)
+		return -1;
+	if (size && fwrite(buf, 1, size, fd) != size)
+		return -1;
+	*p_offset = offset + size;
+	return 0;
+}
+
+static void ssa_db_save_mmap(const char *path_dir, const struct ssa_db *p_ssa_db)
+{
+	FILE *fd;
+	struct ssa_db_bin_hdr hdr;
+	struct ssa_db_bin_section *sections;
+	uint64_t i, offset, pos = 0, tbl_cnt, def_cnt, size;
+	uint32_t crc;
+	char buffer[SSA_DB_HELPER_PATH_MAX] = {};
+	char tmp[SSA_DB_HELPER_PATH_MAX + sizeof(".tmp")] = {};
+
+	tbl_cnt = p_ssa_db->data_tbl_cnt;
+	def_cnt = ntohll(p_ssa_db->db_table_def.set_count);
+
+	sections = calloc(tbl_cnt ? tbl_cnt : 1, sizeof(*sections));
+	if (!sections) {
+		ssa_log_err(SSA_LOG_DEFAULT, "unable to allocate section index\n");
+		return;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SSA_DB_BIN_MAGIC, sizeof(hdr.magic));
+	hdr.version = htonl(SSA_DB_BIN_VERSION);
+	hdr.hdr_size = htonl(sizeof(hdr));
+	hdr.tbl_cnt = htonll(tbl_cnt);
+	hdr.def_cnt = htonll(def_cnt);
+	hdr.db_def = p_ssa_db->db_def;
+	hdr.db_table_def = p_ssa_db->db_table_def;
+
+	offset = ssa_db_bin_align(sizeof(hdr) + tbl_cnt * sizeof(*sections));
+	hdr.def_offset = htonll(offset);
+	hdr.def_crc = htonl(ssa_db_crc32(0, p_ssa_db->p_def_tbl,
+					 def_cnt * sizeof(*p_ssa_db->p_def_tbl)));
+	offset = ssa_db_bin_align(offset + def_cnt * sizeof(*p_ssa_db->p_def_tbl));
+
+	for (i = 0; i < tbl_cnt; i++) {
+		sections[i].dataset = p_ssa_db->p_db_tables[i];
+		sections[i].field_dataset = p_ssa_db->p_db_field_tables[i];
+
+		size = ssa_db_bin_data_size(p_ssa_db, i);
+		sections[i].data_offset = htonll(offset);
+		sections[i].data_size = htonll(size);
+		sections[i].data_crc = htonl(ssa_db_crc32(0, p_ssa_db->pp_tables[i], size));
+		offset = ssa_db_bin_align(offset + size);
+
+		size = 0;
+		if (p_ssa_db->pp_field_tables[i])
+			size = ntohll(p_ssa_db->p_db_field_tables[i].set_count) *
+			       sizeof(struct db_field_def);
+		sections[i].field_offset = htonll(offset);
+		sections[i].field_size = htonll(size);
+		sections[i].field_crc = htonl(ssa_db_crc32(0, p_ssa_db->pp_field_tables[i], size));
+		offset = ssa_db_bin_align(offset + size);
+	}
+	hdr.file_size = htonll(offset);
+
+	crc = ssa_db_crc32(0, &hdr, sizeof(hdr));
+	hdr.hdr_crc = htonl(ssa_db_crc32(crc, sections, tbl_cnt * sizeof(*sections)));
+
+	/* write to temporary file first, so a running loader never sees a partial DB */
+	snprintf(buffer, sizeof(buffer), "%s/%s", path_dir, SSA_DB_HELPER_MMAP_NAME);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", buffer);
+	fd = fopen(tmp, SSA_DB_HELPER_FILE_WRITE_MODE_BIN);
+	if (!fd) {
+		ssa_log_err(SSA_LOG_DEFAULT, "Failed opening %s file\n", tmp);
+		goto out;
+	}
+
+	if (ssa_db_bin_write(fd, &pos, 0, &hdr, sizeof(hdr)) ||
+	    ssa_db_bin_write(fd, &pos, pos, sections, tbl_cnt * sizeof(*sections)) ||
+	    ssa_db_bin_write(fd, &pos, ntohll(hdr.def_offset), p_ssa_db->p_def_tbl,
+			     def_cnt * sizeof(*p_ssa_db->p_def_tbl)))
+		goto err;
+
+	for (i = 0; i < tbl_cnt; i++) {
+		if (ssa_db_bin_write(fd, &pos, ntohll(sections[i].data_offset),
+				     p_ssa_db->pp_tables[i],
+				     ntohll(sections[i].data_size)) ||
+		    ssa_db_bin_write(fd, &pos, ntohll(sections[i].field_offset),
+				     p_ssa_db->pp_field_tables[i],
+				     ntohll(sections[i].field_size)))
+			goto err;
+	}
+
+	if (ssa_db_bin_write(fd, &pos, offset, NULL, 0))
+		goto err;
+
+	if (fclose(fd)) {
+		fd = NULL;
+		goto err;
+	}
+
+	if (rename(tmp, buffer)) {
+		ssa_log_err(SSA_LOG_DEFAULT, "unable to rename %s to %s ERROR %d (%s)\n",
+			    tmp, buffer, errno, strerror(errno));
+		remove(tmp);
+		goto out;
+	}
+
+	ssa_log(SSA_LOG_DEFAULT, "%s was saved (%" PRIu64 " tables, %" PRIu64 " bytes)\n",
+		buffer, tbl_cnt, offset);
+	goto out;
+err:
+	ssa_log_err(SSA_LOG_DEFAULT, "unable to write %s ERROR %d (%s)\n",
+		    tmp, errno, strerror(errno));
+	if (fd)
+		fclose(fd);
+	remove(tmp);
+out:
+	free(sections);
+}
+
+static int ssa_db_bin_section_check(const struct ssa_db_bin_hdr *hdr,
+				    const uint8_t *map, uint64_t offset,
+				    uint64_t size, uint32_t crc)
+{
+	uint64_t file_size = ntohll(hdr->file_size);
+
+	if (offset % SSA_DB_BIN_ALIGN || offset > file_size ||
+	    size > file_size - offset)
+		return -1;
+
+	return ssa_db_crc32(0, map + offset, size) == crc ? 0 : -1;
+}
+
+static struct ssa_db *ssa_db_load_mmap(const char *path_dir)
+{
+	struct ssa_db *p_ssa_db = NULL;
+	struct ssa_db_bin_hdr hdr;
+	const struct ssa_db_bin_section *sections;
+	uint64_t *num_recs_arr = NULL, *num_fields_arr = NULL;
+	size_t *recs_size_arr = NULL;
+	uint64_t i, tbl_cnt, def_cnt, offset, size;
+	uint32_t crc;
+	struct stat st;
+	uint8_t *map;
+	int fd;
+	char buffer[SSA_DB_HELPER_PATH_MAX] = {};
+
+	snprintf(buffer, sizeof(buffer), "%s/%s", path_dir, SSA_DB_HELPER_MMAP_NAME);
+	fd = open(buffer, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) || st.st_size < sizeof(hdr)) {
+		ssa_log_err(SSA_LOG_DEFAULT, "%s is too short\n", buffer);
+		close(fd);
+		return NULL;
+	}
+
+	/* private writable mapping, so in place updates don't reach the file */
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		ssa_log_err(SSA_LOG_DEFAULT, "unable to map %s ERROR %d (%s)\n",
+			    buffer, errno, strerror(errno));
+		return NULL;
+	}
+
+	memcpy(&hdr, map, sizeof(hdr));
+	if (memcmp(hdr.magic, SSA_DB_BIN_MAGIC, sizeof(hdr.magic)) ||
+	    ntohl(hdr.version) != SSA_DB_BIN_VERSION ||
+	    ntohl(hdr.hdr_size) != sizeof(hdr) ||
+	    ntohll(hdr.file_size) != st.st_size) {
+		ssa_log_err(SSA_LOG_DEFAULT, "%s has unsupported format\n", buffer);
+		goto err;
+	}
+
+	tbl_cnt = ntohll(hdr.tbl_cnt);
+	def_cnt = ntohll(hdr.def_cnt);
+	if (tbl_cnt > (st.st_size - sizeof(hdr)) / sizeof(*sections) ||
+	    def_cnt > 2 * tbl_cnt) {
+		ssa_log_err(SSA_LOG_DEFAULT, "%s has bad section index\n", buffer);
+		goto err;
+	}
+
+	sections = (const struct ssa_db_bin_section *) (map + sizeof(hdr));
+	crc = ntohl(hdr.hdr_crc);
+	hdr.hdr_crc = 0;
+	if (ssa_db_crc32(ssa_db_crc32(0, &hdr, sizeof(hdr)), sections,
+			 tbl_cnt * sizeof(*sections)) != crc ||
+	    ssa_db_bin_section_check(&hdr, map, ntohll(hdr.def_offset),
+				     def_cnt * sizeof(struct db_table_def),
+				     ntohl(hdr.def_crc))) {
+		ssa_log_err(SSA_LOG_DEFAULT, "%s header checksum mismatch\n", buffer);
+		goto err;
+	}
+
+	for (i = 0; i < tbl_cnt; i++) {
+		if (ssa_db_bin_section_check(&hdr, map,
+					     ntohll(sections[i].data_offset),
+					     ntohll(sections[i].data_size),
+					     ntohl(sections[i].data_crc)) ||
+		    ssa_db_bin_section_check(&hdr, map,
+					     ntohll(sections[i].field_offset),
+					     ntohll(sections[i].field_size),
+					     ntohl(sections[i].field_crc))) {
+			ssa_log_err(SSA_LOG_DEFAULT,
+				    "%s table %" PRIu64 " checksum mismatch\n",
+				    buffer, i);
+			goto err;
+		}
+	}
+
+	/* allocate only the SSA DB skeleton, tables are taken from the mapping */
+	num_recs_arr = calloc(tbl_cnt ? tbl_cnt : 1, sizeof(*num_recs_arr));
+	recs_size_arr = calloc(tbl_cnt ? tbl_cnt : 1, sizeof(*recs_size_arr));
+	num_fields_arr = calloc(tbl_cnt ? tbl_cnt : 1, sizeof(*num_fields_arr));
+	if (!num_recs_arr || !recs_size_arr || !num_fields_arr) {
+		ssa_log_err(SSA_LOG_DEFAULT, "unable to allocate SSA DB arrays\n");
+		goto err;
+	}
+	for (i = 0; i < tbl_cnt; i++)
+		num_fields_arr[i] = DB_VARIABLE_SIZE;
+
+	p_ssa_db = ssa_db_alloc(num_recs_arr, recs_size_arr, num_fields_arr,
+				tbl_cnt);
+	if (!p_ssa_db) {
+		ssa_log_err(SSA_LOG_DEFAULT, "Failed allocating SSA DB\n");
+		goto err;
+	}
+
+	p_ssa_db->db_def = hdr.db_def;
+	p_ssa_db->db_table_def = hdr.db_table_def;
+	memcpy(p_ssa_db->p_def_tbl, map + ntohll(hdr.def_offset),
+	       def_cnt * sizeof(*p_ssa_db->p_def_tbl));
+
+	for (i = 0; i < tbl_cnt; i++) {
+		p_ssa_db->p_db_tables[i] = sections[i].dataset;
+		p_ssa_db->p_db_field_tables[i] = sections[i].field_dataset;
+
+		offset = ntohll(sections[i].data_offset);
+		size = ntohll(sections[i].data_size);
+		if (size)
+			p_ssa_db->pp_tables[i] = map + offset;
+
+		offset = ntohll(sections[i].field_offset);
+		size = ntohll(sections[i].field_size);
+		if (size)
+			p_ssa_db->pp_field_tables[i] =
+				(struct db_field_def *) (map + offset);
+	}
+
+	p_ssa_db->p_map = map;
+	p_ssa_db->map_len = st.st_size;
+
+	free(num_fields_arr);
+	free(recs_size_arr);
+	free(num_recs_arr);
+
+	ssa_log(SSA_LOG_DEFAULT, "%s was loaded (%" PRIu64 " tables)\n",
+		buffer, tbl_cnt);
+	return p_ssa_db;
+err:
+	free(num_fields_arr);
+	free(recs_size_arr);
+	free(num_recs_arr);
+	munmap(map, st.st_size);
+	return NULL;
+}
+
 void ssa_db_save(const char *path_dir, const struct ssa_db *p_ssa_db,
 		 enum ssa_db_helper_mode mode)
 {
@@ -842,6 +1240,11 @@ void ssa_db_save(const char *path_dir, const struct ssa_db *p_ssa_db,
 
 	mkpath(path_dir, S_IRWXU | S_IRWXG | S_IRWXO);
 
+	if (mode == SSA_DB_HELPER_MMAP) {
+		ssa_db_save_mmap(path_dir, p_ssa_db);
+		return;
+	}
+
 	tbls_n = ntohll(p_ssa_db->db_table_def.set_count);
 
 	/****************** Dumping db_def record *******************/
@@ -983,6 +1386,9 @@ struct ssa_db *ssa_db_load(const char *path_dir, enum ssa_db_helper_mode mode)
 	char buffer[SSA_DB_HELPER_PATH_MAX] = {};
 
 	ssa_log_func(SSA_LOG_DEFAULT);
+	if (mode == SSA_DB_HELPER_MMAP)
+		return ssa_db_load_mmap(path_dir);
+
 	if (mode != SSA_DB_HELPER_STANDARD && mode != SSA_DB_HELPER_DEBUG) {
 		ssa_log_err(SSA_LOG_DEFAULT, "mode (%d) not supported for loading\n", mode);
 		return NULL;
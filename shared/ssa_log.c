@@ -41,7 +41,10 @@
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <stddef.h>
 #include <pthread.h>
+#include <poll.h>
+#include <fcntl.h>
 #include <ssa_log.h>
 #include <syslog.h>
 #include <time.h>
@@ -51,7 +54,8 @@
 #include <common.h>
 #include <ssa_admin.h>
 
-void get_thread_id(char *buff, int size)
+/* Returns nonzero if the thread has no name and its id is used instead */
+int get_thread_id(char *buff, int size)
 {
 	int ret = 1;
 	pthread_t self;
@@ -62,8 +66,11 @@ void get_thread_id(char *buff, int size)
 	if (!ret && !strncmp(buff, program_invocation_short_name, size))
 		ret = 1;
 #endif
-	if (ret || !buff[0])
-		ret = snprintf(buff, size, "%04X", (unsigned) self);
+	if (ret || !buff[0]) {
+		snprintf(buff, size, "%04X", (unsigned) self);
+		return 1;
+	}
+	return 0;
 }
 
 
@@ -71,28 +78,82 @@ void get_thread_id(char *buff, int size)
 FILE *flog;
 int accum_log_file = 0;
 int log_flush = 1;
-static int log_level = SSA_LOG_DEFAULT;
+int log_async = 1;
+int log_rate_limit = 100;
+int ssa_log_mask = SSA_LOG_DEFAULT;
 static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Asynchronous logging.  Each thread formats its message text into a
+ * ring of its own and a writer thread drains all the rings, so callers
+ * never wait on the log file.  Time stamp and thread name are stored
+ * in binary form and only formatted by the writer.  A ring has a
+ * single producer (the owning thread) and a single consumer (the
+ * writer), so head and tail need no lock.  A thread finding its ring
+ * full waits for the writer rather than lose the message.
+ */
+#define SSA_LOG_RING_SIZE	(64 * 1024)	/* power of 2 */
+#define SSA_LOG_LINE_MAX	1024
+#define SSA_LOG_DRAIN_MAX	4096	/* records between flushes */
+#define SSA_LOG_NAME_TRIES	16
+#define SSA_LOG_FULL_WAIT	50	/* usec */
+
+struct ssa_log_rec {
+	uint32_t		len;	/* of the text following the record */
+	uint32_t		reserved;
+	struct timeval		tv;
+	char			tid[16];
+};
+
+#define SSA_LOG_REC_SIZE(len)	((sizeof(struct ssa_log_rec) + (len) + 7) & ~7)
+
+struct ssa_log_ring {
+	struct ssa_log_ring	*next;
+	volatile int		dead;
+	int			name_tries;
+	char			tid[16];
+	volatile uint64_t	head __attribute__((aligned(64)));
+	volatile uint64_t	tail __attribute__((aligned(64)));
+	char			buf[SSA_LOG_RING_SIZE] __attribute__((aligned(64)));
+};
+
+static struct ssa_log_ring *volatile log_rings;
+static __thread struct ssa_log_ring *log_ring;
+static __thread int log_ring_released;
+static pthread_key_t log_ring_key;
+static pthread_once_t log_ring_once = PTHREAD_ONCE_INIT;
+static pthread_t log_writer;
+static volatile int log_writer_running;
+static volatile int log_writer_stop;
+static volatile int log_writer_idle;
+static int log_wake_fd[2] = { -1, -1 };
+/* serializes draining between the writer and ssa_flush_log */
+static pthread_mutex_t log_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void ssa_log_start_writer(void);
+static void ssa_log_stop_writer(void);
+
 void ssa_set_log_level(int level)
 {
-	log_level = level;
+	ssa_log_mask = level;
 }
 
 int ssa_get_log_level()
 {
-	return log_level;
+	return ssa_log_mask;
 }
 
 int ssa_open_log(char *log_file)
 {
 	if (!strcasecmp(log_file, "stdout")) {
 		flog = stdout;
+		ssa_log_start_writer();
 		return 0;
 	}
 
 	if (!strcasecmp(log_file, "stderr")) {
 		flog = stderr;
+		ssa_log_start_writer();
 		return 0;
 	}
 
@@ -101,22 +162,367 @@ int ssa_open_log(char *log_file)
 	else
 		flog = fopen(log_file, "w");
 
-	if (flog)
+	if (flog) {
+		ssa_log_start_writer();
 		return 0;
+	}
 
 	syslog(LOG_WARNING, "Failed to open log file %s ERROR %d (%s)\n",
 	       log_file, errno, strerror(errno));
 	flog = stderr;
+	ssa_log_start_writer();
 	return -1;
 }
 
 void ssa_close_log()
 {
+	ssa_log_stop_writer();
 	if (flog != stdout && flog != stderr)
 		fclose(flog);
 	flog = NULL;
 }
 
+static void ssa_log_ring_release(void *arg)
+{
+	struct ssa_log_ring *ring = arg;
+
+	/*
+	 * The writer frees the ring once drained, so later messages of
+	 * this thread (e.g. from other TSD destructors) are written in
+	 * place instead.
+	 */
+	log_ring = NULL;
+	log_ring_released = 1;
+	ring->dead = 1;
+}
+
+static void ssa_log_ring_key_init(void)
+{
+	pthread_key_create(&log_ring_key, ssa_log_ring_release);
+}
+
+static struct ssa_log_ring *ssa_log_get_ring(void)
+{
+	struct ssa_log_ring *ring;
+
+	if (log_ring)
+		return log_ring;
+	if (log_ring_released)
+		return NULL;
+
+	pthread_once(&log_ring_once, ssa_log_ring_key_init);
+	if (posix_memalign((void **) &ring, 64, sizeof(*ring)))
+		return NULL;
+
+	memset(ring, 0, offsetof(struct ssa_log_ring, buf));
+	do {
+		ring->next = log_rings;
+	} while (!__sync_bool_compare_and_swap(&log_rings, ring->next, ring));
+
+	pthread_setspecific(log_ring_key, ring);
+	log_ring = ring;
+	return ring;
+}
+
+static void ssa_log_wake(void)
+{
+	char c = 0;
+	ssize_t ret;
+
+	if (__sync_bool_compare_and_swap(&log_writer_idle, 1, 0)) {
+		/* a full pipe already has a wake up pending */
+		ret = write(log_wake_fd[1], &c, sizeof c);
+		(void) ret;
+	}
+}
+
+static void ssa_log_ring_copy(struct ssa_log_ring *ring, uint64_t pos,
+			      void *dst, const void *src, size_t len, int in)
+{
+	size_t off = pos & (SSA_LOG_RING_SIZE - 1);
+	size_t n = min(len, SSA_LOG_RING_SIZE - off);
+
+	if (in) {
+		memcpy(ring->buf + off, src, n);
+		memcpy(ring->buf, (const char *) src + n, len - n);
+	} else {
+		memcpy(dst, ring->buf + off, n);
+		memcpy((char *) dst + n, ring->buf, len - n);
+	}
+}
+
+/* Returns 0 if queued, -1 if the message has to be written in place */
+static int ssa_log_enqueue(const char *format, va_list args)
+{
+	struct ssa_log_ring *ring;
+	struct ssa_log_rec rec;
+	char line[SSA_LOG_LINE_MAX];
+	uint64_t head;
+	size_t size;
+	int len;
+
+	ring = ssa_log_get_ring();
+	if (!ring)
+		return -1;
+
+	if (ring->name_tries < SSA_LOG_NAME_TRIES) {
+		/* thread names are set by the creator, possibly late */
+		if (get_thread_id(ring->tid, sizeof ring->tid))
+			ring->name_tries++;
+		else
+			ring->name_tries = SSA_LOG_NAME_TRIES;
+	}
+
+	len = vsnprintf(line, sizeof line, format, args);
+	if (len < 0)
+		return 0;
+	if (len >= sizeof line)
+		len = sizeof line - 1;
+
+	memset(&rec, 0, sizeof rec);
+	rec.len = len;
+	gettimeofday(&rec.tv, NULL);
+	memcpy(rec.tid, ring->tid, sizeof rec.tid);
+
+	size = SSA_LOG_REC_SIZE(len);
+	head = ring->head;
+	while (SSA_LOG_RING_SIZE - (head - ring->tail) < size) {
+		if (log_writer_stop)
+			return -1;
+		ssa_log_wake();
+		usleep(SSA_LOG_FULL_WAIT);
+	}
+	__sync_synchronize();
+
+	ssa_log_ring_copy(ring, head, NULL, &rec, sizeof rec, 1);
+	ssa_log_ring_copy(ring, head + sizeof rec, NULL, line, len, 1);
+	__sync_synchronize();
+	ring->head = head + size;
+
+	ssa_log_wake();
+	return 0;
+}
+
+static void ssa_log_write_line(const struct timeval *tv, const char *tid,
+			       const char *text, int len)
+{
+	ssa_write_date(flog, tv->tv_sec, (unsigned int) tv->tv_usec);
+	fprintf(flog, " [%.16s]: ", tid);
+	fwrite(text, 1, len, flog);
+}
+
+/*
+ * Write out queued messages, oldest first across all the rings, so
+ * lines of different threads stay in time order.
+ */
+static int ssa_log_drain(void)
+{
+	struct ssa_log_ring *ring, *oldest;
+	struct ssa_log_rec rec, oldest_rec;
+	char line[SSA_LOG_LINE_MAX];
+	int cnt;
+
+	for (cnt = 0; cnt < SSA_LOG_DRAIN_MAX; cnt++) {
+		oldest = NULL;
+		for (ring = log_rings; ring; ring = ring->next) {
+			if (ring->head == ring->tail)
+				continue;
+			__sync_synchronize();
+			ssa_log_ring_copy(ring, ring->tail, &rec, NULL,
+					  sizeof rec, 0);
+			if (!oldest || timercmp(&rec.tv, &oldest_rec.tv, <)) {
+				oldest = ring;
+				oldest_rec = rec;
+			}
+		}
+		if (!oldest)
+			break;
+
+		ssa_log_ring_copy(oldest, oldest->tail + sizeof oldest_rec,
+				  line, NULL, oldest_rec.len, 0);
+		ssa_log_write_line(&oldest_rec.tv, oldest_rec.tid, line,
+				   oldest_rec.len);
+		__sync_synchronize();
+		oldest->tail += SSA_LOG_REC_SIZE(oldest_rec.len);
+	}
+
+	if (cnt && log_flush)
+		fflush(flog);
+
+	return cnt;
+}
+
+/*
+ * Free the drained rings of exited threads.  Only the writer thread
+ * walks the list without log_drain_lock (ssa_log_pending), so calling
+ * this from the writer with the lock held keeps every reader safe.
+ */
+static void ssa_log_reap_rings(void)
+{
+	struct ssa_log_ring *ring, *prev = NULL;
+
+	for (ring = log_rings; ring; ring = ring->next) {
+		/* new rings are only pushed at the head, so others can go */
+		if (ring->dead && prev && ring->head == ring->tail) {
+			prev->next = ring->next;
+			free(ring);
+			ring = prev;
+		}
+		prev = ring;
+	}
+}
+
+static int ssa_log_pending(void)
+{
+	struct ssa_log_ring *ring;
+
+	for (ring = log_rings; ring; ring = ring->next)
+		if (ring->head != ring->tail)
+			return 1;
+
+	return 0;
+}
+
+static void *ssa_log_writer_handler(void *context)
+{
+	struct pollfd pfd;
+	char buf[64];
+
+	(void) context;
+
+	pfd.fd = log_wake_fd[0];
+	pfd.events = POLLIN;
+	while (!log_writer_stop) {
+		pthread_mutex_lock(&log_drain_lock);
+		while (ssa_log_drain() == SSA_LOG_DRAIN_MAX)
+			;
+		ssa_log_reap_rings();
+		pthread_mutex_unlock(&log_drain_lock);
+
+		log_writer_idle = 1;
+		__sync_synchronize();
+		/* recheck, as a message could have come before going idle */
+		if (ssa_log_pending()) {
+			log_writer_idle = 0;
+			continue;
+		}
+
+		if (poll(&pfd, 1, 1000) > 0)
+			while (read(log_wake_fd[0], buf, sizeof buf) > 0)
+				;
+		log_writer_idle = 0;
+	}
+
+	return NULL;
+}
+
+static void ssa_log_stop_writer(void)
+{
+	if (!log_writer_running)
+		return;
+
+	log_writer_stop = 1;
+	log_writer_idle = 1;
+	ssa_log_wake();
+	pthread_join(log_writer, NULL);
+	log_writer_running = 0;
+
+	/* the writer is gone, so the rings can be reaped here */
+	pthread_mutex_lock(&log_drain_lock);
+	while (ssa_log_drain())
+		;
+	ssa_log_reap_rings();
+	pthread_mutex_unlock(&log_drain_lock);
+
+	close(log_wake_fd[0]);
+	close(log_wake_fd[1]);
+	log_wake_fd[0] = log_wake_fd[1] = -1;
+}
+
+static void ssa_log_start_writer(void)
+{
+	static int atexit_set;
+
+	if (!log_async || log_writer_running)
+		return;
+
+	if (pipe(log_wake_fd))
+		goto err1;
+	fcntl(log_wake_fd[0], F_SETFL, O_NONBLOCK);
+	fcntl(log_wake_fd[1], F_SETFL, O_NONBLOCK);
+
+	log_writer_stop = 0;
+	if (pthread_create(&log_writer, NULL, ssa_log_writer_handler, NULL))
+		goto err2;
+	SET_THREAD_NAME(log_writer, "LOG");
+	log_writer_running = 1;
+
+	/* messages still queued when the process exits */
+	if (!atexit_set && !atexit(ssa_log_stop_writer))
+		atexit_set = 1;
+	return;
+
+err2:
+	close(log_wake_fd[0]);
+	close(log_wake_fd[1]);
+	log_wake_fd[0] = log_wake_fd[1] = -1;
+err1:
+	syslog(LOG_WARNING, "Failed to start log writer, logging synchronously\n");
+}
+
+/*
+ * Write out whatever is queued, unless the writer is in the middle of
+ * it.  Used before dumping a backtrace.
+ */
+void ssa_flush_log(void)
+{
+	if (!flog || !log_writer_running)
+		return;
+
+	if (pthread_mutex_trylock(&log_drain_lock))
+		return;
+	while (ssa_log_drain())
+		;
+	pthread_mutex_unlock(&log_drain_lock);
+	fflush(flog);
+}
+
+/*
+ * Per call site rate limiting, rl being a static of the call site.
+ * Returns 1 if the message is to be written, reporting first how many
+ * were suppressed during the previous interval.  Callers test it before
+ * formatting anything for the message.
+ */
+int ssa_log_ratelimit(struct ssa_log_ratelimit *rl, int level,
+		      const char *func)
+{
+	time_t now, start;
+	uint32_t suppressed;
+
+	if (!ssa_log_enabled(level))
+		return 0;
+
+	if (log_rate_limit <= 0)
+		return 1;
+
+	now = time(NULL);
+	start = rl->interval_start;
+	if (now != start &&
+	    __sync_bool_compare_and_swap(&rl->interval_start, start, now)) {
+		rl->printed = 0;
+		suppressed = __sync_lock_test_and_set(&rl->suppressed, 0);
+		if (suppressed)
+			ssa_write_log(level, "%s: %u similar messages suppressed\n",
+				      func, suppressed);
+	}
+
+	if (__sync_fetch_and_add(&rl->printed, 1) < (uint32_t) log_rate_limit)
+		return 1;
+
+	__sync_fetch_and_add(&rl->suppressed, 1);
+	return 0;
+}
+
 void ssa_report_error(int level, int error, const char *format, ...)
 {
 	char msg[1024] = {};
@@ -139,13 +545,22 @@ void ssa_write_log(int level, const char *format, ...)
 	char tid[16] = {};
 	struct timeval tv;
 	time_t tim;
+	int ret;
 
 	if (!flog)
 		return;
 
-	if (!(level & log_level))
+	if (!(level & ssa_log_mask))
 		return;
 
+	if (log_writer_running && !log_writer_stop) {
+		va_start(args, format);
+		ret = ssa_log_enqueue(format, args);
+		va_end(args);
+		if (!ret)
+			return;
+	}
+
 	gettimeofday(&tv, NULL);
 	tim = tv.tv_sec;
 	get_thread_id(tid, sizeof tid);
@@ -160,10 +575,10 @@ void ssa_write_log(int level, const char *format, ...)
 	va_end(args);
 }
 
-void ssa_sprint_addr(int level, char *str, size_t str_size,
-		     int addr_type, uint8_t *addr, size_t addr_size)
+void (ssa_sprint_addr)(int level, char *str, size_t str_size,
+		       int addr_type, uint8_t *addr, size_t addr_size)
 {
-	if (!(level & log_level))
+	if (!(level & ssa_log_mask))
 		return;
 
 	ssa_format_addr(str, str_size, addr_type, addr, addr_size);
@@ -176,6 +591,8 @@ void ssa_log_options()
 	gethostname(hostname, HOST_NAME_MAX);
 	ssa_log(SSA_LOG_DEFAULT, "SSA version %s\n", IB_SSA_VERSION);
 	ssa_log(SSA_LOG_DEFAULT, "host name %s\n", hostname);
-	ssa_log(SSA_LOG_DEFAULT, "log level 0x%x\n", log_level);
+	ssa_log(SSA_LOG_DEFAULT, "log level 0x%x\n", ssa_log_mask);
 	ssa_log(SSA_LOG_DEFAULT, "accumulate log file: %s (%d)\n", accum_log_file ? "true" : "false", accum_log_file);
+	ssa_log(SSA_LOG_DEFAULT, "log async %d\n", log_async);
+	ssa_log(SSA_LOG_DEFAULT, "log rate limit %d\n", log_rate_limit);
 }
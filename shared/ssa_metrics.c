@@ -0,0 +1,572 @@
+/*
+ * Copyright (c) 2015 Mellanox Technologies LTD. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <infiniband/ssa_db.h>
+#include <infiniband/ssa_mad.h>
+#include <ssa_admin.h>
+#include <common.h>
+#include <ssa_log.h>
+#include <ssa_metrics.h>
+
+#define SSA_METRICS_TBL_MAX	32
+#define SSA_METRICS_READ_RETRIES	16
+#define SSA_METRICS_REQ_TIMEOUT	1000	/* msec */
+
+short metrics_port = 0;
+char metrics_socket[128] = "none";
+
+struct ssa_metrics_tbl {
+	char		name[DB_NAME_LEN];
+	uint64_t	records;
+	uint64_t	bytes;
+};
+
+/*
+ * Sizes of the last applied DB.  Written under metrics_db_lock by the
+ * thread applying the DB; the METRICS thread reads it without locking
+ * and retries if seq was odd or changed meanwhile.
+ */
+struct ssa_metrics_db {
+	volatile unsigned	seq;
+	int			tbl_cnt;
+	uint64_t		epoch;
+	struct ssa_metrics_tbl	tbl[SSA_METRICS_TBL_MAX];
+};
+
+struct ssa_metrics_cb_entry {
+	ssa_metrics_cb	cb;
+	void		*context;
+};
+
+static const struct {
+	const char *name;
+	const char *help;
+} metrics_counters[COUNTER_ID_LAST] = {
+	[COUNTER_ID_NODE_START_TIME] = { "ssa_node_start_time_seconds", "Node start time" },
+	[COUNTER_ID_DB_UPDATES_NUM] = { "ssa_db_updates_total", "DB updates applied" },
+	[COUNTER_ID_DB_LAST_UPDATE_TIME] = { "ssa_db_last_update_time_seconds", "Time of the last DB update" },
+	[COUNTER_ID_DB_FIRST_UPDATE_TIME] = { "ssa_db_first_update_time_seconds", "Time of the first DB update" },
+	[COUNTER_ID_NUM_CHILDREN] = { "ssa_children", "Number of downstream children" },
+	[COUNTER_ID_NUM_ACCESS_TASKS] = { "ssa_access_tasks", "Pending PRDB calculations" },
+	[COUNTER_ID_NUM_ERR] = { "ssa_errors_total", "Errors" },
+	[COUNTER_ID_LAST_ERR] = { "ssa_last_error", "Last error code" },
+	[COUNTER_ID_TIME_LAST_UPSTR_CONN] = { "ssa_last_upstream_conn_time_seconds", "Time of the last upstream connection" },
+	[COUNTER_ID_TIME_LAST_DOWNSTR_CONN] = { "ssa_last_downstream_conn_time_seconds", "Time of the last downstream connection" },
+	[COUNTER_ID_TIME_LAST_SSA_MAD_RCV] = { "ssa_last_mad_recv_time_seconds", "Time of the last SSA MAD received" },
+	[COUNTER_ID_TIME_LAST_ERR] = { "ssa_last_error_time_seconds", "Time of the last error" },
+	[COUNTER_ID_DB_EPOCH] = { "ssa_db_epoch", "Epoch of the current DB" },
+	[COUNTER_ID_SMDB_EVENTS] = { "ssa_smdb_events_total", "Subnet events triggering SMDB extraction" },
+	[COUNTER_ID_SMDB_EPOCHS] = { "ssa_smdb_epochs_total", "SMDB epochs published" }
+};
+
+static const char *metrics_hist_op[HIST_ID_LAST] = {
+	[HIST_ID_SMDB_EXTRACT] = "smdb_extract",
+	[HIST_ID_SMDB_COMPARE] = "smdb_compare",
+	[HIST_ID_PRDB_CALC] = "prdb_calc",
+	[HIST_ID_DB_RECV] = "db_recv",
+	[HIST_ID_DB_SEND] = "db_send",
+	[HIST_ID_ACM_CACHE_UPDATE] = "acm_cache_update"
+};
+
+static const char *metrics_db_name[SSA_METRICS_DB_NUM] = {
+	[SSA_METRICS_SMDB] = "smdb",
+	[SSA_METRICS_PRDB] = "prdb"
+};
+
+static struct ssa_metrics_db metrics_db[SSA_METRICS_DB_NUM];
+static pthread_mutex_t metrics_db_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct ssa_metrics_cb_entry metrics_cb[SSA_METRICS_CB_MAX];
+static volatile int metrics_cb_cnt;
+static const char *metrics_node_type;
+static pthread_t *metrics_thread;
+static int metrics_stop_pipe[2] = { -1, -1 };
+static int metrics_tcp_fd = -1;
+static int metrics_unix_fd = -1;
+
+int ssa_metrics_register(ssa_metrics_cb cb, void *context)
+{
+	int i = metrics_cb_cnt;
+
+	if (i >= SSA_METRICS_CB_MAX) {
+		ssa_log_err(SSA_LOG_DEFAULT, "no room for metrics callback\n");
+		return -1;
+	}
+
+	metrics_cb[i].cb = cb;
+	metrics_cb[i].context = context;
+	__sync_synchronize();
+	metrics_cb_cnt = i + 1;
+	return 0;
+}
+
+void ssa_metrics_set_db(int db, const struct ssa_db *ssa_db)
+{
+	struct ssa_metrics_db *mdb;
+	struct db_table_def *def;
+	struct db_dataset *dataset;
+	uint64_t i, def_cnt;
+	int n = 0;
+
+	if (db < 0 || db >= SSA_METRICS_DB_NUM || !ssa_db)
+		return;
+
+	mdb = &metrics_db[db];
+	pthread_mutex_lock(&metrics_db_lock);
+	mdb->seq++;
+	__sync_synchronize();
+
+	mdb->epoch = ssa_db_get_epoch(ssa_db, DB_DEF_TBL_ID);
+	def_cnt = ntohll(ssa_db->db_table_def.set_count);
+	for (i = 0; i < def_cnt && n < SSA_METRICS_TBL_MAX; i++) {
+		def = &ssa_db->p_def_tbl[i];
+		if (def->type != DBT_TYPE_DATA ||
+		    def->id.table >= ssa_db->data_tbl_cnt)
+			continue;
+
+		dataset = &ssa_db->p_db_tables[def->id.table];
+		strncpy(mdb->tbl[n].name, def->name, DB_NAME_LEN - 1);
+		mdb->tbl[n].name[DB_NAME_LEN - 1] = '\0';
+		mdb->tbl[n].records = ntohll(dataset->set_count);
+		mdb->tbl[n].bytes = ntohll(dataset->set_size);
+		n++;
+	}
+	mdb->tbl_cnt = n;
+
+	__sync_synchronize();
+	mdb->seq++;
+	pthread_mutex_unlock(&metrics_db_lock);
+}
+
+void ssa_metrics_header(FILE *out, const char *name, const char *type,
+			const char *help)
+{
+	fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static int ssa_metrics_get_db(int db, struct ssa_metrics_db *copy)
+{
+	unsigned seq;
+	int i;
+
+	for (i = 0; i < SSA_METRICS_READ_RETRIES; i++) {
+		seq = metrics_db[db].seq;
+		__sync_synchronize();
+		memcpy(copy, &metrics_db[db], sizeof(*copy));
+		__sync_synchronize();
+		if (!(seq & 1) && seq == metrics_db[db].seq)
+			return seq ? 0 : -1;	/* 0 - never set */
+	}
+	return -1;
+}
+
+static void ssa_metrics_write_counters(FILE *out)
+{
+	struct timeval tv;
+	long long msec;
+	long val;
+	int i;
+
+	for (i = 0; i < COUNTER_ID_LAST; i++) {
+		if (!metrics_counters[i].name)
+			continue;
+
+		switch (ssa_admin_counters_type[i]) {
+		case ssa_counter_timestamp:
+			if (ssa_get_runtime_counter_time(i, &tv))
+				break;
+			ssa_metrics_header(out, metrics_counters[i].name,
+					   "gauge", metrics_counters[i].help);
+			msec = (long long) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+			fprintf(out, "%s %lld.%03lld\n", metrics_counters[i].name,
+				msec / 1000, msec % 1000);
+			break;
+		case ssa_counter_numeric:
+		case ssa_counter_signed_numeric:
+			val = ssa_get_runtime_counter(i);
+			ssa_metrics_header(out, metrics_counters[i].name,
+					   strstr(metrics_counters[i].name, "_total") ?
+					   "counter" : "gauge",
+					   metrics_counters[i].help);
+			fprintf(out, "%s %ld\n", metrics_counters[i].name, val);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/*
+ * Histogram buckets are cumulative in the exposition format.  Values
+ * are whole usecs, so bucket 4k+3 (the last below 4 << k) maps to
+ * le="(4 << k) - 1"; the last internal bucket is the overflow one.
+ */
+static void ssa_metrics_write_hist(FILE *out)
+{
+	uint64_t buckets[SSA_ADMIN_HIST_BUCKETS];
+	uint64_t count;
+	int i, j;
+
+	ssa_metrics_header(out, "ssa_latency_microseconds", "histogram",
+			   "Latency of SSA operations");
+	for (i = 0; i < HIST_ID_LAST; i++) {
+		ssa_hist_get(i, buckets);
+		for (count = 0, j = 0; j < SSA_ADMIN_HIST_BUCKETS; j++)
+			count += buckets[j];
+		if (!count)
+			continue;
+
+		for (count = 0, j = 0; j < SSA_ADMIN_HIST_BUCKETS - 1; j++) {
+			count += buckets[j];
+			if (j % 4 == 3)
+				fprintf(out, "ssa_latency_microseconds_bucket"
+					"{op=\"%s\",le=\"%" PRIu64 "\"} %" PRIu64 "\n",
+					metrics_hist_op[i],
+					ssa_admin_hist_bucket_low(j + 1) - 1,
+					count);
+		}
+		count += buckets[j];
+		fprintf(out, "ssa_latency_microseconds_bucket"
+			"{op=\"%s\",le=\"+Inf\"} %" PRIu64 "\n",
+			metrics_hist_op[i], count);
+		fprintf(out, "ssa_latency_microseconds_sum{op=\"%s\"} %" PRIu64 "\n",
+			metrics_hist_op[i], ssa_hist_get_sum(i));
+		fprintf(out, "ssa_latency_microseconds_count{op=\"%s\"} %" PRIu64 "\n",
+			metrics_hist_op[i], count);
+	}
+}
+
+static void ssa_metrics_write_db(FILE *out)
+{
+	struct ssa_metrics_db mdb[SSA_METRICS_DB_NUM];
+	int set[SSA_METRICS_DB_NUM];
+	int i, j;
+
+	for (i = 0; i < SSA_METRICS_DB_NUM; i++)
+		set[i] = !ssa_metrics_get_db(i, &mdb[i]);
+
+	ssa_metrics_header(out, "ssa_db_applied_epoch", "gauge",
+			   "Epoch of the last DB applied");
+	for (i = 0; i < SSA_METRICS_DB_NUM; i++)
+		if (set[i])
+			fprintf(out, "ssa_db_applied_epoch{db=\"%s\"} %" PRIu64 "\n",
+				metrics_db_name[i], mdb[i].epoch);
+
+	ssa_metrics_header(out, "ssa_db_table_records", "gauge",
+			   "Records in a table of the last DB applied");
+	for (i = 0; i < SSA_METRICS_DB_NUM; i++)
+		for (j = 0; set[i] && j < mdb[i].tbl_cnt; j++)
+			fprintf(out, "ssa_db_table_records{db=\"%s\",table=\"%s\"} %" PRIu64 "\n",
+				metrics_db_name[i], mdb[i].tbl[j].name,
+				mdb[i].tbl[j].records);
+
+	ssa_metrics_header(out, "ssa_db_table_bytes", "gauge",
+			   "Size of a table of the last DB applied");
+	for (i = 0; i < SSA_METRICS_DB_NUM; i++)
+		for (j = 0; set[i] && j < mdb[i].tbl_cnt; j++)
+			fprintf(out, "ssa_db_table_bytes{db=\"%s\",table=\"%s\"} %" PRIu64 "\n",
+				metrics_db_name[i], mdb[i].tbl[j].name,
+				mdb[i].tbl[j].bytes);
+}
+
+static void ssa_metrics_write(FILE *out)
+{
+	int i, cnt;
+
+	ssa_metrics_header(out, "ssa_node_info", "gauge", "SSA node type");
+	fprintf(out, "ssa_node_info{node_type=\"%s\"} 1\n", metrics_node_type);
+
+	ssa_metrics_write_counters(out);
+	ssa_metrics_write_hist(out);
+	ssa_metrics_write_db(out);
+
+	cnt = metrics_cb_cnt;
+	__sync_synchronize();
+	for (i = 0; i < cnt; i++)
+		metrics_cb[i].cb(out, metrics_cb[i].context);
+}
+
+static void ssa_metrics_serve(int fd)
+{
+	static const char hdr[] = "HTTP/1.0 200 OK\r\n"
+				  "Content-Type: text/plain; version=0.0.4\r\n"
+				  "Connection: close\r\n\r\n";
+	struct timeval timeout;
+	struct pollfd pfd;
+	char req[1024];
+	char *body = NULL;
+	size_t len = 0, off;
+	ssize_t ret;
+	FILE *out;
+
+	/* Whatever is requested, the answer is the same */
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, SSA_METRICS_REQ_TIMEOUT) > 0)
+		ret = recv(fd, req, sizeof req, MSG_DONTWAIT);
+
+	out = open_memstream(&body, &len);
+	if (!out) {
+		ssa_log_err(SSA_LOG_DEFAULT, "unable to allocate metrics buffer\n");
+		return;
+	}
+	fputs(hdr, out);
+	ssa_metrics_write(out);
+	fclose(out);
+
+	/* a scraper that stops reading must not hold up the next ones */
+	timeout.tv_sec = SSA_METRICS_REQ_TIMEOUT / 1000;
+	timeout.tv_usec = (SSA_METRICS_REQ_TIMEOUT % 1000) * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+
+	for (off = 0; off < len; off += ret) {
+		ret = send(fd, body + off, len - off, MSG_NOSIGNAL);
+		if (ret <= 0) {
+			ssa_log(SSA_LOG_VERBOSE,
+				"metrics response cut short at %zu of %zu bytes\n",
+				off, len);
+			break;
+		}
+	}
+	free(body);
+}
+
+static void *ssa_metrics_handler(void *context)
+{
+	struct pollfd fds[3];
+	int i, fd;
+
+	SET_THREAD_NAME(*metrics_thread, "METRICS");
+
+	ssa_log_func(SSA_LOG_CTRL);
+
+	fds[0].fd = metrics_stop_pipe[0];
+	fds[1].fd = metrics_tcp_fd;
+	fds[2].fd = metrics_unix_fd;
+	for (i = 0; i < 3; i++) {
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+	}
+
+	while (1) {
+		if (poll(fds, 3, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			ssa_log_err(SSA_LOG_CTRL, "polling metrics fds\n");
+			break;
+		}
+
+		if (fds[0].revents)
+			break;
+
+		for (i = 1; i < 3; i++) {
+			if (!(fds[i].revents & POLLIN))
+				continue;
+
+			fd = accept(fds[i].fd, NULL, NULL);
+			if (fd < 0)
+				continue;
+			ssa_metrics_serve(fd);
+			close(fd);
+		}
+	}
+
+	return NULL;
+}
+
+static int ssa_metrics_listen_tcp(void)
+{
+	struct sockaddr_in addr;
+	int fd, val = 1;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		ssa_log_err(SSA_LOG_DEFAULT, "creating metrics socket\n");
+		return -1;
+	}
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof val);
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(metrics_port);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof addr) ||
+	    listen(fd, 16)) {
+		ssa_log_err(SSA_LOG_DEFAULT, "binding metrics port %u: %d (%s)\n",
+			    metrics_port, errno, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int ssa_metrics_listen_unix(void)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		ssa_log_err(SSA_LOG_DEFAULT, "creating metrics unix socket\n");
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, metrics_socket, sizeof(addr.sun_path) - 1);
+	unlink(addr.sun_path);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof addr) ||
+	    listen(fd, 16)) {
+		ssa_log_err(SSA_LOG_DEFAULT, "binding metrics socket %s: %d (%s)\n",
+			    metrics_socket, errno, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int ssa_metrics_unix_enabled(void)
+{
+	return metrics_socket[0] && strcasecmp(metrics_socket, "none");
+}
+
+int ssa_metrics_start(int node_type)
+{
+	int ret;
+
+	ssa_log_func(SSA_LOG_VERBOSE | SSA_LOG_CTRL);
+
+	metrics_node_type = ssa_node_type_str(node_type);
+	if (!metrics_port && !ssa_metrics_unix_enabled())
+		return 0;
+
+	if (metrics_port) {
+		metrics_tcp_fd = ssa_metrics_listen_tcp();
+		if (metrics_tcp_fd < 0)
+			goto err1;
+	}
+
+	if (ssa_metrics_unix_enabled()) {
+		metrics_unix_fd = ssa_metrics_listen_unix();
+		if (metrics_unix_fd < 0)
+			goto err2;
+	}
+
+	if (pipe(metrics_stop_pipe)) {
+		ssa_log_err(SSA_LOG_DEFAULT, "creating metrics pipe\n");
+		goto err3;
+	}
+
+	metrics_thread = calloc(1, sizeof(*metrics_thread));
+	if (!metrics_thread) {
+		ssa_log_err(SSA_LOG_DEFAULT, "allocating metrics thread memory\n");
+		goto err4;
+	}
+
+	ret = pthread_create(metrics_thread, NULL, ssa_metrics_handler, NULL);
+	if (ret) {
+		ssa_log_err(SSA_LOG_DEFAULT, "creating metrics thread\n");
+		errno = ret;
+		goto err5;
+	}
+
+	return 0;
+err5:
+	free(metrics_thread);
+	metrics_thread = NULL;
+err4:
+	close(metrics_stop_pipe[0]);
+	close(metrics_stop_pipe[1]);
+	metrics_stop_pipe[0] = metrics_stop_pipe[1] = -1;
+err3:
+	if (metrics_unix_fd >= 0) {
+		close(metrics_unix_fd);
+		unlink(metrics_socket);
+		metrics_unix_fd = -1;
+	}
+err2:
+	if (metrics_tcp_fd >= 0) {
+		close(metrics_tcp_fd);
+		metrics_tcp_fd = -1;
+	}
+err1:
+	return 1;
+}
+
+void ssa_metrics_stop(void)
+{
+	char c = 0;
+	int ret;
+
+	if (!metrics_thread)
+		return;
+
+	ssa_log_func(SSA_LOG_VERBOSE | SSA_LOG_CTRL);
+
+	ret = write(metrics_stop_pipe[1], &c, sizeof c);
+	if (ret != sizeof c)
+		ssa_log_err(SSA_LOG_CTRL, "stopping metrics thread\n");
+	pthread_join(*metrics_thread, NULL);
+	free(metrics_thread);
+	metrics_thread = NULL;
+
+	close(metrics_stop_pipe[0]);
+	close(metrics_stop_pipe[1]);
+	if (metrics_unix_fd >= 0) {
+		close(metrics_unix_fd);
+		unlink(metrics_socket);
+		metrics_unix_fd = -1;
+	}
+	if (metrics_tcp_fd >= 0) {
+		close(metrics_tcp_fd);
+		metrics_tcp_fd = -1;
+	}
+}
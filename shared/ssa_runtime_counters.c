@@ -40,12 +40,38 @@
 #include <common.h>
 #include <ssa_admin.h>
 
+/*
+ * Histograms are sharded so threads recording at the same time rarely
+ * share a cache line.  Each thread picks its shard on first use; the
+ * shards are merged on read.
+ */
+#define SSA_HIST_SHARDS		16
+
+struct ssa_hist_shard {
+	volatile long buckets[HIST_ID_LAST][SSA_ADMIN_HIST_BUCKETS];
+	volatile long sum[HIST_ID_LAST];	/* usec */
+} __attribute__((aligned(64)));
+
 struct ssa_runtime_statistics {
 	atomic_t counters[SSA_RUNTIME_COUNTERS_NUM];
 	struct timeval start_time;
+	struct ssa_hist_shard hist[SSA_HIST_SHARDS];
+	atomic_t hist_shard_next;
 };
 
 static struct ssa_runtime_statistics ssa_runtime_stat;
+static __thread int ssa_hist_shard = -1;
+
+struct ssa_epoch_trace_entry {
+	uint64_t epoch;
+	uint32_t origin_time;
+	uint32_t stage_time[SSA_EPOCH_STAGE_NUM];
+};
+
+/* Most recent traced epochs, oldest overwritten first */
+static struct ssa_epoch_trace_entry epoch_trace[SSA_ADMIN_EPOCH_TRACE_NUM];
+static int epoch_trace_next;
+static pthread_mutex_t epoch_trace_lock = PTHREAD_MUTEX_INITIALIZER;
 
 inline static long ssa_runtime_shift(const struct timeval tm)
 {
@@ -61,6 +87,7 @@ void ssa_init_runtime_statistics()
 
 	for (i = 0; i < SSA_RUNTIME_COUNTERS_NUM; ++i)
 	       atomic_init(&ssa_runtime_stat.counters[i]);
+	atomic_init(&ssa_runtime_stat.hist_shard_next);
 	for (i = 0; i < COUNTER_ID_LAST; ++i) {
 		if (ssa_admin_counters_type[i] == ssa_counter_timestamp)
 			ssa_set_runtime_counter(i, -1);
@@ -103,3 +130,115 @@ int ssa_get_runtime_counter_time(int id, struct timeval *time_stamp)
 	return 0;
 
 }
+
+void ssa_hist_record(int id, uint64_t usec)
+{
+	if (ssa_hist_shard < 0)
+		ssa_hist_shard = atomic_inc(&ssa_runtime_stat.hist_shard_next) %
+				 SSA_HIST_SHARDS;
+
+	__sync_fetch_and_add(&ssa_runtime_stat.hist[ssa_hist_shard].
+			     buckets[id][ssa_admin_hist_bucket(usec)], 1);
+	__sync_fetch_and_add(&ssa_runtime_stat.hist[ssa_hist_shard].sum[id],
+			     usec);
+}
+
+void ssa_hist_record_since(int id, const struct timeval *start)
+{
+	struct timeval now;
+	long usec;
+
+	gettimeofday(&now, NULL);
+	usec = (now.tv_sec - start->tv_sec) * 1000000 +
+	       (now.tv_usec - start->tv_usec);
+	ssa_hist_record(id, usec < 0 ? 0 : usec);
+}
+
+uint32_t ssa_epoch_trace_time(void)
+{
+	struct timeval now;
+	uint32_t msec;
+
+	gettimeofday(&now, NULL);
+	msec = (uint32_t) ((uint64_t) now.tv_sec * 1000 + now.tv_usec / 1000);
+	return msec ? msec : 1;	/* 0 stands for not traced */
+}
+
+/*
+ * Arrival keeps the first time an epoch is seen; apply and forward
+ * keep the last, so they tell when the epoch was done with.
+ */
+void ssa_epoch_trace(uint64_t epoch, uint32_t origin_time, int stage)
+{
+	struct ssa_epoch_trace_entry *entry = NULL;
+	int i;
+
+	if (!origin_time || stage < 0 || stage >= SSA_EPOCH_STAGE_NUM)
+		return;
+
+	pthread_mutex_lock(&epoch_trace_lock);
+	for (i = 0; i < SSA_ADMIN_EPOCH_TRACE_NUM; i++) {
+		if (epoch_trace[i].origin_time == origin_time) {
+			entry = &epoch_trace[i];
+			break;
+		}
+	}
+
+	if (!entry) {
+		entry = &epoch_trace[epoch_trace_next];
+		epoch_trace_next = (epoch_trace_next + 1) %
+				   SSA_ADMIN_EPOCH_TRACE_NUM;
+		memset(entry, 0, sizeof(*entry));
+		entry->epoch = epoch;
+		entry->origin_time = origin_time;
+	}
+
+	if (stage != SSA_EPOCH_ARRIVE || !entry->stage_time[stage])
+		entry->stage_time[stage] = ssa_epoch_trace_time();
+	pthread_mutex_unlock(&epoch_trace_lock);
+}
+
+/* Returns the number of records filled, most recent first */
+int ssa_epoch_trace_get(struct ssa_admin_epoch_trace_rec *recs, int n)
+{
+	struct ssa_epoch_trace_entry *entry;
+	int i, j, cnt = 0;
+
+	pthread_mutex_lock(&epoch_trace_lock);
+	for (i = 1; i <= SSA_ADMIN_EPOCH_TRACE_NUM && cnt < n; i++) {
+		entry = &epoch_trace[(epoch_trace_next + SSA_ADMIN_EPOCH_TRACE_NUM - i) %
+				     SSA_ADMIN_EPOCH_TRACE_NUM];
+		if (!entry->origin_time)
+			continue;
+
+		recs[cnt].epoch = htonll(entry->epoch);
+		recs[cnt].origin_time = htonl(entry->origin_time);
+		for (j = 0; j < SSA_EPOCH_STAGE_NUM; j++)
+			recs[cnt].stage_time[j] = htonl(entry->stage_time[j]);
+		cnt++;
+	}
+	pthread_mutex_unlock(&epoch_trace_lock);
+
+	return cnt;
+}
+
+void ssa_hist_get(int id, uint64_t *buckets)
+{
+	int i, j;
+
+	for (j = 0; j < SSA_ADMIN_HIST_BUCKETS; j++) {
+		buckets[j] = 0;
+		for (i = 0; i < SSA_HIST_SHARDS; i++)
+			buckets[j] += ssa_runtime_stat.hist[i].buckets[id][j];
+	}
+}
+
+uint64_t ssa_hist_get_sum(int id)
+{
+	uint64_t sum = 0;
+	int i;
+
+	for (i = 0; i < SSA_HIST_SHARDS; i++)
+		sum += ssa_runtime_stat.hist[i].sum[id];
+	return sum;
+}
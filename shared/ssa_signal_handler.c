@@ -51,7 +51,7 @@
 #define MAX_BACKTRACE_FRAMES 100
 
 extern FILE *flog;
-extern void get_thread_id(char *buff, int size);
+extern int get_thread_id(char *buff, int size);
 extern char *month_str[];
 
 static pthread_spinlock_t signal_handler_lock;
@@ -89,6 +89,8 @@ static void ssa_signal_handler(int sig, siginfo_t *siginfo, void *context)
 	if (ret == EBUSY)
 		return;
 
+	/* queued messages lead up to the signal */
+	ssa_flush_log();
 	fprintf(flog, "%s %02d %02d:%02d:%02d %06d [%.16s]: signal %d received\n",
 		(result.tm_mon < 12 ? month_str[result.tm_mon] : "???"),
 		result.tm_mday, result.tm_hour, result.tm_min,
@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) 2015 Mellanox Technologies LTD. All rights reserved.
+ *
+ * This software is available to you under the terms of the
+ * OpenIB.org BSD license included below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * join_storm - floods the SSA core with distribution tree joins
+ *
+ * Simulates a full cluster reboot from a single port: membership
+ * requests are sent on behalf of many made up port GIDs (access
+ * nodes first, then consumers), with a bounded number outstanding,
+ * and the rate and latency of the core responses are reported.
+ * The made up members are removed again with leave requests.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <time.h>
+#include <infiniband/umad.h>
+#include <infiniband/ssa_mad.h>
+
+#define JS_TID_BASE	0x4a530000ULL	/* "JS" */
+
+struct js_opts {
+	char	*ca_name;
+	int	port_num;
+	int	core_lid;
+	int	access_num;
+	int	consumer_num;
+	int	window;
+	int	timeout_ms;
+	uint64_t guid_base;
+	int	keep;
+};
+
+struct js_stats {
+	double	*latency;	/* msec, per request */
+	int	done;
+	int	denied;
+	int	failed;
+};
+
+static struct js_opts opts = {
+	.ca_name	= NULL,
+	.port_num	= 1,
+	.access_num	= 16,
+	.consumer_num	= 4096,
+	.window		= 64,
+	.timeout_ms	= 2000,
+	.guid_base	= 0x5353410000000000ULL,
+};
+
+static void print_usage(FILE *file, const char *name)
+{
+	fprintf(file, "Usage: %s [options]\n", name);
+	fprintf(file, "\t-d ca name (default first CA)\n");
+	fprintf(file, "\t-p port number (default 1)\n");
+	fprintf(file, "\t-l core LID (default SM LID)\n");
+	fprintf(file, "\t-a number of access nodes (default %d)\n", opts.access_num);
+	fprintf(file, "\t-c number of consumer nodes (default %d)\n", opts.consumer_num);
+	fprintf(file, "\t-w outstanding requests (default %d)\n", opts.window);
+	fprintf(file, "\t-t request timeout in msec (default %d)\n", opts.timeout_ms);
+	fprintf(file, "\t-g first simulated port GUID (default 0x%" PRIx64 ")\n",
+		opts.guid_base);
+	fprintf(file, "\t-k keep simulated members joined\n");
+	fprintf(file, "\t-h help\n");
+}
+
+static double js_elapsed_msec(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000.0 +
+	       (end->tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static int js_cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+static void js_init_member(struct ssa_umad *umad, uint8_t method, int idx,
+			   uint64_t gid_prefix)
+{
+	struct ssa_member_record *rec;
+	uint64_t guid = htonll(opts.guid_base + idx);
+
+	memset(umad, 0, sizeof(*umad));
+	umad_set_addr(&umad->umad, opts.core_lid, 1, 0, UMAD_QKEY);
+
+	umad->packet.mad_hdr.base_version = UMAD_BASE_VERSION;
+	umad->packet.mad_hdr.mgmt_class = SSA_CLASS;
+	umad->packet.mad_hdr.class_version = SSA_CLASS_VERSION;
+	umad->packet.mad_hdr.method = method;
+	umad->packet.mad_hdr.tid = htonll(JS_TID_BASE << 32 | idx);
+	umad->packet.mad_hdr.attr_id = htons(SSA_ATTR_MEMBER_REC);
+
+	rec = &umad->packet.ssa_mad.member;
+	memcpy(rec->port_gid, &gid_prefix, 8);
+	memcpy(rec->port_gid + 8, &guid, 8);
+	rec->node_guid = guid;
+	rec->database_id = htonll(SSA_DB_PATH_DATA);
+	rec->node_type = idx < opts.access_num ?
+			 SSA_NODE_ACCESS : SSA_NODE_CONSUMER;
+}
+
+/*
+ * Send one request per simulated member and wait for all responses,
+ * keeping at most opts.window requests outstanding.
+ */
+static int js_run(int portid, int agentid, uint8_t method, uint64_t gid_prefix,
+		  struct js_stats *stats, double *total_msec)
+{
+	struct timespec *sent, start, now;
+	struct ssa_umad umad;
+	int total = opts.access_num + opts.consumer_num;
+	int next = 0, outstanding = 0, len, ret, idx;
+	uint64_t tid;
+
+	sent = calloc(total, sizeof(*sent));
+	if (!sent)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (stats->done + stats->failed < total) {
+		while (next < total && outstanding < opts.window) {
+			js_init_member(&umad, method, next, gid_prefix);
+			clock_gettime(CLOCK_MONOTONIC, &sent[next]);
+			ret = umad_send(portid, agentid, (void *) &umad,
+					sizeof(umad.packet), opts.timeout_ms, 0);
+			if (ret) {
+				fprintf(stderr, "ERROR - umad_send failed %d\n", ret);
+				stats->failed++;
+			} else {
+				outstanding++;
+			}
+			next++;
+		}
+		if (!outstanding)
+			continue;
+
+		len = sizeof(umad.packet);
+		ret = umad_recv(portid, (void *) &umad, &len, opts.timeout_ms * 2);
+		if (ret < 0) {
+			fprintf(stderr, "ERROR - no response within %d msec\n",
+				opts.timeout_ms * 2);
+			stats->failed += outstanding;
+			break;
+		}
+
+		tid = ntohll(umad.packet.mad_hdr.tid);
+		idx = (int) (tid & 0xFFFFFFFF);
+		if ((tid >> 32) != JS_TID_BASE || idx >= total)
+			continue;
+
+		outstanding--;
+		if (umad.umad.status) {
+			stats->failed++;
+			continue;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		stats->latency[stats->done++] = js_elapsed_msec(&sent[idx], &now);
+		if (umad.packet.mad_hdr.status)
+			stats->denied++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	*total_msec = js_elapsed_msec(&start, &now);
+
+	free(sent);
+	return 0;
+}
+
+static void js_report(const char *name, struct js_stats *stats,
+		      double total_msec)
+{
+	double p50 = 0, p99 = 0, max = 0;
+
+	if (stats->done) {
+		qsort(stats->latency, stats->done, sizeof(double), js_cmp_double);
+		p50 = stats->latency[stats->done / 2];
+		p99 = stats->latency[(stats->done * 99) / 100];
+		max = stats->latency[stats->done - 1];
+	}
+
+	printf("%s: %d responses (%d denied), %d failed in %.1f msec\n",
+	       name, stats->done, stats->denied, stats->failed, total_msec);
+	if (total_msec > 0)
+		printf("%s: %.0f requests/sec\n", name,
+		       stats->done * 1000.0 / total_msec);
+	printf("%s: latency msec p50 %.3f p99 %.3f max %.3f\n",
+	       name, p50, p99, max);
+}
+
+int main(int argc, char **argv)
+{
+	struct js_stats join_stats, leave_stats;
+	double join_msec = 0, leave_msec = 0;
+	umad_port_t port;
+	int portid, agentid, total, opt, ret = 1;
+
+	while ((opt = getopt(argc, argv, "d:p:l:a:c:w:t:g:kh?")) != -1) {
+		switch (opt) {
+		case 'd':
+			opts.ca_name = optarg;
+			break;
+		case 'p':
+			opts.port_num = atoi(optarg);
+			break;
+		case 'l':
+			opts.core_lid = strtol(optarg, NULL, 0);
+			break;
+		case 'a':
+			opts.access_num = atoi(optarg);
+			break;
+		case 'c':
+			opts.consumer_num = atoi(optarg);
+			break;
+		case 'w':
+			opts.window = atoi(optarg);
+			break;
+		case 't':
+			opts.timeout_ms = atoi(optarg);
+			break;
+		case 'g':
+			opts.guid_base = strtoull(optarg, NULL, 0);
+			break;
+		case 'k':
+			opts.keep = 1;
+			break;
+		case 'h':
+		case '?':
+		default:
+			print_usage(stdout, argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	total = opts.access_num + opts.consumer_num;
+	if (total <= 0 || opts.access_num < 0 || opts.consumer_num < 0 ||
+	    opts.window <= 0) {
+		print_usage(stderr, argv[0]);
+		return 1;
+	}
+
+	memset(&join_stats, 0, sizeof(join_stats));
+	memset(&leave_stats, 0, sizeof(leave_stats));
+	join_stats.latency = calloc(total, sizeof(double));
+	leave_stats.latency = calloc(total, sizeof(double));
+	if (!join_stats.latency || !leave_stats.latency) {
+		fprintf(stderr, "ERROR - unable to allocate %d records\n", total);
+		goto out;
+	}
+
+	if (umad_init() < 0) {
+		fprintf(stderr, "ERROR - unable to init UMAD library\n");
+		goto out;
+	}
+
+	if (umad_get_port(opts.ca_name, opts.port_num, &port) < 0) {
+		fprintf(stderr, "ERROR - unable to get port %d info\n",
+			opts.port_num);
+		goto err1;
+	}
+	if (!opts.core_lid)
+		opts.core_lid = port.sm_lid;
+
+	portid = umad_open_port(port.ca_name, opts.port_num);
+	if (portid < 0) {
+		fprintf(stderr, "ERROR - unable to open MAD port\n");
+		goto err2;
+	}
+
+	/* Only solicited responses are received */
+	agentid = umad_register(portid, SSA_CLASS, SSA_CLASS_VERSION, 0, NULL);
+	if (agentid < 0) {
+		fprintf(stderr, "ERROR - unable to register SSA class\n");
+		goto err3;
+	}
+
+	printf("core LID %d: %d access and %d consumer joins, %d outstanding\n",
+	       opts.core_lid, opts.access_num, opts.consumer_num, opts.window);
+
+	if (js_run(portid, agentid, UMAD_METHOD_SET, port.gid_prefix,
+		   &join_stats, &join_msec))
+		goto err4;
+	js_report("join", &join_stats, join_msec);
+
+	if (!opts.keep) {
+		if (js_run(portid, agentid, SSA_METHOD_DELETE, port.gid_prefix,
+			   &leave_stats, &leave_msec))
+			goto err4;
+		js_report("leave", &leave_stats, leave_msec);
+	}
+
+	ret = join_stats.failed || leave_stats.failed;
+err4:
+	umad_unregister(portid, agentid);
+err3:
+	umad_close_port(portid);
+err2:
+	umad_release_port(&port);
+err1:
+	umad_done();
+out:
+	free(join_stats.latency);
+	free(leave_stats.latency);
+	return ret;
+}
@@ -0,0 +1,541 @@
+/*
+ * Copyright (c) 2015 Mellanox Technologies LTD. All rights reserved.
+ *
+ * This software is available to you under the terms of the
+ * OpenIB.org BSD license included below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * pr_bench - PRDB computation benchmark over a saved SMDB
+ *
+ * Loads an SMDB dump, builds the path record index once and computes
+ * the "half world" PRDB of every selected port GUID the way access
+ * nodes do: all worker threads share a single path record context.
+ * Ports are taken in SMDB order (or from a file), so runs over the
+ * same dump are comparable.  Per consumer latency percentiles, PRDB
+ * records per second, index build time and peak RSS are reported.
+ * With -H or -N the SMDB is copied into an arena allocated under the
+ * given db_hugepages / db_numa_interleave policy before the run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#include <linux/limits.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include <ssa_db.h>
+#include <ssa_smdb.h>
+#include <ssa_prdb.h>
+#include <ssa_db_helper.h>
+#include <ssa_log.h>
+#include <infiniband/ssa_path_record.h>
+
+struct pb_opts {
+	const char *smdb_path;
+	const char *guid_file;
+	const char *log_file;
+	int	guid_num;	/* 0 - all */
+	int	threads;
+	int	rounds;
+	int	switches;
+	int	json;
+	int	log_level;
+	int	load_mode;	/* 0 - by the files found */
+	int	arena;		/* copy the SMDB into a policy arena */
+};
+
+struct pb_run {
+	struct ssa_db *smdb;
+	void	*context;
+	uint64_t *guids;	/* host order */
+	int	guid_num;
+	double	*latency;	/* usec, per GUID and round */
+	uint64_t *records;	/* per GUID and round */
+	int	round;
+	int	next;		/* next GUID index, shared by the workers */
+	int	failed;
+	int	absent;
+};
+
+static struct pb_opts opts = {
+	.log_file	= "/dev/null",
+	.threads	= 1,
+	.rounds		= 1,
+};
+
+static void print_usage(FILE *file, const char *name)
+{
+	fprintf(file, "Usage: %s [options] <SMDB directory>\n", name);
+	fprintf(file, "\t-n number of port GUIDs to compute PRDBs for (default all)\n");
+	fprintf(file, "\t-f file with port GUIDs, one 0x<guid> per line\n");
+	fprintf(file, "\t-s include switch ports\n");
+	fprintf(file, "\t-t number of worker threads (default %d)\n", opts.threads);
+	fprintf(file, "\t-r number of rounds over the GUIDs (default %d)\n", opts.rounds);
+	fprintf(file, "\t-m SMDB format: standard, debug or mmap (default mmap if %s\n"
+		      "\t   is found, standard otherwise)\n", SSA_DB_HELPER_MMAP_NAME);
+	fprintf(file, "\t-H db_hugepages policy for the SMDB copy: 0 none, 1 THP,\n"
+		      "\t   2 hugetlbfs 2 MB, 3 hugetlbfs 1 GB\n");
+	fprintf(file, "\t-N interleave the SMDB copy over all NUMA nodes\n");
+	fprintf(file, "\t-J print the results as a JSON object\n");
+	fprintf(file, "\t-L log file (default %s)\n", opts.log_file);
+	fprintf(file, "\t-v log level (default 0)\n");
+	fprintf(file, "\t-h help\n");
+}
+
+static double pb_elapsed_usec(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000.0 +
+	       (end->tv_nsec - start->tv_nsec) / 1000.0;
+}
+
+static int pb_cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+static double pb_percentile(const double *sorted, int n, int permille)
+{
+	int i;
+
+	if (!n)
+		return 0;
+
+	i = ((long) n * permille + 999) / 1000 - 1;
+	return sorted[i < 0 ? 0 : i];
+}
+
+static long pb_peak_rss_kb(void)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage))
+		return -1;
+	return usage.ru_maxrss;
+}
+
+static uint64_t pb_dataset_count(const struct ssa_db *db, int table_id)
+{
+	return ntohll(db->p_db_tables[table_id].set_count);
+}
+
+static struct ssa_db *pb_load_smdb(const char *path, int mode)
+{
+	char buf[PATH_MAX];
+	struct stat st;
+
+	if (!mode) {
+		snprintf(buf, sizeof(buf), "%s/%s", path, SSA_DB_HELPER_MMAP_NAME);
+		mode = stat(buf, &st) ? SSA_DB_HELPER_STANDARD : SSA_DB_HELPER_MMAP;
+	}
+
+	return ssa_db_load(path, mode);
+}
+
+/*
+ * SMDBs loaded in mmap mode or table by table do not go through the
+ * arena, so copy the DB to get one laid out under the current policy.
+ */
+static int pb_arena_smdb(struct pb_run *run)
+{
+	struct ssa_db *copy;
+
+	copy = ssa_db_copy(run->smdb);
+	if (!copy) {
+		fprintf(stderr, "ERROR - unable to copy SMDB into arena\n");
+		return -1;
+	}
+
+	ssa_db_destroy(run->smdb);
+	run->smdb = copy;
+	return 0;
+}
+
+static int pb_read_guids(struct pb_run *run, const char *path)
+{
+	FILE *file;
+	uint64_t guid, *tmp;
+	int size = 0;
+
+	file = fopen(path, "r");
+	if (!file) {
+		fprintf(stderr, "ERROR - unable to open %s\n", path);
+		return -1;
+	}
+
+	while (fscanf(file, "%" SCNx64 "\n", &guid) == 1) {
+		if (run->guid_num == size) {
+			tmp = realloc(run->guids, (size * 2 + 1024) * sizeof(*tmp));
+			if (!tmp) {
+				fprintf(stderr, "ERROR - unable to allocate GUIDs\n");
+				fclose(file);
+				return -1;
+			}
+			run->guids = tmp;
+			size = size * 2 + 1024;
+		}
+		run->guids[run->guid_num++] = guid;
+	}
+
+	fclose(file);
+	return 0;
+}
+
+static int pb_select_guids(struct pb_run *run)
+{
+	const struct smdb_guid2lid *rec;
+	uint64_t i, count;
+
+	if (opts.guid_file) {
+		if (pb_read_guids(run, opts.guid_file))
+			return -1;
+	} else {
+		rec = (const struct smdb_guid2lid *)
+			run->smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
+		count = pb_dataset_count(run->smdb, SMDB_TBL_ID_GUID2LID);
+
+		run->guids = calloc(count ? count : 1, sizeof(*run->guids));
+		if (!run->guids) {
+			fprintf(stderr, "ERROR - unable to allocate GUIDs\n");
+			return -1;
+		}
+
+		for (i = 0; i < count; i++) {
+			if (rec[i].is_switch && !opts.switches)
+				continue;
+			run->guids[run->guid_num++] = ntohll(rec[i].guid);
+		}
+	}
+
+	if (opts.guid_num && opts.guid_num < run->guid_num)
+		run->guid_num = opts.guid_num;
+
+	return 0;
+}
+
+static void *pb_worker(void *arg)
+{
+	struct pb_run *run = arg;
+	struct ssa_db *prdb;
+	struct timespec start, end;
+	ssa_pr_status_t ret;
+	int i, slot;
+
+	for (;;) {
+		i = __sync_fetch_and_add(&run->next, 1);
+		if (i >= run->guid_num)
+			break;
+
+		slot = run->round * run->guid_num + i;
+		prdb = NULL;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		ret = ssa_pr_compute_half_world(run->smdb, run->context,
+						htonll(run->guids[i]), &prdb);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		run->latency[slot] = pb_elapsed_usec(&start, &end);
+		if (ret == SSA_PR_SUCCESS && prdb) {
+			run->records[slot] = pb_dataset_count(prdb, PRDB_TBL_ID_PR);
+		} else if (ret == SSA_PR_PORT_ABSENT) {
+			__sync_fetch_and_add(&run->absent, 1);
+		} else {
+			__sync_fetch_and_add(&run->failed, 1);
+		}
+
+		if (prdb)
+			ssa_db_destroy(prdb);
+	}
+
+	return NULL;
+}
+
+static int pb_run_round(struct pb_run *run, double *wall_usec)
+{
+	pthread_t *threads;
+	struct timespec start, end;
+	int i, started, ret = 0;
+
+	threads = calloc(opts.threads, sizeof(*threads));
+	if (!threads) {
+		fprintf(stderr, "ERROR - unable to allocate threads\n");
+		return -1;
+	}
+
+	run->next = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (started = 0; started < opts.threads; started++) {
+		if (pthread_create(&threads[started], NULL, pb_worker, run)) {
+			fprintf(stderr, "ERROR - unable to start worker thread\n");
+			ret = -1;
+			break;
+		}
+	}
+	/* the started workers drain the GUIDs even if some failed to start */
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	*wall_usec = pb_elapsed_usec(&start, &end);
+	free(threads);
+	return started ? 0 : ret;
+}
+
+static void pb_report(struct pb_run *run, double load_usec, double copy_usec,
+		      double index_usec, const double *round_usec,
+		      long rss_load_kb)
+{
+	uint64_t records = 0;
+	double wall = 0, sum = 0, *sorted;
+	int i, n = run->guid_num * opts.rounds;
+
+	for (i = 0; i < n; i++) {
+		records += run->records[i];
+		sum += run->latency[i];
+	}
+	for (i = 0; i < opts.rounds; i++)
+		wall += round_usec[i];
+
+	sorted = run->latency;
+	qsort(sorted, n, sizeof(*sorted), pb_cmp_double);
+
+	if (opts.json) {
+		printf("{\"smdb\":\"%s\",\"guids\":%d,\"threads\":%d,\"rounds\":%d,"
+		       "\"arena\":%d,\"db_hugepages\":%d,\"db_numa_interleave\":%d,"
+		       "\"load_ms\":%.3f,\"arena_copy_ms\":%.3f,"
+		       "\"index_build_ms\":%.3f,\"wall_ms\":%.3f,"
+		       "\"rounds_ms\":[", opts.smdb_path, run->guid_num,
+		       opts.threads, opts.rounds, opts.arena, db_hugepages,
+		       db_numa_interleave, load_usec / 1000, copy_usec / 1000,
+		       index_usec / 1000, wall / 1000);
+		for (i = 0; i < opts.rounds; i++)
+			printf("%s%.3f", i ? "," : "", round_usec[i] / 1000);
+		printf("],\"records\":%" PRIu64 ",\"records_per_sec\":%.0f,"
+		       "\"consumers_per_sec\":%.1f,\"failed\":%d,\"absent\":%d,"
+		       "\"latency_usec\":{\"min\":%.1f,\"mean\":%.1f,\"p50\":%.1f,"
+		       "\"p90\":%.1f,\"p99\":%.1f,\"max\":%.1f},"
+		       "\"rss_after_load_kb\":%ld,\"peak_rss_kb\":%ld}\n",
+		       records, wall ? records * 1e6 / wall : 0,
+		       wall ? n * 1e6 / wall : 0, run->failed, run->absent,
+		       n ? sorted[0] : 0, n ? sum / n : 0,
+		       pb_percentile(sorted, n, 500), pb_percentile(sorted, n, 900),
+		       pb_percentile(sorted, n, 990), n ? sorted[n - 1] : 0,
+		       rss_load_kb, pb_peak_rss_kb());
+		return;
+	}
+
+	printf("SMDB %s\n", opts.smdb_path);
+	if (opts.arena)
+		printf("arena copy %.3f ms, db_hugepages %d, db_numa_interleave %d\n",
+		       copy_usec / 1000, db_hugepages, db_numa_interleave);
+	printf("load %.3f ms, index build %.3f ms, RSS after load %ld KB\n",
+	       load_usec / 1000, index_usec / 1000, rss_load_kb);
+	printf("%d GUIDs, %d threads, %d rounds\n", run->guid_num,
+	       opts.threads, opts.rounds);
+	for (i = 0; i < opts.rounds; i++)
+		printf("round %d: %.3f ms\n", i, round_usec[i] / 1000);
+	printf("records %" PRIu64 " (%.0f records/sec, %.1f consumers/sec)\n",
+	       records, wall ? records * 1e6 / wall : 0,
+	       wall ? n * 1e6 / wall : 0);
+	if (run->failed || run->absent)
+		printf("failed %d, absent from SMDB %d\n", run->failed,
+		       run->absent);
+	printf("latency usec: min %.1f mean %.1f p50 %.1f p90 %.1f p99 %.1f max %.1f\n",
+	       n ? sorted[0] : 0, n ? sum / n : 0,
+	       pb_percentile(sorted, n, 500), pb_percentile(sorted, n, 900),
+	       pb_percentile(sorted, n, 990), n ? sorted[n - 1] : 0);
+	printf("peak RSS %ld KB\n", pb_peak_rss_kb());
+}
+
+static int pb_parse_int(const char *str, int min, int *val)
+{
+	char *end;
+	long tmp;
+
+	tmp = strtol(str, &end, 0);
+	if (end == str || *end || tmp < min || tmp > INT32_MAX)
+		return -1;
+
+	*val = tmp;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct pb_run run;
+	struct timespec start, end;
+	double load_usec, copy_usec = 0, index_usec, *round_usec = NULL;
+	long rss_load_kb;
+	int opt, ret = EXIT_FAILURE;
+
+	memset(&run, 0, sizeof(run));
+
+	while ((opt = getopt(argc, argv, "n:f:st:r:m:H:NJL:v:h?")) != -1) {
+		switch (opt) {
+		case 'n':
+			if (pb_parse_int(optarg, 0, &opts.guid_num))
+				goto usage;
+			break;
+		case 'f':
+			opts.guid_file = optarg;
+			break;
+		case 's':
+			opts.switches = 1;
+			break;
+		case 't':
+			if (pb_parse_int(optarg, 1, &opts.threads))
+				goto usage;
+			break;
+		case 'r':
+			if (pb_parse_int(optarg, 1, &opts.rounds))
+				goto usage;
+			break;
+		case 'm':
+			if (!strcmp(optarg, "standard"))
+				opts.load_mode = SSA_DB_HELPER_STANDARD;
+			else if (!strcmp(optarg, "debug"))
+				opts.load_mode = SSA_DB_HELPER_DEBUG;
+			else if (!strcmp(optarg, "mmap"))
+				opts.load_mode = SSA_DB_HELPER_MMAP;
+			else
+				goto usage;
+			break;
+		case 'H':
+			if (pb_parse_int(optarg, SSA_DB_HUGEPAGES_NONE,
+					 &db_hugepages) ||
+			    db_hugepages > SSA_DB_HUGEPAGES_1G)
+				goto usage;
+			opts.arena = 1;
+			break;
+		case 'N':
+			db_numa_interleave = 1;
+			opts.arena = 1;
+			break;
+		case 'J':
+			opts.json = 1;
+			break;
+		case 'L':
+			opts.log_file = optarg;
+			break;
+		case 'v':
+			if (pb_parse_int(optarg, 0, &opts.log_level))
+				goto usage;
+			break;
+		case 'h':
+			print_usage(stdout, argv[0]);
+			return 0;
+		default:
+			goto usage;
+		}
+	}
+
+	if (optind != argc - 1)
+		goto usage;
+	opts.smdb_path = argv[optind];
+
+	ssa_open_log((char *) opts.log_file);
+	ssa_set_log_level(opts.log_level);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	run.smdb = pb_load_smdb(opts.smdb_path, opts.load_mode);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (!run.smdb) {
+		fprintf(stderr, "ERROR - unable to load SMDB from %s\n",
+			opts.smdb_path);
+		goto out;
+	}
+	load_usec = pb_elapsed_usec(&start, &end);
+	rss_load_kb = pb_peak_rss_kb();
+
+	if (opts.arena) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (pb_arena_smdb(&run))
+			goto out;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		copy_usec = pb_elapsed_usec(&start, &end);
+	}
+
+	if (pb_select_guids(&run))
+		goto out;
+	if (!run.guid_num) {
+		fprintf(stderr, "ERROR - no port GUIDs to compute PRDBs for\n");
+		goto out;
+	}
+
+	run.latency = calloc((size_t) run.guid_num * opts.rounds,
+			     sizeof(*run.latency));
+	run.records = calloc((size_t) run.guid_num * opts.rounds,
+			     sizeof(*run.records));
+	round_usec = calloc(opts.rounds, sizeof(*round_usec));
+	if (!run.latency || !run.records || !round_usec) {
+		fprintf(stderr, "ERROR - unable to allocate results\n");
+		goto out;
+	}
+
+	run.context = ssa_pr_create_context();
+	if (!run.context) {
+		fprintf(stderr, "ERROR - unable to create path record context\n");
+		goto out;
+	}
+
+	/* built once, the workers only read it as on access nodes */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ssa_pr_reinit_context(run.context, run.smdb);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	index_usec = pb_elapsed_usec(&start, &end);
+
+	for (run.round = 0; run.round < opts.rounds; run.round++) {
+		if (pb_run_round(&run, &round_usec[run.round]))
+			goto out;
+	}
+
+	pb_report(&run, load_usec, copy_usec, index_usec, round_usec,
+		  rss_load_kb);
+	ret = run.failed ? EXIT_FAILURE : 0;
+
+out:
+	if (run.context)
+		ssa_pr_destroy_context(run.context);
+	if (run.smdb)
+		ssa_db_destroy(run.smdb);
+	free(round_usec);
+	free(run.records);
+	free(run.latency);
+	free(run.guids);
+	ssa_close_log();
+	return ret;
+
+usage:
+	print_usage(stderr, argv[0]);
+	return EXIT_FAILURE;
+}
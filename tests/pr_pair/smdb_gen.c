@@ -0,0 +1,912 @@
+/*
+ * Copyright (c) 2015 Mellanox Technologies LTD. All rights reserved.
+ *
+ * This software is available to you under the terms of the
+ * OpenIB.org BSD license included below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * smdb_gen - synthetic SMDB generator for scale testing
+ *
+ * Builds the SMDB an SM would extract from a k-ary fat-tree, a
+ * k-ary n-tree (multi-level Clos) or a dragonfly fabric and saves it
+ * with ssa_db_save(), so pr_bench, the access layer and distribution
+ * can be exercised at sizes no lab fabric has.  GUID to LID, node,
+ * port, pkey, link and LFT tables are filled the way ssa_db_extract()
+ * does; LFTs are min-hop, with equal cost next hops chosen by
+ * destination so that LMC paths of a port leave on different links.
+ *
+ * The fabric can also be written as an ibsim topology, with the LIDs
+ * for the OpenSM guid2lid cache, so SSA nodes run on the simulated
+ * fabric (see tests/ssa_sim) find themselves in the generated SMDBs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <arpa/inet.h>
+
+#include <ssa_db.h>
+#include <ssa_smdb.h>
+#include <ssa_db_helper.h>
+#include <ssa_log.h>
+
+/* values as in the IBA spec, no OpenSM headers needed */
+#define SG_NODE_TYPE_CA		1
+#define SG_NODE_TYPE_SWITCH	2
+#define SG_MTU_4096		5
+#define SG_RATE_100_GBS		16
+#define SG_SM_STATE_MASTER	3
+#define SG_SUBNET_TIMEOUT	18
+#define SG_SUBNET_PREFIX	0xfe80000000000000ULL
+#define SG_SWITCH_GUID_BASE	0x0002c90200000000ULL
+#define SG_HOST_GUID_BASE	0x0002c90300000000ULL
+#define SG_DEFAULT_PKEY		0xFFFF
+#define SG_LFT_NO_PATH		0xFF
+#define SG_MAX_PORTS		254
+/* the PR index addresses LFT blocks below 0xBFFF / 64 only */
+#define SG_MAX_LID		((0xBFFF / UMAD_LEN_SMP_DATA) * UMAD_LEN_SMP_DATA - 1)
+#define SG_NONE			UINT32_MAX
+
+enum sg_topo_type {
+	SG_TOPO_FATTREE,
+	SG_TOPO_CLOS,
+	SG_TOPO_DRAGONFLY
+};
+
+struct sg_peer {
+	uint32_t node;		/* SG_NONE - not connected */
+	uint8_t	port;
+};
+
+struct sg_node {
+	uint64_t guid;		/* node GUID, host order */
+	struct sg_peer *ports;	/* indexed by port number, 0 unused */
+	uint16_t lid;
+	uint8_t	lmc;
+	uint8_t	is_switch;
+	uint8_t	num_ports;
+	char	desc[IB_NODE_DESCRIPTION_SIZE];
+};
+
+struct sg_topo {
+	struct sg_node *nodes;	/* switches first, then hosts */
+	struct sg_peer *peers;
+	uint32_t num_switches;
+	uint32_t num_hosts;
+	uint32_t max_hosts;
+	uint64_t num_links;
+	size_t	peers_used;
+	uint16_t max_lid;
+};
+
+struct sg_opts {
+	const char *output_path;
+	const char *sim_path;
+	const char *log_file;
+	enum sg_topo_type type;
+	int	arity;		/* fat-tree switch radix, Clos arity */
+	int	levels;		/* Clos */
+	int	routers;	/* dragonfly routers per group */
+	int	hosts;		/* dragonfly hosts per router */
+	int	global;		/* dragonfly global links per router */
+	int	groups;		/* dragonfly, 0 - routers * global + 1 */
+	int	max_hosts;	/* 0 - as many as the topology has */
+	int	lmc;
+	int	epoch;
+	enum ssa_db_helper_mode mode;
+};
+
+static struct sg_opts opts = {
+	.log_file	= "/dev/null",
+	.type		= SG_TOPO_FATTREE,
+	.arity		= 8,
+	.levels		= 3,
+	.routers	= 4,
+	.hosts		= 2,
+	.global		= 2,
+	.epoch		= 1,
+	.mode		= SSA_DB_HELPER_STANDARD,
+};
+
+static void print_usage(FILE *file, const char *name)
+{
+	fprintf(file, "Usage: %s [options] -o <output directory>\n", name);
+	fprintf(file, "\t-T topology: fattree, clos or dragonfly (default fattree)\n");
+	fprintf(file, "\t-k fat-tree switch radix or Clos arity (default %d)\n", opts.arity);
+	fprintf(file, "\t-l Clos levels (default %d)\n", opts.levels);
+	fprintf(file, "\t-a dragonfly routers per group (default %d)\n", opts.routers);
+	fprintf(file, "\t-p dragonfly hosts per router (default %d)\n", opts.hosts);
+	fprintf(file, "\t-g dragonfly global links per router (default %d)\n", opts.global);
+	fprintf(file, "\t-G dragonfly groups (default routers * global links + 1)\n");
+	fprintf(file, "\t-n maximum number of hosts (default all the topology has)\n");
+	fprintf(file, "\t-L LMC of the host ports (default %d)\n", opts.lmc);
+	fprintf(file, "\t-e SMDB epoch (default %d)\n", opts.epoch);
+	fprintf(file, "\t-m SSA DB output mode (default b)\n");
+	fprintf(file, "\t\tb - Binary\n");
+	fprintf(file, "\t\td - Debug\n");
+	fprintf(file, "\t\th - Human readable (cannot be preloaded later)\n");
+	fprintf(file, "\t\tm - Single mmap'able file\n");
+	fprintf(file, "\t-o output directory\n");
+	fprintf(file, "\t-s directory for the ibsim net and OpenSM guid2lid files\n");
+	fprintf(file, "\t-h help\n");
+}
+
+static int sg_parse_int(const char *str, int min, int max, int *val)
+{
+	char *end;
+	long tmp;
+
+	tmp = strtol(str, &end, 0);
+	if (end == str || *end || tmp < min || tmp > max)
+		return -1;
+
+	*val = tmp;
+	return 0;
+}
+
+static int sg_alloc(struct sg_topo *topo, uint64_t switches, int radix,
+		    uint64_t hosts)
+{
+	uint64_t nodes;
+
+	if (radix > SG_MAX_PORTS) {
+		fprintf(stderr, "ERROR - switch radix %d is above %d\n",
+			radix, SG_MAX_PORTS);
+		return -1;
+	}
+
+	if (topo->max_hosts && hosts > topo->max_hosts)
+		hosts = topo->max_hosts;
+
+	/* every node takes at least one LID */
+	nodes = switches + hosts;
+	if (nodes > SG_MAX_LID) {
+		fprintf(stderr, "ERROR - %" PRIu64 " switches and %" PRIu64
+			" hosts do not fit the unicast LID space\n",
+			switches, hosts);
+		return -1;
+	}
+
+	topo->nodes = calloc(nodes, sizeof(*topo->nodes));
+	topo->peers = malloc((switches * (radix + 1) + hosts * 2) *
+			     sizeof(*topo->peers));
+	if (!topo->nodes || !topo->peers) {
+		fprintf(stderr, "ERROR - unable to allocate the topology\n");
+		return -1;
+	}
+	memset(topo->peers, 0xFF, (switches * (radix + 1) + hosts * 2) *
+	       sizeof(*topo->peers));
+	topo->max_hosts = hosts;
+	return 0;
+}
+
+static struct sg_node *sg_add_node(struct sg_topo *topo, uint32_t idx,
+				   int num_ports, const char *fmt, ...)
+{
+	struct sg_node *node = &topo->nodes[idx];
+	va_list args;
+
+	node->ports = topo->peers + topo->peers_used;
+	node->num_ports = num_ports;
+	topo->peers_used += num_ports + 1;
+
+	va_start(args, fmt);
+	vsnprintf(node->desc, sizeof(node->desc), fmt, args);
+	va_end(args);
+	return node;
+}
+
+static uint32_t sg_add_switch(struct sg_topo *topo, int radix,
+			      const char *name, int level, int idx)
+{
+	uint32_t sw = topo->num_switches++;
+	struct sg_node *node;
+
+	node = sg_add_node(topo, sw, radix, "%s L%d S%d", name, level, idx);
+	node->guid = SG_SWITCH_GUID_BASE + sw;
+	node->is_switch = 1;
+	return sw;
+}
+
+static void sg_connect(struct sg_topo *topo, uint32_t a, int port_a,
+		       uint32_t b, int port_b)
+{
+	topo->nodes[a].ports[port_a].node = b;
+	topo->nodes[a].ports[port_a].port = port_b;
+	topo->nodes[b].ports[port_b].node = a;
+	topo->nodes[b].ports[port_b].port = port_a;
+	topo->num_links++;
+}
+
+/* hosts above -n are left out, their switch ports stay down */
+static void sg_add_host(struct sg_topo *topo, uint32_t sw, int port)
+{
+	uint32_t host;
+	struct sg_node *node;
+
+	if (topo->num_hosts >= topo->max_hosts)
+		return;
+
+	host = topo->num_switches + topo->num_hosts;
+	node = sg_add_node(topo, host, 1, "host%u HCA-1", topo->num_hosts);
+	node->guid = SG_HOST_GUID_BASE + 2 * (uint64_t) topo->num_hosts;
+	topo->num_hosts++;
+	sg_connect(topo, host, 1, sw, port);
+}
+
+/*
+ * Three level fat-tree of radix k switches: k pods of k/2 edge and
+ * k/2 aggregation switches, (k/2)^2 core switches and k^3/4 hosts.
+ * Down ports are 1..k/2, up ports k/2+1..k.
+ */
+static int sg_build_fattree(struct sg_topo *topo, int k)
+{
+	int half = k / 2, pod, e, a, i;
+	uint32_t core;
+
+	if (k < 2 || k % 2) {
+		fprintf(stderr, "ERROR - fat-tree radix must be even\n");
+		return -1;
+	}
+
+	if (sg_alloc(topo, 5ULL * k * k / 4, k, (uint64_t) k * k * k / 4))
+		return -1;
+
+	/* switch index: pod * k + (edge | half + agg), core after pods */
+	for (pod = 0; pod < k; pod++) {
+		for (e = 0; e < half; e++)
+			sg_add_switch(topo, k, "fattree edge", 0, pod * half + e);
+		for (a = 0; a < half; a++)
+			sg_add_switch(topo, k, "fattree aggr", 1, pod * half + a);
+	}
+	core = topo->num_switches;
+	for (i = 0; i < half * half; i++)
+		sg_add_switch(topo, k, "fattree core", 2, i);
+
+	for (pod = 0; pod < k; pod++) {
+		for (e = 0; e < half; e++)
+			for (a = 0; a < half; a++)
+				sg_connect(topo, pod * k + e, half + 1 + a,
+					   pod * k + half + a, e + 1);
+		for (a = 0; a < half; a++)
+			for (i = 0; i < half; i++)
+				sg_connect(topo, pod * k + half + a,
+					   half + 1 + i,
+					   core + a * half + i, pod + 1);
+	}
+
+	for (pod = 0; pod < k; pod++)
+		for (e = 0; e < half; e++)
+			for (i = 0; i < half; i++)
+				sg_add_host(topo, pod * k + e, i + 1);
+	return 0;
+}
+
+/*
+ * k-ary n-tree: n levels of k^(n-1) switches with 2k ports, k^n
+ * hosts.  Switch <w, l> connects to <w', l + 1> when the base k words
+ * w and w' differ in digit l only.  Down ports are 1..k, up ports
+ * k+1..2k; the top level leaves its up ports unused.
+ */
+static int sg_build_clos(struct sg_topo *topo, int k, int n)
+{
+	uint64_t width = 1, hosts, weight;
+	uint32_t w, up;
+	int l, i;
+
+	if (k < 2 || n < 2) {
+		fprintf(stderr, "ERROR - Clos needs arity and levels of 2 or more\n");
+		return -1;
+	}
+
+	for (l = 0; l < n - 1; l++) {
+		width *= k;
+		if (width > SG_MAX_LID) {
+			fprintf(stderr, "ERROR - Clos is too large\n");
+			return -1;
+		}
+	}
+	hosts = width * k;
+
+	if (sg_alloc(topo, width * n, 2 * k, hosts))
+		return -1;
+
+	for (l = 0; l < n; l++)
+		for (w = 0; w < width; w++)
+			sg_add_switch(topo, 2 * k, "clos", l, w);
+
+	for (l = 0, weight = 1; l < n - 1; l++, weight *= k) {
+		for (w = 0; w < width; w++) {
+			for (i = 0; i < k; i++) {
+				up = w - ((w / weight) % k) * weight + i * weight;
+				sg_connect(topo, l * width + w, k + 1 + i,
+					   (l + 1) * width + up,
+					   (w / weight) % k + 1);
+			}
+		}
+	}
+
+	for (w = 0; w < width; w++)
+		for (i = 0; i < k; i++)
+			sg_add_host(topo, w, i + 1);
+	return 0;
+}
+
+/*
+ * Dragonfly: groups of a fully connected routers, p hosts and h
+ * global links per router.  Global link j of group i goes to group
+ * (i + j + 1) mod g, which sees it as its link g - j - 2, so every
+ * pair of groups is joined once.  Ports: 1..p hosts, p+1..p+a-1 local,
+ * p+a..p+a+h-1 global.
+ */
+static int sg_build_dragonfly(struct sg_topo *topo, int a, int p, int h,
+			      int g)
+{
+	int radix = p + a - 1 + h, i, r, r2, j, t, j2;
+
+	if (a < 1 || p < 1 || h < 1) {
+		fprintf(stderr, "ERROR - dragonfly needs routers, hosts and global links\n");
+		return -1;
+	}
+	if (!g)
+		g = a * h + 1;
+	if (g < 2 || g > a * h + 1) {
+		fprintf(stderr, "ERROR - dragonfly groups must be between 2 and %d\n",
+			a * h + 1);
+		return -1;
+	}
+
+	if (sg_alloc(topo, (uint64_t) a * g, radix, (uint64_t) a * g * p))
+		return -1;
+
+	for (i = 0; i < g; i++)
+		for (r = 0; r < a; r++)
+			sg_add_switch(topo, radix, "dragonfly", i, r);
+
+	for (i = 0; i < g; i++)
+		for (r = 0; r < a; r++)
+			for (r2 = r + 1; r2 < a; r2++)
+				sg_connect(topo, i * a + r, p + r2,
+					   i * a + r2, p + 1 + r);
+
+	for (i = 0; i < g; i++) {
+		for (j = 0; j < g - 1; j++) {
+			t = (i + j + 1) % g;
+			if (t < i)
+				continue;
+			j2 = g - j - 2;
+			sg_connect(topo, i * a + j / h, p + a + j % h,
+				   t * a + j2 / h, p + a + j2 % h);
+		}
+	}
+
+	for (i = 0; i < g * a; i++)
+		for (j = 0; j < p; j++)
+			sg_add_host(topo, i, j + 1);
+	return 0;
+}
+
+/* switches take one LID, host ports LMC aligned blocks after them */
+static int sg_assign_lids(struct sg_topo *topo, int lmc)
+{
+	uint32_t i, lid = 1, mask = (1 << lmc) - 1;
+	struct sg_node *node;
+
+	for (i = 0; i < topo->num_switches + topo->num_hosts; i++) {
+		node = &topo->nodes[i];
+		if (!node->is_switch) {
+			lid = (lid + mask) & ~mask;
+			node->lmc = lmc;
+		}
+		if (lid + (node->is_switch ? 0 : mask) > SG_MAX_LID) {
+			fprintf(stderr, "ERROR - out of LIDs at node %u with LMC %d\n",
+				i, lmc);
+			return -1;
+		}
+		node->lid = lid;
+		lid += node->is_switch ? 1 : mask + 1;
+	}
+	topo->max_lid = lid - 1;
+	return 0;
+}
+
+static uint64_t sg_port_guid(const struct sg_node *node)
+{
+	return node->is_switch ? node->guid : node->guid + 1;
+}
+
+static void sg_set_dataset(struct ssa_db *smdb, int tbl_id, uint64_t count,
+			   size_t rec_size, uint64_t epoch)
+{
+	smdb->p_db_tables[tbl_id].set_count = htonll(count);
+	smdb->p_db_tables[tbl_id].set_size = htonll(count * rec_size);
+	ssa_db_set_epoch(smdb, tbl_id, epoch);
+}
+
+static void sg_fill_ports(struct sg_topo *topo, struct ssa_db *smdb,
+			  uint64_t *p_port_cnt, uint64_t *p_link_cnt)
+{
+	struct smdb_port *port_tbl = smdb->pp_tables[SMDB_TBL_ID_PORT];
+	struct smdb_link *link_tbl = smdb->pp_tables[SMDB_TBL_ID_LINK];
+	be16_t *pkey_tbl = smdb->pp_tables[SMDB_TBL_ID_PKEY];
+	uint64_t port_cnt = 0, link_cnt = 0, pkey_cnt = 0;
+	struct smdb_port *rec;
+	struct smdb_link *link;
+	struct sg_node *node, *remote;
+	struct sg_peer *peer;
+	uint32_t i;
+	int port;
+
+	for (i = 0; i < topo->num_switches + topo->num_hosts; i++) {
+		node = &topo->nodes[i];
+		for (port = node->is_switch ? 0 : 1; port <= node->num_ports;
+		     port++) {
+			rec = &port_tbl[port_cnt++];
+			memset(rec, 0, sizeof(*rec));
+			/* pkey table hangs off switch port 0 and CA ports */
+			if (port == (node->is_switch ? 0 : 1)) {
+				pkey_tbl[pkey_cnt] = htons(SG_DEFAULT_PKEY);
+				rec->pkey_tbl_offset =
+					htonll(pkey_cnt * sizeof(*pkey_tbl));
+				rec->pkey_tbl_size = htons(sizeof(*pkey_tbl));
+				pkey_cnt++;
+			}
+			rec->port_lid = htons(node->lid);
+			rec->port_num = port;
+			rec->mtu_cap = SG_MTU_4096;
+			rec->rate = SG_RATE_100_GBS;
+			if (node->is_switch)
+				rec->rate |= SSA_DB_PORT_IS_SWITCH_MASK;
+
+			if (!port)
+				continue;
+			peer = &node->ports[port];
+			if (peer->node == SG_NONE)
+				continue;
+
+			/* CA ends of a link are port 0 as in smdb_link_init() */
+			remote = &topo->nodes[peer->node];
+			link = &link_tbl[link_cnt++];
+			memset(link, 0, sizeof(*link));
+			link->from_lid = htons(node->lid);
+			link->from_port_num = node->is_switch ? port : 0;
+			link->to_lid = htons(remote->lid);
+			link->to_port_num = remote->is_switch ? peer->port : 0;
+		}
+	}
+
+	*p_port_cnt = port_cnt;
+	*p_link_cnt = link_cnt;
+}
+
+static inline void sg_lft_set(struct smdb_lft_block *blocks, uint16_t nblocks,
+			      uint32_t sw, uint16_t lid, uint8_t port)
+{
+	blocks[sw * nblocks + lid / UMAD_LEN_SMP_DATA].block[lid % UMAD_LEN_SMP_DATA] = port;
+}
+
+/*
+ * Min-hop LFTs: a BFS over the switches from every destination switch,
+ * then on each other switch the LIDs behind it are spread over the
+ * ports that lead one hop closer, by destination node and LID offset.
+ */
+static int sg_fill_lfts(struct sg_topo *topo, struct ssa_db *smdb,
+			uint16_t nblocks)
+{
+	struct smdb_lft_top *top_tbl = smdb->pp_tables[SMDB_TBL_ID_LFT_TOP];
+	struct smdb_lft_block *blocks = smdb->pp_tables[SMDB_TBL_ID_LFT_BLOCK];
+	uint32_t num_sw = topo->num_switches, d, s, head, tail, t;
+	uint16_t *dist, b, lid;
+	uint32_t *queue;
+	uint8_t cand[SG_MAX_PORTS + 1];
+	struct sg_node *node, *dest;
+	struct sg_peer *peer;
+	int port, n, off, ret = -1;
+
+	dist = malloc(num_sw * sizeof(*dist));
+	queue = malloc(num_sw * sizeof(*queue));
+	if (!dist || !queue) {
+		fprintf(stderr, "ERROR - unable to allocate routing state\n");
+		goto out;
+	}
+
+	for (s = 0; s < num_sw; s++) {
+		top_tbl[s].lid = htons(topo->nodes[s].lid);
+		top_tbl[s].lft_top = htons(nblocks * UMAD_LEN_SMP_DATA);
+		memset(top_tbl[s].pad, 0, sizeof(top_tbl[s].pad));
+		for (b = 0; b < nblocks; b++) {
+			blocks[s * nblocks + b].lid = htons(topo->nodes[s].lid);
+			blocks[s * nblocks + b].block_num = htons(b);
+			memset(blocks[s * nblocks + b].block, SG_LFT_NO_PATH,
+			       UMAD_LEN_SMP_DATA);
+		}
+	}
+
+	for (d = 0; d < num_sw; d++) {
+		dest = &topo->nodes[d];
+
+		memset(dist, 0xFF, num_sw * sizeof(*dist));
+		dist[d] = 0;
+		queue[0] = d;
+		for (head = 0, tail = 1; head < tail; head++) {
+			node = &topo->nodes[queue[head]];
+			for (port = 1; port <= node->num_ports; port++) {
+				t = node->ports[port].node;
+				if (t >= num_sw || dist[t] != UINT16_MAX)
+					continue;
+				dist[t] = dist[queue[head]] + 1;
+				queue[tail++] = t;
+			}
+		}
+
+		for (s = 0; s < num_sw; s++) {
+			node = &topo->nodes[s];
+
+			if (s == d) {
+				sg_lft_set(blocks, nblocks, s, node->lid, 0);
+				for (port = 1; port <= node->num_ports; port++) {
+					t = node->ports[port].node;
+					if (t == SG_NONE || t < num_sw)
+						continue;
+					for (off = 0; off < (1 << topo->nodes[t].lmc); off++)
+						sg_lft_set(blocks, nblocks, s,
+							   topo->nodes[t].lid + off, port);
+				}
+				continue;
+			}
+
+			if (dist[s] == UINT16_MAX)
+				continue;
+
+			for (port = 1, n = 0; port <= node->num_ports; port++) {
+				t = node->ports[port].node;
+				if (t < num_sw && dist[t] == dist[s] - 1)
+					cand[n++] = port;
+			}
+
+			sg_lft_set(blocks, nblocks, s, dest->lid, cand[d % n]);
+			for (port = 1; port <= dest->num_ports; port++) {
+				peer = &dest->ports[port];
+				if (peer->node == SG_NONE || peer->node < num_sw)
+					continue;
+				lid = topo->nodes[peer->node].lid;
+				for (off = 0; off < (1 << topo->nodes[peer->node].lmc); off++)
+					sg_lft_set(blocks, nblocks, s, lid + off,
+						   cand[(peer->node + off) % n]);
+			}
+		}
+	}
+	ret = 0;
+out:
+	free(queue);
+	free(dist);
+	return ret;
+}
+
+static struct ssa_db *sg_gen_smdb(struct sg_topo *topo)
+{
+	uint64_t num_recs[SMDB_TBL_ID_MAX] = { 0 };
+	uint64_t port_cnt, link_cnt, nodes, i;
+	struct smdb_subnet_opts *subnet_opts;
+	struct smdb_guid2lid *guid2lid;
+	struct smdb_node *node_rec;
+	struct sg_node *node;
+	struct ssa_db *smdb;
+	uint16_t nblocks;
+
+	nodes = topo->num_switches + topo->num_hosts;
+	nblocks = topo->max_lid / UMAD_LEN_SMP_DATA + 1;
+
+	num_recs[SMDB_TBL_ID_SUBNET_OPTS] = 1;
+	num_recs[SMDB_TBL_ID_GUID2LID] = nodes;
+	num_recs[SMDB_TBL_ID_NODE] = nodes;
+	num_recs[SMDB_TBL_ID_LINK] = 2 * topo->num_links;
+	num_recs[SMDB_TBL_ID_PORT] = topo->peers_used - topo->num_hosts;
+	num_recs[SMDB_TBL_ID_PKEY] = nodes;
+	num_recs[SMDB_TBL_ID_LFT_TOP] = topo->num_switches;
+	num_recs[SMDB_TBL_ID_LFT_BLOCK] = (uint64_t) topo->num_switches * nblocks;
+
+	smdb = ssa_db_smdb_init(opts.epoch, num_recs);
+	if (!smdb) {
+		fprintf(stderr, "ERROR - unable to allocate SMDB\n");
+		return NULL;
+	}
+
+	subnet_opts = smdb->pp_tables[SMDB_TBL_ID_SUBNET_OPTS];
+	memset(subnet_opts, 0, sizeof(*subnet_opts));
+	subnet_opts->subnet_prefix = htonll(SG_SUBNET_PREFIX);
+	subnet_opts->sm_state = SG_SM_STATE_MASTER;
+	subnet_opts->lmc = opts.lmc;
+	subnet_opts->subnet_timeout = SG_SUBNET_TIMEOUT;
+
+	guid2lid = smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
+	node_rec = smdb->pp_tables[SMDB_TBL_ID_NODE];
+	for (i = 0; i < nodes; i++) {
+		node = &topo->nodes[i];
+
+		memset(&guid2lid[i], 0, sizeof(guid2lid[i]));
+		guid2lid[i].guid = htonll(sg_port_guid(node));
+		guid2lid[i].lid = htons(node->lid);
+		guid2lid[i].lmc = node->lmc;
+		guid2lid[i].is_switch = node->is_switch;
+
+		memset(&node_rec[i], 0, sizeof(node_rec[i]));
+		node_rec[i].node_guid = htonll(node->guid);
+		node_rec[i].node_type = node->is_switch ?
+					SG_NODE_TYPE_SWITCH : SG_NODE_TYPE_CA;
+		memcpy(node_rec[i].description, node->desc,
+		       sizeof(node_rec[i].description));
+	}
+
+	sg_fill_ports(topo, smdb, &port_cnt, &link_cnt);
+
+	if (sg_fill_lfts(topo, smdb, nblocks)) {
+		ssa_db_smdb_destroy(smdb);
+		return NULL;
+	}
+
+	sg_set_dataset(smdb, SMDB_TBL_ID_SUBNET_OPTS, 1,
+		       sizeof(struct smdb_subnet_opts), opts.epoch);
+	sg_set_dataset(smdb, SMDB_TBL_ID_GUID2LID, nodes,
+		       sizeof(struct smdb_guid2lid), opts.epoch);
+	sg_set_dataset(smdb, SMDB_TBL_ID_NODE, nodes,
+		       sizeof(struct smdb_node), opts.epoch);
+	sg_set_dataset(smdb, SMDB_TBL_ID_LINK, link_cnt,
+		       sizeof(struct smdb_link), opts.epoch);
+	sg_set_dataset(smdb, SMDB_TBL_ID_PORT, port_cnt,
+		       sizeof(struct smdb_port), opts.epoch);
+	sg_set_dataset(smdb, SMDB_TBL_ID_PKEY, nodes,
+		       sizeof(uint16_t), opts.epoch);
+	sg_set_dataset(smdb, SMDB_TBL_ID_LFT_TOP, topo->num_switches,
+		       sizeof(struct smdb_lft_top), opts.epoch);
+	sg_set_dataset(smdb, SMDB_TBL_ID_LFT_BLOCK,
+		       num_recs[SMDB_TBL_ID_LFT_BLOCK],
+		       sizeof(struct smdb_lft_block), opts.epoch);
+	sg_set_dataset(smdb, SMDB_TBL_ID_IPv4, 0,
+		       sizeof(struct ipdb_ipv4), opts.epoch);
+	sg_set_dataset(smdb, SMDB_TBL_ID_IPv6, 0,
+		       sizeof(struct ipdb_ipv6), opts.epoch);
+	sg_set_dataset(smdb, SMDB_TBL_ID_NAME, 0,
+		       sizeof(struct ipdb_name), opts.epoch);
+
+	printf("Switches: %u Hosts: %u Links: %" PRIu64 " Max LID: %u\n",
+	       topo->num_switches, topo->num_hosts, topo->num_links,
+	       topo->max_lid);
+	return smdb;
+}
+
+static void sg_sim_name(const struct sg_topo *topo, uint32_t idx,
+			char *buf, size_t size)
+{
+	if (idx < topo->num_switches)
+		snprintf(buf, size, "sw%u", idx);
+	else
+		snprintf(buf, size, "host%u", idx - topo->num_switches);
+}
+
+/*
+ * ibsim net file, each link listed from both ends as ibnetdiscover
+ * does, and the guid2lid file OpenSM reads from its cache directory.
+ */
+static int sg_write_sim(struct sg_topo *topo, const char *dir)
+{
+	char path[PATH_MAX], name[32], peer_name[32];
+	FILE *net = NULL, *g2l = NULL;
+	struct sg_node *node;
+	struct sg_peer *peer;
+	uint32_t i;
+	int port, ret = -1;
+
+	snprintf(path, sizeof(path), "%s/net", dir);
+	net = fopen(path, "w");
+	if (!net) {
+		fprintf(stderr, "ERROR - unable to create %s\n", path);
+		goto out;
+	}
+
+	snprintf(path, sizeof(path), "%s/guid2lid", dir);
+	g2l = fopen(path, "w");
+	if (!g2l) {
+		fprintf(stderr, "ERROR - unable to create %s\n", path);
+		goto out;
+	}
+
+	for (i = 0; i < topo->num_switches + topo->num_hosts; i++) {
+		node = &topo->nodes[i];
+		sg_sim_name(topo, i, name, sizeof(name));
+
+		fprintf(net, "%s=0x%016" PRIx64 "\n",
+			node->is_switch ? "switchguid" : "caguid", node->guid);
+		fprintf(net, "%s\t%d \"%s\"\t\t# \"%s\" lid %u\n",
+			node->is_switch ? "Switch" : "Hca", node->num_ports,
+			name, node->desc, node->lid);
+		for (port = 1; port <= node->num_ports; port++) {
+			peer = &node->ports[port];
+			if (peer->node == SG_NONE)
+				continue;
+			sg_sim_name(topo, peer->node, peer_name, sizeof(peer_name));
+			if (node->is_switch)
+				fprintf(net, "[%d]", port);
+			else
+				fprintf(net, "[%d](%" PRIx64 ")", port,
+					sg_port_guid(node));
+			fprintf(net, "\t\"%s\"[%u]\n", peer_name, peer->port);
+		}
+		fprintf(net, "\n");
+
+		fprintf(g2l, "0x%016" PRIx64 " 0x%04x 0x%04x\n",
+			sg_port_guid(node), node->lid,
+			node->lid + (1 << node->lmc) - 1);
+	}
+	ret = 0;
+out:
+	if (g2l)
+		fclose(g2l);
+	if (net)
+		fclose(net);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	struct sg_topo topo;
+	struct ssa_db *smdb = NULL;
+	int opt, ret = EXIT_FAILURE;
+
+	memset(&topo, 0, sizeof(topo));
+
+	while ((opt = getopt(argc, argv, "T:k:l:a:p:g:G:n:L:e:m:o:s:h?")) != -1) {
+		switch (opt) {
+		case 'T':
+			if (!strcmp(optarg, "fattree"))
+				opts.type = SG_TOPO_FATTREE;
+			else if (!strcmp(optarg, "clos"))
+				opts.type = SG_TOPO_CLOS;
+			else if (!strcmp(optarg, "dragonfly"))
+				opts.type = SG_TOPO_DRAGONFLY;
+			else
+				goto usage;
+			break;
+		case 'k':
+			if (sg_parse_int(optarg, 2, SG_MAX_PORTS, &opts.arity))
+				goto usage;
+			break;
+		case 'l':
+			if (sg_parse_int(optarg, 2, 16, &opts.levels))
+				goto usage;
+			break;
+		case 'a':
+			if (sg_parse_int(optarg, 1, SG_MAX_PORTS, &opts.routers))
+				goto usage;
+			break;
+		case 'p':
+			if (sg_parse_int(optarg, 1, SG_MAX_PORTS, &opts.hosts))
+				goto usage;
+			break;
+		case 'g':
+			if (sg_parse_int(optarg, 1, SG_MAX_PORTS, &opts.global))
+				goto usage;
+			break;
+		case 'G':
+			if (sg_parse_int(optarg, 2, SG_MAX_LID, &opts.groups))
+				goto usage;
+			break;
+		case 'n':
+			if (sg_parse_int(optarg, 1, SG_MAX_LID, &opts.max_hosts))
+				goto usage;
+			break;
+		case 'L':
+			if (sg_parse_int(optarg, 0, 7, &opts.lmc))
+				goto usage;
+			break;
+		case 'e':
+			if (sg_parse_int(optarg, 1, INT32_MAX, &opts.epoch))
+				goto usage;
+			break;
+		case 'm':
+			if (optarg[0] == 'b')
+				opts.mode = SSA_DB_HELPER_STANDARD;
+			else if (optarg[0] == 'd')
+				opts.mode = SSA_DB_HELPER_DEBUG;
+			else if (optarg[0] == 'h')
+				opts.mode = SSA_DB_HELPER_HUMAN;
+			else if (optarg[0] == 'm')
+				opts.mode = SSA_DB_HELPER_MMAP;
+			else
+				goto usage;
+			break;
+		case 'o':
+			opts.output_path = optarg;
+			break;
+		case 's':
+			opts.sim_path = optarg;
+			break;
+		case 'h':
+			print_usage(stdout, argv[0]);
+			return 0;
+		default:
+			goto usage;
+		}
+	}
+
+	if (optind != argc || !opts.output_path || !strlen(opts.output_path))
+		goto usage;
+
+	ssa_open_log((char *) opts.log_file);
+
+	topo.max_hosts = opts.max_hosts;
+	switch (opts.type) {
+	case SG_TOPO_FATTREE:
+		ret = sg_build_fattree(&topo, opts.arity);
+		break;
+	case SG_TOPO_CLOS:
+		ret = sg_build_clos(&topo, opts.arity, opts.levels);
+		break;
+	case SG_TOPO_DRAGONFLY:
+		ret = sg_build_dragonfly(&topo, opts.routers, opts.hosts,
+					 opts.global, opts.groups);
+		break;
+	}
+	if (ret || sg_assign_lids(&topo, opts.lmc)) {
+		ret = EXIT_FAILURE;
+		goto out;
+	}
+
+	smdb = sg_gen_smdb(&topo);
+	if (!smdb) {
+		ret = EXIT_FAILURE;
+		goto out;
+	}
+
+	ssa_db_save(opts.output_path, smdb, opts.mode);
+	printf("Output path: %s\n", opts.output_path);
+
+	if (opts.sim_path) {
+		if (sg_write_sim(&topo, opts.sim_path)) {
+			ret = EXIT_FAILURE;
+			goto out;
+		}
+		printf("Simulator files: %s\n", opts.sim_path);
+	}
+	ret = 0;
+
+out:
+	if (smdb)
+		ssa_db_smdb_destroy(smdb);
+	free(topo.peers);
+	free(topo.nodes);
+	ssa_close_log();
+	return ret;
+
+usage:
+	print_usage(stderr, argv[0]);
+	return EXIT_FAILURE;
+}
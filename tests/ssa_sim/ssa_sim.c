@@ -0,0 +1,1239 @@
+/*
+ * Copyright (c) 2015 Mellanox Technologies LTD. All rights reserved.
+ *
+ * This software is available to you under the terms of the
+ * OpenIB.org BSD license included below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * libssa_sim - loopback transport for running SSA nodes on one host
+ *
+ * Preloaded (after libumad2sim) into opensm, ibssa, ibacm and ssadmin
+ * running against an ibsim fabric.  MADs go through umad2sim as usual;
+ * this library covers the rest:
+ *
+ * - rsockets are carried over TCP on 127.0.0.0/8.  The low 24 bits of
+ *   a port GID select the loopback address and the low 16 bits of the
+ *   service ID the TCP port.  Every stream starts with a hello holding
+ *   the GID and LID of the connecting port, which rgetpeername and the
+ *   RDMA_ROUTE socket option report on the accepting side.  Data is
+ *   framed so riowrite to a riomap'ed buffer can travel in band.
+ * - The verbs calls made by the SSA layer are answered from the
+ *   (simulated) umad view of the port.  A thread polls the port and
+ *   turns state, LID and SM LID changes into async events.  No QPs or
+ *   CQs are provided.
+ *
+ * Payload bytes are counted per service port and written to the file
+ * named by SSA_SIM_STATS every 250 ms and on exit, by the process which
+ * opened the first rsocket only: wrappers, helpers run through popen and
+ * fork children inherit the preload too and would otherwise overwrite
+ * the file with their empty (or stale) counters.  The identity of a
+ * process without an active port may be given as SIM_HOST (node
+ * description only).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <stddef.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include <infiniband/umad.h>
+#include <infiniband/ib.h>
+#include <rdma/rsocket.h>
+
+/*
+ * Newer verbs.h wraps ibv_query_port in a macro and declares the
+ * exported symbol with a compat attribute struct, so define it under
+ * its own name and export that as ibv_query_port.
+ */
+#undef ibv_query_port
+int sim_query_port(struct ibv_context *context, uint8_t port_num,
+		   struct ibv_port_attr *port_attr) __asm__("ibv_query_port");
+
+#define SIM_MAX_FD		65536
+#define SIM_MAX_STATS		16
+#define SIM_IOWRITE_MAX		256
+#define SIM_HELLO_TIMEOUT	2000	/* msec */
+#define SIM_STATS_INTERVAL	250000	/* usec */
+#define SIM_WATCH_INTERVAL	500000	/* usec */
+
+enum {
+	SIM_FRAME_HELLO = 1,
+	SIM_FRAME_DATA,
+	SIM_FRAME_IOWRITE
+};
+
+struct sim_frame_hdr {
+	uint8_t		type;
+	uint8_t		reserved[3];
+	uint32_t	len;
+	uint64_t	offset;
+};
+
+struct sim_hello {
+	uint8_t		gid[16];
+	uint16_t	lid;
+	uint8_t		reserved[6];
+};
+
+struct sim_stats {
+	unsigned		port;
+	volatile uint64_t	conns;
+	volatile uint64_t	tx_bytes;
+	volatile uint64_t	rx_bytes;
+	volatile uint64_t	iowrite_tx_bytes;
+	volatile uint64_t	iowrite_rx_bytes;
+};
+
+struct sim_sock {
+	int			listening;
+	struct sim_stats	*stats;
+	uint8_t			local_gid[16];
+	uint16_t		local_port;
+	uint8_t			peer_gid[16];
+	uint16_t		peer_lid;
+	uint16_t		peer_port;
+	struct ibv_path_data	route;
+	int			route_set;
+	void			*iomap_buf;
+	size_t			iomap_len;
+	off_t			iomap_off;
+	size_t			tx_left;
+	size_t			rx_left;
+	struct sim_frame_hdr	rx_hdr;
+	size_t			rx_hdr_len;
+};
+
+struct sim_event {
+	int	type;
+	int	port;
+};
+
+struct sim_context {
+	struct ibv_context	context;
+	int			event_fd;
+	int			running;
+	pthread_t		watcher;
+	umad_port_t		ports[UMAD_CA_MAX_PORTS];
+};
+
+struct sim_comp_channel {
+	struct ibv_comp_channel	channel;
+	int			wfd;
+};
+
+static struct sim_sock *sim_socks[SIM_MAX_FD];
+static struct sim_stats sim_stats[SIM_MAX_STATS];
+static int sim_stats_num;
+static pid_t sim_stats_pid;
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t sim_stats_once = PTHREAD_ONCE_INIT;
+
+static struct ibv_device sim_device;
+static struct ibv_device *sim_device_list[2];
+
+static uint64_t sim_htonll(uint64_t x)
+{
+	return ((uint64_t) htonl(x & 0xffffffff) << 32) | htonl(x >> 32);
+}
+
+static struct sim_sock *sim_get(int fd)
+{
+	if (fd < 0 || fd >= SIM_MAX_FD || !sim_socks[fd]) {
+		errno = EBADF;
+		return NULL;
+	}
+	return sim_socks[fd];
+}
+
+static struct sim_stats *sim_get_stats(unsigned port)
+{
+	struct sim_stats *stats = NULL;
+	int i;
+
+	pthread_mutex_lock(&sim_lock);
+	for (i = 0; i < sim_stats_num; i++) {
+		if (sim_stats[i].port == port) {
+			stats = &sim_stats[i];
+			goto out;
+		}
+	}
+	/* the last slot collects whatever does not fit */
+	if (sim_stats_num < SIM_MAX_STATS) {
+		stats = &sim_stats[sim_stats_num++];
+		stats->port = port;
+	} else
+		stats = &sim_stats[SIM_MAX_STATS - 1];
+out:
+	pthread_mutex_unlock(&sim_lock);
+	return stats;
+}
+
+static void sim_write_stats(void)
+{
+	char tmp[PATH_MAX];
+	const char *path;
+	FILE *f;
+	int i;
+
+	path = getenv("SSA_SIM_STATS");
+	if (!path || !path[0] || sim_stats_pid != getpid())
+		return;
+
+	snprintf(tmp, sizeof tmp, "%s.%d", path, getpid());
+	f = fopen(tmp, "w");
+	if (!f)
+		return;
+
+	fprintf(f, "# port connections tx_bytes rx_bytes "
+		   "iowrite_tx_bytes iowrite_rx_bytes\n");
+	for (i = 0; i < sim_stats_num; i++)
+		fprintf(f, "%u %llu %llu %llu %llu %llu\n", sim_stats[i].port,
+			(unsigned long long) sim_stats[i].conns,
+			(unsigned long long) sim_stats[i].tx_bytes,
+			(unsigned long long) sim_stats[i].rx_bytes,
+			(unsigned long long) sim_stats[i].iowrite_tx_bytes,
+			(unsigned long long) sim_stats[i].iowrite_rx_bytes);
+	fclose(f);
+	rename(tmp, path);
+}
+
+static void *sim_stats_thread(void *context)
+{
+	for (;;) {
+		usleep(SIM_STATS_INTERVAL);
+		sim_write_stats();
+	}
+	return NULL;
+}
+
+static void sim_start_stats(void)
+{
+	pthread_t thread;
+
+	if (!getenv("SSA_SIM_STATS"))
+		return;
+	sim_stats_pid = getpid();
+	if (!pthread_create(&thread, NULL, sim_stats_thread, NULL))
+		pthread_detach(thread);
+}
+
+static void __attribute__((destructor)) sim_fini(void)
+{
+	sim_write_stats();
+}
+
+/*
+ * First active port of the first CA, as seen through umad.
+ * Returns 0 and fills gid (network order) and lid on success.
+ */
+static int sim_local_port(uint8_t *gid, uint16_t *lid)
+{
+	char names[UMAD_MAX_DEVICES][UMAD_CA_NAME_LEN];
+	umad_port_t port;
+	int n, i, p;
+
+	n = umad_get_cas_names(names, UMAD_MAX_DEVICES);
+	for (i = 0; i < n; i++) {
+		for (p = 1; p < UMAD_CA_MAX_PORTS; p++) {
+			if (umad_get_port(names[i], p, &port) < 0)
+				break;
+			if (port.state == IBV_PORT_ACTIVE) {
+				memcpy(gid, &port.gid_prefix, 8);
+				memcpy(gid + 8, &port.port_guid, 8);
+				*lid = port.base_lid;
+				umad_release_port(&port);
+				return 0;
+			}
+			umad_release_port(&port);
+		}
+	}
+	return -1;
+}
+
+static int sim_gid_is_zero(const uint8_t *gid)
+{
+	int i;
+
+	for (i = 0; i < 16; i++)
+		if (gid[i])
+			return 0;
+	return 1;
+}
+
+static void sim_gid_to_sin(const uint8_t *gid, uint16_t port,
+			   struct sockaddr_in *sin)
+{
+	memset(sin, 0, sizeof *sin);
+	sin->sin_family = AF_INET;
+	sin->sin_port = htons(port);
+	sin->sin_addr.s_addr = htonl((127 << 24) | (gid[13] << 16) |
+				     (gid[14] << 8) | gid[15]);
+}
+
+static int sim_sib_port(const struct sockaddr *addr, socklen_t addrlen,
+			uint16_t *port)
+{
+	const struct sockaddr_ib *sib = (const struct sockaddr_ib *) addr;
+
+	if (addrlen < sizeof(*sib) || sib->sib_family != AF_IB) {
+		errno = EAFNOSUPPORT;
+		return -1;
+	}
+	*port = (uint16_t) sim_htonll(sib->sib_sid);
+	return 0;
+}
+
+static void sim_fill_sib(struct sockaddr *addr, socklen_t *addrlen,
+			 const uint8_t *gid, uint16_t port)
+{
+	struct sockaddr_ib sib;
+
+	memset(&sib, 0, sizeof sib);
+	sib.sib_family = AF_IB;
+	sib.sib_pkey = 0xFFFF;
+	memcpy(&sib.sib_addr, gid, 16);
+	sib.sib_sid = sim_htonll(((uint64_t) RDMA_PS_TCP << 16) + port);
+	sib.sib_sid_mask = sim_htonll(RDMA_IB_IP_PS_MASK |
+				      RDMA_IB_IP_PORT_MASK);
+	if (addr && addrlen) {
+		memcpy(addr, &sib, *addrlen < sizeof sib ? *addrlen : sizeof sib);
+		*addrlen = sizeof sib;
+	}
+}
+
+/* Complete a short transfer on a possibly non blocking socket */
+static int sim_xfer_all(int fd, void *buf, size_t len, int send_dir,
+			int timeout)
+{
+	struct pollfd pfd;
+	ssize_t n;
+
+	while (len) {
+		if (send_dir)
+			n = send(fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+		else
+			n = recv(fd, buf, len, MSG_DONTWAIT);
+		if (n > 0) {
+			buf += n;
+			len -= n;
+			continue;
+		}
+		if (n == 0) {
+			errno = ECONNRESET;
+			return -1;
+		}
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			return -1;
+
+		pfd.fd = fd;
+		pfd.events = send_dir ? POLLOUT : POLLIN;
+		pfd.revents = 0;
+		n = poll(&pfd, 1, timeout);
+		if (n == 0) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+		if (n < 0 && errno != EINTR)
+			return -1;
+	}
+	return 0;
+}
+
+int rsocket(int domain, int type, int protocol)
+{
+	struct sim_sock *ss;
+	int fd, val = 1;
+
+	if (domain != AF_IB) {
+		errno = EAFNOSUPPORT;
+		return -1;
+	}
+
+	pthread_once(&sim_stats_once, sim_start_stats);
+
+	fd = socket(AF_INET, type, 0);
+	if (fd < 0)
+		return fd;
+	if (fd >= SIM_MAX_FD) {
+		close(fd);
+		errno = EMFILE;
+		return -1;
+	}
+
+	ss = calloc(1, sizeof *ss);
+	if (!ss) {
+		close(fd);
+		errno = ENOMEM;
+		return -1;
+	}
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof val);
+	sim_socks[fd] = ss;
+	return fd;
+}
+
+int rbind(int socket, const struct sockaddr *addr, socklen_t addrlen)
+{
+	const struct sockaddr_ib *sib = (const struct sockaddr_ib *) addr;
+	struct sim_sock *ss;
+	struct sockaddr_in sin;
+	uint16_t port, lid;
+	int val = 1;
+
+	if (!(ss = sim_get(socket)))
+		return -1;
+	if (sim_sib_port(addr, addrlen, &port))
+		return -1;
+
+	memcpy(ss->local_gid, &sib->sib_addr, 16);
+	if (sim_gid_is_zero(ss->local_gid) &&
+	    sim_local_port(ss->local_gid, &lid)) {
+		memset(&sin, 0, sizeof sin);
+		sin.sin_family = AF_INET;
+		sin.sin_port = htons(port);
+		sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	} else
+		sim_gid_to_sin(ss->local_gid, port, &sin);
+
+	/*
+	 * rsockets have no TIME_WAIT, so a restarted node (or the next run)
+	 * must be able to bind its service port again right away.
+	 */
+	setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &val, sizeof val);
+	ss->local_port = port;
+	return bind(socket, (struct sockaddr *) &sin, sizeof sin);
+}
+
+int rlisten(int socket, int backlog)
+{
+	struct sim_sock *ss;
+
+	if (!(ss = sim_get(socket)))
+		return -1;
+
+	ss->listening = 1;
+	/* a whole subtree may (re)connect at once */
+	return listen(socket, backlog < SOMAXCONN ? SOMAXCONN : backlog);
+}
+
+int raccept(int socket, struct sockaddr *addr, socklen_t *addrlen)
+{
+	struct sim_sock *ls, *ss;
+	struct sim_frame_hdr hdr;
+	struct sim_hello hello;
+	int fd, val = 1;
+
+	if (!(ls = sim_get(socket)))
+		return -1;
+
+	fd = accept(socket, NULL, NULL);
+	if (fd < 0)
+		return fd;
+	if (fd >= SIM_MAX_FD) {
+		close(fd);
+		errno = EMFILE;
+		return -1;
+	}
+
+	if (sim_xfer_all(fd, &hdr, sizeof hdr, 0, SIM_HELLO_TIMEOUT) ||
+	    hdr.type != SIM_FRAME_HELLO || ntohl(hdr.len) != sizeof hello ||
+	    sim_xfer_all(fd, &hello, sizeof hello, 0, SIM_HELLO_TIMEOUT))
+		goto abort;
+
+	ss = calloc(1, sizeof *ss);
+	if (!ss)
+		goto abort;
+
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof val);
+	memcpy(ss->local_gid, ls->local_gid, 16);
+	ss->local_port = ls->local_port;
+	memcpy(ss->peer_gid, hello.gid, 16);
+	ss->peer_lid = ntohs(hello.lid);
+	ss->stats = sim_get_stats(ls->local_port);
+	__sync_fetch_and_add(&ss->stats->conns, 1);
+	sim_socks[fd] = ss;
+
+	sim_fill_sib(addr, addrlen, ss->peer_gid, 0);
+	return fd;
+
+abort:
+	close(fd);
+	errno = ECONNABORTED;
+	return -1;
+}
+
+int rconnect(int socket, const struct sockaddr *addr, socklen_t addrlen)
+{
+	const struct sockaddr_ib *sib = (const struct sockaddr_ib *) addr;
+	struct sim_sock *ss;
+	struct sim_frame_hdr hdr;
+	struct sim_hello hello;
+	struct sockaddr_in sin;
+	uint16_t port, lid = 0;
+	int flags, ret;
+
+	if (!(ss = sim_get(socket)))
+		return -1;
+	if (sim_sib_port(addr, addrlen, &port))
+		return -1;
+
+	memset(&hello, 0, sizeof hello);
+	if (ss->route_set) {
+		memcpy(hello.gid, &ss->route.path.sgid, 16);
+		hello.lid = ss->route.path.slid;
+	} else if (!sim_local_port(hello.gid, &lid)) {
+		hello.lid = htons(lid);
+	} else
+		memcpy(hello.gid, ss->local_gid, 16);
+
+	memcpy(ss->peer_gid, &sib->sib_addr, 16);
+	ss->peer_port = port;
+	if (ss->route_set)
+		ss->peer_lid = ntohs(ss->route.path.dlid);
+	sim_gid_to_sin(ss->peer_gid, port, &sin);
+
+	/*
+	 * Loopback connects complete (or fail) right away, so connect
+	 * synchronously and hand the caller a connected socket.
+	 */
+	flags = fcntl(socket, F_GETFL);
+	if (flags < 0)
+		return -1;
+	fcntl(socket, F_SETFL, flags & ~O_NONBLOCK);
+	ret = connect(socket, (struct sockaddr *) &sin, sizeof sin);
+	if (!ret) {
+		memset(&hdr, 0, sizeof hdr);
+		hdr.type = SIM_FRAME_HELLO;
+		hdr.len = htonl(sizeof hello);
+		ret = sim_xfer_all(socket, &hdr, sizeof hdr, 1, -1);
+		if (!ret)
+			ret = sim_xfer_all(socket, &hello, sizeof hello, 1, -1);
+	}
+	flags = fcntl(socket, F_SETFL, flags) < 0 ? -1 : 0;
+	if (ret)
+		return ret;
+
+	memcpy(ss->local_gid, hello.gid, 16);
+	ss->stats = sim_get_stats(port);
+	__sync_fetch_and_add(&ss->stats->conns, 1);
+	return flags;
+}
+
+int rshutdown(int socket, int how)
+{
+	if (!sim_get(socket))
+		return -1;
+	return shutdown(socket, how);
+}
+
+int rclose(int socket)
+{
+	struct sim_sock *ss;
+
+	if (!(ss = sim_get(socket)))
+		return -1;
+	sim_socks[socket] = NULL;
+	free(ss);
+	return close(socket);
+}
+
+ssize_t rsend(int socket, const void *buf, size_t len, int flags)
+{
+	struct sim_sock *ss;
+	struct sim_frame_hdr hdr;
+	ssize_t n;
+
+	if (!(ss = sim_get(socket)))
+		return -1;
+	if (!len)
+		return 0;
+
+	if (!ss->tx_left) {
+		memset(&hdr, 0, sizeof hdr);
+		hdr.type = SIM_FRAME_DATA;
+		hdr.len = htonl(len);
+		n = send(socket, &hdr, sizeof hdr,
+			 flags | MSG_NOSIGNAL);
+		if (n <= 0)
+			return n ? n : -1;
+		/* once part of a header is out the frame is committed */
+		if (n < sizeof hdr &&
+		    sim_xfer_all(socket, (void *) &hdr + n, sizeof hdr - n,
+				 1, -1))
+			return -1;
+		ss->tx_left = len;
+	}
+
+	n = send(socket, buf, len < ss->tx_left ? len : ss->tx_left,
+		 flags | MSG_NOSIGNAL);
+	if (n > 0) {
+		ss->tx_left -= n;
+		if (ss->stats)
+			__sync_fetch_and_add(&ss->stats->tx_bytes, n);
+	}
+	return n;
+}
+
+ssize_t rrecv(int socket, void *buf, size_t len, int flags)
+{
+	struct sim_sock *ss;
+	uint8_t data[SIM_IOWRITE_MAX];
+	uint64_t offset;
+	uint32_t size;
+	ssize_t n;
+
+	if (!(ss = sim_get(socket)))
+		return -1;
+	if (!len)
+		return 0;
+
+	while (!ss->rx_left) {
+		n = recv(socket, (void *) &ss->rx_hdr + ss->rx_hdr_len,
+			 sizeof ss->rx_hdr - ss->rx_hdr_len, flags);
+		if (n == 0 && ss->rx_hdr_len) {
+			errno = ECONNRESET;
+			return -1;
+		}
+		if (n <= 0)
+			return n;
+		ss->rx_hdr_len += n;
+		if (ss->rx_hdr_len < sizeof ss->rx_hdr) {
+			if (flags & MSG_DONTWAIT)
+				goto again;
+			continue;
+		}
+
+		ss->rx_hdr_len = 0;
+		size = ntohl(ss->rx_hdr.len);
+		switch (ss->rx_hdr.type) {
+		case SIM_FRAME_DATA:
+			ss->rx_left = size;
+			break;
+		case SIM_FRAME_IOWRITE:
+			offset = sim_htonll(ss->rx_hdr.offset);
+			if (size > sizeof data ||
+			    sim_xfer_all(socket, data, size, 0, -1)) {
+				errno = ECONNRESET;
+				return -1;
+			}
+			if (ss->iomap_buf && offset >= ss->iomap_off &&
+			    offset + size <= ss->iomap_off + ss->iomap_len)
+				memcpy(ss->iomap_buf + (offset - ss->iomap_off),
+				       data, size);
+			if (ss->stats)
+				__sync_fetch_and_add(&ss->stats->iowrite_rx_bytes,
+						     size);
+			if (flags & MSG_DONTWAIT)
+				goto again;
+			break;
+		default:
+			errno = EPROTO;
+			return -1;
+		}
+	}
+
+	n = recv(socket, buf, len < ss->rx_left ? len : ss->rx_left, flags);
+	if (n > 0) {
+		ss->rx_left -= n;
+		if (ss->stats)
+			__sync_fetch_and_add(&ss->stats->rx_bytes, n);
+	} else if (n == 0) {
+		errno = ECONNRESET;
+		return -1;
+	}
+	return n;
+
+again:
+	errno = EAGAIN;
+	return -1;
+}
+
+ssize_t rread(int socket, void *buf, size_t count)
+{
+	return rrecv(socket, buf, count, 0);
+}
+
+ssize_t rwrite(int socket, const void *buf, size_t count)
+{
+	return rsend(socket, buf, count, 0);
+}
+
+int rpoll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	return poll(fds, nfds, timeout);
+}
+
+int rselect(int nfds, fd_set *readfds, fd_set *writefds,
+	    fd_set *exceptfds, struct timeval *timeout)
+{
+	return select(nfds, readfds, writefds, exceptfds, timeout);
+}
+
+int rgetpeername(int socket, struct sockaddr *addr, socklen_t *addrlen)
+{
+	struct sim_sock *ss;
+
+	if (!(ss = sim_get(socket)))
+		return -1;
+	sim_fill_sib(addr, addrlen, ss->peer_gid, ss->peer_port);
+	return 0;
+}
+
+int rgetsockname(int socket, struct sockaddr *addr, socklen_t *addrlen)
+{
+	struct sim_sock *ss;
+
+	if (!(ss = sim_get(socket)))
+		return -1;
+	sim_fill_sib(addr, addrlen, ss->local_gid, ss->local_port);
+	return 0;
+}
+
+int rsetsockopt(int socket, int level, int optname,
+		const void *optval, socklen_t optlen)
+{
+	struct sim_sock *ss;
+
+	if (!(ss = sim_get(socket)))
+		return -1;
+
+	if (level != SOL_RDMA)
+		return setsockopt(socket, level, optname, optval, optlen);
+
+	if (optname == RDMA_ROUTE) {
+		if (optlen < sizeof ss->route) {
+			errno = EINVAL;
+			return -1;
+		}
+		memcpy(&ss->route, optval, sizeof ss->route);
+		ss->route_set = 1;
+	}
+	/* queue and inline sizes have no meaning here */
+	return 0;
+}
+
+int rgetsockopt(int socket, int level, int optname,
+		void *optval, socklen_t *optlen)
+{
+	struct ibv_path_data route;
+	struct sim_sock *ss;
+
+	if (!(ss = sim_get(socket)))
+		return -1;
+
+	if (level != SOL_RDMA)
+		return getsockopt(socket, level, optname, optval, optlen);
+
+	if (optname != RDMA_ROUTE || *optlen < sizeof route) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	if (ss->route_set) {
+		route = ss->route;
+	} else {
+		memset(&route, 0, sizeof route);
+		memcpy(&route.path.sgid, ss->local_gid, 16);
+		memcpy(&route.path.dgid, ss->peer_gid, 16);
+		route.path.dlid = htons(ss->peer_lid);
+		route.path.pkey = 0xFFFF;
+	}
+	memcpy(optval, &route, sizeof route);
+	*optlen = sizeof route;
+	return 0;
+}
+
+int rfcntl(int socket, int cmd, ... /* arg */ )
+{
+	va_list args;
+	long arg;
+
+	if (!sim_get(socket))
+		return -1;
+
+	va_start(args, cmd);
+	arg = va_arg(args, long);
+	va_end(args);
+	return fcntl(socket, cmd, arg);
+}
+
+off_t riomap(int socket, void *buf, size_t len, int prot, int flags,
+	     off_t offset)
+{
+	struct sim_sock *ss;
+
+	if (!(ss = sim_get(socket)))
+		return -1;
+	if (ss->iomap_buf) {
+		errno = ENOMEM;
+		return -1;
+	}
+	if (offset == -1)
+		offset = 0;
+
+	ss->iomap_buf = buf;
+	ss->iomap_len = len;
+	ss->iomap_off = offset;
+	return offset;
+}
+
+int riounmap(int socket, void *buf, size_t len)
+{
+	struct sim_sock *ss;
+
+	if (!(ss = sim_get(socket)))
+		return -1;
+	if (ss->iomap_buf != buf) {
+		errno = EINVAL;
+		return -1;
+	}
+	ss->iomap_buf = NULL;
+	ss->iomap_len = 0;
+	return 0;
+}
+
+size_t riowrite(int socket, const void *buf, size_t count, off_t offset,
+		int flags)
+{
+	struct sim_sock *ss;
+	struct {
+		struct sim_frame_hdr	hdr;
+		uint8_t			data[SIM_IOWRITE_MAX];
+	} frame;
+	ssize_t n;
+
+	if (!(ss = sim_get(socket)))
+		return -1;
+
+	/* an iowrite may not be spliced into a partly sent message */
+	if (ss->tx_left) {
+		errno = EAGAIN;
+		return -1;
+	}
+	if (count > SIM_IOWRITE_MAX)
+		count = SIM_IOWRITE_MAX;
+
+	memset(&frame.hdr, 0, sizeof frame.hdr);
+	frame.hdr.type = SIM_FRAME_IOWRITE;
+	frame.hdr.len = htonl(count);
+	frame.hdr.offset = sim_htonll(offset);
+	memcpy(frame.data, buf, count);
+
+	n = send(socket, &frame, sizeof frame.hdr + count,
+		 flags | MSG_NOSIGNAL);
+	if (n <= 0)
+		return n ? n : -1;
+	if (n < sizeof frame.hdr + count &&
+	    sim_xfer_all(socket, (void *) &frame + n,
+			 sizeof frame.hdr + count - n, 1, -1))
+		return -1;
+
+	if (ss->stats)
+		__sync_fetch_and_add(&ss->stats->iowrite_tx_bytes, count);
+	return count;
+}
+
+/*
+ * Verbs: a single device backed by the first umad CA.
+ */
+static int sim_ca(umad_ca_t *ca)
+{
+	char names[UMAD_MAX_DEVICES][UMAD_CA_NAME_LEN];
+
+	if (umad_get_cas_names(names, UMAD_MAX_DEVICES) < 1)
+		return -1;
+	return umad_get_ca(names[0], ca);
+}
+
+struct ibv_device **ibv_get_device_list(int *num_devices)
+{
+	umad_ca_t ca;
+
+	if (sim_ca(&ca) < 0) {
+		if (num_devices)
+			*num_devices = 0;
+		sim_device_list[0] = NULL;
+		return sim_device_list;
+	}
+
+	memset(&sim_device, 0, sizeof sim_device);
+	snprintf(sim_device.name, sizeof sim_device.name, "%s", ca.ca_name);
+	snprintf(sim_device.dev_name, sizeof sim_device.dev_name,
+		 "uverbs0");
+	snprintf(sim_device.ibdev_path, sizeof sim_device.ibdev_path,
+		 "/sys/class/infiniband/%s", ca.ca_name);
+	sim_device.node_type = IBV_NODE_CA;
+	sim_device.transport_type = IBV_TRANSPORT_IB;
+	umad_release_ca(&ca);
+
+	sim_device_list[0] = &sim_device;
+	sim_device_list[1] = NULL;
+	if (num_devices)
+		*num_devices = 1;
+	return sim_device_list;
+}
+
+void ibv_free_device_list(struct ibv_device **list)
+{
+}
+
+__be64 ibv_get_device_guid(struct ibv_device *device)
+{
+	umad_ca_t ca;
+	__be64 guid;
+
+	if (umad_get_ca(device->name, &ca) < 0)
+		return 0;
+	guid = ca.node_guid;
+	umad_release_ca(&ca);
+	return guid;
+}
+
+static void sim_post_event(struct sim_context *ctx, int type, int port)
+{
+	struct sim_event event;
+
+	event.type = type;
+	event.port = port;
+	if (write(ctx->event_fd, &event, sizeof event) != sizeof event)
+		return;
+}
+
+static void *sim_watch_ports(void *context)
+{
+	struct sim_context *ctx = context;
+	umad_port_t port;
+	int p;
+
+	while (ctx->running) {
+		usleep(SIM_WATCH_INTERVAL);
+		for (p = 1; p < UMAD_CA_MAX_PORTS; p++) {
+			if (umad_get_port(ctx->context.device->name, p,
+					  &port) < 0)
+				break;
+			if (port.state != ctx->ports[p].state)
+				sim_post_event(ctx, port.state == IBV_PORT_ACTIVE ?
+					       IBV_EVENT_PORT_ACTIVE :
+					       IBV_EVENT_PORT_ERR, p);
+			else if (port.base_lid != ctx->ports[p].base_lid)
+				sim_post_event(ctx, IBV_EVENT_LID_CHANGE, p);
+			else if (port.sm_lid != ctx->ports[p].sm_lid)
+				sim_post_event(ctx, IBV_EVENT_SM_CHANGE, p);
+			ctx->ports[p].state = port.state;
+			ctx->ports[p].base_lid = port.base_lid;
+			ctx->ports[p].sm_lid = port.sm_lid;
+			umad_release_port(&port);
+		}
+	}
+	return NULL;
+}
+
+struct ibv_context *ibv_open_device(struct ibv_device *device)
+{
+	struct sim_context *ctx;
+	umad_port_t port;
+	int fds[2], p;
+
+	ctx = calloc(1, sizeof *ctx);
+	if (!ctx)
+		return NULL;
+	if (pipe(fds))
+		goto err1;
+
+	ctx->context.device = device;
+	ctx->context.async_fd = fds[0];
+	ctx->context.num_comp_vectors = 1;
+	pthread_mutex_init(&ctx->context.mutex, NULL);
+	ctx->event_fd = fds[1];
+
+	for (p = 1; p < UMAD_CA_MAX_PORTS; p++) {
+		if (umad_get_port(device->name, p, &port) < 0)
+			break;
+		ctx->ports[p].state = port.state;
+		ctx->ports[p].base_lid = port.base_lid;
+		ctx->ports[p].sm_lid = port.sm_lid;
+		umad_release_port(&port);
+	}
+
+	ctx->running = 1;
+	if (pthread_create(&ctx->watcher, NULL, sim_watch_ports, ctx))
+		goto err2;
+	return &ctx->context;
+
+err2:
+	close(fds[0]);
+	close(fds[1]);
+err1:
+	free(ctx);
+	return NULL;
+}
+
+int ibv_close_device(struct ibv_context *context)
+{
+	struct sim_context *ctx = (struct sim_context *) context;
+
+	ctx->running = 0;
+	pthread_join(ctx->watcher, NULL);
+	close(ctx->context.async_fd);
+	close(ctx->event_fd);
+	free(ctx);
+	return 0;
+}
+
+int ibv_get_async_event(struct ibv_context *context,
+			struct ibv_async_event *event)
+{
+	struct sim_event ev;
+
+	if (read(context->async_fd, &ev, sizeof ev) != sizeof ev)
+		return -1;
+
+	memset(event, 0, sizeof *event);
+	event->event_type = ev.type;
+	event->element.port_num = ev.port;
+	return 0;
+}
+
+void ibv_ack_async_event(struct ibv_async_event *event)
+{
+}
+
+int ibv_query_device(struct ibv_context *context,
+		     struct ibv_device_attr *device_attr)
+{
+	umad_ca_t ca;
+
+	if (umad_get_ca(context->device->name, &ca) < 0)
+		return ENODEV;
+
+	memset(device_attr, 0, sizeof *device_attr);
+	snprintf(device_attr->fw_ver, sizeof device_attr->fw_ver, "%s",
+		 ca.fw_ver);
+	device_attr->node_guid = ca.node_guid;
+	device_attr->sys_image_guid = ca.system_guid;
+	device_attr->phys_port_cnt = ca.numports;
+	device_attr->max_pkeys = 128;
+	device_attr->max_qp = 1;
+	device_attr->max_cq = 1;
+	device_attr->max_pd = 1;
+	device_attr->max_ah = 1 << 16;
+	umad_release_ca(&ca);
+	return 0;
+}
+
+int sim_query_port(struct ibv_context *context, uint8_t port_num,
+		   struct ibv_port_attr *port_attr)
+{
+	struct ibv_port_attr attr;
+	umad_port_t port;
+
+	if (umad_get_port(context->device->name, port_num, &port) < 0)
+		return EINVAL;
+
+	memset(&attr, 0, sizeof attr);
+	attr.state = port.state;
+	attr.phys_state = port.phys_state;
+	attr.max_mtu = IBV_MTU_2048;
+	attr.active_mtu = IBV_MTU_2048;
+	attr.gid_tbl_len = 1;
+	attr.port_cap_flags = ntohl(port.capmask);
+	attr.max_msg_sz = 1U << 31;
+	attr.pkey_tbl_len = port.pkeys_size;
+	attr.lid = port.base_lid;
+	attr.sm_lid = port.sm_lid;
+	attr.lmc = port.lmc;
+	attr.sm_sl = port.sm_sl;
+	attr.max_vl_num = 1;
+	attr.subnet_timeout = 18;
+	attr.active_width = 2;	/* 4x */
+	attr.active_speed = 1;	/* SDR */
+	attr.link_layer = IBV_LINK_LAYER_INFINIBAND;
+	umad_release_port(&port);
+
+	/* callers built against older headers pass the shorter struct */
+	memcpy(port_attr, &attr, offsetof(struct ibv_port_attr, link_layer) +
+	       sizeof attr.link_layer);
+	return 0;
+}
+
+int ibv_query_gid(struct ibv_context *context, uint8_t port_num,
+		  int index, union ibv_gid *gid)
+{
+	umad_port_t port;
+
+	if (index)
+		return -1;
+	if (umad_get_port(context->device->name, port_num, &port) < 0)
+		return -1;
+
+	memcpy(gid->raw, &port.gid_prefix, 8);
+	memcpy(gid->raw + 8, &port.port_guid, 8);
+	umad_release_port(&port);
+	return 0;
+}
+
+int ibv_query_pkey(struct ibv_context *context, uint8_t port_num,
+		   int index, __be16 *pkey)
+{
+	umad_port_t port;
+	int ret = 0;
+
+	if (umad_get_port(context->device->name, port_num, &port) < 0)
+		return -1;
+
+	if (index >= 0 && index < port.pkeys_size)
+		*pkey = htons(port.pkeys[index]);
+	else
+		ret = -1;
+	umad_release_port(&port);
+	return ret;
+}
+
+int ibv_read_sysfs_file(const char *dir, const char *file,
+			char *buf, size_t size)
+{
+	char path[PATH_MAX];
+	const char *host;
+	ssize_t len;
+	int fd;
+
+	snprintf(path, sizeof path, "%s/%s", dir, file);
+	fd = open(path, O_RDONLY);
+	if (fd >= 0) {
+		len = read(fd, buf, size);
+		close(fd);
+		if (len > 0) {
+			if (len == size)
+				buf[len - 1] = '\0';
+			else if (buf[len - 1] == '\n')
+				buf[len - 1] = '\0';
+			else
+				buf[len] = '\0';
+			return len;
+		}
+	}
+
+	host = getenv("SIM_HOST");
+	if (!host || strcmp(file, "node_desc"))
+		return -1;
+	return snprintf(buf, size, "%s", host);
+}
+
+struct ibv_pd *ibv_alloc_pd(struct ibv_context *context)
+{
+	struct ibv_pd *pd;
+
+	pd = calloc(1, sizeof *pd);
+	if (pd)
+		pd->context = context;
+	return pd;
+}
+
+int ibv_dealloc_pd(struct ibv_pd *pd)
+{
+	free(pd);
+	return 0;
+}
+
+struct ibv_ah *ibv_create_ah(struct ibv_pd *pd, struct ibv_ah_attr *attr)
+{
+	struct ibv_ah *ah;
+
+	ah = calloc(1, sizeof *ah);
+	if (ah) {
+		ah->context = pd->context;
+		ah->pd = pd;
+	}
+	return ah;
+}
+
+int ibv_destroy_ah(struct ibv_ah *ah)
+{
+	free(ah);
+	return 0;
+}
+
+struct ibv_comp_channel *ibv_create_comp_channel(struct ibv_context *context)
+{
+	struct sim_comp_channel *chan;
+	int fds[2];
+
+	chan = calloc(1, sizeof *chan);
+	if (!chan)
+		return NULL;
+	if (pipe(fds)) {
+		free(chan);
+		return NULL;
+	}
+	chan->channel.context = context;
+	chan->channel.fd = fds[0];
+	chan->wfd = fds[1];
+	return &chan->channel;
+}
+
+int ibv_destroy_comp_channel(struct ibv_comp_channel *channel)
+{
+	struct sim_comp_channel *chan = (struct sim_comp_channel *) channel;
+
+	close(chan->channel.fd);
+	close(chan->wfd);
+	free(chan);
+	return 0;
+}
+
+/* No data path: ACM endpoints stay down and resolve through SSA only */
+struct ibv_cq *ibv_create_cq(struct ibv_context *context, int cqe,
+			     void *cq_context,
+			     struct ibv_comp_channel *channel,
+			     int comp_vector)
+{
+	errno = ENOSYS;
+	return NULL;
+}
+
+int ibv_get_cq_event(struct ibv_comp_channel *channel,
+		     struct ibv_cq **cq, void **cq_context)
+{
+	char c;
+
+	if (read(channel->fd, &c, sizeof c) != sizeof c)
+		return -1;
+	return -1;
+}
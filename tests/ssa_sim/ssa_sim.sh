@@ -0,0 +1,359 @@
+#!/bin/bash
+#
+# Copyright (c) 2015 Mellanox Technologies LTD. All rights reserved.
+#
+# This software is available to you under the terms of the
+# OpenIB.org BSD license included below:
+#
+#     Redistribution and use in source and binary forms, with or
+#     without modification, are permitted provided that the following
+#     conditions are met:
+#
+#      - Redistributions of source code must retain the above
+#        copyright notice, this list of conditions and the following
+#        disclaimer.
+#
+#      - Redistributions in binary form must reproduce the above
+#        copyright notice, this list of conditions and the following
+#        disclaimer in the documentation and/or other materials
+#        provided with the distribution.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+# BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+# ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+
+#
+# ssa_sim.sh - runs a whole SSA tree on one host and measures how fast
+# SMDB epochs reach the ACMs
+#
+# A synthetic fabric is generated with smdb_gen and brought up in ibsim.
+# OpenSM with the SSA core runs as host0, distribution, access and ACM
+# processes as the following hosts, all preloaded with libumad2sim (MADs)
+# and libssa_sim (rsockets and verbs over loopback).  Epochs are fed by
+# renaming freshly generated SMDBs into the directory the core polls.
+# At the end the epoch trace of the whole tree is collected through
+# ssadmin and the per epoch latency and the bytes moved by each layer
+# are reported.
+#
+# The core plugin has to be configured with --enable-simulated-smdb, and
+# distrib with --enable-fake-acm for -f to have an effect.  ibsim serves
+# at most IBSIM_MAX_CLIENTS processes, so larger trees need an ibsim
+# built with a bigger limit.
+#
+# Exit status is non zero when an epoch did not reach every ACM, or took
+# longer than the -t limit to do so.
+#
+
+distrib_num=1
+access_num=2
+acm_num=4
+fake_num=0
+epochs=5
+interval=3
+settle=20
+drain=10
+limit=0
+lmc=0
+workdir=
+umad2sim=
+ssa_sim=
+smdb_gen_opts=
+
+core_gid="fe80::2:c903:0:1"
+pids=()
+
+usage()
+{
+	cat <<EOF
+Usage: $0 [options] [-- smdb_gen options]
+	-d number of distribution nodes (default $distrib_num)
+	-a number of access nodes (default $access_num)
+	-c number of ACM processes (default $acm_num)
+	-f fake ACMs per access node (default $fake_num)
+	-e number of epochs to feed (default $epochs, at most 15)
+	-i seconds between epochs (default $interval, at least 2)
+	-s seconds to let the tree settle before the first epoch (default $settle)
+	-D seconds to wait after the last epoch (default $drain)
+	-t epoch to all ACMs latency limit in msec (default none)
+	-L LMC of the host ports (default $lmc)
+	-w work directory (default a new one under /tmp)
+	-u path to libumad2sim.so
+	-S path to libssa_sim.so
+	-h help
+EOF
+}
+
+find_lib()
+{
+	local name=$1 dir
+
+	for dir in $(dirname $0)/../lib64 $(dirname $0)/../lib \
+		   /usr/lib64 /usr/lib /usr/local/lib64 /usr/local/lib; do
+		for lib in $dir/$name $dir/umad2sim/$name; do
+			if [ -f $lib ]; then
+				echo $lib
+				return
+			fi
+		done
+	done
+}
+
+cleanup()
+{
+	local pid
+
+	for pid in "${pids[@]}"; do
+		kill $pid 2>/dev/null
+	done
+	wait 2>/dev/null
+}
+
+# run_node <host> <name> <command...>
+run_node()
+{
+	local host=$1 name=$2
+
+	shift 2
+	env LD_PRELOAD="$umad2sim $ssa_sim" SIM_HOST=$host \
+	    SSA_SIM_STATS=$workdir/stats/$name.stats \
+	    "$@" > $workdir/log/$name.out 2>&1 &
+	pids+=($!)
+}
+
+while getopts "d:a:c:f:e:i:s:D:t:L:w:u:S:h" opt; do
+	case $opt in
+	d) distrib_num=$OPTARG ;;
+	a) access_num=$OPTARG ;;
+	c) acm_num=$OPTARG ;;
+	f) fake_num=$OPTARG ;;
+	e) epochs=$OPTARG ;;
+	i) interval=$OPTARG ;;
+	s) settle=$OPTARG ;;
+	D) drain=$OPTARG ;;
+	t) limit=$OPTARG ;;
+	L) lmc=$OPTARG ;;
+	w) workdir=$OPTARG ;;
+	u) umad2sim=$OPTARG ;;
+	S) ssa_sim=$OPTARG ;;
+	h) usage; exit 0 ;;
+	*) usage; exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+smdb_gen_opts="$*"
+
+# the core notices a new SMDB by the directory mtime (1 sec resolution)
+if [ $epochs -lt 1 -o $epochs -gt 15 -o $interval -lt 2 ]; then
+	usage
+	exit 1
+fi
+
+[ -z "$umad2sim" ] && umad2sim=$(find_lib libumad2sim.so)
+[ -z "$ssa_sim" ] && ssa_sim=$(find_lib libssa_sim.so)
+if [ ! -f "$umad2sim" -o ! -f "$ssa_sim" ]; then
+	echo "ERROR - libumad2sim.so or libssa_sim.so not found (see -u and -S)"
+	exit 1
+fi
+
+for bin in smdb_gen ibsim opensm ibssa ibacm ssadmin; do
+	if ! which $bin > /dev/null 2>&1; then
+		echo "ERROR - $bin not found in PATH"
+		exit 1
+	fi
+done
+
+[ -z "$workdir" ] && workdir=$(mktemp -d /tmp/ssa_sim.XXXXXX)
+mkdir -p $workdir/sim $workdir/staging $workdir/smdb $workdir/cfg \
+	 $workdir/log $workdir/stats || exit 1
+trap cleanup EXIT
+
+#
+# Fabric and the first epoch
+#
+hosts_needed=$((1 + distrib_num + access_num + acm_num))
+smdb_gen -m m -L $lmc -e 1 -o $workdir/smdb -s $workdir/sim \
+	 $smdb_gen_opts > $workdir/log/smdb_gen.out || exit 1
+hosts=$(grep -c "^Hca" $workdir/sim/net)
+if [ $hosts -lt $hosts_needed ]; then
+	echo "ERROR - fabric has $hosts hosts, $hosts_needed needed"
+	exit 1
+fi
+
+# ibsim takes console commands, so keep its stdin open until we exit
+mkfifo $workdir/ibsim.in || exit 1
+ibsim $workdir/sim/net < $workdir/ibsim.in > $workdir/log/ibsim.out 2>&1 &
+pids+=($!)
+exec 3> $workdir/ibsim.in
+sleep 2
+
+#
+# Core
+#
+cat > $workdir/cfg/core.cfg <<EOF
+log_file $workdir/log/core.log
+log_level 1
+lock_file $workdir/core.pid
+node_type core
+smdb_dump 4
+smdb_dump_dir $workdir/smdb
+EOF
+
+cat > $workdir/cfg/opensm.conf <<EOF
+lmc $lmc
+honor_guid2lid_file TRUE
+sm_priority 15
+event_plugin_name opensmssa
+event_plugin_options $workdir/cfg/core.cfg
+EOF
+
+OSM_CACHE_DIR=$workdir/sim OSM_TMP_DIR=$workdir \
+	run_node host0 opensm opensm -F $workdir/cfg/opensm.conf \
+		 -f $workdir/log/opensm.log
+
+#
+# Distribution tree and ACMs
+#
+host=1
+for ((i = 0; i < distrib_num; i++, host++)); do
+	cat > $workdir/cfg/distrib.$i.cfg <<EOF
+log_file $workdir/log/distrib.$i.log
+log_level 1
+lock_file $workdir/distrib.$i.pid
+node_type distrib
+EOF
+	run_node host$host distrib.$i ibssa -P -O $workdir/cfg/distrib.$i.cfg
+done
+
+for ((i = 0; i < access_num; i++, host++)); do
+	cat > $workdir/cfg/access.$i.cfg <<EOF
+log_file $workdir/log/access.$i.log
+log_level 1
+lock_file $workdir/access.$i.pid
+node_type access
+fake_acm_num $fake_num
+EOF
+	run_node host$host access.$i ibssa -P -O $workdir/cfg/access.$i.cfg
+done
+
+touch $workdir/cfg/ibacm_addr.data
+for ((i = 0; i < acm_num; i++, host++)); do
+	cat > $workdir/cfg/acm.$i.cfg <<EOF
+log_file $workdir/log/acm.$i.log
+log_level 1
+lock_file $workdir/acm.$i.pid
+acm_mode ssa
+server_port $((16125 + i))
+shm_cache 0
+EOF
+	run_node host$host acm.$i ibacm -P -A $workdir/cfg/ibacm_addr.data \
+		 -O $workdir/cfg/acm.$i.cfg
+done
+
+echo "Started $distrib_num distribution, $access_num access and" \
+     "$acm_num ACM nodes on $hosts_needed of $hosts hosts in $workdir"
+sleep $settle
+
+# origin times are the low 32 bits of wall clock msec
+start=$(($(date +%s%3N) & 0xffffffff))
+
+#
+# Epochs: a rename keeps the core from loading a partly written SMDB
+#
+for ((e = 2; e <= epochs + 1; e++)); do
+	smdb_gen -m m -L $lmc -e $e -o $workdir/staging $smdb_gen_opts \
+		 > /dev/null || exit 1
+	mv $workdir/staging/ssa_db.bin $workdir/smdb/ssa_db.bin
+	sleep $interval
+done
+sleep $drain
+
+#
+# Report
+#
+LD_PRELOAD="$umad2sim $ssa_sim" SIM_HOST=host0 \
+	ssadmin -g $core_gid -r -J epochtrace > $workdir/epochtrace.json \
+	2> $workdir/log/ssadmin.out
+
+awk -v acms=$acm_num -v start=$start -v limit=$limit '
+/^{/ {
+	if (!match($0, /"node_type":"[^"]*"/))
+		next
+	type = substr($0, RSTART + 13, RLENGTH - 14)
+	line = $0
+	while (match(line, /"origin":[0-9]+,"arrive_ms":[^,]*,"apply_ms":[^,}]*/)) {
+		rec = substr(line, RSTART, RLENGTH)
+		line = substr(line, RSTART + RLENGTH)
+		split(rec, f, /[:,]/)
+		origin = f[2]; apply = f[6]
+		# skip the epoch the tree was brought up with
+		d = origin - start
+		if (d < -2147483648)
+			d += 4294967296
+		else if (d > 2147483647)
+			d -= 4294967296
+		if (d < 0)
+			continue
+		if (type == "Core")
+			origins[origin] = 1
+		if (apply == "null")
+			continue
+		reached[origin, type]++
+		if (!((origin, type) in max) || apply + 0 > max[origin, type])
+			max[origin, type] = apply + 0
+	}
+}
+END {
+	n = 0
+	for (o in origins)
+		sorted[++n] = o + 0
+	for (i = 2; i <= n; i++)
+		for (j = i; j > 1 && sorted[j] < sorted[j - 1]; j--) {
+			t = sorted[j]; sorted[j] = sorted[j - 1]; sorted[j - 1] = t
+		}
+
+	printf("%-12s %14s %14s %10s %14s\n", "origin", "distrib max ms",
+	       "access max ms", "ACMs", "ACM max ms")
+	fail = 0
+	for (i = 1; i <= n; i++) {
+		o = sorted[i]
+		printf("%-12u %14s %14s %5d/%-4d %14s\n", o,
+		       ((o, "Distribution") in max) ? max[o, "Distribution"] : "-",
+		       ((o, "Access") in max) ? max[o, "Access"] : "-",
+		       reached[o, "Consumer"], acms,
+		       ((o, "Consumer") in max) ? max[o, "Consumer"] : "-")
+		if (reached[o, "Consumer"] < acms ||
+		    (limit && max[o, "Consumer"] > limit))
+			fail = 1
+	}
+	if (!n) {
+		print "no epochs traced at the core"
+		fail = 1
+	}
+	exit fail
+}' $workdir/epochtrace.json
+status=$?
+
+echo
+printf "%-10s %6s %12s %14s %14s %12s\n" layer port connections \
+       tx_bytes rx_bytes iowrite_bytes
+for role in opensm distrib access acm; do
+	cat $workdir/stats/$role*.stats 2>/dev/null | grep -v "^#" |
+	awk -v role=$role '
+	{
+		conns[$1] += $2; tx[$1] += $3; rx[$1] += $4; io[$1] += $5
+	}
+	END {
+		name = role == "opensm" ? "core" : role
+		for (port in conns)
+			printf("%-10s %6u %12u %14u %14u %12u\n", name, port,
+			       conns[port], tx[port], rx[port], io[port])
+	}'
+done
+
+exit $status
@@ -52,6 +52,7 @@ static void print_usage(FILE* file,const char* name)
 	fprintf(file, "\tb - Binary (default)\n");
 	fprintf(file, "\td - Debug\n");
 	fprintf(file, "\th - Human readable (cannot be preloaded later)\n");
+	fprintf(file, "\tm - Single mmap'able file\n");
 }
 
 static int is_file_exist(const char *fname)
@@ -348,6 +349,8 @@ int main(int argc,char *argv[])
 				ssa_db_mode = SSA_DB_HELPER_DEBUG;
 			} else if (optarg[0] == 'h') {
 				ssa_db_mode = SSA_DB_HELPER_HUMAN;
+			} else if (optarg[0] == 'm') {
+				ssa_db_mode = SSA_DB_HELPER_MMAP;
 			} else {
 				print_usage(stdout, argv[0]);
 				return 0;
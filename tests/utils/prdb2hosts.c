@@ -64,6 +64,7 @@ static void print_usage(FILE* file,const char* name)
 	fprintf(file, "PRDB input mode:\n");
 	fprintf(file, "\tb - Binary (default)\n");
 	fprintf(file, "\td - Debug\n");
+	fprintf(file, "\tm - Single mmap'able file\n");
 }
 
 static int is_dir_exist(const char* path)
@@ -147,6 +148,8 @@ int main(int argc,char *argv[])
 				ssa_db_mode = SSA_DB_HELPER_STANDARD;
 			} else if (optarg[0] == 'd') {
 				ssa_db_mode = SSA_DB_HELPER_DEBUG;
+			} else if (optarg[0] == 'm') {
+				ssa_db_mode = SSA_DB_HELPER_MMAP;
 			} else {
 				print_usage(stdout, argv[0]);
 				return 0;